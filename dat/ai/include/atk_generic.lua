@@ -3,6 +3,15 @@
 --]]
 
 
+-- Vectors owned by the ranged attack functions below so they don't create
+-- new ones every tick. Each is only used by the function using it.
+local _kite_tpos  = vec2.new()
+local _kite_spos  = vec2.new()
+local _kite_vel   = vec2.new()
+local _ranged_tvel = vec2.new()
+local _ranged_pvel = vec2.new()
+
+
 --[[
 -- Required initialization function
 --]]
@@ -145,7 +154,7 @@ function _atk_g_ranged_strafe( target, dist )
          range - dist*radial_vel/(ai.getweapspeed("all_seek")-radial_vel))
 
    local goal = ai.follow_accurate(target, range * 0.8, 0, 10, 20, "keepangle")
-   local mod = vec2.mod(goal - p:pos())
+   local mod = goal:dist( p:pos( vec2.scratch() ) )
 
    --Must approach or stabilize
    if mod > 3000 then
@@ -199,10 +208,10 @@ function _atk_g_ranged_kite( target, dist )
    local p = ai.pilot()
 
    -- Try to keep velocity vector away from enemy
-   local targetpos = target:pos()
-   local selfpos = p:pos()
-   local unused, targetdir = (selfpos-targetpos):polar()
-   local velmod, veldir = p:vel():polar()
+   local targetpos = target:pos( _kite_tpos )
+   local selfpos = p:pos( _kite_spos )
+   local unused, targetdir = selfpos:polar( targetpos )
+   local velmod, veldir = p:vel( _kite_vel ):polar()
    if velmod < 0.8*p:stats().speed or math.abs(targetdir-veldir) > 30 then
       local dir = ai.face( target, true )
       if math.abs(180-dir) < 30 then
@@ -245,9 +254,9 @@ function _atk_g_ranged( target, dist )
       _atk_g_ranged_dogfight( target, dist )
    elseif target:target() == ai.pilot() and dist < range
          and ai.hasprojectile() then
-      local tvel = target:vel()
-      local pvel = ai.pilot():vel()
-      local vel = (tvel-pvel):polar()
+      local tvel = target:vel( _ranged_tvel )
+      local pvel = ai.pilot():vel( _ranged_pvel )
+      local vel = tvel:polar( pvel )
       -- If will make contact soon, try to engage
       if dist < wrange+8*vel then
          _atk_g_ranged_dogfight( target, dist )
@@ -55,8 +55,8 @@ function _atk_decide_zz()
    local dir = ai.idir(target)
    local dist  = ai.dist( target )
 
-   local m, d1 = vec2.polar( pilot:vel() )
-   local m, d2 = vec2.polar( target:pos() - pilot:pos() )
+   local m, d1 = pilot:vel( vec2.scratch(1) ):polar()
+   local m, d2 = target:pos( vec2.scratch(1) ):polar( pilot:pos( vec2.scratch(2) ) )
    local d = d1-d2
 
    return ( (dist > (1.1*range)) and (ai.hasprojectile())
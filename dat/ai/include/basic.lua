@@ -223,7 +223,7 @@ function follow_accurate ()
    local goal = ai.follow_accurate(target, mem.radius,
          mem.angle, mem.Kp, mem.Kd)
 
-   local mod = vec2.mod(goal - p:pos())
+   local mod = goal:dist( p:pos( vec2.scratch() ) )
 
    --  Always face the goal
    local dir   = ai.face(goal)
@@ -469,9 +469,9 @@ function runaway ()
       ai.pushsubtask( "__landgo" )
    else
       -- find which one is the closest
-      local pilpos = ai.pilot():pos()
-      local modt = vec2.mod(t:pos()-pilpos)
-      local modp = vec2.mod(p:pos()-pilpos)
+      local pilpos = ai.pilot():pos( vec2.scratch() )
+      local modt = pilpos:dist( t:pos() )
+      local modp = pilpos:dist( p:pos() )
       if modt < modp then
          local pos = ai.sethyptarget(t)
          ai.pushsubtask( "__run_hyp", pos )
@@ -904,7 +904,7 @@ function mine ()
    ai.setasterotarget(field, ast)
 
    local target, vel = system.asteroidPos(field, ast)
-   local dist, angle = vec2.polar(p:pos() - target)
+   local dist, angle = p:pos( vec2.scratch() ):polar( target )
 
    -- First task : place the ship close to the asteroid
    local goal = ai.face_accurate(target, vel, trange, angle, mem.Kp, mem.Kd)
@@ -916,8 +916,8 @@ function mine ()
       ai.accel()
    end
 
-   local relpos = vec2.add(p:pos(), target * -1):mod()
-   local relvel = vec2.add(p:vel(), vel * -1):mod()
+   local relpos = p:pos( vec2.scratch() ):dist( target )
+   local relvel = p:vel( vec2.scratch() ):dist( vel )
 
    if relpos < wrange and relvel < 10 then
       ai.pushsubtask("__killasteroid")
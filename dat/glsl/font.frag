@@ -1,20 +1,21 @@
 #include "lib/math.glsl"
 
-uniform float m;
-uniform vec4 color;
 uniform vec4 outline_color;
 uniform sampler2D sampler;
 
 in vec2 tex_coord_out;
+in vec4 glyph_color;
+in float glyph_m;
 out vec4 color_out;
 
 void main(void) {
    // d is the signed distance to the glyph; m is the distance value corresponding to 1 "pixel".
+   float m  = glyph_m;
    float d  = 0.5 - texture(sampler, tex_coord_out).r;
    // Map the signed distance to mixing parameters for outline..foreground, transparent..opaque.
    float alpha = smoothstep(-0.5    *m, +0.5*m, -d);
    float beta  = smoothstep(-M_SQRT2*m, -1.0*m, -d);
-   vec4 fg_c   = mix( outline_color, color, alpha );
+   vec4 fg_c   = mix( outline_color, glyph_color, alpha );
    color_out   = vec4( fg_c.rgb, beta*fg_c.a );
    // Change [-1,1] range to [0,1]
    gl_FragDepth = d*0.5 + 0.5;
@@ -2,9 +2,15 @@ uniform mat4 projection;
 
 in vec4 vertex;
 in vec2 tex_coord;
+in vec4 color;
+in float m;
 out vec2 tex_coord_out;
+out vec4 glyph_color;
+out float glyph_m;
 
 void main(void) {
    tex_coord_out = tex_coord;
-   gl_Position = projection * vertex;
+   glyph_color   = color;
+   glyph_m       = m;
+   gl_Position   = projection * vertex;
 }
@@ -20,16 +20,16 @@ subroutine uniform trail_func_prototype trail_func;
 
 // For ideas: https://thebookofshaders.com/05/
 
-uniform vec4 c1;  // Start colour
-uniform vec4 c2;  // End colour
-uniform float t1; // Start time [0,1]
-uniform float t2; // End time [0,1]
-uniform float dt; // Current time (in seconds)
-uniform vec2 pos1;// Start position
-uniform vec2 pos2;// End position
-uniform float r;  // Unique value per trail [0,1]
 uniform vec3 nebu_col; // Base colour of the nebula, only changes when entering new system
 
+in vec4 c1;  // Start colour
+in vec4 c2;  // End colour
+in float t1; // Start time [0,1]
+in float t2; // End time [0,1]
+in float dt; // Current time (in seconds)
+in vec2 pos1;// Start position
+in vec2 pos2;// End position
+in float r;  // Unique value per trail [0,1]
 in vec2 pos;
 out vec4 color_out;
 
@@ -0,0 +1,33 @@
+uniform mat4 projection;
+
+in vec4 vertex;
+in vec2 corner;
+in vec4 color1;
+in vec4 color2;
+in vec2 time;
+in vec4 bounds;
+in vec2 param;
+
+out vec2 pos;
+out vec4 c1;
+out vec4 c2;
+out float t1;
+out float t2;
+out vec2 pos1;
+out vec2 pos2;
+out float dt;
+out float r;
+
+void main(void) {
+   /* Everything but the corner is the same for the whole segment. */
+   pos  = corner;
+   c1   = color1;
+   c2   = color2;
+   t1   = time.x;
+   t2   = time.y;
+   pos1 = bounds.xy;
+   pos2 = bounds.zw;
+   dt   = param.x;
+   r    = param.y;
+   gl_Position = projection * vertex;
+}
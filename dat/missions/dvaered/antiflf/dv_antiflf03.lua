@@ -214,8 +214,7 @@ function land()
         player.pay(1000000) -- 1M
         var.pop("flfbase_intro")
         var.pop("flfbase_sysname")
-        diff.apply("FLF_base")
-        diff.apply("flf_dead")
+        diff.apply{"FLF_base", "flf_dead"}
         dv_addAntiFLFLog(log_text)
         local t = time.get():tonumber()
         var.push("invasion_time", t) -- Timer for the frontier's invasion
@@ -85,12 +85,14 @@
 #include "nlua_faction.h"
 #include "nlua_pilot.h"
 #include "nlua_planet.h"
+#include "nlua_prof.h"
 #include "nlua_rnd.h"
 #include "nlua_vec2.h"
 #include "nluadef.h"
 #include "nstring.h"
 #include "physics.h"
 #include "pilot.h"
+#include "pilot_grid.h"
 #include "player.h"
 #include "rng.h"
 #include "space.h"
@@ -128,7 +130,7 @@ static nlua_env equip_env = LUA_NOREF; /**< Equipment enviornment. */
  * prototypes
  */
 /* Internal C routines */
-static void ai_run( nlua_env env, int nargs );
+static void ai_run( nlua_env env, int nargs, const char *task );
 static int ai_loadProfile( const char* filename );
 static void ai_setMemory (void);
 static void ai_create( Pilot* pilot );
@@ -137,6 +139,8 @@ static int ai_loadEquip (void);
 static void ai_taskGC( Pilot* pilot );
 static Task* ai_createTask( lua_State *L, int subtask );
 static int ai_tasktarget( lua_State *L, Task *t );
+/* Queries. */
+static int ai_gridNotSelf( const Pilot *p, const Pilot *target, void *data );
 
 
 
@@ -433,13 +437,22 @@ void ai_setPilot( Pilot *p )
  *
  *    @param[in] env Lua env to run function in.
  *    @param[in] nargs Number of arguments to run.
+ *    @param[in] task Name of the task being run (for profiling).
  */
-static void ai_run( nlua_env env, int nargs )
+static void ai_run( nlua_env env, int nargs, const char *task )
 {
+   int prof = nlua_profiling;
+
+   if (prof)
+      nlua_profEnter( "ai:%s:%s", cur_pilot->ai->name, task );
+
    if (nlua_pcall(env, nargs, 0)) { /* error has occurred */
       WARN( _("Pilot '%s' ai error: %s"), cur_pilot->name, lua_tostring(naevL,-1));
       lua_pop(naevL,1);
    }
+
+   if (prof)
+      nlua_profLeave();
 }
 
 
@@ -586,7 +599,7 @@ int ai_load (void)
  */
 static int ai_loadEquip (void)
 {
-   char *buf;
+   const char *buf;
    size_t bufsize;
    const char *filename = AI_EQUIP_PATH;
 
@@ -599,7 +612,7 @@ static int ai_loadEquip (void)
    nlua_loadStandard(equip_env);
 
    /* Load the file. */
-   buf = ndata_read( filename, &bufsize );
+   buf = ndata_map( filename, &bufsize );
    if (nlua_dobufenv(equip_env, buf, bufsize, filename) != 0) {
       WARN( _("Error loading file: %s\n"
           "%s\n"
@@ -607,7 +620,7 @@ static int ai_loadEquip (void)
             filename, lua_tostring(naevL, -1));
       return -1;
    }
-   free(buf);
+   ndata_unmap( buf, bufsize );
 
    return 0;
 }
@@ -621,7 +634,7 @@ static int ai_loadEquip (void)
  */
 static int ai_loadProfile( const char* filename )
 {
-   char* buf = NULL;
+   const char *buf = NULL;
    size_t bufsize = 0;
    nlua_env env;
    AI_Profile *prof;
@@ -658,7 +671,7 @@ static int ai_loadProfile( const char* filename )
    lua_pop(naevL, 1);                /*  */
 
    /* Now load the file since all the functions have been previously loaded */
-   buf = ndata_read( filename, &bufsize );
+   buf = ndata_map( filename, &bufsize );
    if (nlua_dobufenv(env, buf, bufsize, filename) != 0) {
       WARN( _("Error loading AI file: %s\n"
           "%s\n"
@@ -667,10 +680,10 @@ static int ai_loadProfile( const char* filename )
       array_erase( &profiles, prof, &prof[1] );
       free(prof->name);
       nlua_freeEnv( env );
-      free(buf);
+      ndata_unmap( buf, bufsize );
       return -1;
    }
-   free(buf);
+   ndata_unmap( buf, bufsize );
 
    /* Find and set up the necessary references. */
    str = _("AI Profile '%s' is missing '%s' function!");
@@ -739,6 +752,7 @@ void ai_think( Pilot* pilot, const double dt )
    nlua_env env;
    (void) dt;
    int data;
+   const char *task;
 
    Task *t;
 
@@ -769,10 +783,10 @@ void ai_think( Pilot* pilot, const double dt )
       if (pilot_isFlag(pilot,PILOT_PLAYER) ||
           pilot_isFlag(cur_pilot, PILOT_MANUAL_CONTROL)) {
          lua_rawgeti( naevL, LUA_REGISTRYINDEX, cur_pilot->ai->ref_control_manual );
-         ai_run(env, 0);
+         ai_run(env, 0, "control_manual");
       } else {
          lua_rawgeti( naevL, LUA_REGISTRYINDEX, cur_pilot->ai->ref_control );
-         ai_run(env, 0); /* run control */
+         ai_run(env, 0, "control"); /* run control */
       }
 
       nlua_getenv(env, "control_rate");
@@ -791,6 +805,7 @@ void ai_think( Pilot* pilot, const double dt )
    if (t != NULL) {
       /* Run subtask if available, otherwise run main task. */
       if (t->subtask != NULL) {
+         task = t->subtask->name;
          lua_rawgeti( naevL, LUA_REGISTRYINDEX, t->subtask->func );
          /* Use subtask data or task data if subtask is not set. */
          data = t->subtask->dat;
@@ -798,15 +813,16 @@ void ai_think( Pilot* pilot, const double dt )
             data = t->dat;
       }
       else {
+         task = t->name;
          lua_rawgeti( naevL, LUA_REGISTRYINDEX, t->func );
          data = t->dat;
       }
       /* Function should be on the stack. */
       if (data != LUA_NOREF) {
          lua_rawgeti( naevL, LUA_REGISTRYINDEX, data );
-         ai_run(env, 1);
+         ai_run(env, 1, task);
       } else
-         ai_run(env, 0);
+         ai_run(env, 0, task);
 
       /* Manual control must check if IDLE hook has to be run. */
       if (pilot_isFlag(cur_pilot, PILOT_MANUAL_CONTROL)) {
@@ -1324,6 +1340,15 @@ static int aiL_getrndpilot( lua_State *L )
    return 1;
 }
 
+/**
+ * @brief Grid filter that skips the pilot doing the query.
+ */
+static int ai_gridNotSelf( const Pilot *p, const Pilot *target, void *data )
+{
+   (void) data;
+   return (target->id != p->id);
+}
+
 /**
  * @brief gets the nearest pilot to the current pilot
  *
@@ -1332,30 +1357,24 @@ static int aiL_getrndpilot( lua_State *L )
  */
 static int aiL_getnearestpilot( lua_State *L )
 {
-   /*dist will be initialized to a number*/
-   /*this will only seek out pilots closer than dist*/
-   Pilot *const* pilot_stack = pilot_getAll();
-   int dist=1000;
-   int i;
-   int candidate_id = -1;
+   PilotGridQuery q;
+   Pilot *t;
 
-   /*cycle through all the pilots and find the closest one that is not the pilot */
-
-   for (i = 0; i<array_size(pilot_stack); i++)
-   {
-       if (pilot_stack[i]->id != cur_pilot->id && vect_dist(&pilot_stack[i]->solid->pos, &cur_pilot->solid->pos) < dist)
-       {
-            dist = vect_dist(&pilot_stack[i]->solid->pos, &cur_pilot->solid->pos);
-            candidate_id = i;
-       }
-   }
+   /* Only seek out pilots closer than 1000. */
+   memset( &q, 0, sizeof(q) );
+   q.p         = cur_pilot;
+   q.x         = cur_pilot->solid->pos.x;
+   q.y         = cur_pilot->solid->pos.y;
+   q.range     = 1000.;
+   q.relation  = PILOT_GRID_ALL;
+   q.filter    = ai_gridNotSelf;
 
    /* Last check. */
-   if (candidate_id == -1)
+   if (pilot_gridNearest( &q, &t, NULL, 1 ) <= 0)
       return 0;
 
    /* Actually found a pilot. */
-   lua_pushpilot(L, pilot_stack[candidate_id]->id);
+   lua_pushpilot(L, t->id);
    return 1;
 }
 
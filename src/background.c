@@ -272,7 +272,7 @@ void background_renderStars(const double dt, const int is_stars)
    gl_Matrix4 projection;
    int use_lines = 0;
 
-   glUseProgram(shaders.stars.program);
+   gl_useProgram(shaders.stars.program);
 
    glLineWidth(1. / gl_screen.scale);
    glPointSize(1. / gl_screen.scale);
@@ -330,10 +330,10 @@ void background_renderStars(const double dt, const int is_stars)
    }
 
    /* Render. */
-   glEnableVertexAttribArray(shaders.stars.vertex);
-   glEnableVertexAttribArray(shaders.stars.brightness);
-   glEnableVertexAttribArray(shaders.stars.relspeed);
-   glEnableVertexAttribArray(shaders.stars.color);
+   gl_enableVertexAttribArray(shaders.stars.vertex);
+   gl_enableVertexAttribArray(shaders.stars.brightness);
+   gl_enableVertexAttribArray(shaders.stars.relspeed);
+   gl_enableVertexAttribArray(shaders.stars.color);
    gl_vboActivateAttribOffset(is_stars ? star_vertexVBO : dust_vertexVBO,
          shaders.stars.vertex, 0, 2, GL_FLOAT,
          7 * sizeof(GLfloat));
@@ -357,15 +357,15 @@ void background_renderStars(const double dt, const int is_stars)
          is_stars ? nstars : ndust);
 
    /* Disable vertex array. */
-   glDisableVertexAttribArray(shaders.stars.vertex);
-   glDisableVertexAttribArray(shaders.stars.brightness);
-   glDisableVertexAttribArray(shaders.stars.relspeed);
-   glDisableVertexAttribArray(shaders.stars.color);
+   gl_disableVertexAttribArray(shaders.stars.vertex);
+   gl_disableVertexAttribArray(shaders.stars.brightness);
+   gl_disableVertexAttribArray(shaders.stars.relspeed);
+   gl_disableVertexAttribArray(shaders.stars.color);
 
    glLineWidth(1. / gl_screen.scale);
    glPointSize(1. / gl_screen.scale);
 
-   glUseProgram(0);
+   gl_useProgram(0);
 
    /* Check for errors. */
    gl_checkErr();
@@ -524,7 +524,7 @@ static nlua_env background_create( const char *name )
 {
    size_t bufsize;
    char path[PATH_MAX];
-   char *buf;
+   const char *buf;
    nlua_env env;
 
    /* Create file name. */
@@ -539,7 +539,7 @@ static nlua_env background_create( const char *name )
    nlua_loadCamera(env);
 
    /* Open file. */
-   buf = ndata_read( path, &bufsize );
+   buf = ndata_map( path, &bufsize );
    if (buf == NULL) {
       WARN( _("Background script '%s' not found."), path);
       nlua_freeEnv(env);
@@ -552,11 +552,11 @@ static nlua_env background_create( const char *name )
             "%s\n"
             "Most likely Lua file has improper syntax, please check"),
             path, lua_tostring(naevL,-1));
-      free(buf);
+      ndata_unmap( buf, bufsize );
       nlua_freeEnv(env);
       return LUA_NOREF;
    }
-   free(buf);
+   ndata_unmap( buf, bufsize );
 
    return env;
 }
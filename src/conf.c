@@ -110,6 +110,7 @@ static void print_usage( void )
    LOG(_("   -s f, --svol f        sets the sound volume to f"));
    LOG(_("   -d, --datapath        adds a new datapath to be mounted (i.e., appends it to the search path for game assets)"));
    LOG(_("   -X, --scale           defines the scale factor"));
+   LOG(_("   --startup-report file writes how long each startup stage took to file as JSON"));
 #ifdef DEBUGGING
    LOG(_("   --devmode             enables dev mode perks like the editors"));
 #endif /* DEBUGGING */
@@ -157,6 +158,9 @@ void conf_setDefaults (void)
    conf.nosave = 0;
    conf.devmode = 0;
    conf.devautosave = 0;
+   conf.lua_gc_budget = LUA_GC_BUDGET_DEFAULT;
+   conf.tex_budget = TEX_BUDGET_DEFAULT;
+   conf.universe_snapshot = UNIVERSE_SNAPSHOT_DEFAULT;
 
    /* Gameplay. */
    conf_setGameplayDefaults();
@@ -172,6 +176,7 @@ void conf_setDefaults (void)
 
    /* Debugging. */
    conf.fpu_except   = 0; /* Causes many issues. */
+   conf.diff_verify  = DIFF_VERIFY_DEFAULT;
 
    /* Editor. */
    conf.dev_save_sys = strdup( DEV_SAVE_SYSTEM_DEFAULT );
@@ -266,6 +271,7 @@ void conf_cleanup (void)
    free(conf.ndata);
    free(conf.language);
    free(conf.joystick_nam);
+   free(conf.startup_report);
    free(conf.dev_save_sys);
    free(conf.dev_save_map);
    free(conf.dev_save_asset);
@@ -408,9 +414,15 @@ int conf_loadConfig ( const char* file )
       conf_loadBool( lEnv, "devmode", conf.devmode );
       conf_loadBool( lEnv, "devautosave", conf.devautosave );
       conf_loadBool( lEnv, "conf_nosave", conf.nosave );
+      conf_loadFloat( lEnv, "lua_gc_budget", conf.lua_gc_budget );
+      conf.lua_gc_budget = MAX( 0., conf.lua_gc_budget );
+      conf_loadInt( lEnv, "tex_budget", conf.tex_budget );
+      conf.tex_budget = MAX( 0, conf.tex_budget );
+      conf_loadBool( lEnv, "universe_snapshot", conf.universe_snapshot );
 
       /* Debugging. */
       conf_loadBool( lEnv, "fpu_except", conf.fpu_except );
+      conf_loadBool( lEnv, "diff_verify", conf.diff_verify );
 
       /* Editor. */
       conf_loadString( lEnv, "dev_save_sys", conf.dev_save_sys );
@@ -552,6 +564,7 @@ void conf_parseCLI( int argc, char** argv )
       { "mvol", required_argument, 0, 'm' },
       { "svol", required_argument, 0, 's' },
       { "scale", required_argument, 0, 'X' },
+      { "startup-report", required_argument, 0, 'R' },
 #ifdef DEBUGGING
       { "devmode", no_argument, 0, 'D' },
 #endif /* DEBUGGING */
@@ -615,6 +628,10 @@ void conf_parseCLI( int argc, char** argv )
          case 'X':
             conf.scalefactor = atof(optarg);
             break;
+         case 'R':
+            free(conf.startup_report);
+            conf.startup_report = strdup(optarg);
+            break;
 #ifdef DEBUGGING
          case 'D':
             conf.devmode = 1;
@@ -1020,11 +1037,31 @@ int conf_saveConfig ( const char* file )
    conf_saveInt("conf_nosave",conf.nosave);
    conf_saveEmptyLine();
 
+   conf_saveComment(_("Time in milliseconds to spend collecting Lua garbage at the end of each frame"));
+   conf_saveComment(_("Setting this to 0 leaves garbage collection entirely up to Lua"));
+   conf_saveFloat("lua_gc_budget",conf.lua_gc_budget);
+   conf_saveEmptyLine();
+
+   conf_saveComment(_("Video memory in MiB ship and outfit graphics can use before unused ones are unloaded"));
+   conf_saveComment(_("Setting this to 0 keeps them loaded once used"));
+   conf_saveInt("tex_budget",conf.tex_budget);
+   conf_saveEmptyLine();
+
+   conf_saveComment(_("Cache faction presence and commodity prices between runs to speed up loading"));
+   conf_saveComment(_("The cache is regenerated whenever the game data changes"));
+   conf_saveBool("universe_snapshot",conf.universe_snapshot);
+   conf_saveEmptyLine();
+
    /* Debugging. */
    conf_saveComment(_("Enables FPU exceptions - only works on DEBUG builds"));
    conf_saveBool("fpu_except",conf.fpu_except);
    conf_saveEmptyLine();
 
+   conf_saveComment(_("Checks the universe after applying or removing unidiffs against a full rebuild"));
+   conf_saveComment(_("Only useful to debug the incremental rebuild, it makes diffs much slower"));
+   conf_saveBool("diff_verify",conf.diff_verify);
+   conf_saveEmptyLine();
+
    /* Editor. */
    conf_saveComment(_("Paths for saving different files from the editor"));
    conf_saveString("dev_save_sys",conf.dev_save_sys);
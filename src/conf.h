@@ -57,6 +57,11 @@
 #define FONT_SIZE_SMALL_DEFAULT 11 /**< conf.font_size_small */
 /* Debugging option defaults */
 #define REDIRECT_FILE_DEFAULT 1 /**< conf.redirect_file */
+#define DIFF_VERIFY_DEFAULT   0 /**< conf.diff_verify */
+/* Performance option defaults */
+#define LUA_GC_BUDGET_DEFAULT 1. /**< conf.lua_gc_budget */
+#define TEX_BUDGET_DEFAULT    256 /**< conf.tex_budget */
+#define UNIVERSE_SNAPSHOT_DEFAULT 1 /**< conf.universe_snapshot */
 /* Editor option defaults */
 #define DEV_SAVE_SYSTEM_DEFAULT "../dat/ssys/" /**< conf.dev_save_sys */
 #define DEV_SAVE_ASSET_DEFAULT "../dat/assets/" /**< conf.dev_save_asset */
@@ -145,10 +150,15 @@ typedef struct PlayerConf_s {
    int devmode; /**< Developer mode. */
    int devautosave; /**< Developer mode autosave. */
    char *lastversion; /**< The last version the game was ran in. */
+   char *startup_report; /**< File to write the startup timing report to, only set from the command line. */
+   double lua_gc_budget; /**< Time in ms per frame to spend collecting Lua garbage (0 leaves it to Lua). */
+   int tex_budget; /**< Video memory in MiB for ship and outfit graphics before evicting unused ones (0 is unlimited). */
+   int universe_snapshot; /**< Whether to cache the resolved universe between runs. */
 
    /* Debugging. */
    int redirect_file; /**< Whether to redirect logs and errors to files. */
    int fpu_except; /**< Enable FPU exceptions? */
+   int diff_verify; /**< Compare the rebuilds after universe diffs with full rebuilds. */
 
    /* Editor. */
    char *dev_save_sys; /**< Path to save systems to. */
@@ -2112,7 +2112,7 @@ void sysedit_renderMap( double bx, double by, double w, double h, double x, doub
    map_renderFactionDisks( x, y, r, 1, 1. );
 
    /* Render jump paths. */
-   map_renderJumps( x, y, r, 1 );
+   map_renderJumps( bx, by, x, y, w, h, r, 1 );
 
    /* Render systems. */
    map_renderSystems( bx, by, x, y, w, h, r, 1 );
@@ -592,8 +592,6 @@ void economy_initialiseCommodityPrices(void)
    int i, j, k;
    Planet *planet;
    StarSystem *sys;
-   Commodity *com;
-   CommodityModifier *this, *next;
    /* First use planet attributes to set prices and variability */
    for (k=0; k<array_size(systems_stack); k++) {
       sys = &systems_stack[k];
@@ -624,26 +622,78 @@ void economy_initialiseCommodityPrices(void)
       sys = &systems_stack[i];
       economy_calcUpdatedCommodityPrice(sys);
    }
-   /* And now free temporary commodity information */
-   for ( i=0 ; i<array_size(commodity_stack); i++ ) {
-      com = &commodity_stack[i];
-      next = com->planet_modifier;
-      com->planet_modifier = NULL;
-      while (next != NULL) {
-         this = next;
-         next = this->next;
-         free(this->name);
-         free(this);
+}
+
+
+/**
+ * @brief Recomputes the commodity prices of some systems.
+ *
+ * Prices depend on the neighbouring systems, so their averages are computed
+ *  too, but their own prices are left untouched. The result is the same as
+ *  economy_initialiseCommodityPrices() for these systems.
+ *
+ *    @param systems Array (array.h) of the ids of the systems to recompute.
+ */
+void economy_initialiseCommodityPricesSubset( const int *systems )
+{
+   int i, j, k, *ring, ret;
+   char *in;
+   Planet *planet;
+   StarSystem *sys;
+   CommodityPrice **saved;
+
+   in = calloc( MAX(1,array_size(systems_stack)), sizeof(char) );
+   for (i=0; i<array_size(systems); i++)
+      in[ systems[i] ] = 1;
+   ring  = systems_getNeighbourhood( systems, 1 );
+   saved = array_create( CommodityPrice* );
+
+   /* Use planet attributes to set prices, keeping a copy of the neighbours. */
+   ret = 0;
+   for (k=0; (k<array_size(ring)) && !ret; k++) {
+      sys = &systems_stack[ ring[k] ];
+      for ( j=0; (j<array_size(sys->planets)) && !ret; j++ ) {
+         planet = sys->planets[j];
+         if (!in[ sys->id ])
+            array_push_back( &saved, (planet->commodityPrice == NULL) ? NULL :
+                  array_copy( CommodityPrice, planet->commodityPrice ) );
+         for ( i=0; i<array_size(planet->commodities); i++ ) {
+            ret = economy_calcPrice(planet, planet->commodities[i], &planet->commodityPrice[i]);
+            if (ret)
+               break;
+         }
       }
-      next = com->faction_modifier;
-      com->faction_modifier = NULL;
-      while (next != NULL) {
-         this = next;
-         next = this->next;
-         free(this->name);
-         free(this);
+   }
+
+   if (!ret) {
+      for (k=0; k<array_size(ring); k++)
+         economy_modifySystemCommodityPrice( &systems_stack[ ring[k] ] );
+      for (k=0; k<array_size(systems); k++)
+         economy_smoothCommodityPrice( &systems_stack[ systems[k] ] );
+      for (k=0; k<array_size(systems); k++)
+         economy_calcUpdatedCommodityPrice( &systems_stack[ systems[k] ] );
+   }
+
+   /* Restore the neighbours. */
+   i = 0;
+   for (k=0; k<array_size(ring); k++) {
+      sys = &systems_stack[ ring[k] ];
+      if (in[ sys->id ])
+         continue;
+      array_free( sys->averagePrice );
+      sys->averagePrice = NULL;
+      for ( j=0; (j<array_size(sys->planets)) && (i<array_size(saved)); j++ ) {
+         planet = sys->planets[j];
+         if (saved[i] != NULL)
+            memcpy( planet->commodityPrice, saved[i], sizeof(CommodityPrice) * array_size(saved[i]) );
+         array_free( saved[i] );
+         i++;
       }
    }
+
+   array_free( saved );
+   array_free( ring );
+   free( in );
 }
 
 
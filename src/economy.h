@@ -34,6 +34,7 @@ credits_t economy_getPriceAtTime( const Commodity *com, const StarSystem *sys, c
  * Calculating the sinusoidal economy values
  */
 void economy_initialiseCommodityPrices(void);
+void economy_initialiseCommodityPricesSubset( const int *systems );
 int economy_getAveragePrice( const Commodity *com, credits_t *mean, double *std );
 void economy_initialiseSingleSystem( StarSystem *sys, Planet *planet );
 
@@ -86,7 +86,7 @@ static Event_t *event_active     = NULL; /**< Active events. */
  */
 static unsigned int event_genID (void);
 static int event_cmp( const void* a, const void* b );
-static int event_parseFile( const char* file );
+static int event_parseFile( const XmlParseJob *job );
 static int event_parseXML( EventData *temp, const xmlNodePtr parent );
 static void event_freeData( EventData *event );
 static int event_create( int dataid, unsigned int *id );
@@ -487,15 +487,20 @@ int events_load (void)
 {
    int    i;
    char **event_files;
+   XmlParseStream *stream;
+   XmlParseJob *job;
 
    /* Run over events. */
    event_files = ndata_listRecursive( EVENT_DATA_PATH );
    event_data  = array_create_size( EventData, array_size( event_files ) );
-   for ( i = 0; i < array_size( event_files ); i++ ) {
+   stream = xml_parseStreamOpen( (const char**)event_files, array_size( event_files ), 1 );
+   while ((job = xml_parseStreamNext( stream )) != NULL) {
       if (!naev_pollQuit())
-         event_parseFile(event_files[i]);
-      free( event_files[ i ] );
+         event_parseFile( job );
    }
+   xml_parseStreamClose( stream );
+   for ( i = 0; i < array_size( event_files ); i++ )
+      free( event_files[i] );
    array_free( event_files );
    array_shrink( &event_data );
 
@@ -511,12 +516,11 @@ int events_load (void)
 /**
  * @brief Parses an event file.
  */
-static int event_parseFile( const char* file )
+static int event_parseFile( const XmlParseJob *job )
 {
-   size_t bufsize;
    xmlNodePtr node;
-   xmlDocPtr doc;
-   char *filebuf;
+   const char *file, *filebuf;
+   size_t bufsize;
    const char *pos, *start_pos;
    EventData *temp;
 
@@ -525,8 +529,10 @@ static int event_parseFile( const char* file )
    int ret;
 #endif /* DEBUGGING */
 
-   /* Load string. */
-   filebuf = ndata_read( file, &bufsize );
+   /* File was already read and its header parsed by xml_parseStreamNext(). */
+   file     = job->filename;
+   filebuf  = job->buf;
+   bufsize  = job->bufsize;
    if (filebuf == NULL) {
       WARN(_("Unable to read data from '%s'"), file);
       return -1;
@@ -538,7 +544,6 @@ static int event_parseFile( const char* file )
       pos = strnstr( filebuf, "function create", bufsize );
       if ((pos != NULL) && !strncmp(pos,"--common",bufsize))
          WARN(_("Event '%s' has create function but no XML header!"), file);
-      free(filebuf);
       return 0;
    }
 
@@ -551,14 +556,13 @@ static int event_parseFile( const char* file )
    }
 
    /* Parse the header. */
-   doc = xmlParseMemory( start_pos, pos-start_pos );
-   if (doc == NULL) {
+   if (job->doc == NULL) {
       WARN(_("Unable to parse document XML header for Event '%s'"), file);
       return -1;
    }
 
    /* Get the root node. */
-   node = doc->xmlChildrenNode;
+   node = job->doc->xmlChildrenNode;
    if (!xml_isNode(node,XML_EVENT_TAG)) {
       WARN(_("Malformed '%s' file: missing root element '%s'"), file, XML_EVENT_TAG);
       return -1;
@@ -566,7 +570,7 @@ static int event_parseFile( const char* file )
 
    temp = &array_grow(&event_data);
    event_parseXML( temp, node );
-   temp->lua = strdup(filebuf);
+   temp->lua = strndup(filebuf, bufsize);
    temp->sourcefile = strdup(file);
 
 #ifdef DEBUGGING
@@ -580,10 +584,6 @@ static int event_parseFile( const char* file )
    }
 #endif /* DEBUGGING */
 
-   /* Clean up. */
-   xmlFreeDoc(doc);
-   free(filebuf);
-
    return 0;
 }
 
@@ -1497,7 +1497,8 @@ static int faction_parse( Faction* temp, xmlNodePtr parent )
 {
    xmlNodePtr node;
    int player;
-   char buf[PATH_MAX], *dat, *ctmp;
+   char buf[PATH_MAX], *ctmp;
+   const char *dat;
    size_t ndat;
 
    /* Clear memory. */
@@ -1546,7 +1547,7 @@ static int faction_parse( Faction* temp, xmlNodePtr parent )
          snprintf( buf, sizeof(buf), FACTIONS_PATH"spawn/%s.lua", xml_raw(node) );
          temp->sched_env = nlua_newEnv(1);
          nlua_loadStandard( temp->sched_env );
-         dat = ndata_read( buf, &ndat );
+         dat = ndata_map( buf, &ndat );
          if (nlua_dobufenv(temp->sched_env, dat, ndat, buf) != 0) {
             WARN(_("Failed to run spawn script: %s\n"
                   "%s\n"
@@ -1555,7 +1556,7 @@ static int faction_parse( Faction* temp, xmlNodePtr parent )
             nlua_freeEnv( temp->sched_env );
             temp->sched_env = LUA_NOREF;
          }
-         free(dat);
+         ndata_unmap( dat, ndat );
          continue;
       }
 
@@ -1577,7 +1578,7 @@ static int faction_parse( Faction* temp, xmlNodePtr parent )
          snprintf( buf, sizeof(buf), FACTIONS_PATH"equip/%s.lua", xml_raw(node) );
          temp->equip_env = nlua_newEnv(1);
          nlua_loadStandard( temp->equip_env );
-         dat = ndata_read( buf, &ndat );
+         dat = ndata_map( buf, &ndat );
          if (nlua_dobufenv(temp->equip_env, dat, ndat, buf) != 0) {
             WARN(_("Failed to run equip script: %s\n"
                   "%s\n"
@@ -1586,7 +1587,7 @@ static int faction_parse( Faction* temp, xmlNodePtr parent )
             nlua_freeEnv( temp->equip_env );
             temp->equip_env = LUA_NOREF;
          }
-         free(dat);
+         ndata_unmap( dat, ndat );
          continue;
       }
 
@@ -1635,13 +1636,14 @@ static int faction_parse( Faction* temp, xmlNodePtr parent )
  *    @param scriptname Name of the lua script to use (e.g., "static").
  */
 static void faction_addStandingScript( Faction* temp, const char* scriptname ) {
-   char buf[PATH_MAX], *dat;
+   char buf[PATH_MAX];
+   const char *dat;
    size_t ndat;
 
    snprintf( buf, sizeof(buf), FACTIONS_PATH"standing/%s.lua", scriptname );
    temp->env = nlua_newEnv(1);
    nlua_loadStandard( temp->env );
-   dat = ndata_read( buf, &ndat );
+   dat = ndata_map( buf, &ndat );
    if (nlua_dobufenv(temp->env, dat, ndat, buf) != 0) {
       WARN(_("Failed to run standing script: %s\n"
             "%s\n"
@@ -1650,7 +1652,7 @@ static void faction_addStandingScript( Faction* temp, const char* scriptname ) {
       nlua_freeEnv( temp->env );
       temp->env = LUA_NOREF;
    }
-   free(dat);
+   ndata_unmap( dat, ndat );
 }
 
 
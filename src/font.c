@@ -10,11 +10,21 @@
  * We use distance fields [1] to render high quality fonts with the help of
  * some shaders. Characters are generated on demand using a texture atlas.
  *
+ * Computing the distance fields is expensive, so they are kept in an on-disk
+ * cache per font file (identified by its path, size and modification time)
+ * and size. The
+ * common glyph ranges are generated in parallel when a font is created.
+ *
+ * Laying out text is also expensive, so the glyph positions and line breaks
+ * of the texts printed are cached, and the glyphs of each print are drawn with
+ * a single call per texture.
+ *
  * [1]: https://steamcdn-a.akamaihd.net/apps/valve/2007/SIGGRAPH2007_AlphaTestedMagnification.pdf
  */
 
 
 /** @cond */
+#include <errno.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_GLYPH_H
@@ -22,6 +32,7 @@
 #include <wctype.h>
 #include "linebreak.h"
 #include "linebreakdef.h"
+#include "physfs.h"
 
 #include "naev.h"
 /** @endcond */
@@ -34,6 +45,7 @@
 #include "log.h"
 #include "ndata.h"
 #include "nfile.h"
+#include "threadpool.h"
 #include "utf8.h"
 
 
@@ -42,6 +54,16 @@
 #define HASH_LUT_SIZE 512 /**< Size of glyph look up table. */
 #define DEFAULT_TEXTURE_SIZE 1024 /**< Default size of texture caches for glyphs. */
 #define MAX_ROWS 64 /**< Max number of rows per texture cache. */
+#define FONT_CACHE_PATH       "glyphs/" /**< Directory of the glyph caches in the cache directory. */
+#define FONT_CACHE_MAGIC      0x46445347 /**< Magic number of the glyph caches. */
+#define FONT_CACHE_VERSION    2 /**< Version of the glyph cache format. */
+#define FONT_PRECACHE_CHUNK   32 /**< Number of glyphs generated per job when precaching. */
+#define FONT_VERTEX_SIZE      9 /**< Floats per glyph vertex: position, texture coordinates, colour and distance units. */
+#define FONT_LAYOUT_SETS      256 /**< Number of sets of the layout cache, must be a power of two. */
+#define FONT_LAYOUT_WAYS      4 /**< Number of layouts per set of the layout cache. */
+#define FONT_LAYOUT_LINE      0 /**< Lays out the whole text as a single line. */
+#define FONT_LAYOUT_LIMIT     1 /**< Lays out as much text as fits in the width as a single line. */
+#define FONT_LAYOUT_WRAP      2 /**< Breaks the text into lines that fit in the width. */
 
 
 /**
@@ -116,18 +138,81 @@ typedef struct glFontFile_s {
    int refcount; /**< Reference counting. */
    FT_Byte *data; /**< Font data buffer. */
    size_t datasize; /**< Font data size. */
+   int64_t size; /**< Size of the font file when it was read. */
+   int64_t mtime; /**< Modification time of the font file when it was read. */
+   uint64_t key; /**< Hash of the name, size and modification time, identifies the glyph caches. */
 } glFontFile;
 
 
+/**
+ * @brief Glyph record of the on-disk cache, followed by the distance field if any.
+ */
+typedef struct glFontCacheRecord_s {
+   uint32_t index; /**< Glyph index in the face. */
+   int32_t w; /**< Width. */
+   int32_t h; /**< Height. */
+   int32_t off_x; /**< X offset when rendering. */
+   int32_t off_y; /**< Y offset when rendering. */
+   float adv_x; /**< X advancement on the screen. */
+   float m; /**< Number of distance units corresponding to 1 "pixel". */
+   uint32_t field; /**< Whether a distance field follows, empty glyphs have none. */
+} glFontCacheRecord;
+
+
+/**
+ * @brief Cached glyph of a face.
+ */
+typedef struct glFontCacheGlyph_s {
+   glFontCacheRecord r; /**< Glyph record. */
+   GLfloat *dataf; /**< Distance field, points into the cache blob unless owned. */
+   int owned; /**< Whether dataf was allocated. */
+} glFontCacheGlyph;
+
+
 /**
  * @brief Freetype Font structure.
  */
 typedef struct glFontStashFreetype_s {
    glFontFile *file; /**< Font file. */
    FT_Face face; /**< Face structure. */
+   int h; /**< Height the face is set up for. */
+   char *cache_blob; /**< Contents of the glyph cache file. */
+   glFontCacheGlyph *cache; /**< Cached glyphs sorted by index. */
+   int cache_dirty; /**< Whether the glyph cache has to be saved. */
 } glFontStashFreetype;
 
 
+/**
+ * @brief Glyph generated by a precaching job.
+ */
+typedef struct FontPrecacheGlyph_s {
+   FT_UInt index; /**< Glyph index in the face. */
+   int ret; /**< Return value of font_renderGlyph(), -2 if it never ran. */
+   font_char_t c; /**< Generated glyph. */
+} FontPrecacheGlyph;
+
+
+/**
+ * @brief Precaching job, generates a group of glyphs of a single face.
+ */
+typedef struct FontPrecacheJob_s {
+   const glFontFile *file; /**< Font file to use. */
+   int h; /**< Height of the font. */
+   FontPrecacheGlyph *glyphs; /**< Glyphs to generate. */
+   int n; /**< Number of glyphs. */
+   int ret; /**< Setup error of the job to log on the main thread, see font_precacheWorker(). */
+} FontPrecacheJob;
+
+
+/**
+ * @brief Codepoint ranges generated when a font is created.
+ */
+static const uint32_t font_precacheRanges[][2] = {
+   { 0x20, 0x7E }, /* Basic Latin. */
+   { 0xA0, 0xFF }, /* Latin-1 Supplement. */
+};
+
+
 /**
  * @brief Font structure.
  */
@@ -142,12 +227,10 @@ typedef struct glFontStash_s {
    int tw; /**< Width of textures. */
    int th; /**< Height of textures. */
    glFontTex *tex; /**< Textures. */
-   gl_vbo *vbo_tex; /**< VBO associated to texture coordinates. */
-   gl_vbo *vbo_vert; /**< VBO associated to vertex coordinates. */
-   GLfloat *vbo_tex_data; /**< Copy of texture coordinate data. */
-   GLshort *vbo_vert_data; /**< Copy of vertex coordinate data. */
-   int nvbo; /**< Amount of vbo data. */
-   int mvbo; /**< Amount of vbo memory. */
+   GLfloat *vbo_tex_data; /**< Texture coordinates of the glyph quads. */
+   GLshort *vbo_vert_data; /**< Vertex coordinates of the glyph quads. */
+   int nvbo; /**< Amount of glyph quads. */
+   int mvbo; /**< Amount of glyph quad memory. */
    glFontGlyph *glyphs; /**< Unicode glyphs. */
    int lut[HASH_LUT_SIZE]; /**< Look up table. */
 
@@ -157,6 +240,56 @@ typedef struct glFontStash_s {
    int refcount; /**< Reference counting. */
 } glFontStash;
 
+/**
+ * @brief Glyph or colour change of a text layout.
+ */
+typedef struct glFontLayoutItem_s {
+   int glyph; /**< Index of the glyph in the stash, -1 for a colour change. */
+   uint32_t code; /**< Character or colour code. */
+   GLfloat x; /**< Position from the start of the line, kerning included. */
+} glFontLayoutItem;
+
+
+/**
+ * @brief Line of a text layout.
+ */
+typedef struct glFontLayoutLine_s {
+   int item; /**< First item of the line. */
+   int n; /**< Number of items of the line. */
+   int width; /**< Width of the line. */
+} glFontLayoutLine;
+
+
+/**
+ * @brief Cached layout of a text, so it doesn't have to be measured and broken into lines every frame.
+ */
+typedef struct glFontLayout_s {
+   char *text; /**< Text laid out, NULL if the entry is free. */
+   uint64_t hash; /**< Hash of the key. */
+   int stash; /**< Font stash used. */
+   int width; /**< Maximum width. */
+   int mode; /**< Layout mode (FONT_LAYOUT_*). */
+   size_t len; /**< Number of bytes of the text laid out. */
+   glFontLayoutItem *items; /**< Items of all the lines. */
+   glFontLayoutLine *lines; /**< Lines of the text. */
+   unsigned int used; /**< Last time the layout was used. */
+} glFontLayout;
+
+static glFontLayout font_layouts[ FONT_LAYOUT_SETS ][ FONT_LAYOUT_WAYS ]; /**< Layout cache, replaces the least recently used layout of a set. */
+static unsigned int font_layoutTick = 0; /**< Layout cache clock. */
+
+
+/*
+ * Glyph rendering. The quads of all the glyphs of a print are gathered by
+ * texture and drawn at once in gl_fontRenderEnd().
+ */
+static GLfloat **font_buckets    = NULL; /**< Vertices of the glyphs to render, per texture of the stash. */
+static GLfloat *font_vbo_data    = NULL; /**< Vertices of all the glyphs being uploaded. */
+static gl_vbo *font_vbo          = NULL; /**< Stream VBO the glyphs are uploaded into. */
+static glColour font_col; /**< Colour of the glyphs being rendered. */
+static glColour font_outlineCol; /**< Colour of the outline of the glyphs being rendered. */
+
+
 /**
  * Available fonts stashes.
  */
@@ -182,19 +315,36 @@ static const glColour* gl_fontGetColour( uint32_t ch );
 static uint32_t font_nextChar( const char *s, size_t *i );
 /* Get unicode glyphs from cache. */
 static glFontGlyph* gl_fontGetGlyph( glFontStash *stsh, uint32_t ch );
-/* Render.
- * TODO this should be changed to be more like font-stash (https://github.com/akrinke/Font-Stash)
- * In particular, instead of writing char by char, they should be batched up by textures and rendered
- * when gl_fontRenderEnd() is called, saving lots of opengl calls.
- */
+/* Layout. */
+static const glFontLayout* font_layoutGet( const glFont *ft_font, const char *text, int width, int mode );
+static void font_layoutLine( glFontStash *stsh, glFontLayout *layout, const char *text, size_t begin, size_t end, int width );
+static void font_layoutFree( glFontLayout *layout );
+static void font_layoutPurge( int stash );
+/* Render. */
 static void gl_fontRenderStart( const glFontStash *stsh, double x, double y, const glColour *c, double outlineR );
 static void gl_fontRenderStartH( const glFontStash* stsh, const gl_Matrix4 *H, const glColour *c, double outlineR );
-static int gl_fontRenderGlyph( glFontStash *stsh, uint32_t ch, const glColour *c, int state );
-static void gl_fontRenderEnd (void);
+static void gl_fontRenderLine( glFontStash *stsh, const glFontLayout *layout, int line, double dy, const glColour *c );
+static void gl_fontRenderEnd( const glFontStash *stsh );
 /* Fussy layout concerns. */
+static uint32_t hashint( uint32_t a );
 static void gl_fontKernStart (void);
 static int gl_fontKernGlyph( glFontStash* stsh, uint32_t ch, glFontGlyph* glyph );
 static void gl_fontstashftDestroy( glFontStashFreetype *ft );
+/* Glyph generation and caching. */
+static uint64_t font_hash( const void *data, size_t len );
+static void font_setupFace( FT_Face face, unsigned int h );
+static int font_renderGlyph( FT_Face face, FT_UInt glyph_index, int h, font_char_t *c );
+static void font_renderWarn( const char *name, int ret );
+static void font_cachePath( const glFontStashFreetype *ft, char *buf, size_t len );
+static int font_cacheCmp( const void *p1, const void *p2 );
+static void font_cacheLoad( glFontStashFreetype *ft );
+static glFontCacheGlyph* font_cacheFind( const glFontStashFreetype *ft, FT_UInt index );
+static int font_cacheGet( const glFontStashFreetype *ft, FT_UInt index, font_char_t *c );
+static void font_cacheAdd( glFontStashFreetype *ft, FT_UInt index, const font_char_t *c );
+static void font_cacheSave( glFontStashFreetype *ft );
+static void font_cacheFree( glFontStashFreetype *ft );
+static int font_precacheWorker( void *data );
+static void gl_fontstashPrecache( glFontStash *stsh );
 
 
 /**
@@ -271,7 +421,7 @@ static int gl_fontAddGlyphTex( glFontStash *stsh, font_char_t *ch, glFontGlyph *
 
       /* Create new texture. */
       glGenTextures( 1, &tex->id );
-      glBindTexture( GL_TEXTURE_2D, tex->id );
+      gl_bindTexture( GL_TEXTURE_2D, tex->id );
 
       /* Set a reasonable default minification and magnification filter. */
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, stsh->magfilter);
@@ -294,7 +444,7 @@ static int gl_fontAddGlyphTex( glFontStash *stsh, font_char_t *ch, glFontGlyph *
    }
 
    /* Upload data. */
-   glBindTexture( GL_TEXTURE_2D, tex->id );
+   gl_bindTexture( GL_TEXTURE_2D, tex->id );
    glPixelStorei(GL_UNPACK_ALIGNMENT,1);
    if (ch->dataf != NULL)
       glTexSubImage2D( GL_TEXTURE_2D, 0, gr->x, gr->y, ch->w, ch->h,
@@ -370,10 +520,6 @@ static int gl_fontAddGlyphTex( glFontStash *stsh, font_char_t *ch, glFontGlyph *
    vbo_vert[ 5 ] = vy;
    vbo_vert[ 6 ] = vx+vw; /* Bottom right. */
    vbo_vert[ 7 ] = vy;
-   /* Update vbos. */
-   gl_vboData( stsh->vbo_tex,  sizeof(GLfloat)*n,  stsh->vbo_tex_data );
-   gl_vboData( stsh->vbo_vert, sizeof(GLshort)*n, stsh->vbo_vert_data );
-
    /* Add space for the new character. */
    gr->x += ch->w;
 
@@ -381,10 +527,6 @@ static int gl_fontAddGlyphTex( glFontStash *stsh, font_char_t *ch, glFontGlyph *
    glyph->vbo_id = (n-8)/2;
    glyph->tex_index = tex - stsh->tex;
 
-   /* Since the VBOs have possibly changed, we have to reset the data. */
-   gl_vboActivateAttribOffset( stsh->vbo_vert, shaders.font.vertex, 0, 2, GL_SHORT, 0 );
-   gl_vboActivateAttribOffset( stsh->vbo_tex, shaders.font.tex_coord, 0, 2, GL_FLOAT, 0 );
-
    return 0;
 }
 
@@ -626,6 +768,173 @@ static uint32_t font_nextChar( const char *s, size_t *i )
 }
 
 
+/**
+ * @brief Gets the layout of a text, laying it out if it isn't cached.
+ *
+ * The layout is only valid until the next call.
+ *
+ *    @param ft_font Font to lay out with.
+ *    @param text Text to lay out.
+ *    @param width Maximum width, ignored by FONT_LAYOUT_LINE.
+ *    @param mode How to lay out the text (FONT_LAYOUT_*).
+ *    @return The layout of the text, with at least a line.
+ */
+static const glFontLayout* font_layoutGet( const glFont *ft_font, const char *text, int width, int mode )
+{
+   int i, stash, w;
+   size_t len;
+   uint64_t hash;
+   glFontLayout *set, *layout;
+   glPrintLineIterator iter;
+   glFontStash *stsh = gl_fontGetStash( ft_font );
+
+   if (mode == FONT_LAYOUT_LINE)
+      width = 0;
+   stash = ft_font->id;
+   len   = strlen( text );
+   hash  = font_hash( text, len ) ^ hashint( (uint32_t)width ^ ((uint32_t)stash << 2) ^ (uint32_t)mode );
+
+   /* Look for it in its set, remembering the least recently used entry. */
+   font_layoutTick++;
+   set = font_layouts[ hash & (FONT_LAYOUT_SETS-1) ];
+   layout = &set[0];
+   for (i=0; i<FONT_LAYOUT_WAYS; i++) {
+      if ((set[i].text != NULL) && (set[i].hash == hash) && (set[i].stash == stash)
+            && (set[i].width == width) && (set[i].mode == mode)
+            && (strcmp( set[i].text, text ) == 0)) {
+         set[i].used = font_layoutTick;
+         return &set[i];
+      }
+      if (set[i].used < layout->used)
+         layout = &set[i];
+   }
+
+   /* Not cached, replace the entry. */
+   font_layoutFree( layout );
+   layout->text   = strdup( text );
+   layout->hash   = hash;
+   layout->stash  = stash;
+   layout->width  = width;
+   layout->mode   = mode;
+   layout->items  = array_create( glFontLayoutItem );
+   layout->lines  = array_create( glFontLayoutLine );
+   layout->used   = font_layoutTick;
+   switch (mode) {
+      case FONT_LAYOUT_LINE:
+         layout->len = len;
+         font_layoutLine( stsh, layout, text, 0, len, 0 );
+         break;
+
+      case FONT_LAYOUT_LIMIT:
+         w = 0;
+         layout->len = font_limitSize( stsh, &w, text, width );
+         font_layoutLine( stsh, layout, text, 0, layout->len, w );
+         break;
+
+      case FONT_LAYOUT_WRAP:
+         layout->len = len;
+         gl_printLineIteratorInit( &iter, ft_font, text, width );
+         while (gl_printLineIteratorNext( &iter ))
+            font_layoutLine( stsh, layout, text, iter.l_begin, iter.l_end, iter.l_width );
+         break;
+   }
+
+   return layout;
+}
+
+
+/**
+ * @brief Lays out a line of text, positioning its glyphs.
+ *
+ *    @param stsh Font stash to lay out with.
+ *    @param layout Layout to add the line to.
+ *    @param text Text being laid out.
+ *    @param begin Byte the line starts at.
+ *    @param end Byte after the end of the line.
+ *    @param width Width of the line.
+ */
+static void font_layoutLine( glFontStash *stsh, glFontLayout *layout, const char *text,
+      size_t begin, size_t end, int width )
+{
+   size_t i;
+   uint32_t ch;
+   GLfloat x;
+   glFontGlyph *glyph;
+   glFontLayoutItem *item;
+   glFontLayoutLine *line;
+
+   line = &array_grow( &layout->lines );
+   line->item  = array_size( layout->items );
+   line->width = width;
+
+   gl_fontKernStart();
+   x = 0.;
+   i = begin;
+   while (i < end) {
+      ch = u8_nextchar( text, &i );
+
+      /* Handle escape sequences. */
+      if (ch == FONT_COLOUR_CODE) {
+         if (i >= end)
+            break;
+         ch = u8_nextchar( text, &i );
+         if (ch != FONT_COLOUR_CODE) {
+            item = &array_grow( &layout->items );
+            item->glyph = -1;
+            item->code  = ch;
+            item->x     = x;
+            continue;
+         }
+      }
+
+      glyph = gl_fontGetGlyph( stsh, ch );
+      if (glyph == NULL) {
+         WARN(_("Unable to find glyph '%d'!"), ch );
+         continue;
+      }
+
+      /* Kern if possible. */
+      x += gl_fontKernGlyph( stsh, ch, glyph );
+
+      item = &array_grow( &layout->items );
+      item->glyph = glyph - stsh->glyphs;
+      item->code  = ch;
+      item->x     = x;
+      x += glyph->adv_x;
+   }
+
+   line->n = array_size( layout->items ) - line->item;
+}
+
+
+/**
+ * @brief Frees a layout, leaving its cache entry free.
+ */
+static void font_layoutFree( glFontLayout *layout )
+{
+   free( layout->text );
+   array_free( layout->items );
+   array_free( layout->lines );
+   memset( layout, 0, sizeof(glFontLayout) );
+}
+
+
+/**
+ * @brief Frees all the cached layouts of a font stash.
+ *
+ *    @param stash Index of the font stash.
+ */
+static void font_layoutPurge( int stash )
+{
+   int i, j;
+
+   for (i=0; i<FONT_LAYOUT_SETS; i++)
+      for (j=0; j<FONT_LAYOUT_WAYS; j++)
+         if ((font_layouts[i][j].text != NULL) && (font_layouts[i][j].stash == stash))
+            font_layoutFree( &font_layouts[i][j] );
+}
+
+
 /**
  * @brief Prints text on screen.
  *
@@ -641,21 +950,17 @@ static uint32_t font_nextChar( const char *s, size_t *i )
 void gl_printRaw( const glFont *ft_font, double x, double y, const glColour* c,
       double outlineR, const char *text )
 {
-   int s;
-   size_t i;
-   uint32_t ch;
+   const glFontLayout *layout;
 
    if (ft_font == NULL)
       ft_font = &gl_defFont;
    glFontStash *stsh = gl_fontGetStash( ft_font );
+   layout = font_layoutGet( ft_font, text, 0, FONT_LAYOUT_LINE );
 
    /* Render it. */
-   s = 0;
-   i = 0;
    gl_fontRenderStart( stsh, x, y, c, outlineR );
-   while ((ch = u8_nextchar( text, &i )))
-      s = gl_fontRenderGlyph( stsh, ch, c, s );
-   gl_fontRenderEnd();
+   gl_fontRenderLine( stsh, layout, 0, 0., c );
+   gl_fontRenderEnd( stsh );
 }
 
 
@@ -673,21 +978,17 @@ void gl_printRaw( const glFont *ft_font, double x, double y, const glColour* c,
 void gl_printRawH( const glFont *ft_font, const gl_Matrix4 *H,
       const glColour* c, const double outlineR , const char *text )
 {
-   int s;
-   size_t i;
-   uint32_t ch;
+   const glFontLayout *layout;
 
    if (ft_font == NULL)
       ft_font = &gl_defFont;
    glFontStash *stsh = gl_fontGetStash( ft_font );
+   layout = font_layoutGet( ft_font, text, 0, FONT_LAYOUT_LINE );
 
    /* Render it. */
-   s = 0;
-   i = 0;
    gl_fontRenderStartH( stsh, H, c, outlineR );
-   while ((ch = u8_nextchar( text, &i )))
-      s = gl_fontRenderGlyph( stsh, ch, c, s );
-   gl_fontRenderEnd();
+   gl_fontRenderLine( stsh, layout, 0, 0., c );
+   gl_fontRenderEnd( stsh );
 }
 
 
@@ -748,26 +1049,21 @@ void gl_print( const glFont *ft_font,
 int gl_printMaxRaw( const glFont *ft_font, const int max, double x, double y,
       const glColour* c, double outlineR, const char *text)
 {
-   int s;
-   size_t ret, i;
-   uint32_t ch;
+   const glFontLayout *layout;
 
    if (ft_font == NULL)
       ft_font = &gl_defFont;
    glFontStash *stsh = gl_fontGetStash( ft_font );
 
    /* Limit size. */
-   ret = font_limitSize( stsh, NULL, text, max );
+   layout = font_layoutGet( ft_font, text, max, FONT_LAYOUT_LIMIT );
 
    /* Render it. */
-   s = 0;
    gl_fontRenderStart( stsh, x, y, c, outlineR );
-   i = 0;
-   while ((ch = u8_nextchar( text, &i )) && (i <= ret))
-      s = gl_fontRenderGlyph( stsh, ch, c, s );
-   gl_fontRenderEnd();
+   gl_fontRenderLine( stsh, layout, 0, 0., c );
+   gl_fontRenderEnd( stsh );
 
-   return ret;
+   return layout->len;
 }
 
 
@@ -823,28 +1119,22 @@ int gl_printMidRaw(
       const char *text
       )
 {
-   int n, s;
-   size_t ret, i;
-   uint32_t ch;
+   const glFontLayout *layout;
 
    if (ft_font == NULL)
       ft_font = &gl_defFont;
    glFontStash *stsh = gl_fontGetStash( ft_font );
 
    /* limit size */
-   n = 0;
-   ret = font_limitSize( stsh, &n, text, width );
-   x += (double)(width - n)/2.;
+   layout = font_layoutGet( ft_font, text, width, FONT_LAYOUT_LIMIT );
+   x += (double)(width - layout->lines[0].width)/2.;
 
    /* Render it. */
-   s = 0;
    gl_fontRenderStart( stsh, x, y, c, outlineR );
-   i = 0;
-   while ((ch = u8_nextchar( text, &i )) && (i <= ret))
-      s = gl_fontRenderGlyph( stsh, ch, c, s );
-   gl_fontRenderEnd();
+   gl_fontRenderLine( stsh, layout, 0, 0., c );
+   gl_fontRenderEnd( stsh );
 
-   return ret;
+   return layout->len;
 }
 
 
@@ -904,15 +1194,14 @@ int gl_printTextRaw( const glFont *ft_font,
       const char *text
     )
 {
-   glPrintLineIterator iter;
-   int s;
-   double x,y;
-   size_t i;
-   uint32_t ch;
+   const glFontLayout *layout;
+   int i;
+   double x,y, y0;
 
    if (ft_font == NULL)
       ft_font = &gl_defFont;
    glFontStash *stsh = gl_fontGetStash( ft_font );
+   layout = font_layoutGet( ft_font, text, width, FONT_LAYOUT_WRAP );
 
    x = bx;
    y = by + height - (double)ft_font->h; /* y is top left corner */
@@ -924,22 +1213,19 @@ int gl_printTextRaw( const glFont *ft_font,
    /* Clears restoration. */
    gl_printRestoreClear();
 
-   s = 0;
-   gl_printLineIteratorInit( &iter, ft_font, text, width );
-   while ((y - by > -1e-5) && gl_printLineIteratorNext( &iter )) {
+   /* Lines are offset from the first one, rounded like it is. */
+   gl_fontRenderStart( stsh, x, y, c, outlineR );
+   y0 = round(y + 0.5*gl_screen.hscale);
+   for (i=0; (y - by > -1e-5) && (i < array_size(layout->lines)); i++) {
       /* Must restore stuff. */
       gl_printRestoreLast();
 
       /* Render it. */
-      gl_fontRenderStart( stsh, x, y, c, outlineR );
-      for (i = iter.l_begin; i < iter.l_end; ) {
-         ch = u8_nextchar( text, &i );
-         s = gl_fontRenderGlyph( stsh, ch, c, s );
-      }
-      gl_fontRenderEnd();
+      gl_fontRenderLine( stsh, layout, i, round(y + 0.5*gl_screen.hscale) - y0, c );
 
       y -= line_height; /* move position down */
    }
+   gl_fontRenderEnd( stsh );
 
    return 0;
 }
@@ -1059,9 +1345,8 @@ int gl_printWidth( const glFont *ft_font, const char *fmt, ... )
 int gl_printHeightRaw( const glFont *ft_font,
       const int width, const char *text )
 {
-   glPrintLineIterator iter;
+   const glFontLayout *layout;
    int line_height;
-   double y = 0.;
 
    /* Check 0 length strings. */
    if (text[0] == '\0')
@@ -1071,11 +1356,9 @@ int gl_printHeightRaw( const glFont *ft_font,
       ft_font = &gl_defFont;
 
    line_height = 1.5*(double)ft_font->h;
-   gl_printLineIteratorInit( &iter, ft_font, text, width );
-   while (gl_printLineIteratorNext( &iter ))
-      y += line_height;
+   layout = font_layoutGet( ft_font, text, width, FONT_LAYOUT_WRAP );
 
-   return (int)y - line_height + ft_font->h + 1;
+   return (array_size(layout->lines) - 1) * line_height + ft_font->h + 1;
 }
 
 /**
@@ -1111,17 +1394,562 @@ int gl_printHeight( const glFont *ft_font,
  *
  */
 /**
+ * @brief Hashes data with FNV-1a.
  */
-static int font_makeChar( glFontStash *stsh, font_char_t *c, uint32_t ch )
+static uint64_t font_hash( const void *data, size_t len )
+{
+   const unsigned char *p = data;
+   uint64_t hash;
+   size_t i;
+
+   hash = 0xCBF29CE484222325ULL;
+   for (i=0; i<len; i++) {
+      hash ^= p[i];
+      hash *= 0x100000001B3ULL;
+   }
+   return hash;
+}
+
+
+/**
+ * @brief Sets up the size and character map of a face.
+ *
+ *    @param face Face to set up.
+ *    @param h Height of the font.
+ */
+static void font_setupFace( FT_Face face, unsigned int h )
+{
+   FT_Matrix scale;
+
+   /* Try to resize. */
+   if (FT_IS_SCALABLE(face)) {
+      if (FT_Set_Char_Size( face,
+               0, /* Same as width. */
+               h * 64,
+               96, /* Create at 96 DPI */
+               96)) /* Create at 96 DPI */
+         WARN(_("FT_Set_Char_Size failed."));
+      scale.xx = scale.yy = (FT_Fixed)FONT_DISTANCE_FIELD_SIZE*0x10000/h;
+      scale.xy = scale.yx = 0;
+      FT_Set_Transform( face, &scale, NULL );
+   }
+   else
+      WARN(_("Font isn't resizable!"));
+
+   /* Select the character map. */
+   if (FT_Select_Charmap( face, FT_ENCODING_UNICODE ))
+      WARN(_("FT_Select_Charmap failed to change character mapping."));
+}
+
+
+/**
+ * @brief Renders a glyph and computes its distance field.
+ *
+ * Only touches the face and doesn't log, so it can be used from any thread as
+ *  long as the face isn't shared. Problems are reported with
+ *  font_renderWarn() from the main thread.
+ *
+ *    @param face Face to render with.
+ *    @param glyph_index Index of the glyph in the face.
+ *    @param h Height of the font.
+ *    @param[out] c Rendered character, ft_index is not set.
+ *    @return 0 on success, 1 if it was rendered but not in FT_PIXEL_MODE_GRAY
+ *            and -1 on failure.
+ */
+static int font_renderGlyph( FT_Face face, FT_UInt glyph_index, int h, font_char_t *c )
 {
    FT_Bitmap bitmap;
    FT_GlyphSlot slot;
-   FT_UInt glyph_index;
-   int i, u,v, w,h, rw,rh, len, b;
+   int u,v, w,hb, rw,rh, b, ret;
    double vmax;
-   glFontStashFreetype *ft;
    GLubyte *buffer;
 
+   c->data = NULL;
+   c->dataf = NULL;
+
+   /* Load the glyph. */
+   if (FT_Load_Glyph( face, glyph_index, FT_LOAD_RENDER | FT_LOAD_NO_BITMAP | FT_LOAD_TARGET_NORMAL))
+      return -1;
+
+   slot = face->glyph; /* Small shortcut. */
+   bitmap = slot->bitmap; /* to simplify */
+   ret = (bitmap.pixel_mode != FT_PIXEL_MODE_GRAY);
+
+   w = bitmap.width;
+   hb = bitmap.rows;
+
+   /* Store data. */
+   if (bitmap.buffer == NULL) {
+      /* Space characters tend to have no buffer. */
+      b = 0;
+      rw = w;
+      rh = hb;
+      c->data = malloc( sizeof(GLubyte) * w*hb );
+      memset( c->data, 0, sizeof(GLubyte) * w*hb );
+      vmax = 1.0; /* arbitrary */
+   }
+   else {
+      /* Create a larger image using an extra border and center glyph. */
+      b = 1 + ((MAX_EFFECT_RADIUS+1) * FONT_DISTANCE_FIELD_SIZE - 1) / h;
+      rw = w+b*2;
+      rh = hb+b*2;
+      buffer = calloc( rw*rh, sizeof(GLubyte) );
+      for (v=0; v<hb; v++)
+         for (u=0; u<w; u++)
+            buffer[ (b+v)*rw+(b+u) ] = bitmap.buffer[ v*w+u ];
+      /* Compute signed fdistance field with buffered glyph. */
+      c->dataf = make_distance_mapbf( buffer, rw, rh, &vmax );
+      free( buffer );
+   }
+   c->w     = rw;
+   c->h     = rh;
+   c->m     = FONT_DISTANCE_FIELD_SIZE / (2. * vmax * h);
+   c->off_x = slot->bitmap_left-b;
+   c->off_y = slot->bitmap_top +b;
+   c->adv_x = (GLfloat)slot->metrics.horiAdvance / 64.;
+
+   return ret;
+}
+
+
+/**
+ * @brief Logs the result of font_renderGlyph(), main thread only.
+ *
+ *    @param name Name of the font file.
+ *    @param ret Return value of font_renderGlyph().
+ */
+static void font_renderWarn( const char *name, int ret )
+{
+   if (ret < 0)
+      WARN(_("FT_Load_Glyph failed with font %s."), name);
+   else if (ret > 0)
+      WARN(_("Font '%s' not using FT_PIXEL_MODE_GRAY!"), name);
+}
+
+
+/**
+ * @brief Gets the path of the glyph cache of a face.
+ */
+static void font_cachePath( const glFontStashFreetype *ft, char *buf, size_t len )
+{
+   snprintf( buf, len, "%s"FONT_CACHE_PATH"%016"PRIx64"-%d.bin",
+         nfile_cachePath(), ft->file->key, ft->h );
+}
+
+
+/**
+ * @brief Compares cached glyphs by index.
+ */
+static int font_cacheCmp( const void *p1, const void *p2 )
+{
+   uint32_t i1, i2;
+   i1 = ((const glFontCacheGlyph*)p1)->r.index;
+   i2 = ((const glFontCacheGlyph*)p2)->r.index;
+   if (i1 < i2)
+      return -1;
+   else if (i1 > i2)
+      return +1;
+   return 0;
+}
+
+
+/**
+ * @brief Loads the glyph cache of a face.
+ *
+ * The format is a header (magic, version, number of glyphs and height as
+ *  uint32_t, font file size and modification time as int64_t and a hash of
+ *  the font data as uint64_t) followed by the glyph records, each one
+ *  followed by its distance field. Everything is in native byte order.
+ *
+ * The hash of the font data is only written and checked with DEBUG_PARANOID,
+ *  as hashing the whole font is too slow for every startup. It is 0 when
+ *  not set.
+ */
+static void font_cacheLoad( glFontStashFreetype *ft )
+{
+   char path[PATH_MAX], *p, *end;
+   size_t size, n;
+   uint32_t header[4];
+   int64_t sm[2];
+   uint64_t hash;
+   glFontCacheGlyph *g;
+
+   ft->cache = array_create( glFontCacheGlyph );
+
+   font_cachePath( ft, path, sizeof(path) );
+   if (!nfile_fileExists( path ))
+      return;
+   ft->cache_blob = nfile_readFile( &size, path );
+   if (ft->cache_blob == NULL)
+      return;
+
+   p     = ft->cache_blob;
+   end   = ft->cache_blob + size;
+   if (size < sizeof(header) + sizeof(sm) + sizeof(hash))
+      goto corrupt;
+   memcpy( header, p, sizeof(header) );
+   p += sizeof(header);
+   memcpy( sm, p, sizeof(sm) );
+   p += sizeof(sm);
+   memcpy( &hash, p, sizeof(hash) );
+   p += sizeof(hash);
+   if ((header[0] != FONT_CACHE_MAGIC) || (header[1] != FONT_CACHE_VERSION) ||
+         (header[3] != (uint32_t)ft->h) ||
+         (sm[0] != ft->file->size) || (sm[1] != ft->file->mtime))
+      goto corrupt;
+#if DEBUG_PARANOID
+   if ((hash != 0) && (hash != font_hash( ft->file->data, ft->file->datasize )))
+      goto corrupt;
+#endif /* DEBUG_PARANOID */
+
+   array_free( ft->cache );
+   ft->cache = array_create_size( glFontCacheGlyph, MAX( 1, MIN( header[2], size / sizeof(glFontCacheRecord) ) ) );
+   while (p < end) {
+      if ((size_t)(end-p) < sizeof(glFontCacheRecord))
+         goto corrupt;
+      g = &array_grow( &ft->cache );
+      memcpy( &g->r, p, sizeof(glFontCacheRecord) );
+      p += sizeof(glFontCacheRecord);
+      g->owned = 0;
+      g->dataf = NULL;
+      if ((g->r.w < 0) || (g->r.h < 0))
+         goto corrupt;
+      if (g->r.field) {
+         /* Check the size before moving past it, it could overflow. */
+         if ((g->r.w <= 0) || (g->r.h <= 0))
+            goto corrupt;
+         n = (size_t)g->r.w * g->r.h;
+         if (n > (size_t)(end-p) / sizeof(GLfloat))
+            goto corrupt;
+         g->dataf = (GLfloat*)p;
+         p += sizeof(GLfloat) * n;
+      }
+   }
+
+   qsort( ft->cache, array_size(ft->cache), sizeof(glFontCacheGlyph), font_cacheCmp );
+   return;
+
+corrupt:
+   WARN(_("Glyph cache '%s' is invalid, regenerating."), path);
+   array_free( ft->cache );
+   ft->cache = array_create( glFontCacheGlyph );
+   free( ft->cache_blob );
+   ft->cache_blob = NULL;
+   ft->cache_dirty = 1;
+}
+
+
+/**
+ * @brief Finds a glyph in the cache of a face.
+ */
+static glFontCacheGlyph* font_cacheFind( const glFontStashFreetype *ft, FT_UInt index )
+{
+   glFontCacheGlyph key;
+
+   if (ft->cache == NULL)
+      return NULL;
+   key.r.index = index;
+   return bsearch( &key, ft->cache, array_size(ft->cache), sizeof(glFontCacheGlyph), font_cacheCmp );
+}
+
+
+/**
+ * @brief Gets a glyph from the cache of a face.
+ *
+ *    @param ft Face to get glyph of.
+ *    @param index Index of the glyph.
+ *    @param[out] c Character with newly allocated data, ft_index is not set.
+ *    @return 0 if the glyph was cached.
+ */
+static int font_cacheGet( const glFontStashFreetype *ft, FT_UInt index, font_char_t *c )
+{
+   const glFontCacheGlyph *g;
+   size_t n;
+
+   g = font_cacheFind( ft, index );
+   if (g == NULL)
+      return -1;
+
+   n        = (size_t)g->r.w * g->r.h;
+   c->w     = g->r.w;
+   c->h     = g->r.h;
+   c->off_x = g->r.off_x;
+   c->off_y = g->r.off_y;
+   c->adv_x = g->r.adv_x;
+   c->m     = g->r.m;
+   c->data  = NULL;
+   c->dataf = NULL;
+   if (g->r.field) {
+      c->dataf = malloc( sizeof(GLfloat) * n );
+      memcpy( c->dataf, g->dataf, sizeof(GLfloat) * n );
+   }
+   else
+      c->data = calloc( MAX( 1, n ), sizeof(GLubyte) );
+   return 0;
+}
+
+
+/**
+ * @brief Adds a glyph to the cache of a face.
+ *
+ *    @param ft Face to add to.
+ *    @param index Index of the glyph.
+ *    @param c Character to add, the data is copied.
+ */
+static void font_cacheAdd( glFontStashFreetype *ft, FT_UInt index, const font_char_t *c )
+{
+   glFontCacheGlyph *g;
+   size_t n;
+   int i;
+
+   if ((ft->cache == NULL) || (font_cacheFind( ft, index ) != NULL))
+      return;
+
+   /* Keep the cache sorted. */
+   for (i=array_size(ft->cache); i>0; i--)
+      if (ft->cache[i-1].r.index < index)
+         break;
+   (void)array_grow( &ft->cache );
+   g = &ft->cache[i];
+   memmove( g+1, g, sizeof(glFontCacheGlyph) * (array_size(ft->cache)-i-1) );
+
+   n           = (size_t)c->w * c->h;
+   g->r.index  = index;
+   g->r.w      = c->w;
+   g->r.h      = c->h;
+   g->r.off_x  = c->off_x;
+   g->r.off_y  = c->off_y;
+   g->r.adv_x  = c->adv_x;
+   g->r.m      = c->m;
+   g->r.field  = (c->dataf != NULL);
+   g->dataf    = NULL;
+   g->owned    = g->r.field;
+   if (g->r.field) {
+      g->dataf = malloc( sizeof(GLfloat) * n );
+      memcpy( g->dataf, c->dataf, sizeof(GLfloat) * n );
+   }
+   ft->cache_dirty = 1;
+}
+
+
+/**
+ * @brief Saves the glyph cache of a face if new glyphs were generated.
+ *
+ * Written to a temporary file first, so an interrupted save never leaves a
+ *  truncated cache behind.
+ */
+static void font_cacheSave( glFontStashFreetype *ft )
+{
+   char path[PATH_MAX], tmp[PATH_MAX];
+   uint32_t header[4];
+   int64_t sm[2];
+   uint64_t hash;
+   SDL_RWops *rw;
+   glFontCacheGlyph *g;
+   int i, ret;
+
+   if ((ft->cache == NULL) || !ft->cache_dirty)
+      return;
+
+   snprintf( path, sizeof(path), "%s"FONT_CACHE_PATH, nfile_cachePath() );
+   nfile_dirMakeExist( path );
+   font_cachePath( ft, path, sizeof(path) );
+   snprintf( tmp, sizeof(tmp), "%s.tmp", path );
+   rw = SDL_RWFromFile( tmp, "wb" );
+   if (rw == NULL) {
+      WARN(_("Unable to open '%s' for writing: %s"), tmp, SDL_GetError());
+      return;
+   }
+   header[0] = FONT_CACHE_MAGIC;
+   header[1] = FONT_CACHE_VERSION;
+   header[2] = array_size(ft->cache);
+   header[3] = ft->h;
+   sm[0]     = ft->file->size;
+   sm[1]     = ft->file->mtime;
+#if DEBUG_PARANOID
+   hash      = font_hash( ft->file->data, ft->file->datasize );
+#else /* DEBUG_PARANOID */
+   hash      = 0;
+#endif /* DEBUG_PARANOID */
+   ret = (SDL_RWwrite( rw, header, sizeof(header), 1 ) != 1);
+   if (!ret)
+      ret = (SDL_RWwrite( rw, sm, sizeof(sm), 1 ) != 1);
+   if (!ret)
+      ret = (SDL_RWwrite( rw, &hash, sizeof(hash), 1 ) != 1);
+   for (i=0; (i<array_size(ft->cache)) && !ret; i++) {
+      g = &ft->cache[i];
+      ret = (SDL_RWwrite( rw, &g->r, sizeof(glFontCacheRecord), 1 ) != 1);
+      if (!ret && g->r.field && (g->r.w * g->r.h > 0))
+         ret = (SDL_RWwrite( rw, g->dataf, sizeof(GLfloat) * g->r.w * g->r.h, 1 ) != 1);
+   }
+   if (SDL_RWclose( rw ) != 0)
+      ret = 1;
+   if (ret) {
+      WARN(_("Error writing glyph cache '%s': %s"), tmp, SDL_GetError());
+      remove( tmp );
+      return;
+   }
+   if (nfile_rename( tmp, path ) < 0) {
+      WARN(_("Unable to rename '%s' to '%s': %s"), tmp, path, strerror(errno));
+      remove( tmp );
+      return;
+   }
+   ft->cache_dirty = 0;
+}
+
+
+/**
+ * @brief Frees the glyph cache of a face.
+ */
+static void font_cacheFree( glFontStashFreetype *ft )
+{
+   int i;
+
+   for (i=0; i<array_size(ft->cache); i++)
+      if (ft->cache[i].owned)
+         free( ft->cache[i].dataf );
+   array_free( ft->cache );
+   free( ft->cache_blob );
+   ft->cache = NULL;
+   ft->cache_blob = NULL;
+}
+
+
+/**
+ * @brief Generates a group of glyphs on a worker thread.
+ *
+ * FreeType objects can't be shared between threads, so each job sets up its
+ *  own library and face from the shared font data. Nothing is logged here,
+ *  job->ret is -1 if the library failed to initialize and -2 if the face
+ *  failed to load, and each glyph keeps its own result.
+ */
+static int font_precacheWorker( void *data )
+{
+   FontPrecacheJob *job = data;
+   FT_Library library;
+   FT_Face face;
+   int i;
+
+   job->ret = 0;
+   if (FT_Init_FreeType( &library )) {
+      job->ret = -1;
+      return -1;
+   }
+   if (FT_New_Memory_Face( library, job->file->data, job->file->datasize, 0, &face )) {
+      FT_Done_FreeType( library );
+      job->ret = -2;
+      return -1;
+   }
+   font_setupFace( face, job->h );
+
+   for (i=0; i<job->n; i++)
+      job->glyphs[i].ret = font_renderGlyph( face,
+            job->glyphs[i].index, job->h, &job->glyphs[i].c );
+
+   FT_Done_Face( face );
+   FT_Done_FreeType( library );
+   return 0;
+}
+
+
+/**
+ * @brief Generates the common glyphs of a font stash that aren't cached yet.
+ *
+ * The distance fields are computed in parallel and only added to the glyph
+ *  caches, the textures are still filled on demand.
+ */
+static void gl_fontstashPrecache( glFontStash *stsh )
+{
+   int i, j, k, nft;
+   uint32_t ch;
+   FT_UInt index;
+   FontPrecacheGlyph **glyphs, *g;
+   FontPrecacheJob *jobs, *job;
+   ThreadQueue *queue;
+   int warned;
+
+   nft = array_size(stsh->ft);
+   if (nft <= 0)
+      return;
+
+   /* Find the missing glyphs of each face. */
+   glyphs = calloc( nft, sizeof(FontPrecacheGlyph*) );
+   for (k=0; k<(int)(sizeof(font_precacheRanges)/sizeof(font_precacheRanges[0])); k++) {
+      for (ch=font_precacheRanges[k][0]; ch<=font_precacheRanges[k][1]; ch++) {
+         /* Same face lookup as font_makeChar(). */
+         for (i=0; i<nft; i++) {
+            index = FT_Get_Char_Index( stsh->ft[i].face, ch );
+            if (index != 0)
+               break;
+         }
+         if ((i >= nft) || (font_cacheFind( &stsh->ft[i], index ) != NULL))
+            continue;
+         if (glyphs[i] == NULL)
+            glyphs[i] = array_create( FontPrecacheGlyph );
+         g = &array_grow( &glyphs[i] );
+         memset( g, 0, sizeof(FontPrecacheGlyph) );
+         g->index = index;
+         g->ret   = -2; /* Not generated, the job failed. */
+      }
+   }
+
+   /* Split them into jobs. */
+   jobs = array_create( FontPrecacheJob );
+   for (i=0; i<nft; i++) {
+      for (j=0; j<array_size(glyphs[i]); j+=FONT_PRECACHE_CHUNK) {
+         job = &array_grow( &jobs );
+         job->file   = stsh->ft[i].file;
+         job->h      = stsh->h;
+         job->glyphs = &glyphs[i][j];
+         job->n      = MIN( FONT_PRECACHE_CHUNK, array_size(glyphs[i])-j );
+         job->ret    = 0;
+      }
+   }
+   if (array_size(jobs) > 0) {
+      queue = vpool_create();
+      for (i=0; i<array_size(jobs); i++)
+         vpool_enqueue( queue, font_precacheWorker, &jobs[i] );
+      vpool_wait( queue );
+   }
+
+   /* Log the errors of the workers. */
+   for (i=0; i<array_size(jobs); i++) {
+      if (jobs[i].ret == -1)
+         WARN(_("FT_Init_FreeType failed with font %s."), jobs[i].file->name);
+      else if (jobs[i].ret == -2)
+         WARN(_("FT_New_Memory_Face failed loading library from %s"), jobs[i].file->name);
+   }
+
+   /* Store the results, only warning once per face. */
+   for (i=0; i<nft; i++) {
+      warned = 0;
+      for (j=0; j<array_size(glyphs[i]); j++) {
+         g = &glyphs[i][j];
+         if (((g->ret == -1) || (g->ret > 0)) && !warned) {
+            font_renderWarn( stsh->ft[i].file->name, g->ret );
+            warned = 1;
+         }
+         if (g->ret >= 0)
+            font_cacheAdd( &stsh->ft[i], g->index, &g->c );
+         free( g->c.data );
+         free( g->c.dataf );
+      }
+      array_free( glyphs[i] );
+   }
+   free( glyphs );
+   array_free( jobs );
+}
+
+
+/**
+ * @brief Generates a character, using the glyph cache if possible.
+ */
+static int font_makeChar( glFontStash *stsh, font_char_t *c, uint32_t ch )
+{
+   FT_UInt glyph_index;
+   int i, len, ret;
+   glFontStashFreetype *ft;
+
    len = array_size(stsh->ft);
    for (i=0; i<len; i++) {
       ft = &stsh->ft[i];
@@ -1138,51 +1966,14 @@ static int font_makeChar( glFontStash *stsh, font_char_t *c, uint32_t ch )
          }
       }
 
-      /* Load the glyph. */
-      if (FT_Load_Glyph( ft->face, glyph_index, FT_LOAD_RENDER | FT_LOAD_NO_BITMAP | FT_LOAD_TARGET_NORMAL)) {
-         WARN(_("FT_Load_Glyph failed."));
-         return -1;
-      }
-
-      slot = ft->face->glyph; /* Small shortcut. */
-      bitmap = slot->bitmap; /* to simplify */
-      if (bitmap.pixel_mode != FT_PIXEL_MODE_GRAY)
-         WARN(_("Font '%s' not using FT_PIXEL_MODE_GRAY!"), ft->file->name);
-
-      w = bitmap.width;
-      h = bitmap.rows;
-
-      /* Store data. */
-      c->data = NULL;
-      c->dataf = NULL;
-      if (bitmap.buffer == NULL) {
-         /* Space characters tend to have no buffer. */
-         b = 0;
-         rw = w;
-         rh = h;
-         c->data = malloc( sizeof(GLubyte) * w*h );
-         memset( c->data, 0, sizeof(GLubyte) * w*h );
-	 vmax = 1.0; /* arbitrary */
-      }
-      else {
-         /* Create a larger image using an extra border and center glyph. */
-         b = 1 + ((MAX_EFFECT_RADIUS+1) * FONT_DISTANCE_FIELD_SIZE - 1) / stsh->h;
-         rw = w+b*2;
-         rh = h+b*2;
-         buffer = calloc( rw*rh, sizeof(GLubyte) );
-         for (v=0; v<h; v++)
-            for (u=0; u<w; u++)
-               buffer[ (b+v)*rw+(b+u) ] = bitmap.buffer[ v*w+u ];
-         /* Compute signed fdistance field with buffered glyph. */
-         c->dataf = make_distance_mapbf( buffer, rw, rh, &vmax );
-         free( buffer );
+      /* Distance fields are expensive, so only compute them if not cached. */
+      if (font_cacheGet( ft, glyph_index, c )) {
+         ret = font_renderGlyph( ft->face, glyph_index, stsh->h, c );
+         font_renderWarn( ft->file->name, ret );
+         if (ret < 0)
+            return -1;
+         font_cacheAdd( ft, glyph_index, c );
       }
-      c->w     = rw;
-      c->h     = rh;
-      c->m     = FONT_DISTANCE_FIELD_SIZE / (2. * vmax * stsh->h);
-      c->off_x = slot->bitmap_left-b;
-      c->off_y = slot->bitmap_top +b;
-      c->adv_x = (GLfloat)slot->metrics.horiAdvance / 64.;
       c->ft_index = i;
 
       return 0;
@@ -1192,6 +1983,7 @@ static int font_makeChar( glFontStash *stsh, font_char_t *c, uint32_t ch )
 }
 
 
+
 /**
  * @brief Starts the rendering engine.
  */
@@ -1204,12 +1996,13 @@ static void gl_fontRenderStart( const glFontStash* stsh, double x, double y, con
 }
 static void gl_fontRenderStartH( const glFontStash* stsh, const gl_Matrix4 *H, const glColour *c, double outlineR )
 {
-   double a, scale;
+   double a;
    const glColour *col;
+   int i;
 
    outlineR = outlineR==-1 ? 1 : MAX( outlineR, 0 );
 
-   /* Handle colour. */
+   /* Handle colour, the lines set the colour of the glyphs. */
    a = (c==NULL) ? 1. : c->a;
    if (font_restoreLast)
       col = font_lastCol;
@@ -1218,27 +2011,105 @@ static void gl_fontRenderStartH( const glFontStash* stsh, const gl_Matrix4 *H, c
    else
       col = c;
 
-   glUseProgram(shaders.font.program);
-   gl_uniformAColor(shaders.font.color, col, a);
-   if (outlineR == 0.)
-      gl_uniformAColor(shaders.font.outline_color, col, 0.);
-   else
-      gl_uniformAColor(shaders.font.outline_color, &cGrey10, a);
+   if (outlineR == 0.) {
+      font_outlineCol   = *col;
+      font_outlineCol.a = 0.;
+   }
+   else {
+      font_outlineCol   = cGrey10;
+      font_outlineCol.a = a;
+   }
 
-   scale = (double)stsh->h / FONT_DISTANCE_FIELD_SIZE;
-   font_projection_mat = gl_Matrix4_Scale(*H, scale, scale, 1 );
+   /* Glyph quads are laid out in pixels. */
+   font_projection_mat = *H;
 
+   /* Clear the glyphs of the previous print. */
+   for (i=0; i<array_size(font_buckets); i++)
+      array_resize( &font_buckets[i], 0 );
+}
+
+
+/**
+ * @brief Adds the glyphs of a line of a layout to render.
+ *
+ *    @param stsh Font stash the layout uses.
+ *    @param layout Layout to render.
+ *    @param line Line of the layout to render.
+ *    @param dy Vertical offset of the line.
+ *    @param c Colour to use (uses white if NULL).
+ */
+static void gl_fontRenderLine( glFontStash *stsh, const glFontLayout *layout, int line, double dy, const glColour *c )
+{
+   static const int corners[6] = { 0, 1, 2, 2, 1, 3 }; /* Triangles of the glyph quad. */
+   int i, j, n, k;
+   double a, scale;
+   const glColour *col;
+   const glFontLayoutLine *l;
+   const glFontLayoutItem *item;
+   const glFontGlyph *glyph;
+   const GLshort *vert;
+   const GLfloat *tex;
+   GLfloat *v;
+
+   /* Start from the restored colour or the default one. */
+   a = (c==NULL) ? 1. : c->a;
+   if (font_restoreLast) {
+      font_col    = *font_lastCol;
+      font_col.a  = a;
+   }
+   else if (c==NULL)
+      font_col = cWhite;
+   else
+      font_col = *c;
    font_restoreLast = 0;
-   gl_fontKernStart();
 
-   /* Activate the appropriate VBOs. */
-   glEnableVertexAttribArray( shaders.font.vertex );
-   gl_vboActivateAttribOffset( stsh->vbo_vert, shaders.font.vertex, 0, 2, GL_SHORT, 0 );
-   glEnableVertexAttribArray( shaders.font.tex_coord );
-   gl_vboActivateAttribOffset( stsh->vbo_tex, shaders.font.tex_coord, 0, 2, GL_FLOAT, 0 );
+   scale = (double)stsh->h / FONT_DISTANCE_FIELD_SIZE;
+   l = &layout->lines[ line ];
+   for (i=l->item; i<l->item+l->n; i++) {
+      item = &layout->items[i];
+
+      /* Colour change. */
+      if (item->glyph < 0) {
+         col = gl_fontGetColour( item->code );
+         if (col != NULL) {
+            font_col    = *col;
+            font_col.a  = a;
+         }
+         else if (c==NULL)
+            font_col = cWhite;
+         else
+            font_col = *c;
+         font_lastCol = col;
+         continue;
+      }
 
-   /* Depth testing is used to draw the outline under the glyph. */
-   glEnable( GL_DEPTH_TEST );
+      /* Get the bucket of the glyph texture. */
+      glyph = &stsh->glyphs[ item->glyph ];
+      if (font_buckets == NULL)
+         font_buckets = array_create( GLfloat* );
+      while (array_size(font_buckets) <= glyph->tex_index)
+         array_push_back( &font_buckets, array_create( GLfloat ) );
+      n = array_size( font_buckets[ glyph->tex_index ] );
+      array_resize( &font_buckets[ glyph->tex_index ], n + 6*FONT_VERTEX_SIZE );
+      v = &font_buckets[ glyph->tex_index ][n];
+
+      /* Expand the quad. */
+      vert  = &stsh->vbo_vert_data[ 2*glyph->vbo_id ];
+      tex   = &stsh->vbo_tex_data[ 2*glyph->vbo_id ];
+      for (j=0; j<6; j++) {
+         k = 2*corners[j];
+         v[0] = item->x + scale*vert[k];
+         v[1] = dy + scale*vert[k+1];
+         v[2] = tex[k];
+         v[3] = tex[k+1];
+         v[4] = font_col.r;
+         v[5] = font_col.g;
+         v[6] = font_col.b;
+         v[7] = font_col.a;
+         v[8] = glyph->m;
+         v += FONT_VERTEX_SIZE;
+      }
+   }
 }
 
 
@@ -1390,76 +2261,68 @@ static int gl_fontKernGlyph( glFontStash* stsh, uint32_t ch, glFontGlyph* glyph
 
 
 /**
- * @brief Renders a character.
+ * @brief Ends the rendering engine, drawing the glyphs with a call per texture.
  */
-static int gl_fontRenderGlyph( glFontStash* stsh, uint32_t ch, const glColour *c, int state )
+static void gl_fontRenderEnd( const glFontStash *stsh )
 {
-   double scale;
-   double a;
-   const glColour *col;
-   int kern_adv_x;
-
-   /* Handle escape sequences. */
-   if ((ch == FONT_COLOUR_CODE) && (state==0)) {/* Start sequence. */
-      return 1;
-   }
-   if ((state == 1) && (ch != FONT_COLOUR_CODE)) {
-      col = gl_fontGetColour( ch );
-      a = (c==NULL) ? 1. : c->a;
-      if (col != NULL)
-         gl_uniformAColor(shaders.font.color, col, a );
-      else if (c==NULL)
-         gl_uniformColor(shaders.font.color, &cWhite);
-      else
-         gl_uniformColor(shaders.font.color, c);
-      font_lastCol = col;
-      return 0;
+   int i, n, first;
+   GLsizei stride;
+
+   /* Gather the glyphs of all the textures for a single upload. */
+   if (font_vbo_data == NULL)
+      font_vbo_data = array_create( GLfloat );
+   array_resize( &font_vbo_data, 0 );
+   for (i=0; i<array_size(font_buckets); i++) {
+      n = array_size( font_vbo_data );
+      array_resize( &font_vbo_data, n + array_size(font_buckets[i]) );
+      memcpy( &font_vbo_data[n], font_buckets[i], sizeof(GLfloat) * array_size(font_buckets[i]) );
    }
+   if (array_size(font_vbo_data) == 0)
+      return;
+   if (font_vbo == NULL)
+      font_vbo = gl_vboCreateStream( sizeof(GLfloat) * array_size(font_vbo_data), font_vbo_data );
+   else
+      gl_vboData( font_vbo, sizeof(GLfloat) * array_size(font_vbo_data), font_vbo_data );
+
+   gl_useProgram( shaders.font.program );
+   gl_uniformColor( shaders.font.outline_color, &font_outlineCol );
+   gl_Matrix4_Uniform( shaders.font.projection, font_projection_mat );
+
+   /* Activate the vertices. */
+   stride = sizeof(GLfloat) * FONT_VERTEX_SIZE;
+   gl_enableVertexAttribArray( shaders.font.vertex );
+   gl_enableVertexAttribArray( shaders.font.tex_coord );
+   gl_enableVertexAttribArray( shaders.font.color );
+   gl_enableVertexAttribArray( shaders.font.m );
+   gl_vboActivateAttribOffset( font_vbo, shaders.font.vertex,
+         0, 2, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( font_vbo, shaders.font.tex_coord,
+         sizeof(GLfloat) * 2, 2, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( font_vbo, shaders.font.color,
+         sizeof(GLfloat) * 4, 4, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( font_vbo, shaders.font.m,
+         sizeof(GLfloat) * 8, 1, GL_FLOAT, stride );
 
-   /* Unicode goes here.
-    * First try to find the glyph. */
-   glFontGlyph *glyph;
-   glyph = gl_fontGetGlyph( stsh, ch );
-   if (glyph == NULL) {
-      WARN(_("Unable to find glyph '%d'!"), ch );
-      return -1;
-   }
+   /* Depth testing is used to draw the outline under the glyph. */
+   gl_enable( GL_DEPTH_TEST );
 
-   /* Kern if possible. */
-   scale = (double)stsh->h / FONT_DISTANCE_FIELD_SIZE;
-   kern_adv_x = gl_fontKernGlyph( stsh, ch, glyph );
-   if (kern_adv_x) {
-      font_projection_mat = gl_Matrix4_Translate( font_projection_mat,
-            kern_adv_x/scale, 0, 0 );
+   /* Draw, one call per texture. */
+   first = 0;
+   for (i=0; i<array_size(font_buckets); i++) {
+      n = array_size( font_buckets[i] ) / FONT_VERTEX_SIZE;
+      if (n == 0)
+         continue;
+      gl_bindTexture( GL_TEXTURE_2D, stsh->tex[i].id );
+      glDrawArrays( GL_TRIANGLES, first, n );
+      first += n;
    }
 
-   /* Activate texture. */
-   glBindTexture(GL_TEXTURE_2D, stsh->tex[glyph->tex_index].id);
-
-   glUniform1f(shaders.font.m, glyph->m);
-   gl_Matrix4_Uniform(shaders.font.projection, font_projection_mat);
-
-   /* Draw the element. */
-   glDrawArrays( GL_TRIANGLE_STRIP, glyph->vbo_id, 4 );
-
-   /* Translate matrix. */
-   font_projection_mat = gl_Matrix4_Translate( font_projection_mat,
-         glyph->adv_x/scale, 0, 0 );
-
-   return 0;
-}
+   gl_disableVertexAttribArray( shaders.font.vertex );
+   gl_disableVertexAttribArray( shaders.font.tex_coord );
+   gl_disableVertexAttribArray( shaders.font.color );
+   gl_disableVertexAttribArray( shaders.font.m );
 
-
-/**
- * @brief Ends the rendering engine.
- */
-static void gl_fontRenderEnd (void)
-{
-   glDisableVertexAttribArray( shaders.font.vertex );
-   glDisableVertexAttribArray( shaders.font.tex_coord );
-   glUseProgram(0);
-
-   glDisable( GL_DEPTH_TEST );
+   gl_disable( GL_DEPTH_TEST );
 
    /* Check for errors. */
    gl_checkErr();
@@ -1483,7 +2346,7 @@ void gl_fontSetFilter( const glFont *ft_font, GLint min, GLint mag )
    stsh->magfilter = mag;
 
    for (i=0; i<array_size(stsh->tex); i++) {
-      glBindTexture( GL_TEXTURE_2D, stsh->tex[i].id );
+      gl_bindTexture( GL_TEXTURE_2D, stsh->tex[i].id );
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, stsh->magfilter);
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, stsh->minfilter);
    }
@@ -1585,12 +2448,13 @@ int gl_fontInit( glFont* font, const char *fname, const unsigned int h, const ch
    stsh->glyphs = array_create( glFontGlyph );
    stsh->tex    = array_create( glFontTex );
 
-   /* Set up VBOs. */
+   /* Set up glyph quads. */
    stsh->mvbo = 256;
    stsh->vbo_tex_data  = calloc( 8*stsh->mvbo, sizeof(GLfloat) );
    stsh->vbo_vert_data = calloc( 8*stsh->mvbo, sizeof(GLshort) );
-   stsh->vbo_tex  = gl_vboCreateStatic( sizeof(GLfloat)*8*stsh->mvbo,  stsh->vbo_tex_data );
-   stsh->vbo_vert = gl_vboCreateStatic( sizeof(GLshort)*8*stsh->mvbo, stsh->vbo_vert_data );
+
+   /* Generate the common glyphs ahead of time. */
+   gl_fontstashPrecache( stsh );
 
    return 0;
 }
@@ -1626,6 +2490,9 @@ int gl_fontAddFallback( glFont* font, const char *fname, const char *prefix )
       }
    }
 
+   /* Common glyphs missing from the other faces may come from the new ones. */
+   gl_fontstashPrecache( stsh );
+
    return ret;
 }
 
@@ -1641,8 +2508,9 @@ int gl_fontAddFallback( glFont* font, const char *fname, const char *prefix )
 static int gl_fontstashAddFallback( glFontStash* stsh, const char *fname, unsigned int h )
 {
    glFontStashFreetype ft = {.file=NULL, .face=NULL};
-   FT_Matrix scale;
    int i, j;
+   char key[PATH_MAX];
+   PHYSFS_Stat st;
 
    /* Set up file data. Reference a loaded copy if we have one. */
    for (i=0; i<array_size(avail_fonts); i++) {
@@ -1668,6 +2536,17 @@ static int gl_fontstashAddFallback( glFontStash* stsh, const char *fname, unsign
          gl_fontstashftDestroy( &ft );
          return -1;
       }
+      /* Identify the glyph caches without hashing the whole font. */
+      if (PHYSFS_stat( fname, &st )) {
+         ft.file->size  = st.filesize;
+         ft.file->mtime = st.modtime;
+      }
+      else {
+         ft.file->size  = ft.file->datasize;
+         ft.file->mtime = -1;
+      }
+      snprintf( key, sizeof(key), "%s:%"PRId64":%"PRId64, fname, ft.file->size, ft.file->mtime );
+      ft.file->key = font_hash( key, strlen(key) );
    }
 
    /* Object which freetype uses to store font info. */
@@ -1677,24 +2556,11 @@ static int gl_fontstashAddFallback( glFontStash* stsh, const char *fname, unsign
       return -1;
    }
 
-   /* Try to resize. */
-   if (FT_IS_SCALABLE(ft.face)) {
-      if (FT_Set_Char_Size( ft.face,
-               0, /* Same as width. */
-               h * 64,
-               96, /* Create at 96 DPI */
-               96)) /* Create at 96 DPI */
-         WARN(_("FT_Set_Char_Size failed."));
-      scale.xx = scale.yy = (FT_Fixed)FONT_DISTANCE_FIELD_SIZE*0x10000/h;
-      scale.xy = scale.yx = 0;
-      FT_Set_Transform( ft.face, &scale, NULL );
-   }
-   else
-      WARN(_("Font isn't resizable!"));
+   font_setupFace( ft.face, h );
 
-   /* Select the character map. */
-   if (FT_Select_Charmap( ft.face, FT_ENCODING_UNICODE ))
-      WARN(_("FT_Select_Charmap failed to change character mapping."));
+   /* Load the glyphs generated in previous runs. */
+   ft.h = h;
+   font_cacheLoad( &ft );
 
    /* Save stuff. */
    array_push_back( &stsh->ft, ft );
@@ -1725,23 +2591,36 @@ void gl_freeFont( glFont* font )
       return;
    /* Not references and must eliminate. */
 
-   for (i=0; i<array_size(stsh->ft); i++)
+   for (i=0; i<array_size(stsh->ft); i++) {
+      font_cacheSave( &stsh->ft[i] );
       gl_fontstashftDestroy( &stsh->ft[i] );
+   }
    array_free( stsh->ft );
 
+   /* Layouts reference the glyphs. */
+   font_layoutPurge( stsh - avail_fonts );
+
    if (--font_library_refs == 0) {
       FT_Done_FreeType( font_library );
       font_library = NULL;
+
+      /* Last font, rendering buffers are no longer needed. */
+      for (i=0; i<array_size(font_buckets); i++)
+         array_free( font_buckets[i] );
+      array_free( font_buckets );
+      font_buckets = NULL;
+      array_free( font_vbo_data );
+      font_vbo_data = NULL;
+      gl_vboDestroy( font_vbo );
+      font_vbo = NULL;
    }
 
    free( stsh->fname );
    for (i=0; i<array_size(stsh->tex); i++)
-      glDeleteTextures( 1, &stsh->tex->id );
+      gl_deleteTextures( 1, &stsh->tex->id );
    array_free( stsh->tex );
 
    array_free( stsh->glyphs );
-   gl_vboDestroy(stsh->vbo_tex);
-   gl_vboDestroy(stsh->vbo_vert);
    free(stsh->vbo_tex_data);
    free(stsh->vbo_vert_data);
    memset( stsh, 0, sizeof(glFontStash) );
@@ -1751,6 +2630,7 @@ void gl_freeFont( glFont* font )
  * @brief Frees resources referenced by a glFontStashFreetype struct.
  */
 static void gl_fontstashftDestroy( glFontStashFreetype *ft ) {
+   font_cacheFree( ft );
    if(--ft->file->refcount == 0) {
       free(ft->file->name);
       free(ft->file->data);
@@ -486,7 +486,7 @@ static void gui_renderTargetReticles( const SimpleShader *shd, double x, double
    gl_gameToScreenCoords( &rx, &ry, x, y );
    r = (double)radius *  1.2 * cam_getZoom();
 
-   glUseProgram(shd->program);
+   gl_useProgram(shd->program);
    glUniform1f(shd->dt, animation_dt);
    glUniform1f(shd->paramf, radius);
    gl_renderShader( rx, ry, r, r, angle, shd, c, 1 );
@@ -880,8 +880,8 @@ void gui_render( double dt )
    /* Perform the fade. */
    if (fade > 0.) {
       /* Set up the program. */
-      glUseProgram( shaders.jump.program );
-      glEnableVertexAttribArray( shaders.jump.vertex );
+      gl_useProgram( shaders.jump.program );
+      gl_enableVertexAttribArray( shaders.jump.vertex );
       gl_vboActivateAttribOffset( gl_squareVBO, shaders.jump.vertex, 0, 2, GL_FLOAT, 0 );
 
       /* Set up the projection. */
@@ -906,8 +906,8 @@ void gui_render( double dt )
       glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
 
       /* Clear state. */
-      glDisableVertexAttribArray( shaders.jump.vertex );
-      glUseProgram(0);
+      gl_disableVertexAttribArray( shaders.jump.vertex );
+      gl_useProgram(0);
 
       /* Check errors. */
       gl_checkErr();
@@ -1307,7 +1307,7 @@ void gui_renderPilot( const Pilot* p, RadarShape shape, double w, double h, doub
       col = gui_getPilotColour(p);
 
    scale = MAX(scale+2.0, 4.0); /* Compensate for outline. */
-   glUseProgram(shaders.pilotmarker.program);
+   gl_useProgram(shaders.pilotmarker.program);
    gl_renderShader( x, y, scale, scale, p->solid->dir, &shaders.pilotmarker, col, 1 );
 
    /* Draw selection if targeted. */
@@ -1388,7 +1388,7 @@ void gui_renderAsteroid( const Asteroid* a, double w, double h, double res, int
 
    //gl_renderRect( px, py, MIN( 2*sx, w-px ), MIN( 2*sy, h-py ), col );
    r = (sx+sy)/2.0+1.5;
-   glUseProgram(shaders.asteroidmarker.program);
+   gl_useProgram(shaders.asteroidmarker.program);
    gl_renderShader( px, py, r, r, 0., &shaders.asteroidmarker, col, 1 );
 
    if (targeted)
@@ -1413,7 +1413,7 @@ void gui_renderPlayer( double res, int overlay )
       r = MAX(12., 1.25 * player.p->ship->rdr_scale * (1. + RADAR_RES_REF/res));
    }
 
-   glUseProgram(shaders.playermarker.program);
+   gl_useProgram(shaders.playermarker.program);
    gl_renderShader( x, y, r, r, player.p->solid->dir, &shaders.playermarker, &cRadar_player, 1 );
 }
 
@@ -1457,7 +1457,7 @@ static void gui_blink( double cx, double cy, double vr, const glColour *col, dou
 {
    if (blinkVar > blinkInterval/2.)
       return;
-   glUseProgram(shaders.blinkmarker.program);
+   gl_useProgram(shaders.blinkmarker.program);
    gl_renderShader( cx, cy, vr, vr, 0., &shaders.blinkmarker, col, 1 );
 }
 
@@ -1569,7 +1569,7 @@ void gui_renderPlanet( int ind, RadarShape shape, double w, double h, double res
    if (ind == player.p->nav_planet)
       gui_blink( cx, cy, vr*2., col, RADAR_BLINK_PLANET, blink_planet);
 
-   glUseProgram(shaders.planetmarker.program);
+   gl_useProgram(shaders.planetmarker.program);
    glUniform1i(shaders.planetmarker.parami,
          planet_hasService(planet, PLANET_SERVICE_LAND));
    gl_renderShader( cx, cy, vr, vr, 0., &shaders.planetmarker, col, 1 );
@@ -1651,7 +1651,7 @@ void gui_renderJumpPoint( int ind, RadarShape shape, double w, double h, double
    else
       col = &cGreen;
 
-   glUseProgram(shaders.jumpmarker.program);
+   gl_useProgram(shaders.jumpmarker.program);
    gl_renderShader(cx, cy, vr*1.5, vr*1.5, -jp->angle+M_PI,
          &shaders.jumpmarker, col, 1);
 
@@ -1986,7 +1986,8 @@ char* gui_pick (void)
  */
 int gui_load( const char* name )
 {
-   char *buf, path[PATH_MAX];
+   char path[PATH_MAX];
+   const char *buf;
    size_t bufsize;
 
    /* Set defaults. */
@@ -1997,7 +1998,7 @@ int gui_load( const char* name )
 
    /* Open file. */
    snprintf( path, sizeof(path), GUI_PATH"%s.lua", name );
-   buf = ndata_read( path, &bufsize );
+   buf = ndata_map( path, &bufsize );
    if (buf == NULL) {
       WARN(_("Unable to find GUI '%s'."), path );
       return -1;
@@ -2018,10 +2019,10 @@ int gui_load( const char* name )
             path, lua_tostring(naevL,-1));
       nlua_freeEnv( gui_env );
       gui_env = LUA_NOREF;
-      free(buf);
+      ndata_unmap( buf, bufsize );
       return -1;
    }
-   free(buf);
+   ndata_unmap( buf, bufsize );
    nlua_loadStandard( gui_env );
    nlua_loadGFX( gui_env );
    nlua_loadGUI( gui_env );
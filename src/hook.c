@@ -39,6 +39,7 @@
 #include "nlua_evt.h"
 #include "nlua_hook.h"
 #include "nlua_pilot.h"
+#include "nlua_prof.h"
 #include "nstring.h"
 #include "nxml.h"
 #include "player.h"
@@ -304,7 +305,7 @@ static int hook_runMisn( Hook *hook, HookParam *param, int claims )
 {
    unsigned long id;
    Mission* misn;
-   int n;
+   int n, ret, prof;
 
    /* Simplicity. */
    id = hook->id;
@@ -342,7 +343,13 @@ static int hook_runMisn( Hook *hook, HookParam *param, int claims )
 
    /* Run mission code. */
    hook->ran_once = 1;
-   if (misn_runFunc( misn, hook->u.misn.func, n ) < 0) { /* error has occurred */
+   prof = nlua_profiling;
+   if (prof)
+      nlua_profEnter( "misn:%s:%s", misn->data->name, hook->u.misn.func );
+   ret = misn_runFunc( misn, hook->u.misn.func, n );
+   if (prof)
+      nlua_profLeave();
+   if (ret < 0) { /* error has occurred */
       WARN(_("Hook [%s] '%lu' -> '%s' failed"), hook->stack,
             hook->id, hook->u.misn.func);
       return -1;
@@ -361,7 +368,7 @@ static int hook_runMisn( Hook *hook, HookParam *param, int claims )
  */
 static int hook_runEvent( Hook *hook, HookParam *param, int claims )
 {
-   int ret;
+   int ret, prof;
    int n;
 
    /* Must match claims. */
@@ -389,7 +396,13 @@ static int hook_runEvent( Hook *hook, HookParam *param, int claims )
    n++;
 
    /* Run the hook. */
+   prof = nlua_profiling;
+   if (prof)
+      nlua_profEnter( "evt:%s:%s", event_getData( hook->u.event.parent ),
+            hook->u.event.func );
    ret = event_runFunc( hook->u.event.parent, hook->u.event.func, n );
+   if (prof)
+      nlua_profLeave();
    hook->ran_once = 1;
    if (ret < 0) {
       hook_rmRaw( hook );
@@ -411,7 +424,7 @@ static int hook_runEvent( Hook *hook, HookParam *param, int claims )
  */
 static int hook_run( Hook *hook, HookParam *param, int claims )
 {
-   int ret;
+   int ret, prof;
 
    /* Do not run if pending deletion. */
    if (hook->delete)
@@ -421,6 +434,10 @@ static int hook_run( Hook *hook, HookParam *param, int claims )
    if (menu_isOpen(MENU_MAIN))
       return 0;
 
+   prof = nlua_profiling;
+   if (prof)
+      nlua_profEnter( "hook:%s", hook->stack );
+
    switch (hook->type) {
       case HOOK_TYPE_MISN:
          ret = hook_runMisn(hook, param, claims);
@@ -437,9 +454,12 @@ static int hook_run( Hook *hook, HookParam *param, int claims )
       default:
          WARN(_("Invalid hook type '%u', deleting."), hook->type);
          hook->delete = 1;
-         return -1;
+         ret = -1;
    }
 
+   if (prof)
+      nlua_profLeave();
+
    return ret;
 }
 
@@ -1534,7 +1534,7 @@ void takeoff( int delay )
  */
 static void land_stranded (void)
 {
-   char *buf;
+   const char *buf;
    size_t bufsize;
    const char *file = RESCUE_PATH;
 
@@ -1547,16 +1547,16 @@ static void land_stranded (void)
       nlua_loadStandard( rescue_env );
       nlua_loadTk( rescue_env );
 
-      buf = ndata_read( file, &bufsize );
+      buf = ndata_map( file, &bufsize );
       if (nlua_dobufenv(rescue_env, buf, bufsize, file) != 0) {
          WARN( _("Error loading file: %s\n"
              "%s\n"
              "Most likely Lua file has improper syntax, please check"),
                file, lua_tostring(naevL,-1));
-         free(buf);
+         ndata_unmap( buf, bufsize );
          return;
       }
-      free(buf);
+      ndata_unmap( buf, bufsize );
    }
 
    /* Run Lua. */
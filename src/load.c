@@ -36,6 +36,7 @@
 #include "nxml.h"
 #include "outfit.h"
 #include "player.h"
+#include "save.h"
 #include "shiplog.h"
 #include "space.h"
 #include "toolkit.h"
@@ -47,6 +48,9 @@
 #define BUTTON_WIDTH ((LOAD_WIDTH-80) / 3) /**< Button width. */
 #define BUTTON_HEIGHT 30 /**< Button height. */
 
+#define LOAD_INDEX         "saves/index.xml" /**< Cached headers of the saved games. */
+#define LOAD_INDEX_VERSION 1 /**< Version of the index format, bump when nsave_t changes. */
+
 
 /**
  * @brief Struct containing a file's name and stat structure.
@@ -57,7 +61,19 @@ typedef struct filedata {
 } filedata_t;
 
 
+/**
+ * @brief Cached header of a saved game, see load_indexRead().
+ */
+typedef struct LoadIndexEntry_ {
+   char *file; /**< Name of the file in the saves directory. */
+   PHYSFS_sint64 size; /**< Size of the file when it was indexed. */
+   PHYSFS_sint64 modtime; /**< Modification time of the file when it was indexed. */
+   nsave_t save; /**< Header of the saved game, without the path. */
+} LoadIndexEntry;
+
+
 static nsave_t *load_saves = NULL; /**< Array of save.s */
+static int load_indexFailed = 0; /**< Whether writing the saved game index failed this run. */
 extern int save_loaded; /**< From save.c */
 
 
@@ -87,6 +103,12 @@ static void load_menu_close( unsigned int wdw, char *str );
 static void load_menu_load( unsigned int wdw, char *str );
 static void load_menu_delete( unsigned int wdw, char *str );
 static int load_load( nsave_t *save, const char *path );
+static void load_freeSave( nsave_t *save );
+static LoadIndexEntry *load_indexRead( void );
+static int load_indexCmp( const void *p1, const void *p2 );
+static int load_indexGet( LoadIndexEntry *index, nsave_t *save, const char *path, const filedata_t *file );
+static int load_indexWrite( const nsave_t *saves, const filedata_t *files );
+static void load_indexFree( LoadIndexEntry *index );
 static int load_gameInternal( const char* file, const char* version );
 static int load_enumerateCallback( void* data, const char* origdir, const char* fname );
 static int load_sortCompare( const void *p1, const void *p2 );
@@ -205,22 +227,271 @@ static int load_load( nsave_t *save, const char *path )
 }
 
 
+/**
+ * @brief Frees the contents of a save header.
+ *
+ *    @param save Save header to free.
+ */
+static void load_freeSave( nsave_t *save )
+{
+   free(save->path);
+   free(save->name);
+   free(save->player_name);
+   free(save->version);
+   free(save->data);
+   free(save->planet);
+   free(save->shipname);
+   free(save->shipmodel);
+}
+
+
+/**
+ * @brief Reads the index of saved game headers.
+ *
+ *    @return Array (array.h) of index entries sorted by file name. Empty if
+ *            there is no usable index.
+ */
+static LoadIndexEntry *load_indexRead( void )
+{
+   xmlDocPtr doc;
+   xmlNodePtr root, node, cur;
+   LoadIndexEntry *index, *e;
+   int version;
+
+   index = array_create( LoadIndexEntry );
+   if (!PHYSFS_exists( LOAD_INDEX ))
+      return index;
+
+   doc = load_xml_parsePhysFS( LOAD_INDEX );
+   if (doc == NULL)
+      return index;
+   root = doc->xmlChildrenNode;
+   if ((root == NULL) || !xml_isNode(root, "saves")) {
+      xmlFreeDoc(doc);
+      return index;
+   }
+
+   /* Old indices are simply rebuilt. */
+   xmlr_attr_int( root, "version", version );
+   if (version != LOAD_INDEX_VERSION) {
+      xmlFreeDoc(doc);
+      return index;
+   }
+
+   node = root->xmlChildrenNode;
+   do {
+      xml_onlyNodes(node);
+      if (!xml_isNode(node, "save"))
+         continue;
+
+      e = &array_grow( &index );
+      memset( e, 0, sizeof(LoadIndexEntry) );
+      xmlr_attr_strd( node, "file", e->file );
+      xmlr_attr_long( node, "size", e->size );
+      xmlr_attr_long( node, "modtime", e->modtime );
+      cur = node->xmlChildrenNode;
+      do {
+         xml_onlyNodes(cur);
+         xmlr_strd(cur, "name", e->save.name);
+         xmlr_strd(cur, "player_name", e->save.player_name);
+         xmlr_strd(cur, "version", e->save.version);
+         xmlr_strd(cur, "data", e->save.data);
+         xmlr_strd(cur, "planet", e->save.planet);
+         xmlr_long(cur, "date", e->save.date);
+         xmlr_ulong(cur, "credits", e->save.credits);
+         xmlr_strd(cur, "shipname", e->save.shipname);
+         xmlr_strd(cur, "shipmodel", e->save.shipmodel);
+      } while (xml_nextNode(cur));
+
+      /* Drop incomplete entries, the save will be parsed instead. */
+      if ((e->file == NULL) || (e->save.name == NULL)
+            || (e->save.player_name == NULL) || (e->save.version == NULL)) {
+         free( e->file );
+         load_freeSave( &e->save );
+         array_erase( &index, e, e+1 );
+      }
+   } while (xml_nextNode(node));
+   xmlFreeDoc(doc);
+
+   qsort( index, array_size(index), sizeof(LoadIndexEntry), load_indexCmp );
+   return index;
+}
+
+
+/**
+ * @brief qsort compare function for index entries.
+ */
+static int load_indexCmp( const void *p1, const void *p2 )
+{
+   const LoadIndexEntry *e1, *e2;
+
+   e1 = (const LoadIndexEntry*) p1;
+   e2 = (const LoadIndexEntry*) p2;
+
+   return strcmp( e1->file, e2->file );
+}
+
+
+/**
+ * @brief Gets the header of a saved game from the index.
+ *
+ * The header is moved out of the index, so each entry can only be used once.
+ *
+ *    @param index Index to look in.
+ *    @param[out] save Structure to populate.
+ *    @param path PhysicsFS path of the saved game.
+ *    @param file File of the saved game.
+ *    @return 0 on success, -1 if the index has no up to date header.
+ */
+static int load_indexGet( LoadIndexEntry *index, nsave_t *save, const char *path, const filedata_t *file )
+{
+   LoadIndexEntry key, *e;
+
+   key.file = file->name;
+   e = bsearch( &key, index, array_size(index), sizeof(LoadIndexEntry), load_indexCmp );
+   if ((e == NULL) || (e->save.name == NULL))
+      return -1;
+
+   /* The save was written after being indexed. */
+   if ((e->size != file->stat.filesize) || (e->modtime != file->stat.modtime))
+      return -1;
+
+   *save = e->save;
+   save->path = strdup(path);
+   memset( &e->save, 0, sizeof(nsave_t) );
+   return 0;
+}
+
+
+/**
+ * @brief Writes the index of saved game headers.
+ *
+ * The index is only a cache, so failing to write it just means the saved
+ *  games are read again next time. It is warned about once and not written
+ *  again for the rest of the run.
+ *
+ *    @param saves Array (array.h) of saved game headers.
+ *    @param files Files of the saved games, one per header.
+ *    @return 0 on success.
+ */
+static int load_indexWrite( const nsave_t *saves, const filedata_t *files )
+{
+   char path[PATH_MAX], tmp[PATH_MAX];
+   xmlBufferPtr buf;
+   xmlTextWriterPtr writer;
+   xmlOutputBufferPtr out;
+   const nsave_t *ns;
+   int i, ret;
+
+   if (load_indexFailed)
+      return -1;
+
+   /* Serialise the index. */
+   buf = xmlBufferCreate();
+   writer = xmlNewTextWriterMemory( buf, 0 );
+   if (writer == NULL) {
+      xmlBufferFree( buf );
+      goto err;
+   }
+   xmlw_setParams( writer );
+#define CHECK(x)  if ((x) < 0) goto err_writer
+   CHECK( xmlTextWriterStartDocument( writer, NULL, "UTF-8", NULL ) );
+   CHECK( xmlTextWriterStartElement( writer, (xmlChar*)"saves" ) );
+   CHECK( xmlTextWriterWriteFormatAttribute( writer, (xmlChar*)"version", "%d", LOAD_INDEX_VERSION ) );
+   for (i=0; i<array_size(saves); i++) {
+      ns = &saves[i];
+      CHECK( xmlTextWriterStartElement( writer, (xmlChar*)"save" ) );
+      CHECK( xmlTextWriterWriteFormatAttribute( writer, (xmlChar*)"file", "%s", files[i].name ) );
+      CHECK( xmlTextWriterWriteFormatAttribute( writer, (xmlChar*)"size", "%"PRIi64, (int64_t)files[i].stat.filesize ) );
+      CHECK( xmlTextWriterWriteFormatAttribute( writer, (xmlChar*)"modtime", "%"PRIi64, (int64_t)files[i].stat.modtime ) );
+      CHECK( xmlTextWriterWriteFormatElement( writer, (xmlChar*)"name", "%s", ns->name ) );
+      CHECK( xmlTextWriterWriteFormatElement( writer, (xmlChar*)"player_name", "%s", ns->player_name ) );
+      CHECK( xmlTextWriterWriteFormatElement( writer, (xmlChar*)"version", "%s", ns->version ) );
+      if (ns->data != NULL)
+         CHECK( xmlTextWriterWriteFormatElement( writer, (xmlChar*)"data", "%s", ns->data ) );
+      if (ns->planet != NULL)
+         CHECK( xmlTextWriterWriteFormatElement( writer, (xmlChar*)"planet", "%s", ns->planet ) );
+      CHECK( xmlTextWriterWriteFormatElement( writer, (xmlChar*)"date", "%"PRIi64, ns->date ) );
+      CHECK( xmlTextWriterWriteFormatElement( writer, (xmlChar*)"credits", "%"CREDITS_PRI, ns->credits ) );
+      if (ns->shipname != NULL)
+         CHECK( xmlTextWriterWriteFormatElement( writer, (xmlChar*)"shipname", "%s", ns->shipname ) );
+      if (ns->shipmodel != NULL)
+         CHECK( xmlTextWriterWriteFormatElement( writer, (xmlChar*)"shipmodel", "%s", ns->shipmodel ) );
+      CHECK( xmlTextWriterEndElement( writer ) ); /* "save" */
+   }
+   CHECK( xmlTextWriterEndElement( writer ) ); /* "saves" */
+   CHECK( xmlTextWriterEndDocument( writer ) );
+#undef CHECK
+   xmlFreeTextWriter( writer );
+
+   /* Write to a temporary file so a broken index is never left behind. */
+   snprintf( path, sizeof(path), "%s/%s", PHYSFS_getWriteDir(), LOAD_INDEX );
+   snprintf( tmp, sizeof(tmp), "%s.tmp", path );
+   out = xmlOutputBufferCreateFilename( tmp, NULL, 0 );
+   if (out == NULL) {
+      xmlBufferFree( buf );
+      goto err;
+   }
+   ret = xmlOutputBufferWrite( out, xmlBufferLength( buf ), (const char*)xmlBufferContent( buf ) );
+   xmlBufferFree( buf );
+   if ((xmlOutputBufferClose( out ) < 0) || (ret < 0)) {
+      remove( tmp );
+      goto err;
+   }
+   if (nfile_rename( tmp, path ) < 0) {
+      remove( tmp );
+      goto err;
+   }
+   return 0;
+
+err_writer:
+   xmlFreeTextWriter( writer );
+   xmlBufferFree( buf );
+err:
+   WARN(_("Unable to write the saved game index '%s', saved games will be read every time."), LOAD_INDEX);
+   load_indexFailed = 1;
+   return -1;
+}
+
+
+/**
+ * @brief Frees the index of saved game headers.
+ */
+static void load_indexFree( LoadIndexEntry *index )
+{
+   int i;
+
+   for (i=0; i<array_size(index); i++) {
+      free( index[i].file );
+      load_freeSave( &index[i].save );
+   }
+   array_free( index );
+}
+
+
 /**
  * @brief Loads or refreshes saved games.
  *
+ * Headers are taken from the saves index when it is up to date, so only new
+ *  or modified saved games have to be parsed.
+ *
  *    @return 0 on success, 1 if there are no saves.
  */
 int load_refresh(void)
 {
    char buf[PATH_MAX];
-   filedata_t *files, tmp;
+   filedata_t *files, *loaded, tmp;
+   LoadIndexEntry *index;
    size_t len;
-   int i, ok;
+   int i, ok, hits, dirty;
    nsave_t *ns;
 
    if (load_saves != NULL)
       load_free();
 
+   /* Make sure the last saved game is listed. */
+   save_wait();
+
    /* load the saves */
    files = array_create( filedata_t );
    PHYSFS_enumerate( "saves", load_enumerateCallback, &files );
@@ -249,21 +520,40 @@ int load_refresh(void)
       files[i+1]  = tmp;
    }
 
-   /* Allocate and parse. */
+   /* Allocate and parse, only falling back to the saves themselves when the
+    * index is missing or stale. */
    ok = 0;
    ns = NULL;
+   hits = 0;
+   dirty = 0;
+   index = load_indexRead();
+   loaded = array_create_size( filedata_t, array_size(files) );
    load_saves = array_create_size( nsave_t, array_size(files) );
    for (i=0; i<array_size(files); i++) {
       if (!ok)
          ns = &array_grow( &load_saves );
       snprintf(buf, sizeof(buf), "saves/%s", files[i].name);
-      ok = load_load(ns, buf);
+      ok = load_indexGet( index, ns, buf, &files[i] );
+      if (ok == 0)
+         hits++;
+      else {
+         ok = load_load(ns, buf);
+         dirty = 1;
+      }
+      if (ok == 0)
+         array_push_back( &loaded, files[i] );
    }
 
    /* If the save was invalid, array is 1 member too large. */
    if (ok)
       array_resize( &load_saves, array_size(load_saves)-1 );
 
+   /* Rewrite the index if it gained or lost saves. */
+   if (dirty || (hits != array_size(index)))
+      load_indexWrite( load_saves, loaded );
+   load_indexFree( index );
+   array_free( loaded );
+
    /* Clean up memory. */
    for (i=0; i<array_size(files); i++)
       free( files[i].name );
@@ -336,19 +626,9 @@ static int load_sortCompare( const void *p1, const void *p2 )
 void load_free (void)
 {
    int i;
-   nsave_t *ns;
 
-   for (i=0; i<array_size(load_saves); i++) {
-      ns = &load_saves[i];
-      free(ns->path);
-      free(ns->name);
-      free(ns->player_name);
-      free(ns->version);
-      free(ns->data);
-      free(ns->planet);
-      free(ns->shipname);
-      free(ns->shipmodel);
-   }
+   for (i=0; i<array_size(load_saves); i++)
+      load_freeSave( &load_saves[i] );
    array_free( load_saves );
    load_saves = NULL;
 }
@@ -693,6 +973,9 @@ static int load_gameInternal( const char* file, const char* version )
    Planet *pnt;
    int version_diff = (version!=NULL) ? naev_versionCompare(version) : 0;
 
+   /* The saved game may still be being written. */
+   save_wait();
+
    /* Make sure it exists. */
    if (!PHYSFS_exists( file )) {
       dialogue_alert( _("Saved game file seems to have been deleted.") );
@@ -54,6 +54,32 @@ typedef enum MapMode_ {
 
 #define MAP_MARKER_CYCLE  750 /**< Time of a mission marker's animation cycle in milliseconds. */
 
+#define MAP_JUMP_VERTEX   (2+4) /**< Floats per jump route vertex: position and colour. */
+#define MAP_JUMP_CELL     500. /**< Size of the cells jump routes are grouped in for culling. */
+
+
+/**
+ * @brief Jump route being generated, a system's side of a jump.
+ */
+typedef struct MapJumpLine_ {
+   int cx; /**< Cell X index. */
+   int cy; /**< Cell Y index. */
+   double bounds[4]; /**< Bounding box: left, bottom, right and top. */
+   int n; /**< Number of vertices, drawn as lines. */
+   GLfloat vertex[4*MAP_JUMP_VERTEX]; /**< Vertices. */
+} MapJumpLine;
+
+
+/**
+ * @brief Jump routes of a cell, drawn together.
+ */
+typedef struct MapJumpCell_ {
+   double bounds[4]; /**< Bounding box of the routes: left, bottom, right and top. */
+   int first; /**< First vertex of the cell. */
+   int n; /**< Number of vertices of the cell. */
+} MapJumpCell;
+
+
 /* map decorator stack */
 static MapDecorator* decorator_stack = NULL; /**< Contains all the map decorators. */
 
@@ -81,6 +107,9 @@ static double commod_av_gal_price = 0; /**< Average price across the galaxy. */
 static double map_nebu_dt = 0.; /***< Nebula animation stuff. */
 /* VBO. */
 static gl_vbo *map_vbo = NULL; /**< Map VBO. */
+static gl_vbo *map_jumpVBO = NULL; /**< Static VBO of the jump routes, in universe coordinates. */
+static MapJumpCell *map_jumpCells = NULL; /**< Array (array.h) of the cells of the jump routes, in VBO order. */
+static uint64_t map_jumpKey = 0; /**< Key of the state the jump routes were generated for. */
 
 /*
  * extern
@@ -99,6 +128,14 @@ extern Planet* land_planet;
 static void map_update( unsigned int wid );
 /* Render. */
 static void map_render( double bx, double by, double w, double h, void *data );
+static uint64_t map_jumpsKey( double stub, int editor );
+static void map_jumpsVertex( MapJumpLine *line, double x, double y, const glColour *c, double a );
+static void map_jumpsLine( MapJumpLine *line, const Vector2d *p1, const Vector2d *p2,
+      const glColour *c1, const glColour *c2 );
+static void map_jumpsStub( MapJumpLine *line, const Vector2d *p1, const Vector2d *p2,
+      double stub, const glColour *c );
+static int map_jumpsCmp( const void *p1, const void *p2 );
+static void map_jumpsGen( double stub, int editor );
 static void map_renderPath( double x, double y, double a, double alpha );
 static void map_renderMarkers( double x, double y, double r, double a );
 static void map_renderCommod( double bx, double by, double x, double y,
@@ -143,6 +180,10 @@ void map_exit (void)
 
    gl_vboDestroy(map_vbo);
    map_vbo = NULL;
+   gl_vboDestroy(map_jumpVBO);
+   map_jumpVBO = NULL;
+   array_free(map_jumpCells);
+   map_jumpCells = NULL;
 
    if (decorator_stack != NULL) {
       for (i=0; i<array_size(decorator_stack); i++)
@@ -866,7 +907,7 @@ static void map_drawMarker( double x, double y, double r, double a,
    y = y + 3.0*r * sin(alpha);
    r *= 2.0;
 
-   glUseProgram(shaders.sysmarker.program);
+   gl_useProgram(shaders.sysmarker.program);
    if (type==0)
       glUniform1i( shaders.sysmarker.parami, 1 );
    else
@@ -947,7 +988,7 @@ else (x) = MAX( y, (x) - dt )
       map_renderFactionDisks( x, y, r, 0, map_alpha_faction );
 
    /* Render jump routes. */
-   map_renderJumps( x, y, r, 0 );
+   map_renderJumps( bx, by, x, y, w, h, r, 0 );
 
    /* Cause alpha to move smoothly between 0-1. */
    col.a = 0.5 + 0.5 * ( ABS(MAP_MARKER_CYCLE - (int)SDL_GetTicks() % (2*MAP_MARKER_CYCLE))
@@ -1126,7 +1167,7 @@ void map_renderFactionDisks( double x, double y, double r, int editor, double al
          c.b = col->b;
          c.a = 0.6 * alpha;
 
-         glUseProgram(shaders.factiondisk.program);
+         gl_useProgram(shaders.factiondisk.program);
          glUniform1f(shaders.factiondisk.paramf, r / sr );
          gl_renderShader( tx, ty, sr, sr, 0., &shaders.factiondisk, &c, 1 );
       }
@@ -1173,7 +1214,7 @@ void map_renderSystemEnvironment( double x, double y, int editor, double alpha )
          projection = gl_Matrix4_Scale(projection, sw, sh, 1);
 
          /* Start the program. */
-         glUseProgram(shaders.nebula_map.program);
+         gl_useProgram(shaders.nebula_map.program);
 
          /* Set shader uniforms. */
          glUniform1f(shaders.nebula_map.hue, sys->nebu_hue);
@@ -1184,13 +1225,13 @@ void map_renderSystemEnvironment( double x, double y, int editor, double alpha )
          glUniform2f(shaders.nebula_map.globalpos, sys->pos.x, sys->pos.y );
 
          /* Draw. */
-         glEnableVertexAttribArray( shaders.nebula_map.vertex );
+         gl_enableVertexAttribArray( shaders.nebula_map.vertex );
          gl_vboActivateAttribOffset( gl_squareVBO, shaders.nebula_map.vertex, 0, 2, GL_FLOAT, 0 );
          glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
 
          /* Clean up. */
-         glDisableVertexAttribArray( shaders.nebula_map.vertex );
-         glUseProgram(0);
+         gl_disableVertexAttribArray( shaders.nebula_map.vertex );
+         gl_useProgram(0);
          gl_checkErr();
       }
    }
@@ -1198,19 +1239,151 @@ void map_renderSystemEnvironment( double x, double y, int editor, double alpha )
 
 
 /**
- * @brief Renders the jump routes between systems.
+ * @brief Gets a key of the state the jump routes depend on.
+ *
+ * Cheap enough to check every frame, so the routes don't have to track every
+ * place that discovers, hides or edits systems and jumps.
+ *
+ *    @param stub Length of the long range jump lines.
+ *    @param editor Whether in the editor.
+ *    @return The key of the current state.
  */
-void map_renderJumps( double x, double y, double r, int editor)
+static uint64_t map_jumpsKey( double stub, int editor )
 {
-   int i, j, k;
-   double dir;
+   int i, j;
+   uint64_t h;
+   union { double d; uint64_t u; } v;
+   StarSystem *sys;
+   JumpPoint *jp;
+
+   /* FNV-1a, a word at a time. */
+#define MAP_MIX(x)   h = (h ^ (uint64_t)(x)) * 0x100000001b3ULL
+   h = 0xcbf29ce484222325ULL;
+   MAP_MIX( editor );
+   v.d = stub;
+   MAP_MIX( v.u );
+   MAP_MIX( array_size(systems_stack) );
+   for (i=0; i<array_size(systems_stack); i++) {
+      sys = system_getIndex( i );
+      MAP_MIX( sys->flags & (SYSTEM_KNOWN | SYSTEM_HIDDEN) );
+      v.d = sys->pos.x;
+      MAP_MIX( v.u );
+      v.d = sys->pos.y;
+      MAP_MIX( v.u );
+      MAP_MIX( array_size(sys->jumps) );
+      for (j=0; j<array_size(sys->jumps); j++) {
+         jp = &sys->jumps[j];
+         MAP_MIX( jp->targetid );
+         MAP_MIX( jp->flags );
+      }
+   }
+#undef MAP_MIX
+
+   return h;
+}
+
+
+/**
+ * @brief Adds a vertex to a jump route being generated.
+ */
+static void map_jumpsVertex( MapJumpLine *line, double x, double y, const glColour *c, double a )
+{
+   GLfloat *vertex;
+
+   vertex = &line->vertex[ line->n * MAP_JUMP_VERTEX ];
+   vertex[0] = x;
+   vertex[1] = y;
+   vertex[2] = c->r;
+   vertex[3] = c->g;
+   vertex[4] = c->b;
+   vertex[5] = a;
+
+   if (line->n == 0) {
+      line->bounds[0] = line->bounds[2] = x;
+      line->bounds[1] = line->bounds[3] = y;
+   }
+   else {
+      line->bounds[0] = MIN( line->bounds[0], x );
+      line->bounds[1] = MIN( line->bounds[1], y );
+      line->bounds[2] = MAX( line->bounds[2], x );
+      line->bounds[3] = MAX( line->bounds[3], y );
+   }
+   line->n++;
+}
+
+
+/**
+ * @brief Generates a jump route between two systems, fading between their colours.
+ */
+static void map_jumpsLine( MapJumpLine *line, const Vector2d *p1, const Vector2d *p2,
+      const glColour *c1, const glColour *c2 )
+{
+   glColour cm;
+
+   cm.r = pow((sqrt(c1->r) + sqrt(c2->r)) / 2., 2);
+   cm.g = pow((sqrt(c1->g) + sqrt(c2->g)) / 2., 2);
+   cm.b = pow((sqrt(c1->b) + sqrt(c2->b)) / 2., 2);
+
+   line->n = 0;
+   map_jumpsVertex( line, p1->x, p1->y, c1, 0.8 );
+   map_jumpsVertex( line, (p1->x+p2->x)/2., (p1->y+p2->y)/2., &cm, 0.8 );
+   map_jumpsVertex( line, (p1->x+p2->x)/2., (p1->y+p2->y)/2., &cm, 0.8 );
+   map_jumpsVertex( line, p2->x, p2->y, c2, 0.8 );
+}
+
+
+/**
+ * @brief Generates the line of a long range jump route leaving a system.
+ */
+static void map_jumpsStub( MapJumpLine *line, const Vector2d *p1, const Vector2d *p2,
+      double stub, const glColour *c )
+{
+   double dir, x, y;
+
+   dir = ANGLE(p2->x - p1->x, p2->y - p1->y);
+   x = p1->x + cos(dir)*stub;
+   y = p1->y + sin(dir)*stub;
+
+   /* Goes out and back, fading out at the end. */
+   line->n = 0;
+   map_jumpsVertex( line, p1->x, p1->y, c, 1. );
+   map_jumpsVertex( line, x, y, c, 0. );
+   map_jumpsVertex( line, x, y, c, 0. );
+   map_jumpsVertex( line, p1->x, p1->y, c, 1. );
+}
+
+
+/**
+ * @brief Compares jump routes by cell.
+ */
+static int map_jumpsCmp( const void *p1, const void *p2 )
+{
+   const MapJumpLine *l1, *l2;
+
+   l1 = (const MapJumpLine*) p1;
+   l2 = (const MapJumpLine*) p2;
+   if (l1->cy != l2->cy)
+      return l1->cy - l2->cy;
+   return l1->cx - l2->cx;
+}
+
+
+/**
+ * @brief Generates the jump routes into the static VBO, grouped by cell.
+ *
+ *    @param stub Length of the long range jump lines.
+ *    @param editor Whether in the editor.
+ */
+static void map_jumpsGen( double stub, int editor )
+{
+   int i, j, k, n;
    const glColour *col, *cole;
-   GLfloat vertex[8*(2+4)];
    StarSystem *sys, *jsys;
+   MapJumpLine *lines, *line;
+   MapJumpCell *cell;
+   GLfloat *vertex;
 
-   /* Generate smooth lines. */
-   glLineWidth( CLAMP(1., 4., 2. * map_zoom)*gl_screen.scale );
-
+   lines = array_create( MapJumpLine );
    for (i=0; i<array_size(systems_stack); i++) {
       sys = system_getIndex( i );
 
@@ -1220,11 +1393,6 @@ void map_renderJumps( double x, double y, double r, int editor)
       if (!sys_isKnown(sys) && !editor)
          continue; /* we don't draw hyperspace lines */
 
-      /* first we draw all of the paths. */
-      gl_beginSmoothProgram(gl_view_matrix);
-      gl_vboActivateAttribOffset( map_vbo, shaders.smooth.vertex, 0, 2, GL_FLOAT, 0 );
-      gl_vboActivateAttribOffset( map_vbo, shaders.smooth.vertex_color,
-            sizeof(GLfloat) * 2*3, 4, GL_FLOAT, 0 );
       for (j=0; j<array_size(sys->jumps); j++) {
          jsys = sys->jumps[j].target;
          if (sys_isFlag(jsys,SYSTEM_HIDDEN))
@@ -1251,78 +1419,119 @@ void map_renderJumps( double x, double y, double r, int editor)
             col = &cLightBlue;
 
          if (jp_isFlag(&sys->jumps[j], JP_LONGRANGE)) {
-            /* Draw the line for the source system. */
-            dir = ANGLE(jsys->pos.x - sys->pos.x, jsys->pos.y - sys->pos.y);
-            vertex[0] = x + sys->pos.x*map_zoom;
-            vertex[1] = y + sys->pos.y*map_zoom;
-            vertex[2] = vertex[0] + cos(dir)*8*r;
-            vertex[3] = vertex[1] + sin(dir)*8*r;
-            vertex[4] = x + sys->pos.x*map_zoom;
-            vertex[5] = y + sys->pos.y*map_zoom;
-            vertex[6] = col->r;
-            vertex[7] = col->g;
-            vertex[8] = col->b;
-            vertex[9] = 1.;
-            vertex[10] = col->r;
-            vertex[11] = col->g;
-            vertex[12] = col->b;
-            vertex[13] = 0.;
-            vertex[14] = col->r;
-            vertex[15] = col->g;
-            vertex[16] = col->b;
-            vertex[17] = 1.;
-            gl_vboSubData(map_vbo, 0, sizeof(GLfloat) * 3*(2+4), vertex);
-            glDrawArrays(GL_LINE_STRIP, 0, 3);
-
-            /* Draw the line for the dest system. */
-            dir = ANGLE(sys->pos.x - jsys->pos.x, sys->pos.y - jsys->pos.y);
-            vertex[0] = x + jsys->pos.x*map_zoom;
-            vertex[1] = y + jsys->pos.y*map_zoom;
-            vertex[2] = vertex[0] + cos(dir)*8*r;
-            vertex[3] = vertex[1] + sin(dir)*8*r;
-            vertex[4] = x + jsys->pos.x*map_zoom;
-            vertex[5] = y + jsys->pos.y*map_zoom;
-            vertex[6] = cole->r;
-            vertex[7] = cole->g;
-            vertex[8] = cole->b;
-            vertex[9] = 1.;
-            vertex[10] = cole->r;
-            vertex[11] = cole->g;
-            vertex[12] = cole->b;
-            vertex[13] = 0.;
-            vertex[14] = cole->r;
-            vertex[15] = cole->g;
-            vertex[16] = cole->b;
-            vertex[17] = 1.;
-            gl_vboSubData(map_vbo, 0, sizeof(GLfloat) * 3*(2+4), vertex);
-            glDrawArrays(GL_LINE_STRIP, 0, 3);
-         }
-         else {
-            /* Draw the lines. */
-            vertex[0] = x + sys->pos.x*map_zoom;
-            vertex[1] = y + sys->pos.y*map_zoom;
-            vertex[2] = vertex[0] + (jsys->pos.x-sys->pos.x)/2. * map_zoom;
-            vertex[3] = vertex[1] + (jsys->pos.y-sys->pos.y)/2. * map_zoom;
-            vertex[4] = x + jsys->pos.x*map_zoom;
-            vertex[5] = y + jsys->pos.y*map_zoom;
-            vertex[6] = col->r;
-            vertex[7] = col->g;
-            vertex[8] = col->b;
-            vertex[9] = 0.8;
-            vertex[10] = pow((sqrt(col->r) + sqrt(cole->r)) / 2., 2);
-            vertex[11] = pow((sqrt(col->g) + sqrt(cole->g)) / 2., 2);
-            vertex[12] = pow((sqrt(col->b) + sqrt(cole->b)) / 2., 2);
-            vertex[13] = 0.8;
-            vertex[14] = cole->r;
-            vertex[15] = cole->g;
-            vertex[16] = cole->b;
-            vertex[17] = 0.8;
-            gl_vboSubData(map_vbo, 0, sizeof(GLfloat) * 3*(2+4), vertex);
-            glDrawArrays(GL_LINE_STRIP, 0, 3);
+            /* Draw the line for the source and the dest system. */
+            map_jumpsStub( &array_grow( &lines ), &sys->pos, &jsys->pos, stub, col );
+            map_jumpsStub( &array_grow( &lines ), &jsys->pos, &sys->pos, stub, cole );
          }
+         else
+            map_jumpsLine( &array_grow( &lines ), &sys->pos, &jsys->pos, col, cole );
+      }
+   }
+
+   /* Group the routes by the cell their bounding box starts in. */
+   for (i=0; i<array_size(lines); i++) {
+      lines[i].cx = (int)floor( lines[i].bounds[0] / MAP_JUMP_CELL );
+      lines[i].cy = (int)floor( lines[i].bounds[1] / MAP_JUMP_CELL );
+   }
+   qsort( lines, array_size(lines), sizeof(MapJumpLine), map_jumpsCmp );
+
+   /* Pack the cells. */
+   array_free( map_jumpCells );
+   map_jumpCells = array_create( MapJumpCell );
+   vertex = array_create( GLfloat );
+   cell = NULL;
+   for (i=0; i<array_size(lines); i++) {
+      line = &lines[i];
+      if ((i == 0) || (line->cx != lines[i-1].cx) || (line->cy != lines[i-1].cy)) {
+         cell = &array_grow( &map_jumpCells );
+         memcpy( cell->bounds, line->bounds, sizeof(cell->bounds) );
+         cell->first = array_size(vertex) / MAP_JUMP_VERTEX;
+         cell->n     = 0;
+      }
+      else {
+         cell->bounds[0] = MIN( cell->bounds[0], line->bounds[0] );
+         cell->bounds[1] = MIN( cell->bounds[1], line->bounds[1] );
+         cell->bounds[2] = MAX( cell->bounds[2], line->bounds[2] );
+         cell->bounds[3] = MAX( cell->bounds[3], line->bounds[3] );
+      }
+      n = array_size(vertex);
+      array_resize( &vertex, n + line->n * MAP_JUMP_VERTEX );
+      memcpy( &vertex[n], line->vertex, sizeof(GLfloat) * line->n * MAP_JUMP_VERTEX );
+      cell->n += line->n;
+   }
+
+   gl_vboDestroy( map_jumpVBO );
+   map_jumpVBO = gl_vboCreateStatic( sizeof(GLfloat) * array_size(vertex), vertex );
+
+   array_free( vertex );
+   array_free( lines );
+}
+
+
+/**
+ * @brief Renders the jump routes between systems.
+ *
+ * The routes are kept in a static VBO, generated again only when the systems,
+ * their jumps or the zoom change, and drawn by cells overlapping the area.
+ */
+void map_renderJumps( double bx, double by, double x, double y,
+      double w, double h, double r, int editor )
+{
+   int i, first, n;
+   double stub, ux, uy, uw, uh;
+   uint64_t key;
+   gl_Matrix4 projection;
+   GLsizei stride;
+   const MapJumpCell *cell;
+
+   /* Long range jump lines have a fixed length on screen. */
+   stub = 8.*r / map_zoom;
+   key = map_jumpsKey( stub, editor );
+   if ((map_jumpVBO == NULL) || (key != map_jumpKey)) {
+      map_jumpsGen( stub, editor );
+      map_jumpKey = key;
+   }
+
+   /* Visible area in universe coordinates. */
+   ux = (bx - x) / map_zoom;
+   uy = (by - y) / map_zoom;
+   uw = w / map_zoom;
+   uh = h / map_zoom;
+
+   /* Generate smooth lines. */
+   glLineWidth( CLAMP(1., 4., 2. * map_zoom)*gl_screen.scale );
+
+   projection = gl_Matrix4_Translate( gl_view_matrix, x, y, 0. );
+   projection = gl_Matrix4_Scale( projection, map_zoom, map_zoom, 1. );
+   gl_beginSmoothProgram( projection );
+   stride = sizeof(GLfloat) * MAP_JUMP_VERTEX;
+   gl_vboActivateAttribOffset( map_jumpVBO, shaders.smooth.vertex,
+         0, 2, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( map_jumpVBO, shaders.smooth.vertex_color,
+         sizeof(GLfloat) * 2, 4, GL_FLOAT, stride );
+
+   /* Draw the visible cells, consecutive ones with a single call. */
+   first = 0;
+   n = 0;
+   for (i=0; i<array_size(map_jumpCells); i++) {
+      cell = &map_jumpCells[i];
+      if (!rectOverlap( cell->bounds[0], cell->bounds[1],
+               cell->bounds[2] - cell->bounds[0], cell->bounds[3] - cell->bounds[1],
+               ux, uy, uw, uh ))
+         continue;
+      if ((n > 0) && (first + n == cell->first)) {
+         n += cell->n;
+         continue;
       }
-      gl_endSmoothProgram();
+      if (n > 0)
+         glDrawArrays( GL_LINES, first, n );
+      first = cell->first;
+      n     = cell->n;
    }
+   if (n > 0)
+      glDrawArrays( GL_LINES, first, n );
+
+   gl_endSmoothProgram();
 
    /* Reset render parameters. */
    glLineWidth( 1. );
@@ -1555,10 +1764,14 @@ void map_renderNames( double bx, double by, double x, double y,
 
       font = (map_zoom >= 1.5) ? &gl_defFont : &gl_smallFont;
 
-      textw = gl_printWidthRaw( font, _(sys->name) );
       tx = x + (sys->pos.x+12.) * map_zoom;
       ty = y + (sys->pos.y) * map_zoom - font->h*0.5;
 
+      /* Skip before measuring the text if it can't be visible. */
+      if ((tx > bx+w) || (ty > by+h) || (ty+font->h < by))
+         continue;
+      textw = gl_printWidthRaw( font, _(sys->name) );
+
       /* Skip if out of bounds. */
       if (!rectOverlap(tx, ty, textw, font->h, bx, by, w, h))
          continue;
@@ -73,7 +73,7 @@ static int mission_matchFaction( MissionData* misn, int faction );
 static int mission_location( const char *loc );
 /* Loading. */
 static int missions_cmp( const void *a, const void *b );
-static int mission_parseFile( const char* file );
+static int mission_parseFile( const XmlParseJob *job );
 static int mission_parseXML( MissionData *temp, const xmlNodePtr parent );
 static int missions_parseActive( xmlNodePtr parent );
 
@@ -853,6 +853,8 @@ int missions_load (void)
 {
    int    i;
    char **mission_files;
+   XmlParseStream *stream;
+   XmlParseJob *job;
 
    /* Allocate player missions. */
    for (i=0; i<MISSION_MAX; i++)
@@ -861,11 +863,14 @@ int missions_load (void)
    /* Run over missions. */
    mission_files = ndata_listRecursive( MISSION_DATA_PATH );
    mission_stack = array_create_size( MissionData, array_size( mission_files ) );
-   for ( i = 0; i < array_size( mission_files ); i++ ) {
+   stream = xml_parseStreamOpen( (const char**)mission_files, array_size( mission_files ), 1 );
+   while ((job = xml_parseStreamNext( stream )) != NULL) {
       if (!naev_pollQuit())
-         mission_parseFile(mission_files[i]);
-      free( mission_files[i] );
+         mission_parseFile( job );
    }
+   xml_parseStreamClose( stream );
+   for ( i = 0; i < array_size( mission_files ); i++ )
+      free( mission_files[i] );
    array_free( mission_files );
    array_shrink(&mission_stack);
 
@@ -881,12 +886,11 @@ int missions_load (void)
 /**
  * @brief Parses a single mission.
  */
-static int mission_parseFile( const char* file )
+static int mission_parseFile( const XmlParseJob *job )
 {
-   xmlDocPtr doc;
    xmlNodePtr node;
+   const char *file, *filebuf;
    size_t bufsize;
-   char *filebuf;
    const char *pos, *start_pos;
    MissionData *temp;
 
@@ -895,8 +899,10 @@ static int mission_parseFile( const char* file )
    int ret;
 #endif /* DEBUGGING */
 
-   /* Load string. */
-   filebuf = ndata_read( file, &bufsize );
+   /* File was already read and its header parsed by xml_parseStreamNext(). */
+   file     = job->filename;
+   filebuf  = job->buf;
+   bufsize  = job->bufsize;
    if (filebuf == NULL) {
       WARN(_("Unable to read data from '%s'"), file);
       return -1;
@@ -908,7 +914,6 @@ static int mission_parseFile( const char* file )
       pos = strnstr( filebuf, "function create", bufsize );
       if ((pos != NULL) && !strncmp(pos,"--common",bufsize))
          WARN(_("Mission '%s' has create function but no XML header!"), file);
-      free(filebuf);
       return 0;
    }
 
@@ -921,13 +926,12 @@ static int mission_parseFile( const char* file )
    }
 
    /* Parse the header. */
-   doc = xmlParseMemory( start_pos, pos-start_pos);
-   if (doc == NULL) {
+   if (job->doc == NULL) {
       WARN(_("Unable to parse document XML header for Mission '%s'"), file);
       return -1;
    }
 
-   node = doc->xmlChildrenNode;
+   node = job->doc->xmlChildrenNode;
    if (!xml_isNode(node,XML_MISSION_TAG)) {
       ERR( _("Malformed XML header for '%s' mission: missing root element '%s'"), file, XML_MISSION_TAG );
       return -1;
@@ -935,7 +939,7 @@ static int mission_parseFile( const char* file )
 
    temp = &array_grow(&mission_stack);
    mission_parseXML( temp, node );
-   temp->lua = strdup(filebuf);
+   temp->lua = strndup(filebuf, bufsize);
    temp->sourcefile = strdup(file);
 
 #ifdef DEBUGGING
@@ -949,10 +953,6 @@ static int mission_parseFile( const char* file )
    }
 #endif /* DEBUGGING */
 
-   /* Clean up. */
-   xmlFreeDoc(doc);
-   free(filebuf);
-
    return 0;
 }
 
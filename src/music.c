@@ -489,13 +489,13 @@ static int music_luaSetup (void)
  */
 int music_luaFile( const char *filename )
 {
-   char *buf;
+   const char *buf;
    size_t bufsize;
 
    music_luaSetup();
 
    /* load the actual Lua music code */
-   buf = ndata_read( filename, &bufsize );
+   buf = ndata_map( filename, &bufsize );
    if (nlua_dobufenv(music_env, buf, bufsize, filename) != 0) {
       ERR(_("Error loading music file: %s\n"
           "%s\n"
@@ -503,7 +503,7 @@ int music_luaFile( const char *filename )
             filename, lua_tostring(naevL,-1) );
       return -1;
    }
-   free(buf);
+   ndata_unmap( buf, bufsize );
 
    /* Free repeatname. */
    free( music_temp_repeatname );
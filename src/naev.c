@@ -60,6 +60,7 @@
 #include "nebula.h"
 #include "news.h"
 #include "nfile.h"
+#include "nlua.h"
 #include "nlua_misn.h"
 #include "nlua_var.h"
 #include "npc.h"
@@ -74,9 +75,11 @@
 #include "player.h"
 #include "render.h"
 #include "rng.h"
+#include "save.h"
 #include "semver.h"
 #include "ship.h"
 #include "slots.h"
+#include "snapshot.h"
 #include "sound.h"
 #include "space.h"
 #include "spfx.h"
@@ -89,6 +92,8 @@
 
 #define CONF_FILE       "conf.lua" /**< Configuration file by default. */
 #define VERSION_FILE    "VERSION" /**< Version file by default. */
+#define LOADING_STAGES     16. /**< Amount of loading stages. */
+#define LOADING_PROGRESS_MS   33 /**< Minimum time between load screen updates within a stage. */
 
 static int quit               = 0; /**< For primary loop */
 static unsigned int time_ms   = 0; /**< used to calculate FPS and movement. */
@@ -96,6 +101,8 @@ static double loading_r       = 0.; /**< Just to provide some randomness. */
 static glTexture *loading     = NULL; /**< Loading screen. */
 static glFont loading_font; /**< Loading font. */
 static char *loading_txt = NULL; /**< Loading text to display. */
+static double loading_done    = 0.; /**< Progress at the start of the current loading stage. */
+static const char *loading_msg = NULL; /**< Message of the current loading stage, NULL when not loading. */
 static SDL_Surface *naev_icon = NULL; /**< Icon. */
 static int fps_skipped        = 0; /**< Skipped last frame? */
 /* Version stuff. */
@@ -115,6 +122,21 @@ static double fps_x     =  15.; /**< FPS X position. */
 static double fps_y     = -15.; /**< FPS Y position. */
 const double fps_min    = 1./30.; /**< Minimum fps to run at. */
 
+/*
+ * Startup timing.
+ */
+/**
+ * @brief Time spent in a stage of the startup.
+ */
+typedef struct StartupStage_ {
+   const char *name; /**< Name of the stage. */
+   double time; /**< Time spent in milliseconds. */
+} StartupStage;
+static StartupStage *startup_stages = NULL; /**< Stages in the order they first ran. */
+static Uint64 startup_start   = 0; /**< Performance counter when started. */
+static Uint64 startup_last    = 0; /**< Performance counter at the last mark. */
+static int startup_done       = 0; /**< Whether the first frame was reached. */
+
 /*
  * prototypes
  */
@@ -132,6 +154,12 @@ static void fps_control (void);
 static void update_all (void);
 /* Misc. */
 static void loadscreen_render( double done, const char *msg );
+static void loadscreen_draw( double done, const char *msg );
+/* Startup timing. */
+static void startup_add( const char *name, Uint64 ticks );
+static void startup_mark( const char *name );
+static void startup_skip( const char *name, Uint64 start );
+static void startup_report( const char *path );
 void main_loop( int update ); /* dialogue.c */
 
 
@@ -190,6 +218,9 @@ int main( int argc, char** argv )
    memset( debug_flags , 0, DEBUG_FLAGS_MAX );
 #endif /* DEBUGGING */
 
+   /* Start timing. */
+   startup_mark( NULL );
+
    env_detect( argc, argv );
 
    log_init();
@@ -292,6 +323,7 @@ int main( int argc, char** argv )
       ERR( _("Failed to load module start data.") );
    LOG(" %s", start_name());
    DEBUG_BLANK();
+   startup_mark( "init" );
 
    /* Display the SDL Version. */
    print_SDLversion();
@@ -309,18 +341,21 @@ int main( int argc, char** argv )
       exit(EXIT_FAILURE);
    }
    window_caption();
+   startup_mark( "gl_init" );
 
    /* Have to set up fonts before rendering anything. */
    //DEBUG("Using '%s' as main font and '%s' as monospace font.", _(FONT_DEFAULT_PATH), _(FONT_MONOSPACE_PATH));
    gl_fontInit( &gl_defFont, _(FONT_DEFAULT_PATH), conf.font_size_def, FONT_PATH_PREFIX, 0 ); /* initializes default font to size */
    gl_fontInit( &gl_smallFont, _(FONT_DEFAULT_PATH), conf.font_size_small, FONT_PATH_PREFIX, 0 ); /* small font */
    gl_fontInit( &gl_defFontMono, _(FONT_MONOSPACE_PATH), conf.font_size_def, FONT_PATH_PREFIX, 0 );
+   startup_mark( "gl_fontInit" );
 
    /* Detect size changes that occurred after window creation. */
    naev_resize();
 
    /* Display the load screen. */
    loadscreen_load();
+   startup_mark( "loadscreen_load" );
    loadscreen_render( 0., _("Initializing subsystems...") );
    time_ms = SDL_GetTicks();
 
@@ -372,6 +407,7 @@ int main( int argc, char** argv )
    map_system_init(); /* Initialise the solar system map */
    cond_init(); /* Initialize conditional subsystem. */
    cli_init(); /* Initialize console. */
+   startup_mark( "subsystems" );
 
    /* Data loading */
    load_all();
@@ -384,6 +420,7 @@ int main( int argc, char** argv )
 
    /* Start menu. */
    menu_main();
+   startup_mark( "menu_main" );
 
    LOG( _( "Reached main menu" ) );
 
@@ -414,8 +451,22 @@ int main( int argc, char** argv )
       }
 
       main_loop( 1 );
+
+      /* Report once the first frame of the main menu is out. */
+      if (!startup_done) {
+         startup_mark( "first_frame" );
+         if (conf.startup_report != NULL)
+            startup_report( conf.startup_report );
+         array_free( startup_stages );
+         startup_stages = NULL;
+         startup_done   = 1;
+      }
    }
 
+   /* Finish writing the saved game. */
+   save_wait();
+   save_poll();
+
    /* Save configuration. */
    conf_saveConfig(conf_file_path);
 
@@ -533,12 +584,56 @@ void loadscreen_load (void)
 
 
 /**
- * @brief Renders the load screen with message.
+ * @brief Renders the load screen with message, starting a new loading stage.
  *
  *    @param done Amount done (1. == completed).
  *    @param msg Loading screen message.
  */
 void loadscreen_render( double done, const char *msg )
+{
+   loading_done = done;
+   loading_msg  = msg;
+   loadscreen_draw( done, msg );
+   startup_mark( "loadscreen_render" );
+}
+
+
+/**
+ * @brief Updates the load screen from within the current loading stage.
+ *
+ * Used by long stages that would otherwise leave the load screen frozen,
+ *  like while waiting on the threadpool. Only does something while loading
+ *  and at most every LOADING_PROGRESS_MS. Main thread only.
+ *
+ *    @param done Amount of the current stage done (1. == completed).
+ */
+void naev_loadProgress( double done )
+{
+   static Uint32 last = 0;
+   Uint32 t;
+   Uint64 start;
+
+   if (loading_msg == NULL)
+      return;
+   t = SDL_GetTicks();
+   if (t - last < LOADING_PROGRESS_MS)
+      return;
+   last = t;
+
+   /* Don't count the drawing as part of the stage. */
+   start = SDL_GetPerformanceCounter();
+   loadscreen_draw( MIN( 1., loading_done + CLAMP( 0., 1., done ) / LOADING_STAGES ), loading_msg );
+   startup_skip( "loadscreen_render", start );
+}
+
+
+/**
+ * @brief Draws the load screen.
+ *
+ *    @param done Amount done (1. == completed).
+ *    @param msg Loading screen message.
+ */
+static void loadscreen_draw( double done, const char *msg )
 {
    const double SHIP_IMAGE_WIDTH    = 512.;  /**< Loadscreen Ship Image Width */
    const double SHIP_IMAGE_HEIGHT   = 512.; /**< Loadscreen Ship Image Height */
@@ -578,7 +673,7 @@ void loadscreen_render( double done, const char *msg )
    }
 
    /* Draw progress bar. */
-   glUseProgram(shaders.progressbar.program);
+   gl_useProgram(shaders.progressbar.program);
    glUniform1f( shaders.progressbar.paramf, loading_r );
    glUniform1f( shaders.progressbar.dt, done );
    gl_renderShader( x, y, w, h, 0., &shaders.progressbar, NULL, 0 );
@@ -596,6 +691,9 @@ void loadscreen_render( double done, const char *msg )
    /* Flip buffers. HACK: Also try to catch a late-breaking resize from the WM. */
    SDL_GL_SwapWindow( gl_screen.window );
    naev_resize();
+
+   /* Upload graphics decoded in the background so far. */
+   gl_texLoadUpdate( OPENGL_TEX_UPLOAD_BUDGET );
 }
 
 
@@ -604,6 +702,7 @@ void loadscreen_render( double done, const char *msg )
  */
 static void loadscreen_unload (void)
 {
+   loading_msg = NULL;
    gl_freeTexture(loading);
    loading = NULL;
    gl_freeFont( &loading_font );
@@ -611,65 +710,198 @@ static void loadscreen_unload (void)
 }
 
 
+/**
+ * @brief Marks the end of a startup stage.
+ *
+ * Time since the last mark is added to the stage, so stages that run several
+ *  times (like rendering the load screen) accumulate.
+ *
+ *    @param name Name of the stage, must be a constant string. NULL just
+ *           resets the timer.
+ */
+static void startup_mark( const char *name )
+{
+   Uint64 t;
+
+   /* Only time up to the first frame. */
+   if (startup_done)
+      return;
+
+   t = SDL_GetPerformanceCounter();
+   if (startup_start == 0)
+      startup_start = t;
+
+   if ((name != NULL) && (startup_last != 0))
+      startup_add( name, t - startup_last );
+   startup_last = t;
+}
+
+
+/**
+ * @brief Adds time to a startup stage.
+ *
+ *    @param name Name of the stage, must be a constant string.
+ *    @param ticks Time to add in performance counter ticks.
+ */
+static void startup_add( const char *name, Uint64 ticks )
+{
+   int i;
+   StartupStage *st;
+
+   if (startup_stages == NULL)
+      startup_stages = array_create( StartupStage );
+   st = NULL;
+   for (i=0; i<array_size(startup_stages); i++)
+      if (strcmp( startup_stages[i].name, name )==0)
+         st = &startup_stages[i];
+   if (st == NULL) {
+      st       = &array_grow( &startup_stages );
+      st->name = name;
+      st->time = 0.;
+   }
+   st->time += (double)ticks * 1000. / (double)SDL_GetPerformanceFrequency();
+}
+
+
+/**
+ * @brief Moves the time since start out of the stage in progress.
+ *
+ * Unlike startup_mark(), the stage in progress isn't ended.
+ *
+ *    @param name Name of the stage to give the time to, must be a constant string.
+ *    @param start Performance counter at the start of the time to move.
+ */
+static void startup_skip( const char *name, Uint64 start )
+{
+   Uint64 t;
+
+   if (startup_done || (startup_last == 0))
+      return;
+   t = SDL_GetPerformanceCounter();
+   startup_add( name, t - start );
+   startup_last += t - start;
+}
+
+
+/**
+ * @brief Writes the startup timing report as JSON.
+ *
+ *    @param path File to write to.
+ */
+static void startup_report( const char *path )
+{
+   int i, ret;
+   char buf[STRMAX];
+   size_t l;
+   SDL_RWops *rw;
+
+   rw = SDL_RWFromFile( path, "w" );
+   if (rw == NULL) {
+      WARN(_("Unable to open '%s' for writing: %s"), path, SDL_GetError());
+      return;
+   }
+
+   l = scnprintf( buf, sizeof(buf), "{\n   \"version\": \"%s\",\n   \"total_ms\": %.3f,\n   \"stages\": [\n",
+         naev_version(1),
+         (double)(startup_last - startup_start) * 1000. / (double)SDL_GetPerformanceFrequency() );
+   ret = (SDL_RWwrite( rw, buf, l, 1 ) != 1);
+   for (i=0; (i<array_size(startup_stages)) && !ret; i++) {
+      l = scnprintf( buf, sizeof(buf), "      { \"name\": \"%s\", \"ms\": %.3f }%s\n",
+            startup_stages[i].name, startup_stages[i].time,
+            (i < array_size(startup_stages)-1) ? "," : "" );
+      ret = (SDL_RWwrite( rw, buf, l, 1 ) != 1);
+   }
+   if (!ret)
+      ret = (SDL_RWwrite( rw, "   ]\n}\n", strlen("   ]\n}\n"), 1 ) != 1);
+   SDL_RWclose( rw );
+
+   if (ret)
+      WARN(_("Error writing startup report '%s': %s"), path, SDL_GetError());
+   else
+      LOG(_("Wrote startup report to '%s'"), path);
+}
+
+
 /**
  * @brief Loads all the data, makes main() simpler.
  */
-#define LOADING_STAGES     16. /**< Amount of loading stages. */
 void load_all (void)
 {
    /* We can do fast stuff here. */
    sp_load();
+   startup_mark( "sp_load" );
 
    /* order is very important as they're interdependent */
    loadscreen_render(1./LOADING_STAGES, _("Loading Commodities…"));
    commodity_load(); /* dep for space */
+   startup_mark( "commodity_load" );
 
    loadscreen_render(2./LOADING_STAGES, _("Loading Special Effects…"));
    spfx_load(); /* no dep */
+   startup_mark( "spfx_load" );
 
    loadscreen_render(3./LOADING_STAGES, _("Loading Damage Types…"));
    dtype_load(); /* dep for outfits */
+   startup_mark( "dtype_load" );
 
    loadscreen_render(4./LOADING_STAGES, _("Loading Outfits…"));
    outfit_load(); /* dep for ships, factions */
+   startup_mark( "outfit_load" );
 
    loadscreen_render(5./LOADING_STAGES, _("Loading Ships…"));
    ships_load(); /* dep for fleet */
+   startup_mark( "ships_load" );
 
    loadscreen_render(6./LOADING_STAGES, _("Loading Factions…"));
    factions_load(); /* dep for fleet, space, missions, AI */
+   startup_mark( "factions_load" );
 
    loadscreen_render(7./LOADING_STAGES, _("Loading Events…"));
    events_load(); /* no dep */
+   startup_mark( "events_load" );
 
    loadscreen_render(8./LOADING_STAGES, _("Loading Missions…"));
    missions_load(); /* no dep */
+   startup_mark( "missions_load" );
 
    loadscreen_render(9./LOADING_STAGES, _("Loading AI…"));
    ai_load(); /* dep for fleets */
+   startup_mark( "ai_load" );
 
    loadscreen_render(10./LOADING_STAGES, _("Loading Fleets…"));
    fleet_load(); /* dep for space */
+   startup_mark( "fleet_load" );
 
    loadscreen_render(11./LOADING_STAGES, _("Loading Techs…"));
    tech_load(); /* dep for space */
+   startup_mark( "tech_load" );
 
    loadscreen_render(12./LOADING_STAGES, _("Loading the Universe…"));
    space_load();
+   startup_mark( "space_load" );
 
    loadscreen_render(13./LOADING_STAGES, _("Loading the UniDiffs…"));
    diff_loadAvailable();
+   startup_mark( "diff_loadAvailable" );
 
    loadscreen_render(14./LOADING_STAGES, _("Populating Maps…"));
    outfit_mapParse();
+   startup_mark( "outfit_mapParse" );
 
    loadscreen_render(15./LOADING_STAGES, _("Initializing Details…"));
    background_init();
+   startup_mark( "background_init" );
    map_load();
    map_system_load();
+   startup_mark( "map_load" );
    pilots_init();
    weapon_init();
    player_init(); /* Initialize player stuff. */
+   startup_mark( "player_init" );
+   gl_texLoadFlush(); /* Graphics decoded in the background. */
+   gl_transCacheSave();
+   snapshot_save(); /* Before any unidiff gets applied. */
+   startup_mark( "gl_texLoadFlush" );
    loadscreen_render(1., _("Loading Completed!"));
 }
 /**
@@ -735,6 +967,9 @@ void main_loop( int update )
    /* Safe hook should be run every frame regardless of whether game is paused or not. */
    hooks_run( "safe" );
 
+   /* Report saved games that failed to be written in the background. */
+   save_poll();
+
    /* Checks to see if we want to land. */
    space_checkLand();
 
@@ -746,6 +981,11 @@ void main_loop( int update )
       render_all( game_dt, real_dt );
       /* Draw buffer. */
       SDL_GL_SwapWindow( gl_screen.window );
+      /* Upload graphics loaded in the background and unload unused ones. */
+      gl_texLoadUpdate( OPENGL_TEX_UPLOAD_BUDGET );
+      gl_texEvict( (size_t)conf.tex_budget * 1024 * 1024 );
+      /* Collect Lua garbage in the remaining frame time. */
+      nlua_gcStep( conf.lua_gc_budget );
    }
 }
 
@@ -903,6 +1143,9 @@ void display_fps( const double dt )
 {
    double x,y;
    double dt_mod_base = 1.;
+   double heap, gc_time;
+   int sprites, draws;
+   unsigned int calls, avoided;
 
    fps_dt  += dt;
    fps_cur += 1.;
@@ -913,9 +1156,19 @@ void display_fps( const double dt )
 
    x = fps_x;
    y = fps_y;
+   gl_batchStats( &sprites, &draws );
+   gl_stateStats( &calls, &avoided );
    if (conf.fps_show) {
       gl_print( NULL, x, y, NULL, _("%.2f FPS"), fps );
       y -= gl_defFont.h + 5.;
+      nlua_gcStats( &heap, &gc_time );
+      gl_print( NULL, x, y, NULL, _("Lua %.1f MiB, GC %.2f ms"),
+            heap / 1024., gc_time );
+      y -= gl_defFont.h + 5.;
+      gl_print( NULL, x, y, NULL, _("%d sprites in %d draws"), sprites, draws );
+      y -= gl_defFont.h + 5.;
+      gl_print( NULL, x, y, NULL, _("GL state %u calls, %u avoided"), calls, avoided );
+      y -= gl_defFont.h + 5.;
    }
 
    if ((player.p != NULL) && !player_isFlag(PLAYER_DESTROYED) &&
@@ -89,6 +89,7 @@ int naev_versionCompare( const char *version );
 void naev_quit (void);
 int naev_isQuit (void);
 int naev_pollQuit(void);
+void naev_loadProgress( double done );
 double naev_getrealdt (void);
 
 
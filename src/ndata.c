@@ -22,6 +22,13 @@
 #include "SDL.h"
 
 #include "naev.h"
+
+#if HAS_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif /* HAS_POSIX */
 /** @endcond */
 
 #include "ndata.h"
@@ -37,11 +44,19 @@
 #include "nstring.h"
 
 
+#if HAS_POSIX
+static const char **ndata_heap = NULL; /**< Buffers from ndata_map() that were read instead of mapped (array.h). */
+static SDL_SpinLock ndata_heapLock = 0; /**< Protects ndata_heap, ndata_map() is used by workers. */
+#endif /* HAS_POSIX */
+
+
 /*
  * Prototypes.
  */
 static void ndata_testVersion (void);
 static int ndata_found (void);
+static PHYSFS_file* ndata_open( const char* path, PHYSFS_sint64 *len );
+static int ndata_readAll( PHYSFS_file *file, const char *path, char *buf, PHYSFS_sint64 len );
 static int ndata_enumerateCallback( void* data, const char* origdir, const char* fname );
 
 
@@ -145,29 +160,24 @@ void ndata_setupReadDirs (void)
 
 
 /**
- * @brief Reads a file from the ndata.
+ * @brief Opens a regular file from the ndata and gets its length.
  *
- *    @param path Path of the file to read.
- *    @param[out] filesize Stores the size of the file.
- *    @return The file data or NULL on error.
+ *    @param path Path of the file to open.
+ *    @param[out] len Length of the file.
+ *    @return The opened file or NULL on error.
  */
-void* ndata_read( const char* path, size_t *filesize )
+static PHYSFS_file* ndata_open( const char* path, PHYSFS_sint64 *len )
 {
-   char *buf;
    PHYSFS_file *file;
-   PHYSFS_sint64 len, n;
-   size_t pos;
    PHYSFS_Stat path_stat;
 
    if (!PHYSFS_stat( path, &path_stat )) {
       WARN( _( "Error occurred while opening '%s': %s" ), path,
             PHYSFS_getErrorByCode( PHYSFS_getLastErrorCode() ) );
-      *filesize = 0;
       return NULL;
    }
    if (path_stat.filetype != PHYSFS_FILETYPE_REGULAR) {
       WARN( _( "Error occurred while opening '%s': It is not a regular file" ), path );
-      *filesize = 0;
       return NULL;
    }
 
@@ -176,29 +186,35 @@ void* ndata_read( const char* path, size_t *filesize )
    if ( file == NULL ) {
       WARN( _( "Error occurred while opening '%s': %s" ), path,
             PHYSFS_getErrorByCode( PHYSFS_getLastErrorCode() ) );
-      *filesize = 0;
       return NULL;
    }
 
    /* Get file size. TODO: Don't assume this is always possible? */
-   len = PHYSFS_fileLength( file );
-   if ( len == -1 ) {
+   *len = PHYSFS_fileLength( file );
+   if ( *len == -1 ) {
       WARN( _( "Error occurred while seeking '%s': %s" ), path,
             PHYSFS_getErrorByCode( PHYSFS_getLastErrorCode() ) );
       PHYSFS_close( file );
-      *filesize = 0;
       return NULL;
    }
 
-   /* Allocate buffer. */
-   buf = malloc( len+1 );
-   if (buf == NULL) {
-      WARN(_("Out of Memory"));
-      PHYSFS_close( file );
-      *filesize = 0;
-      return NULL;
-   }
-   buf[len] = '\0';
+   return file;
+}
+
+
+/**
+ * @brief Reads a whole opened file from the ndata and closes it.
+ *
+ *    @param file File to read.
+ *    @param path Path of the file, for warnings.
+ *    @param buf Buffer to read into.
+ *    @param len Length of the file.
+ *    @return 0 on success.
+ */
+static int ndata_readAll( PHYSFS_file *file, const char *path, char *buf, PHYSFS_sint64 len )
+{
+   PHYSFS_sint64 n;
+   size_t pos;
 
    /* Read the file. */
    n = 0;
@@ -208,21 +224,188 @@ void* ndata_read( const char* path, size_t *filesize )
          WARN( _( "Error occurred while reading '%s': %s" ), path,
             PHYSFS_getErrorByCode( PHYSFS_getLastErrorCode() ) );
          PHYSFS_close( file );
-         *filesize = 0;
-         free(buf);
-         return NULL;
+         return -1;
       }
       n += pos;
    }
 
    /* Close the file. */
    PHYSFS_close(file);
+   return 0;
+}
+
+
+/**
+ * @brief Reads a file from the ndata.
+ *
+ *    @param path Path of the file to read.
+ *    @param[out] filesize Stores the size of the file.
+ *    @return The file data or NULL on error.
+ */
+void* ndata_read( const char* path, size_t *filesize )
+{
+   char *buf;
+   PHYSFS_file *file;
+   PHYSFS_sint64 len;
+
+   *filesize = 0;
+   file = ndata_open( path, &len );
+   if (file == NULL)
+      return NULL;
+
+   /* Allocate buffer. */
+   buf = malloc( len+1 );
+   if (buf == NULL) {
+      WARN(_("Out of Memory"));
+      PHYSFS_close( file );
+      return NULL;
+   }
+   buf[len] = '\0';
+
+   if (ndata_readAll( file, path, buf, len )) {
+      free(buf);
+      return NULL;
+   }
 
    *filesize = len;
    return buf;
 }
 
 
+/**
+ * @brief Maps a file from the ndata into memory, avoiding copies if possible.
+ *
+ * Files that come from a plain directory are memory mapped directly, while
+ *  files in archives are read into a copy. The data is read-only, it is not
+ *  NUL terminated and it must be released with ndata_unmap(). Safe to call
+ *  from worker threads.
+ *
+ *    @param path Path of the file to map.
+ *    @param[out] filesize Stores the size of the file.
+ *    @return The file data or NULL on error.
+ */
+const char* ndata_map( const char* path, size_t *filesize )
+{
+#if HAS_POSIX
+   const char *realdir;
+   char realpath[PATH_MAX];
+   struct stat st;
+   const char *data;
+   void *buf;
+   PHYSFS_file *file;
+   PHYSFS_sint64 len;
+
+   *filesize = 0;
+
+   /* Directly map files in directories. */
+   realdir = PHYSFS_getRealDir( path );
+   if ((realdir != NULL) && (stat( realdir, &st ) == 0) && S_ISDIR(st.st_mode)) {
+      snprintf( realpath, sizeof(realpath), "%s/%s", realdir, path );
+      data = ndata_mapFile( realpath, filesize );
+      if (data != NULL)
+         return data;
+   }
+
+   /* Archives are read into memory, remember it so ndata_unmap() frees it. */
+   file = ndata_open( path, &len );
+   if (file == NULL)
+      return NULL;
+   buf = malloc( MAX(1,len) );
+   if (buf == NULL) {
+      WARN(_("Out of Memory"));
+      PHYSFS_close( file );
+      return NULL;
+   }
+   if (ndata_readAll( file, path, buf, len )) {
+      free( buf );
+      return NULL;
+   }
+   SDL_AtomicLock( &ndata_heapLock );
+   if (ndata_heap == NULL)
+      ndata_heap = array_create( const char* );
+   array_push_back( &ndata_heap, buf );
+   SDL_AtomicUnlock( &ndata_heapLock );
+   *filesize = len;
+   return buf;
+#else /* HAS_POSIX */
+   return ndata_read( path, filesize );
+#endif /* HAS_POSIX */
+}
+
+
+/**
+ * @brief Maps a file from the real filesystem, outside of the ndata.
+ *
+ * Meant for files the game writes itself, like caches. Doesn't log, empty or
+ *  missing files simply give NULL. Release with ndata_unmap().
+ *
+ *    @param path Real path of the file to map.
+ *    @param[out] filesize Stores the size of the file.
+ *    @return The file data or NULL on error.
+ */
+const char* ndata_mapFile( const char* path, size_t *filesize )
+{
+#if HAS_POSIX
+   struct stat st;
+   int fd;
+   void *buf;
+
+   *filesize = 0;
+   fd = open( path, O_RDONLY );
+   if (fd < 0)
+      return NULL;
+   buf = MAP_FAILED;
+   if ((fstat( fd, &st ) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0))
+      buf = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+   close( fd );
+   if (buf == MAP_FAILED)
+      return NULL;
+   *filesize = st.st_size;
+   return buf;
+#else /* HAS_POSIX */
+   if (!nfile_fileExists( path ))
+      return NULL;
+   return nfile_readFile( filesize, path );
+#endif /* HAS_POSIX */
+}
+
+
+/**
+ * @brief Releases a file mapped with ndata_map() or ndata_mapFile().
+ *
+ *    @param data Data of the file, may be NULL.
+ *    @param filesize Size of the file as returned by ndata_map().
+ */
+void ndata_unmap( const char *data, size_t filesize )
+{
+#if HAS_POSIX
+   int i, heap;
+#endif /* HAS_POSIX */
+
+   if (data == NULL)
+      return;
+#if HAS_POSIX
+   heap = 0;
+   SDL_AtomicLock( &ndata_heapLock );
+   for (i=0; i<array_size(ndata_heap); i++) {
+      if (ndata_heap[i] == data) {
+         array_erase( &ndata_heap, &ndata_heap[i], &ndata_heap[i+1] );
+         heap = 1;
+         break;
+      }
+   }
+   SDL_AtomicUnlock( &ndata_heapLock );
+   if (heap)
+      free( (void*)data );
+   else
+      munmap( (void*)data, MAX(1,filesize) );
+#else /* HAS_POSIX */
+   (void) filesize;
+   free( (void*)data );
+#endif /* HAS_POSIX */
+}
+
+
 /**
  * @brief Lists all the visible files in a directory, at any depth.
  *
@@ -82,6 +82,9 @@
 void ndata_setupWriteDir (void);
 void ndata_setupReadDirs (void);
 void* ndata_read( const char* filename, size_t *filesize );
+const char* ndata_map( const char* filename, size_t *filesize );
+const char* ndata_mapFile( const char* path, size_t *filesize );
+void ndata_unmap( const char *data, size_t filesize );
 char** ndata_listRecursive( const char *path );
 int ndata_backupIfExists( const char *path );
 int ndata_copyIfExists( const char *path1, const char *path2 );
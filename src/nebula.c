@@ -114,7 +114,7 @@ int nebu_resize (void)
    nebu_render_w = fbo_w;
    nebu_render_h = fbo_h;
    nebu_dofbo = (nebu_scale != 1.);
-   glDeleteTextures( 1, &nebu_tex );
+   gl_deleteTextures( 1, &nebu_tex );
    glDeleteFramebuffers( 1, &nebu_fbo );
 
    if (nebu_dofbo)
@@ -124,11 +124,11 @@ int nebu_resize (void)
    nebu_render_P = gl_Matrix4_Identity();
    nebu_render_P = gl_Matrix4_Translate(nebu_render_P, -nebu_render_w/2., -nebu_render_h/2., 0. );
    nebu_render_P = gl_Matrix4_Scale(nebu_render_P, nebu_render_w, nebu_render_h, 1);
-   glUseProgram(shaders.nebula_background.program);
+   gl_useProgram(shaders.nebula_background.program);
    gl_Matrix4_Uniform(shaders.nebula_background.projection, nebu_render_P);
-   glUseProgram(shaders.nebula.program);
+   gl_useProgram(shaders.nebula.program);
    gl_Matrix4_Uniform(shaders.nebula.projection, nebu_render_P);
-   glUseProgram(0);
+   gl_useProgram(0);
 
    return 0;
 }
@@ -158,7 +158,7 @@ void nebu_exit (void)
 
    if (nebu_dofbo) {
       glDeleteFramebuffers( 1, &nebu_fbo );
-      glDeleteTextures( 1, &nebu_tex );
+      gl_deleteTextures( 1, &nebu_tex );
    }
 }
 
@@ -191,7 +191,7 @@ static void nebu_renderBackground( const double dt )
    }
 
    /* Start the program. */
-   glUseProgram(shaders.nebula_background.program);
+   gl_useProgram(shaders.nebula_background.program);
 
    /* Set shader uniforms. */
    glUniform1f(shaders.nebula_background.eddy_scale, nebu_view * cam_getZoom() / nebu_scale);
@@ -199,14 +199,14 @@ static void nebu_renderBackground( const double dt )
    glUniform1f(shaders.nebula_background.brightness, conf.bg_brightness);
 
    /* Draw. */
-   glEnableVertexAttribArray( shaders.nebula_background.vertex );
+   gl_enableVertexAttribArray( shaders.nebula_background.vertex );
    gl_vboActivateAttribOffset( gl_squareVBO, shaders.nebula_background.vertex, 0, 2, GL_FLOAT, 0 );
    glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
    nebu_blitFBO();
 
    /* Clean up. */
-   glDisableVertexAttribArray( shaders.nebula_background.vertex );
-   glUseProgram(0);
+   gl_disableVertexAttribArray( shaders.nebula_background.vertex );
+   gl_useProgram(0);
    gl_checkErr();
 }
 
@@ -219,11 +219,11 @@ static void nebu_blitFBO (void)
    if (nebu_dofbo) {
       glBindFramebuffer(GL_FRAMEBUFFER, gl_screen.current_fbo);
 
-      glUseProgram(shaders.texture.program);
+      gl_useProgram(shaders.texture.program);
 
-      glBindTexture( GL_TEXTURE_2D, nebu_tex );
+      gl_bindTexture( GL_TEXTURE_2D, nebu_tex );
 
-      glEnableVertexAttribArray( shaders.texture.vertex );
+      gl_enableVertexAttribArray( shaders.texture.vertex );
       gl_vboActivateAttribOffset( gl_squareVBO, shaders.texture.vertex,
             0, 2, GL_FLOAT, 0 );
 
@@ -236,7 +236,7 @@ static void nebu_blitFBO (void)
       glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
 
       /* Clear state. */
-      glDisableVertexAttribArray( shaders.texture.vertex );
+      gl_disableVertexAttribArray( shaders.texture.vertex );
    }
 }
 
@@ -283,7 +283,7 @@ void nebu_renderOverlay( const double dt )
    }
 
    /* Start the program. */
-   glUseProgram(shaders.nebula.program);
+   gl_useProgram(shaders.nebula.program);
 
    /* Set shader uniforms. */
    glUniform1f(shaders.nebula.horizon, nebu_view * z / nebu_scale);
@@ -292,15 +292,15 @@ void nebu_renderOverlay( const double dt )
    glUniform1f(shaders.nebula.brightness, conf.bg_brightness);
 
    /* Draw. */
-   glEnableVertexAttribArray(shaders.nebula.vertex);
+   gl_enableVertexAttribArray(shaders.nebula.vertex);
    gl_vboActivateAttribOffset( gl_squareVBO, shaders.nebula.vertex, 0, 2, GL_FLOAT, 0 );
    glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
    nebu_blitFBO();
 
    /* Clean up. */
-   glDisableVertexAttribArray( shaders.nebula.vertex );
+   gl_disableVertexAttribArray( shaders.nebula.vertex );
    glClearColor( 0., 0., 0., 1. );
-   glUseProgram(0);
+   gl_useProgram(0);
    gl_checkErr();
 
    /* Reset puff movement. */
@@ -380,17 +380,17 @@ void nebu_prep( double density, double volatility, double hue )
 
    /* Set the hue. */
    nebu_hue = hue;
-   glUseProgram(shaders.nebula.program);
+   gl_useProgram(shaders.nebula.program);
    glUniform1f(shaders.nebula.hue, nebu_hue);
-   glUseProgram(shaders.nebula_background.program);
+   gl_useProgram(shaders.nebula_background.program);
    glUniform1f(shaders.nebula_background.hue, nebu_hue);
-   glUseProgram(0);
+   gl_useProgram(0);
 
    /* Also set the hue for trails */
    col_hsv2rgb( &col, nebu_hue*360., 0.7, 1.0 );
-   glUseProgram(shaders.trail.program);
+   gl_useProgram(shaders.trail.program);
    glUniform3f( shaders.trail.nebu_col, col.r, col.g, col.b );
-   glUseProgram(0);
+   gl_useProgram(0);
 
    /* Set density parameters. */
    nebu_density = density;
@@ -376,10 +376,6 @@ int nfile_backupIfExists( const char *path )
  */
 int nfile_copyIfExists( const char* file1, const char* file2 )
 {
-   FILE *f_in, *f_out;
-   char buf[ 8*1024 ];
-   size_t lr, lw;
-
    if (file1 == NULL)
       return -1;
 
@@ -387,15 +383,41 @@ int nfile_copyIfExists( const char* file1, const char* file2 )
    if (!nfile_fileExists(file1))
       return 0;
 
+   if (nfile_copy( file1, file2 ) < 0) {
+      WARN( _("Failure to copy '%s' to '%s': %s"), file1, file2, strerror(errno) );
+      return -1;
+   }
+
+   return 0;
+}
+
+
+/**
+ * @brief Copies a file.
+ *
+ * Doesn't log anything so it can be used from worker threads, errno is set
+ *  on failure.
+ *
+ *    @param file1 Filename to copy from.
+ *    @param file2 Filename to copy to.
+ *    @return 0 on success, -1 on error.
+ */
+int nfile_copy( const char* file1, const char* file2 )
+{
+   FILE *f_in, *f_out;
+   char buf[ 8*1024 ];
+   size_t lr, lw;
+   int err;
+
    /* Open files. */
    f_in  = fopen( file1, "rb" );
+   if (f_in == NULL)
+      return -1;
    f_out = fopen( file2, "wb" );
-   if ((f_in==NULL) || (f_out==NULL)) {
-      WARN( _("Failure to copy '%s' to '%s': %s"), file1, file2, strerror(errno) );
-      if (f_in!=NULL)
-         fclose(f_in);
-      if (f_out!=NULL)
-         fclose(f_out);
+   if (f_out == NULL) {
+      err = errno;
+      fclose(f_in);
+      errno = err;
       return -1;
    }
 
@@ -417,14 +439,16 @@ int nfile_copyIfExists( const char* file1, const char* file2 )
 
    /* Close files. */
    fclose( f_in );
-   fclose( f_out );
+   if (fclose( f_out ) == EOF)
+      return -1;
 
    return 0;
 
 err:
-   WARN( _("Failure to copy '%s' to '%s': %s"), file1, file2, strerror(errno) );
+   err = errno;
    fclose( f_in );
    fclose( f_out );
+   errno = err;
 
    return -1;
 }
@@ -588,6 +612,76 @@ int nfile_writeFile( const char *data, size_t len, const char *path )
 }
 
 
+/**
+ * @brief Renames a file, replacing the destination if it exists.
+ *
+ * The destination is never left missing, it is either the old or the new
+ *  file. Doesn't log anything so it can be used from worker threads, errno
+ *  is set on failure.
+ *
+ *    @param from Path of the file to rename.
+ *    @param to New path of the file.
+ *    @return 0 on success, -1 on error.
+ */
+int nfile_rename( const char *from, const char *to )
+{
+#if WIN32
+   if (!MoveFileExA( from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH )) {
+      errno = (GetLastError() == ERROR_ACCESS_DENIED) ? EACCES : EIO;
+      return -1;
+   }
+#else /* WIN32 */
+   if (rename( from, to ) != 0)
+      return -1;
+#endif /* WIN32 */
+   return 0;
+}
+
+
+/**
+ * @brief Removes a directory along with the files in it.
+ *
+ * Subdirectories aren't descended into, so the removal fails if there are
+ *  any. Doesn't log anything, errno is set on failure.
+ *
+ *    @param path Path of the directory to remove.
+ *    @return 0 on success, -1 on error.
+ */
+int nfile_dirRemove( const char *path )
+{
+   DIR *d;
+   struct dirent *de;
+   char file[PATH_MAX];
+   int ret;
+
+   d = opendir( path );
+   if (d == NULL)
+      return -1;
+   ret = 0;
+   while ((de = readdir( d )) != NULL) {
+      if ((strcmp( de->d_name, "." ) == 0) || (strcmp( de->d_name, ".." ) == 0))
+         continue;
+      snprintf( file, sizeof(file), "%s/%s", path, de->d_name );
+      if (remove( file ) != 0)
+         ret = -1;
+   }
+   closedir( d );
+   if (ret)
+      return -1;
+
+#if WIN32
+   if (!RemoveDirectoryA( path )) {
+      errno = (GetLastError() == ERROR_ACCESS_DENIED) ? EACCES : EIO;
+      return -1;
+   }
+#else /* WIN32 */
+   if (rmdir( path ) != 0)
+      return -1;
+#endif /* WIN32 */
+   return 0;
+}
+
+
 /**
  * @brief Checks to see if a character is used to separate files in a path.
  *
@@ -36,9 +36,12 @@ int nfile_dirExists( const char *path );
 int nfile_fileExists( const char *path ); /* Returns 1 on exists */
 int nfile_backupIfExists( const char *path );
 int nfile_copyIfExists( const char *path1, const char *path2 );
+int nfile_copy( const char *path1, const char *path2 );
 char *nfile_readFile( size_t *filesize, const char *path );
 int nfile_touch( const char *path );
 int nfile_writeFile( const char *data, size_t len, const char *path );
+int nfile_rename( const char *from, const char *to );
+int nfile_dirRemove( const char *path );
 int nfile_isSeparator( uint32_t c );
 
 
@@ -35,6 +35,7 @@
 #include "nlua_pilot.h"
 #include "nlua_planet.h"
 #include "nlua_player.h"
+#include "nlua_prof.h"
 #include "nlua_rnd.h"
 #include "nlua_shiplog.h"
 #include "nlua_system.h"
@@ -45,9 +46,20 @@
 #include "nstring.h"
 
 
+#define NLUA_GC_STEPSIZE   4 /**< Size of each incremental collection step (KiB). */
+#define NLUA_GC_GROWTH     1.25 /**< Heap growth since the last collection which starts a new cycle. */
+
+
 lua_State *naevL = NULL;
 nlua_env __NLUA_CURENV = LUA_NOREF;
 
+/*
+ * Garbage collection.
+ */
+static int nlua_gc_cycle      = 0; /**< Whether an incremental cycle is in progress. */
+static double nlua_gc_base    = 0.; /**< Heap size after the last finished cycle (KiB). */
+static double nlua_gc_time    = 0.; /**< Smoothed time spent collecting per frame (ms). */
+
 
 /*
  * prototypes
@@ -186,11 +198,63 @@ void lua_init(void) {
  * @brief Closes the global Lua state.
  */
 void lua_exit(void) {
+   nlua_profFree();
    lua_close(naevL);
    naevL = NULL;
 }
 
 
+/**
+ * @brief Runs the Lua garbage collector incrementally within a time budget.
+ *
+ * Meant to be called once per frame after rendering, so that garbage is
+ * collected in small steps instead of in large pauses whenever Lua decides.
+ * A new collection cycle is only started once the heap has grown enough since
+ * the last one finished. Lua's own collector is left running as a safety net
+ * for when the budget is not enough to keep up.
+ *
+ *    @param budget Maximum time to spend collecting (ms), 0 disables stepping.
+ */
+void nlua_gcStep( double budget )
+{
+   Uint64 start, end;
+   double freq, dt;
+
+   dt = 0.;
+   if ((budget > 0.) && (nlua_gc_cycle
+         || (lua_gc(naevL, LUA_GCCOUNT, 0) >= nlua_gc_base * NLUA_GC_GROWTH))) {
+      nlua_gc_cycle = 1;
+      freq  = (double)SDL_GetPerformanceFrequency();
+      start = SDL_GetPerformanceCounter();
+      do {
+         if (lua_gc(naevL, LUA_GCSTEP, NLUA_GC_STEPSIZE)) {
+            nlua_gc_cycle  = 0;
+            nlua_gc_base   = lua_gc(naevL, LUA_GCCOUNT, 0);
+         }
+         end = SDL_GetPerformanceCounter();
+         dt  = (double)(end - start) * 1000. / freq;
+      } while (nlua_gc_cycle && (dt < budget));
+   }
+
+   /* Smooth out for display. */
+   nlua_gc_time = 0.9*nlua_gc_time + 0.1*dt;
+}
+
+
+/**
+ * @brief Gets the Lua heap and garbage collection statistics.
+ *
+ *    @param[out] heap Current size of the Lua heap (KiB).
+ *    @param[out] time Average time spent collecting per frame (ms).
+ */
+void nlua_gcStats( double *heap, double *time )
+{
+   *heap = (double)lua_gc(naevL, LUA_GCCOUNT, 0)
+         + (double)lua_gc(naevL, LUA_GCCOUNTB, 0) / 1024.;
+   *time = nlua_gc_time;
+}
+
+
 /*
  * @brief Run code from buffer in Lua environment.
  *
@@ -457,10 +521,11 @@ static int nlua_require( lua_State* L )
    const char *filename;
    size_t bufsize, len_tried_paths;
    int envtab;
-   char *buf, *q;
+   char *q;
+   const char *buf;
    char path_filename[PATH_MAX], tmpname[PATH_MAX], tried_paths[STRMAX];
    const char *packagepath, *start, *end;
-   int i, done;
+   int i, done, ret;
 
    /* Environment table to load module into */
    envtab = lua_upvalueindex(1);
@@ -540,7 +605,7 @@ static int nlua_require( lua_State* L )
 
       /* Try to load the file. */
       if (PHYSFS_exists( path_filename )) {
-         buf = ndata_read( path_filename, &bufsize );
+         buf = ndata_map( path_filename, &bufsize );
          if (buf != NULL)
             break;
       }
@@ -558,8 +623,10 @@ static int nlua_require( lua_State* L )
       return 1;
    }
 
-   /* Try to process the Lua. */
-   if (luaL_loadbuffer(L, buf, bufsize, path_filename) != 0) {
+   /* Try to process the Lua, the chunk no longer needs the file. */
+   ret = luaL_loadbuffer(L, buf, bufsize, path_filename);
+   ndata_unmap( buf, bufsize );
+   if (ret != 0) {
       lua_error(L);
       return 1;
    }
@@ -589,8 +656,7 @@ static int nlua_require( lua_State* L )
    lua_setfield(L, -2, filename);            /* val, t */
    lua_pop(L, 1);                            /* val */
 
-   /* cleanup, success */
-   free(buf);
+   /* success */
    return 1;
 }
 
@@ -692,7 +758,12 @@ int nlua_errTrace( lua_State *L )
  *    @param nresults Number of return values to take.
  */
 int nlua_pcall( nlua_env env, int nargs, int nresults ) {
-   int errf, ret, prev_env;
+   int errf, ret, prev_env, prof;
+
+   /* Profile by function, has to be done before the stack is touched. */
+   prof = nlua_profiling;
+   if (prof)
+      nlua_profEnterFunc( -1-nargs );
 
 #if DEBUGGING
    int top = lua_gettop(naevL);
@@ -714,6 +785,9 @@ int nlua_pcall( nlua_env env, int nargs, int nresults ) {
    lua_remove(naevL, top-nargs);
 #endif /* DEBUGGING */
 
+   if (prof)
+      nlua_profLeave();
+
    return ret;
 }
 
@@ -49,5 +49,11 @@ int nlua_pcall( nlua_env env, int nargs, int nresults );
 int nlua_refenv( nlua_env env, const char *name );
 int nlua_refenvtype( nlua_env env, const char *name, int type );
 
+/*
+ * Garbage collection.
+ */
+void nlua_gcStep( double budget );
+void nlua_gcStats( double *heap, double *time );
+
 
 #endif /* NLUA_H */
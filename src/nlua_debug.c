@@ -18,13 +18,27 @@
 #include "nlua_debug.h"
 
 #include "debug.h"
+#include "nlua_prof.h"
 #include "nluadef.h"
+#include "opengl.h"
 
 /* Debug metatable methods. */
 
 static int debugL_showEmitters( lua_State *L );
+static int debugL_profileStart( lua_State *L );
+static int debugL_profileStop( lua_State *L );
+static int debugL_profileReset( lua_State *L );
+static int debugL_profileReport( lua_State *L );
+static int debugL_profileDump( lua_State *L );
+static int debugL_textureReport( lua_State *L );
 static const luaL_Reg debugL_methods[] = {
    { "showEmitters", debugL_showEmitters },
+   { "profileStart", debugL_profileStart },
+   { "profileStop", debugL_profileStop },
+   { "profileReset", debugL_profileReset },
+   { "profileReport", debugL_profileReport },
+   { "profileDump", debugL_profileDump },
+   { "textureReport", debugL_textureReport },
    {0,0}
 }; /**< Debug metatable methods. */
 
@@ -78,3 +92,110 @@ static int debugL_showEmitters( lua_State *L )
 
    return 0;
 }
+
+
+/**
+ * @brief Starts the Lua profiler.
+ *
+ * Wall time and Lua allocations are collected for hooks, AI tasks, outfit
+ * scripts, spawn schedulers and every Lua function called from the engine.
+ *
+ * @usage debug.profileStart()
+ *
+ *    @luatparam[opt=false] boolean reset Whether to clear previously collected data.
+ * @luafunc profileStart
+ */
+static int debugL_profileStart( lua_State *L )
+{
+   NLUA_CHECKRW(L);
+   if (lua_toboolean(L, 1))
+      nlua_profReset();
+   nlua_profStart();
+   return 0;
+}
+
+
+/**
+ * @brief Stops the Lua profiler, keeping the collected data.
+ *
+ * @usage debug.profileStop()
+ * @luafunc profileStop
+ */
+static int debugL_profileStop( lua_State *L )
+{
+   NLUA_CHECKRW(L);
+   nlua_profStop();
+   return 0;
+}
+
+
+/**
+ * @brief Clears the data collected by the Lua profiler.
+ *
+ * @usage debug.profileReset()
+ * @luafunc profileReset
+ */
+static int debugL_profileReset( lua_State *L )
+{
+   NLUA_CHECKRW(L);
+   nlua_profReset();
+   return 0;
+}
+
+
+/**
+ * @brief Gets a summary of the frames with the most self time.
+ *
+ * @usage print( debug.profileReport() )
+ *
+ *    @luatparam[opt=20] number n Number of frames to list.
+ *    @luatreturn string The report.
+ * @luafunc profileReport
+ */
+static int debugL_profileReport( lua_State *L )
+{
+   char *report = nlua_profReport( luaL_optinteger(L, 1, 20) );
+   lua_pushstring(L, report);
+   free(report);
+   return 1;
+}
+
+
+/**
+ * @brief Dumps the collected data as folded stacks for flamegraph tools.
+ *
+ * @usage debug.profileDump() -- Writes time in microseconds to "profile.folded"
+ * @usage debug.profileDump( "alloc.folded", true ) -- Writes Lua allocations in bytes
+ *
+ *    @luatparam[opt="profile.folded"] string filename File to write in the write directory.
+ *    @luatparam[opt=false] boolean alloc Whether to weight by allocations instead of time.
+ *    @luatreturn boolean true on success.
+ * @luafunc profileDump
+ */
+static int debugL_profileDump( lua_State *L )
+{
+   const char *filename;
+
+   NLUA_CHECKRW(L);
+   filename = luaL_optstring(L, 1, "profile.folded");
+   lua_pushboolean(L, nlua_profDump( filename, lua_toboolean(L, 2) )==0);
+   return 1;
+}
+
+
+/**
+ * @brief Gets a summary of the video memory used by textures.
+ *
+ * @usage print( debug.textureReport() )
+ *
+ *    @luatparam[opt=20] number n Number of textures to list, largest first.
+ *    @luatreturn string The report.
+ * @luafunc textureReport
+ */
+static int debugL_textureReport( lua_State *L )
+{
+   char *report = gl_texReport( luaL_optinteger(L, 1, 20) );
+   lua_pushstring(L, report);
+   free(report);
+   return 1;
+}
@@ -62,20 +62,44 @@ int nlua_loadDiff( nlua_env env )
  * diff.apply( "collective_dead" )
  * @endcode
  *
+ * Several diffs applied at once should be passed as a table, so the universe
+ *  is only rebuilt once:
+ * @code
+ * diff.apply{ "FLF_base", "flf_dead" }
+ * @endcode
+ *
  * @luamod diff
  */
 /**
  * @brief Applies a diff by name.
  *
- *    @luatparam string name Name of the diff to apply.
+ *    @luatparam string|table name Name of the diff to apply, or a table of
+ *       names to apply all of them with a single rebuild of the universe.
  * @luafunc apply
  */
 static int diff_applyL( lua_State *L )
 {
    const char *name;
+   int i, n;
 
    NLUA_CHECKRW(L);
 
+   if (lua_istable(L,1)) {
+      n = lua_objlen(L,1);
+      diff_begin();
+      for (i=1; i<=n; i++) {
+         lua_rawgeti(L,1,i);
+         name = lua_tostring(L,-1);
+         if (name != NULL)
+            diff_apply( name );
+         else
+            WARN(_("diff.apply: element %d of the table is not a string!"), i);
+         lua_pop(L,1);
+      }
+      diff_commit();
+      return 0;
+   }
+
    name = luaL_checkstring(L,1);
 
    diff_apply( name );
@@ -301,31 +301,31 @@ static int gfxL_renderTexH( lua_State *L )
    col   = luaL_optcolour(L,4,&cWhite);
    TH    = luaL_opttransform( L,5,&ID );
 
-   glUseProgram( shader->program );
+   gl_useProgram( shader->program );
 
    /* Set the vertex. */
-   glEnableVertexAttribArray( shader->VertexPosition );
+   gl_enableVertexAttribArray( shader->VertexPosition );
    gl_vboActivateAttribOffset( gl_squareVBO, shader->VertexPosition,
          0, 2, GL_FLOAT, 0 );
 
    /* Set up texture vertices if necessary. */
    if (shader->VertexTexCoord >= 0) {
       gl_Matrix4_Uniform( shader->ViewSpaceFromLocal, *TH );
-      glEnableVertexAttribArray( shader->VertexTexCoord );
+      gl_enableVertexAttribArray( shader->VertexTexCoord );
       gl_vboActivateAttribOffset( gl_squareVBO, shader->VertexTexCoord,
             0, 2, GL_FLOAT, 0 );
    }
 
    /* Set the texture(s). */
-   glBindTexture( GL_TEXTURE_2D, t->texture );
+   gl_bindTexture( GL_TEXTURE_2D, gl_texResident( t ) );
    glUniform1i( shader->MainTex, 0 );
    for (int i=0; i<array_size(shader->tex); i++) {
       LuaTexture_t *t = &shader->tex[i];
-      glActiveTexture( t->active );
-      glBindTexture( GL_TEXTURE_2D, t->texid );
+      gl_activeTexture( t->active );
+      gl_bindTexture( GL_TEXTURE_2D, (t->tex != NULL) ? gl_texResident( t->tex ) : 0 );
       glUniform1i( t->uniform, t->value );
    }
-   glActiveTexture( GL_TEXTURE0 );
+   gl_activeTexture( GL_TEXTURE0 );
 
    /* Set shader uniforms. */
    gl_uniformColor( shader->ConstantColor, col );
@@ -335,14 +335,14 @@ static int gfxL_renderTexH( lua_State *L )
    glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
 
    /* Clear state. */
-   glDisableVertexAttribArray( shader->VertexPosition );
+   gl_disableVertexAttribArray( shader->VertexPosition );
    if (shader->VertexTexCoord >= 0)
-      glDisableVertexAttribArray( shader->VertexTexCoord );
+      gl_disableVertexAttribArray( shader->VertexTexCoord );
 
    /* anything failed? */
    gl_checkErr();
 
-   glUseProgram(0);
+   gl_useProgram(0);
 
    return 0;
 }
@@ -836,7 +836,7 @@ static int gfxL_setBlendMode( lua_State *L )
       NLUA_INVALID_PARAMETER(L);
 
    glBlendEquation(func);
-   glBlendFuncSeparate(srcRGB, dstRGB, srcA, dstA);
+   gl_blendFuncSeparate(srcRGB, dstRGB, srcA, dstA);
    gl_checkErr();
 
    return 0;
@@ -353,7 +353,11 @@ static int naevL_conf( lua_State *L )
    PUSH_BOOL( L, "devmode", conf.devmode );
    PUSH_BOOL( L, "devautosave", conf.devautosave );
    PUSH_BOOL( L, "conf_nosave", conf.nosave );
+   PUSH_DOUBLE( L, "lua_gc_budget", conf.lua_gc_budget );
+   PUSH_INT( L, "tex_budget", conf.tex_budget );
+   PUSH_BOOL( L, "universe_snapshot", conf.universe_snapshot );
    PUSH_BOOL( L, "fpu_except", conf.fpu_except );
+   PUSH_BOOL( L, "diff_verify", conf.diff_verify );
    PUSH_STRING( L, "dev_save_sys", conf.dev_save_sys );
    PUSH_STRING( L, "dev_save_map", conf.dev_save_map );
    PUSH_STRING( L, "dev_save_asset", conf.dev_save_asset );
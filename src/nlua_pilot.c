@@ -37,12 +37,30 @@
 #include "nlua_vec2.h"
 #include "nluadef.h"
 #include "pilot.h"
+#include "pilot_grid.h"
 #include "pilot_heat.h"
 #include "player.h"
 #include "rng.h"
 #include "space.h"
 #include "weapon.h"
 
+
+#define PILOT_CACHE  "pilot_cache" /**< Registry field of the pilot userdata cache. */
+
+
+/**
+ * @brief Contents of a pilot userdata.
+ *
+ * The ID must be the first member, as the rest of the code only ever sees the
+ * userdata as a LuaPilot.
+ */
+typedef struct LuaPilotData_ {
+   LuaPilot id; /**< ID of the pilot. */
+   Pilot *p; /**< Cached pilot, only valid while gen matches the pilot generation. */
+   unsigned int gen; /**< Pilot generation when p was looked up. */
+} LuaPilotData;
+
+
 /*
  * From ai.c
  */
@@ -56,6 +74,8 @@ static Task *pilotL_newtask( lua_State *L, Pilot* p, const char *task );
 static int pilotL_addFleetFrom( lua_State *L, int from_ship );
 static int outfit_compareActive( const void *slot1, const void *slot2 );
 static int pilotL_setFlagWrapper( lua_State *L, int flag );
+static int pilotL_gridHostile( const Pilot *p, const Pilot *target, void *data );
+static int pilotL_gridVisible( const Pilot *p, const Pilot *target, void *data );
 
 
 /* Pilot metatable methods. */
@@ -332,6 +352,9 @@ static int pilotL_setFlagWrapper( lua_State *L, int flag )
    else
       pilot_rmFlag( p, flag );
 
+   /* Visibility flags are cached by the grid. */
+   pilot_gridInvalidate();
+
    return 0;
 }
 
@@ -358,7 +381,7 @@ static int pilotL_setFlagWrapper( lua_State *L, int flag )
  */
 LuaPilot lua_topilot( lua_State *L, int ind )
 {
-   return *((LuaPilot*) lua_touserdata(L,ind));
+   return ((LuaPilotData*) lua_touserdata(L,ind))->id;
 }
 /**
  * @brief Gets pilot at index or raises error if there is no pilot at index.
@@ -377,38 +400,97 @@ LuaPilot luaL_checkpilot( lua_State *L, int ind )
 /**
  * @brief Makes sure the pilot is valid or raises a Lua error.
  *
+ * The pilot pointer is cached in the userdata and reused for as long as the
+ * pilot generation doesn't change, which avoids searching the pilot stack
+ * every time a pilot method is called.
+ *
  *    @param L State currently running.
  *    @param ind Index of the pilot to validate.
  *    @return The pilot (doesn't return if fails - raises Lua error ).
  */
 Pilot* luaL_validpilot( lua_State *L, int ind )
 {
+   LuaPilotData *lp;
    Pilot *p;
+   unsigned int gen;
+
+   if (!lua_ispilot(L,ind)) {
+      luaL_typerror(L, ind, PILOT_METATABLE);
+      return NULL;
+   }
+   lp  = (LuaPilotData*) lua_touserdata(L,ind);
+   gen = pilot_getGeneration();
+
+   /* Fast path, nothing was freed since we last looked the pilot up. The
+    * player is special cased as player.p can be swapped without freeing. */
+   if ((lp->p != NULL) && (lp->gen == gen) && (lp->id != PLAYER_ID)
+         && !pilot_isFlag(lp->p, PILOT_DELETE))
+      return lp->p;
 
    /* Get the pilot. */
-   p  = pilot_get(luaL_checkpilot(L,ind));
+   p  = pilot_get(lp->id);
    if (p==NULL) {
+      lp->p = NULL;
       NLUA_ERROR(L,_("Pilot is invalid."));
       return NULL;
    }
+   lp->p    = p;
+   lp->gen  = gen;
 
    return p;
 }
 /**
  * @brief Pushes a pilot on the stack.
  *
+ * Live pilots only ever have a single userdata, which is interned in a weak
+ * table in the registry. This avoids allocating a new userdata (and creating
+ * garbage) every time a pilot is passed to Lua.
+ *
  *    @param L Lua state to push pilot into.
  *    @param pilot Pilot to push.
  *    @return Newly pushed pilot.
  */
 LuaPilot* lua_pushpilot( lua_State *L, LuaPilot pilot )
 {
-   LuaPilot *p;
-   p = (LuaPilot*) lua_newuserdata(L, sizeof(LuaPilot));
-   *p = pilot;
+   LuaPilotData *lp;
+
+   /* Get the cache, creating it if necessary. */
+   lua_getfield(L, LUA_REGISTRYINDEX, PILOT_CACHE);
+   if (lua_isnil(L,-1)) {
+      lua_pop(L,1);
+      lua_newtable(L);
+      lua_newtable(L); /* Metatable making the values weak. */
+      lua_pushstring(L, "v");
+      lua_setfield(L, -2, "__mode");
+      lua_setmetatable(L, -2);
+      lua_pushvalue(L, -1);
+      lua_setfield(L, LUA_REGISTRYINDEX, PILOT_CACHE);
+   }
+
+   /* Reuse the existing userdata if still alive. */
+   lua_rawgeti(L, -1, pilot);
+   if (!lua_isnil(L,-1)) {
+      lp = (LuaPilotData*) lua_touserdata(L,-1);
+      lua_remove(L,-2);
+      return &lp->id;
+   }
+   lua_pop(L,1);
+
+   /* Create a new one. */
+   lp = (LuaPilotData*) lua_newuserdata(L, sizeof(LuaPilotData));
+   lp->id   = pilot;
+   lp->p    = NULL;
+   lp->gen  = 0;
    luaL_getmetatable(L, PILOT_METATABLE);
    lua_setmetatable(L, -2);
-   return p;
+
+   /* Only cache live pilots, so the table doesn't fill up with dead IDs. */
+   if (pilot_get(pilot) != NULL) {
+      lua_pushvalue(L, -1);
+      lua_rawseti(L, -3, pilot);
+   }
+   lua_remove(L,-2);
+   return &lp->id;
 }
 /**
  * @brief Checks to see if ind is a pilot.
@@ -950,6 +1032,45 @@ static int pilotL_getPilots( lua_State *L )
 }
 
 
+/**
+ * @brief Grid filter for pilot.getHostiles().
+ *
+ *    @param data Pointer to whether or not to skip disabled pilots.
+ */
+static int pilotL_gridHostile( const Pilot *p, const Pilot *target, void *data )
+{
+   /* Must be hostile. */
+   if ( !( areEnemies( target->faction, p->faction )
+            || ( (p->id == PLAYER_ID)
+               && pilot_isHostile(target) ) ) )
+      return 0;
+   /* Check if disabled. */
+   if (*(int*)data && pilot_isDisabled(target))
+      return 0;
+   return 1;
+}
+
+
+/**
+ * @brief Grid filter for pilot.getVisible().
+ *
+ *    @param data Pointer to whether or not to skip disabled pilots.
+ */
+static int pilotL_gridVisible( const Pilot *p, const Pilot *target, void *data )
+{
+   /* Check if dead. */
+   if (pilot_isFlag(target, PILOT_DELETE))
+      return 0;
+   /* Check if disabled. */
+   if (*(int*)data && pilot_isDisabled(target))
+      return 0;
+   /* Check visibilitiy. */
+   if (!pilot_validTarget( p, target ))
+      return 0;
+   return 1;
+}
+
+
 /**
  * @brief Gets hostile pilots to a pilot within a certain distance.
  *
@@ -961,37 +1082,33 @@ static int pilotL_getPilots( lua_State *L )
  */
 static int pilotL_getHostiles( lua_State *L )
 {
-   int i, k, dd;
+   int i;
    Pilot *p = luaL_validpilot(L,1);
    double dist = luaL_optnumber(L,2,-1.);
    int dis = lua_toboolean(L,3);
-   Pilot *const* pilot_stack;
-
-   if (dist >= 0.)
-      dd = dist*dist;
+   Pilot **hostiles;
+   PilotGridQuery q;
+
+   /* The player also counts hostile pilots of friendly factions. */
+   memset( &q, 0, sizeof(q) );
+   q.p         = p;
+   q.x         = p->solid->pos.x;
+   q.y         = p->solid->pos.y;
+   q.range     = dist;
+   q.faction   = p->faction;
+   q.relation  = (p->id == PLAYER_ID) ? PILOT_GRID_ALL : PILOT_GRID_ENEMY;
+   q.filter    = pilotL_gridHostile;
+   q.data      = &dis;
+   hostiles    = pilot_gridRange( &q );
 
    /* Now put all the matching pilots in a table. */
-   pilot_stack = pilot_getAll();
-   lua_newtable(L);
-   k = 1;
-   for (i=0; i<array_size(pilot_stack); i++) {
-      /* Must be hostile. */
-      if ( !( areEnemies( pilot_stack[i]->faction, p->faction )
-               || ( (p->id == PLAYER_ID)
-                  && pilot_isHostile(pilot_stack[i]) ) ) )
-         continue;
-      /* Check if disabled. */
-      if (dis && pilot_isDisabled(pilot_stack[i]))
-         continue;
-      /* Check distance if necessary. */
-      if (dist >= 0. &&
-            vect_dist2(&pilot_stack[i]->solid->pos, &p->solid->pos) > dd)
-         continue;
-
-      lua_pushnumber(L, k++); /* key */
-      lua_pushpilot(L, pilot_stack[i]->id); /* value */
+   lua_createtable(L, array_size(hostiles), 0);
+   for (i=0; i<array_size(hostiles); i++) {
+      lua_pushnumber(L, i+1); /* key */
+      lua_pushpilot(L, hostiles[i]->id); /* value */
       lua_rawset(L,-3); /* table[key] = value */
    }
+   array_free( hostiles );
 
    return 1;
 }
@@ -1008,30 +1125,29 @@ static int pilotL_getHostiles( lua_State *L )
  */
 static int pilotL_getVisible( lua_State *L )
 {
-   int i, k;
+   int i;
    Pilot *p = luaL_validpilot(L,1);
    int dis = lua_toboolean(L,2);
-   Pilot *const* pilot_stack;
+   Pilot **visible;
+   PilotGridQuery q;
+
+   memset( &q, 0, sizeof(q) );
+   q.p         = p;
+   q.range     = -1.;
+   q.relation  = PILOT_GRID_ALL;
+   q.visible   = 1;
+   q.filter    = pilotL_gridVisible;
+   q.data      = &dis;
+   visible     = pilot_gridRange( &q );
 
    /* Now put all the matching pilots in a table. */
-   pilot_stack = pilot_getAll();
-   lua_newtable(L);
-   k = 1;
-   for (i=0; i<array_size(pilot_stack); i++) {
-      /* Check if dead. */
-      if (pilot_isFlag(pilot_stack[i], PILOT_DELETE))
-         continue;
-      /* Check if disabled. */
-      if (dis && pilot_isDisabled(pilot_stack[i]))
-         continue;
-      /* Check visibilitiy. */
-      if (!pilot_validTarget( p, pilot_stack[i] ))
-         continue;
-
-      lua_pushnumber(L, k++); /* key */
-      lua_pushpilot(L, pilot_stack[i]->id); /* value */
+   lua_createtable(L, array_size(visible), 0);
+   for (i=0; i<array_size(visible); i++) {
+      lua_pushnumber(L, i+1); /* key */
+      lua_pushpilot(L, visible[i]->id); /* value */
       lua_rawset(L,-3); /* table[key] = value */
    }
+   array_free( visible );
 
    return 1;
 }
@@ -2029,8 +2145,10 @@ static int pilotL_rename( lua_State *L )
  * @brief Gets the pilot's position.
  *
  * @usage v = p:pos()
+ * @usage p:pos( v ) -- Stores the position in v instead of creating a new vector
  *
  *    @luatparam Pilot p Pilot to get the position of.
+ *    @luatparam[opt] Vec2 v Vector to store the position in.
  *    @luatreturn Vec2 The pilot's current position.
  * @luafunc pos
  */
@@ -2042,7 +2160,7 @@ static int pilotL_position( lua_State *L )
    p     = luaL_validpilot(L,1);
 
    /* Push position. */
-   lua_pushvector(L, p->solid->pos);
+   lua_pushvectorout(L, 2, p->solid->pos);
    return 1;
 }
 
@@ -2050,8 +2168,10 @@ static int pilotL_position( lua_State *L )
  * @brief Gets the pilot's velocity.
  *
  * @usage vel = p:vel()
+ * @usage p:vel( v ) -- Stores the velocity in v instead of creating a new vector
  *
  *    @luatparam Pilot p Pilot to get the velocity of.
+ *    @luatparam[opt] Vec2 v Vector to store the velocity in.
  *    @luatreturn Vec2 The pilot's current velocity.
  * @luafunc vel
  */
@@ -2063,7 +2183,7 @@ static int pilotL_velocity( lua_State *L )
    p     = luaL_validpilot(L,1);
 
    /* Push velocity. */
-   lua_pushvector(L, p->solid->vel);
+   lua_pushvectorout(L, 2, p->solid->vel);
    return 1;
 }
 
@@ -2214,6 +2334,7 @@ static int pilotL_setPosition( lua_State *L )
 
    /* Warp pilot to new position. */
    p->solid->pos = *vec;
+   pilot_gridInvalidate();
 
    /* Update if necessary. */
    if (pilot_isPlayer(p))
@@ -4719,6 +4840,9 @@ static int pilotL_setLeader( lua_State *L ) {
       }
    }
 
+   /* Parents are cached by the grid. */
+   pilot_gridInvalidate();
+
    return 0;
 }
 
@@ -856,7 +856,7 @@ static int playerL_land( lua_State *L )
       map_clear();
       map_select(map_getDestination(NULL), 0);
 
-      player.p->solid->pos = pnt->pos;
+      player_warp( pnt->pos.x, pnt->pos.y );
    }
    space_queueLand( pnt );
    return 0;
@@ -1749,7 +1749,7 @@ static int playerL_teleport( lua_State *L )
 
    /* Move to planet. */
    if (pnt != NULL)
-      player.p->solid->pos = pnt->pos;
+      player_warp( pnt->pos.x, pnt->pos.y );
 
    return 0;
 }
@@ -0,0 +1,414 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file nlua_prof.c
+ *
+ * @brief Lightweight instrumenting profiler for the Lua scripting.
+ *
+ * Hot call sites (nlua_pcall, AI tasks, hooks, outfit updates and spawn
+ * schedulers) open named frames which are merged into a call tree. Each node
+ * of the tree accumulates wall time, number of calls and the growth of the
+ * Lua heap, which is what we use to approximate allocations. The tree can be
+ * summarized in the console or dumped as folded stacks that can be fed
+ * directly to flamegraph tools.
+ *
+ * When the profiler is not running the instrumented code only checks
+ * nlua_profiling, so the cost is a single branch per call.
+ */
+
+/** @cond */
+#include "physfs.h"
+#include "SDL.h"
+
+#include "naev.h"
+/** @endcond */
+
+#include "nlua_prof.h"
+
+#include "array.h"
+#include "log.h"
+#include "nlua.h"
+
+
+/**
+ * @brief A node in the profiling call tree.
+ */
+typedef struct ProfNode_ {
+   char *name; /**< Name of the frame. */
+   int parent; /**< Index of the parent node, -1 for the root. */
+   int child; /**< Index of the first child, -1 if none. */
+   int sibling; /**< Index of the next sibling, -1 if none. */
+   unsigned int calls; /**< Number of times the frame was entered. */
+   Uint64 time; /**< Total time spent in the frame (performance counter ticks). */
+   Uint64 time_child; /**< Time spent in children of the frame. */
+   double mem; /**< Total Lua heap growth in the frame (bytes). */
+   double mem_child; /**< Lua heap growth in children of the frame. */
+} ProfNode;
+
+
+/**
+ * @brief An active profiling frame.
+ */
+typedef struct ProfFrame_ {
+   int node; /**< Node the frame belongs to. */
+   Uint64 start; /**< Performance counter when entered. */
+   double mem; /**< Lua heap size when entered. */
+} ProfFrame;
+
+
+int nlua_profiling = 0; /**< Whether or not the Lua profiler is running. */
+static ProfNode *prof_nodes   = NULL; /**< Call tree, node 0 is the root. */
+static ProfFrame *prof_stack  = NULL; /**< Stack of open frames. */
+
+
+/*
+ * Prototypes.
+ */
+static void prof_init( void );
+static double prof_luaMem( void );
+static int prof_getChild( int parent, const char *name );
+static void prof_push( const char *name );
+static int prof_path( char *buf, int len, int node );
+static int prof_cmpSelf( const void *p1, const void *p2 );
+
+
+/**
+ * @brief Sets up the root of the call tree if needed.
+ */
+static void prof_init( void )
+{
+   ProfNode *root;
+
+   if (prof_nodes != NULL)
+      return;
+
+   prof_nodes  = array_create( ProfNode );
+   prof_stack  = array_create( ProfFrame );
+   root        = &array_grow( &prof_nodes );
+   memset( root, 0, sizeof(ProfNode) );
+   root->name  = strdup( "lua" );
+   root->parent  = -1;
+   root->child   = -1;
+   root->sibling = -1;
+}
+
+
+/**
+ * @brief Gets the current size of the Lua heap in bytes.
+ */
+static double prof_luaMem( void )
+{
+   return (double)lua_gc( naevL, LUA_GCCOUNT, 0 ) * 1024.
+         + (double)lua_gc( naevL, LUA_GCCOUNTB, 0 );
+}
+
+
+/**
+ * @brief Gets (and creates if necessary) the child of a node by name.
+ *
+ *    @param parent Node to get child of.
+ *    @param name Name of the child.
+ *    @return Index of the child node.
+ */
+static int prof_getChild( int parent, const char *name )
+{
+   int i;
+   char *c;
+   ProfNode *n;
+
+   for (i=prof_nodes[parent].child; i>=0; i=prof_nodes[i].sibling)
+      if (strcmp( prof_nodes[i].name, name )==0)
+         return i;
+
+   /* Create a new node. */
+   n = &array_grow( &prof_nodes );
+   memset( n, 0, sizeof(ProfNode) );
+   n->name = strdup( name );
+   /* Folded stacks use ';' as a separator. */
+   for (c=n->name; *c!='\0'; c++)
+      if ((*c == ';') || (*c == '\n'))
+         *c = ',';
+   n->parent   = parent;
+   n->child    = -1;
+   i           = array_size(prof_nodes)-1;
+   n->sibling  = prof_nodes[parent].child;
+   prof_nodes[parent].child = i;
+   return i;
+}
+
+
+/**
+ * @brief Opens a frame on the profiling stack.
+ */
+static void prof_push( const char *name )
+{
+   int parent;
+   ProfFrame *f;
+
+   prof_init();
+
+   parent   = (array_size(prof_stack) > 0) ? array_back(prof_stack).node : 0;
+   f        = &array_grow( &prof_stack );
+   f->node  = prof_getChild( parent, name );
+   f->mem   = prof_luaMem();
+   f->start = SDL_GetPerformanceCounter();
+}
+
+
+/**
+ * @brief Opens a named profiling frame.
+ *
+ *    @param fmt Format of the frame name.
+ */
+void nlua_profEnter( const char *fmt, ... )
+{
+   char buf[STRMAX_SHORT];
+   va_list ap;
+
+   va_start( ap, fmt );
+   vsnprintf( buf, sizeof(buf), fmt, ap );
+   va_end( ap );
+
+   prof_push( buf );
+}
+
+
+/**
+ * @brief Opens a profiling frame named after a Lua function.
+ *
+ *    @param ind Stack index of the function.
+ */
+void nlua_profEnterFunc( int ind )
+{
+   char buf[STRMAX_SHORT];
+   lua_Debug ar;
+
+   if (!lua_isfunction( naevL, ind ))
+      snprintf( buf, sizeof(buf), "?" );
+   else {
+      lua_pushvalue( naevL, ind );
+      lua_getinfo( naevL, ">S", &ar );
+      if (ar.linedefined > 0)
+         snprintf( buf, sizeof(buf), "%s:%d", ar.short_src, ar.linedefined );
+      else
+         snprintf( buf, sizeof(buf), "%s", ar.short_src );
+   }
+
+   prof_push( buf );
+}
+
+
+/**
+ * @brief Closes the last opened profiling frame.
+ */
+void nlua_profLeave( void )
+{
+   ProfFrame *f;
+   ProfNode *n;
+   Uint64 dt;
+   double mem;
+
+   /* Profiler may have been reset while the frame was open. */
+   if (array_size(prof_stack) <= 0)
+      return;
+
+   f     = &array_back( prof_stack );
+   dt    = SDL_GetPerformanceCounter() - f->start;
+   mem   = MAX( 0., prof_luaMem() - f->mem );
+   n     = &prof_nodes[ f->node ];
+   n->calls++;
+   n->time += dt;
+   n->mem  += mem;
+   prof_nodes[ n->parent ].time_child += dt;
+   prof_nodes[ n->parent ].mem_child  += mem;
+   array_erase( &prof_stack, f, f+1 );
+}
+
+
+/**
+ * @brief Starts the profiler.
+ */
+void nlua_profStart( void )
+{
+   prof_init();
+   nlua_profiling = 1;
+}
+
+
+/**
+ * @brief Stops the profiler, keeping the collected data.
+ */
+void nlua_profStop( void )
+{
+   nlua_profiling = 0;
+}
+
+
+/**
+ * @brief Clears all the collected data.
+ */
+void nlua_profReset( void )
+{
+   int running = nlua_profiling;
+   nlua_profFree();
+   prof_init();
+   nlua_profiling = running;
+}
+
+
+/**
+ * @brief Frees the profiler.
+ */
+void nlua_profFree( void )
+{
+   int i;
+
+   for (i=0; i<array_size(prof_nodes); i++)
+      free( prof_nodes[i].name );
+   array_free( prof_nodes );
+   array_free( prof_stack );
+   prof_nodes     = NULL;
+   prof_stack     = NULL;
+   nlua_profiling = 0;
+}
+
+
+/**
+ * @brief Writes the folded path of a node.
+ *
+ *    @param buf Buffer to write to.
+ *    @param len Length of the buffer.
+ *    @param node Node to write path of.
+ *    @return Number of characters written.
+ */
+static int prof_path( char *buf, int len, int node )
+{
+   int l;
+
+   if (prof_nodes[node].parent < 0)
+      return scnprintf( buf, len, "%s", prof_nodes[node].name );
+
+   l = prof_path( buf, len, prof_nodes[node].parent );
+   return l + scnprintf( &buf[l], len-l, ";%s", prof_nodes[node].name );
+}
+
+
+/**
+ * @brief Sorts nodes by self time, largest first.
+ */
+static int prof_cmpSelf( const void *p1, const void *p2 )
+{
+   const ProfNode *n1, *n2;
+   Uint64 s1, s2;
+
+   n1 = &prof_nodes[ *(const int*)p1 ];
+   n2 = &prof_nodes[ *(const int*)p2 ];
+   s1 = n1->time - MIN( n1->time, n1->time_child );
+   s2 = n2->time - MIN( n2->time, n2->time_child );
+   if (s1 > s2)
+      return -1;
+   else if (s1 < s2)
+      return +1;
+   return 0;
+}
+
+
+/**
+ * @brief Summarizes the frames with the most self time.
+ *
+ *    @param n Maximum number of frames to list.
+ *    @return Newly allocated report string.
+ */
+char *nlua_profReport( int n )
+{
+   int i, l, len, nnodes, *order;
+   char *buf, path[STRMAX];
+   double freq, total;
+   ProfNode *nd;
+
+   prof_init();
+
+   nnodes   = array_size(prof_nodes) - 1;
+   n        = CLAMP( 0, nnodes, n );
+   len      = (n+2) * (STRMAX_SHORT + 64);
+   buf      = malloc( len );
+   freq     = (double)SDL_GetPerformanceFrequency();
+
+   /* Total is what was spent in the top-level frames. */
+   total    = (double)prof_nodes[0].time_child / freq;
+   l = scnprintf( buf, len, _("Lua profile: %.3f s in %d frames (%s)\n"),
+         total, nnodes, nlua_profiling ? _("running") : _("stopped") );
+   l += scnprintf( &buf[l], len-l, "%10s %10s %8s %10s  %s\n",
+         _("self ms"), _("total ms"), _("calls"), _("alloc KiB"), _("frame") );
+
+   /* Sort by self time. */
+   order = malloc( MAX(1,nnodes) * sizeof(int) );
+   for (i=0; i<nnodes; i++)
+      order[i] = i+1;
+   qsort( order, nnodes, sizeof(int), prof_cmpSelf );
+
+   for (i=0; i<n; i++) {
+      nd = &prof_nodes[ order[i] ];
+      prof_path( path, sizeof(path), order[i] );
+      l += scnprintf( &buf[l], len-l, "%10.3f %10.3f %8u %10.1f  %s\n",
+            (double)(nd->time - MIN(nd->time, nd->time_child)) * 1000. / freq,
+            (double)nd->time * 1000. / freq,
+            nd->calls, nd->mem / 1024.,
+            /* Skip the root name to keep it readable. */
+            &path[ strlen(prof_nodes[0].name)+1 ] );
+   }
+   free( order );
+
+   return buf;
+}
+
+
+/**
+ * @brief Dumps the call tree as flamegraph compatible folded stacks.
+ *
+ *    @param filename File to write to (in the write directory).
+ *    @param alloc Whether to weight by Lua allocations (in bytes) instead of
+ *                 wall time (in microseconds).
+ *    @return 0 on success.
+ */
+int nlua_profDump( const char *filename, int alloc )
+{
+   int i, l;
+   char buf[STRMAX];
+   double freq, val;
+   PHYSFS_File *f;
+   ProfNode *nd;
+
+   prof_init();
+
+   f = PHYSFS_openWrite( filename );
+   if (f == NULL) {
+      WARN(_("Unable to open '%s' for writing: %s"), filename,
+            PHYSFS_getErrorByCode( PHYSFS_getLastErrorCode() ) );
+      return -1;
+   }
+
+   freq = (double)SDL_GetPerformanceFrequency();
+   for (i=1; i<array_size(prof_nodes); i++) {
+      nd = &prof_nodes[i];
+      if (alloc)
+         val = MAX( 0., nd->mem - nd->mem_child );
+      else
+         val = (double)(nd->time - MIN(nd->time, nd->time_child)) * 1e6 / freq;
+      if (val < 1.)
+         continue;
+      l = prof_path( buf, sizeof(buf), i );
+      l += scnprintf( &buf[l], sizeof(buf)-l, " %.0f\n", val );
+      if (PHYSFS_writeBytes( f, buf, l ) != l) {
+         WARN(_("Error writing to '%s': %s"), filename,
+               PHYSFS_getErrorByCode( PHYSFS_getLastErrorCode() ) );
+         PHYSFS_close( f );
+         return -1;
+      }
+   }
+
+   PHYSFS_close( f );
+   return 0;
+}
@@ -0,0 +1,39 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef NLUA_PROF_H
+#  define NLUA_PROF_H
+
+
+#include "nstring.h"
+
+
+extern int nlua_profiling; /**< Whether or not the Lua profiler is running. */
+
+
+/*
+ * Control.
+ */
+void nlua_profStart( void );
+void nlua_profStop( void );
+void nlua_profReset( void );
+void nlua_profFree( void );
+
+/*
+ * Instrumentation. Only call these when nlua_profiling is set, and always
+ * pair a successful nlua_profEnter() with nlua_profLeave().
+ */
+PRINTF_FORMAT( 1, 2 ) void nlua_profEnter( const char *fmt, ... );
+void nlua_profEnterFunc( int ind );
+void nlua_profLeave( void );
+
+/*
+ * Output.
+ */
+char *nlua_profReport( int n );
+int nlua_profDump( const char *filename, int alloc );
+
+
+#endif /* NLUA_PROF_H */
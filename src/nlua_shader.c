@@ -145,10 +145,14 @@ int lua_isshader( lua_State *L, int ind )
 static int shaderL_gc( lua_State *L )
 {
    LuaShader_t *shader = luaL_checkshader(L,1);
+   int i;
    if (shader->pp_id > 0)
       render_postprocessRm( shader->pp_id );
    glDeleteProgram( shader->program );
    free(shader->uniforms);
+   for (i=0; i<array_size(shader->tex); i++)
+      luaL_unref( L, LUA_REGISTRYINDEX, shader->tex[i].ref );
+   array_free(shader->tex);
    return 0;
 }
 
@@ -256,7 +260,8 @@ static int shaderL_new( lua_State *L )
          t = &array_grow( &shader.tex );
          ntex++;
          t->active = GL_TEXTURE0+ntex;
-         t->texid = 0;
+         t->tex = NULL;
+         t->ref = LUA_NOREF;
          t->uniform = u->id;
          t->value = ntex;
          u->tex = ntex-1;
@@ -355,6 +360,7 @@ static int shaderL_sendHelper( lua_State *L, int ignore_missing )
    GLfloat values[4];
    GLint ivalues[4];
    glTexture *tex;
+   LuaTexture_t *t;
 
    ls = luaL_checkshader(L,1);
    name = luaL_checkstring(L,2);
@@ -368,7 +374,7 @@ static int shaderL_sendHelper( lua_State *L, int ignore_missing )
 
    /* With OpenGL 4.1 or ARB_separate_shader_objects, there
     * is no need to set the program first. */
-   glUseProgram( ls->program );
+   gl_useProgram( ls->program );
    idx = 3;
    switch (u->type) {
       case GL_FLOAT:
@@ -406,14 +412,20 @@ static int shaderL_sendHelper( lua_State *L, int ignore_missing )
          break;
 
       case GL_SAMPLER_2D:
+         /* Keep a reference to the texture instead of its OpenGL ID, as it
+          * may be freed or evicted while the shader still uses it. */
          tex = luaL_checktex(L,idx);
-         ls->tex[ u->tex ].texid = tex->texture;
+         t = &ls->tex[ u->tex ];
+         luaL_unref( L, LUA_REGISTRYINDEX, t->ref );
+         lua_pushvalue( L, idx );
+         t->ref = luaL_ref( L, LUA_REGISTRYINDEX );
+         t->tex = tex;
          break;
 
       default:
          WARN(_("Unsupported shader uniform type '%d' for uniform '%s'. Ignoring."), u->type, u->name );
    }
-   glUseProgram( 0 );
+   gl_useProgram( 0 );
 
    gl_checkErr();
 
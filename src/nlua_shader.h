@@ -30,7 +30,8 @@ typedef struct LuaUniform_s {
 
 typedef struct LuaTexture_s {
    GLenum active;
-   GLuint texid;
+   glTexture *tex; /**< Texture to bind, made resident when binding. */
+   int ref; /**< Lua reference keeping the texture alive. */
    GLint uniform;
    GLint value;
 } LuaTexture_t;
@@ -384,7 +384,7 @@ static int texL_writeData( lua_State *L )
    data = malloc( len );
 
    /* Read raw data. */
-   glBindTexture( GL_TEXTURE_2D, tex->texture );
+   gl_bindTexture( GL_TEXTURE_2D, gl_texResident( tex ) );
    glGetTexImage( GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, data );
    gl_checkErr();
 
@@ -528,7 +528,7 @@ static int texL_setFilter( lua_State *L )
    if (min==0 || mag==0)
       NLUA_INVALID_PARAMETER(L);
 
-   glBindTexture( GL_TEXTURE_2D, tex->texture );
+   gl_bindTexture( GL_TEXTURE_2D, gl_texResident( tex ) );
    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag );
    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min );
    gl_checkErr();
@@ -561,7 +561,7 @@ static int texL_setWrap( lua_State *L )
    if (horiz==0 || vert==0 || depth==0)
       NLUA_INVALID_PARAMETER(L);
 
-   glBindTexture( GL_TEXTURE_2D, tex->texture );
+   gl_bindTexture( GL_TEXTURE_2D, gl_texResident( tex ) );
    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, horiz );
    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, vert );
    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, depth );
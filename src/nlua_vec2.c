@@ -22,9 +22,17 @@
 #include "nluadef.h"
 
 
+#define VECTOR_SCRATCH        8 /**< Number of scratch vectors available. */
+#define VECTOR_SCRATCH_FIELD  "vec2_scratch" /**< Registry field of the scratch vectors. */
+
+
+/* Helpers. */
+static int vector_getXY( lua_State *L, int ind, double *x, double *y );
 /* Vector metatable methods */
 static int vectorL_new( lua_State *L );
 static int vectorL_newP( lua_State *L );
+static int vectorL_copy( lua_State *L );
+static int vectorL_scratch( lua_State *L );
 static int vectorL_add__( lua_State *L );
 static int vectorL_add( lua_State *L );
 static int vectorL_sub__( lua_State *L );
@@ -33,6 +41,9 @@ static int vectorL_mul__( lua_State *L );
 static int vectorL_mul( lua_State *L );
 static int vectorL_div__( lua_State *L );
 static int vectorL_div( lua_State *L );
+static int vectorL_addXY( lua_State *L );
+static int vectorL_subXY( lua_State *L );
+static int vectorL_mulXY( lua_State *L );
 static int vectorL_get( lua_State *L );
 static int vectorL_polar( lua_State *L );
 static int vectorL_set( lua_State *L );
@@ -43,6 +54,8 @@ static int vectorL_mod( lua_State *L );
 static const luaL_Reg vector_methods[] = {
    { "new", vectorL_new },
    { "newP", vectorL_newP },
+   { "copy", vectorL_copy },
+   { "scratch", vectorL_scratch },
    { "__add", vectorL_add },
    { "add", vectorL_add__ },
    { "__sub", vectorL_sub },
@@ -51,6 +64,9 @@ static const luaL_Reg vector_methods[] = {
    { "mul", vectorL_mul__ },
    { "__div", vectorL_div },
    { "div", vectorL_div__ },
+   { "addXY", vectorL_addXY },
+   { "subXY", vectorL_subXY },
+   { "mulXY", vectorL_mulXY },
    { "get", vectorL_get },
    { "polar", vectorL_polar },
    { "set", vectorL_set },
@@ -88,6 +104,13 @@ int nlua_loadVector( nlua_env env )
  * my_vec = my_vec - your_vec -- my_vec is now (19,13)
  * @endcode
  *
+ * The operators always create a new vector, and the add, sub, mul and div
+ * methods modify the vector in place but also return a new copy of it. Code
+ * that runs every frame (such as the AI) should prefer the XY variants which
+ * return plain numbers, functions that can write into an existing vector like
+ * pilot:pos(v), or scratch vectors, as every new vector is garbage the
+ * collector has to deal with later.
+ *
  * To call members of the metatable always use:
  * @code
  * vector:function( param )
@@ -138,6 +161,28 @@ Vector2d* lua_pushvector( lua_State *L, Vector2d vec )
    return v;
 }
 
+/**
+ * @brief Pushes a vector on the stack, reusing an output vector if given.
+ *
+ * Used by functions taking an optional vector to write their result into, so
+ * that scripts can avoid allocating a new vector on every call.
+ *
+ *    @param L Lua state to push vector onto.
+ *    @param ind Index of the optional output vector.
+ *    @param vec Vector to push.
+ *    @return Vector just pushed.
+ */
+Vector2d* lua_pushvectorout( lua_State *L, int ind, Vector2d vec )
+{
+   Vector2d *v;
+   if (lua_isnoneornil(L,ind))
+      return lua_pushvector( L, vec );
+   v  = luaL_checkvector(L,ind);
+   *v = vec;
+   lua_pushvalue(L,ind);
+   return v;
+}
+
 /**
  * @brief Checks to see if ind is a vector.
  *
@@ -161,6 +206,33 @@ int lua_isvector( lua_State *L, int ind )
    return ret;
 }
 
+/**
+ * @brief Gets either a vector or a pair of cartesian coordinates.
+ *
+ *    @param L Lua state to get coordinates from.
+ *    @param ind Index of the vector or X coordinate.
+ *    @param[out] x X coordinate.
+ *    @param[out] y Y coordinate.
+ *    @return 0 on success.
+ */
+static int vector_getXY( lua_State *L, int ind, double *x, double *y )
+{
+   Vector2d *v;
+
+   if (lua_isvector(L,ind)) {
+      v  = lua_tovector(L,ind);
+      *x = v->x;
+      *y = v->y;
+   }
+   else if ((lua_gettop(L) > ind) && lua_isnumber(L,ind) && lua_isnumber(L,ind+1)) {
+      *x = lua_tonumber(L,ind);
+      *y = lua_tonumber(L,ind+1);
+   }
+   else
+      return -1;
+   return 0;
+}
+
 /**
  * @brief Creates a new vector.
  *
@@ -221,11 +293,68 @@ static int vectorL_newP( lua_State *L )
    return 1;
 }
 
+/**
+ * @brief Creates a copy of a vector.
+ *
+ * @usage v2 = v:copy()
+ *
+ *    @luatparam Vec2 v Vector to copy.
+ *    @luatreturn Vec2 A new vector with the same coordinates.
+ * @luafunc copy
+ */
+static int vectorL_copy( lua_State *L )
+{
+   lua_pushvector( L, *luaL_checkvector(L,1) );
+   return 1;
+}
+
+/**
+ * @brief Gets a scratch vector.
+ *
+ * Scratch vectors are allocated once and shared by all the scripts, so they
+ * are only meant to hold temporary values which are used within the same
+ * expression. Any other function, including the ones called in between, may
+ * take the same scratch vector and overwrite it, so never keep one in a
+ * variable. Use a vector owned by the script for anything longer lived.
+ *
+ * @usage d = p:pos( vec2.scratch(1) ):dist( t:pos( vec2.scratch(2) ) )
+ *
+ *    @luatparam[opt=1] number n Number of the scratch vector to get (1 to 8).
+ *    @luatreturn Vec2 The scratch vector, set to (0,0).
+ * @luafunc scratch
+ */
+static int vectorL_scratch( lua_State *L )
+{
+   int n, i;
+
+   n = luaL_optinteger(L,1,1);
+   if ((n < 1) || (n > VECTOR_SCRATCH))
+      NLUA_ERROR(L, _("Scratch vector must be between 1 and %d."), VECTOR_SCRATCH);
+
+   /* Create the scratch vectors the first time. */
+   lua_getfield(L, LUA_REGISTRYINDEX, VECTOR_SCRATCH_FIELD);
+   if (lua_isnil(L,-1)) {
+      lua_pop(L,1);
+      lua_createtable(L, VECTOR_SCRATCH, 0);
+      for (i=1; i<=VECTOR_SCRATCH; i++) {
+         lua_pushvector(L, (Vector2d){ .x=0., .y=0. });
+         lua_rawseti(L, -2, i);
+      }
+      lua_pushvalue(L,-1);
+      lua_setfield(L, LUA_REGISTRYINDEX, VECTOR_SCRATCH_FIELD);
+   }
+
+   lua_rawgeti(L, -1, n);
+   vect_cset( lua_tovector(L,-1), 0., 0. );
+   return 1;
+}
+
 /**
  * @brief Adds two vectors or a vector and some cartesian coordinates.
  *
  * If x is a vector it adds both vectors, otherwise it adds cartesian coordinates
- * to the vector.
+ * to the vector. The method modifies the vector in place and returns a copy of
+ * the result, while the operator creates a new vector.
  *
  * @usage my_vec = my_vec + your_vec
  * @usage my_vec:add( your_vec )
@@ -302,7 +431,8 @@ static int vectorL_add__( lua_State *L )
  * @brief Subtracts two vectors or a vector and some cartesian coordinates.
  *
  * If x is a vector it subtracts both vectors, otherwise it subtracts cartesian
- * coordinates to the vector.
+ * coordinates to the vector. The method modifies the vector in place and
+ * returns a copy of the result, while the operator creates a new vector.
  *
  * @usage my_vec = my_vec - your_vec
  * @usage my_vec:sub( your_vec )
@@ -376,6 +506,9 @@ static int vectorL_sub__( lua_State *L )
 /**
  * @brief Multiplies a vector by a number.
  *
+ * The method modifies the vector in place and returns a copy of the result,
+ * while the operator creates a new vector.
+ *
  * @usage my_vec = my_vec * 3
  * @usage my_vec:mul( 3 )
  *
@@ -416,6 +549,9 @@ static int vectorL_mul__( lua_State *L )
 /**
  * @brief Divides a vector by a number.
  *
+ * The method modifies the vector in place and returns a copy of the result,
+ * while the operator creates a new vector.
+ *
  * @usage my_vec = my_vec / 3
  * @usage my_vec:div(3)
  *
@@ -453,6 +589,87 @@ static int vectorL_div__( lua_State *L )
    return 1;
 }
 
+/**
+ * @brief Adds a vector or cartesian coordinates to a vector without creating a new one.
+ *
+ * @usage x,y = my_vec:addXY( your_vec )
+ * @usage x,y = my_vec:addXY( 5, 3 )
+ *
+ *    @luatparam Vec2 v Vector to add to.
+ *    @luatparam number|Vec2 x X coordinate or vector to add.
+ *    @luatparam number|nil y Y coordinate or nil to add.
+ *    @luatreturn number X coordinate of the result.
+ *    @luatreturn number Y coordinate of the result.
+ * @luafunc addXY
+ */
+static int vectorL_addXY( lua_State *L )
+{
+   Vector2d *v1;
+   double x, y;
+
+   v1 = luaL_checkvector(L,1);
+   if (vector_getXY( L, 2, &x, &y )) {
+      NLUA_INVALID_PARAMETER(L);
+      return 0;
+   }
+
+   lua_pushnumber(L, v1->x + x);
+   lua_pushnumber(L, v1->y + y);
+   return 2;
+}
+
+/**
+ * @brief Subtracts a vector or cartesian coordinates from a vector without creating a new one.
+ *
+ * @usage x,y = my_vec:subXY( your_vec )
+ * @usage x,y = my_vec:subXY( 5, 3 )
+ *
+ *    @luatparam Vec2 v Vector to subtract from.
+ *    @luatparam number|Vec2 x X coordinate or vector to subtract.
+ *    @luatparam number|nil y Y coordinate or nil to subtract.
+ *    @luatreturn number X coordinate of the result.
+ *    @luatreturn number Y coordinate of the result.
+ * @luafunc subXY
+ */
+static int vectorL_subXY( lua_State *L )
+{
+   Vector2d *v1;
+   double x, y;
+
+   v1 = luaL_checkvector(L,1);
+   if (vector_getXY( L, 2, &x, &y )) {
+      NLUA_INVALID_PARAMETER(L);
+      return 0;
+   }
+
+   lua_pushnumber(L, v1->x - x);
+   lua_pushnumber(L, v1->y - y);
+   return 2;
+}
+
+/**
+ * @brief Multiplies a vector by a number without creating a new one.
+ *
+ * @usage x,y = my_vec:mulXY( 3 )
+ *
+ *    @luatparam Vec2 v Vector to multiply.
+ *    @luatparam number mod Amount to multiply by.
+ *    @luatreturn number X coordinate of the result.
+ *    @luatreturn number Y coordinate of the result.
+ * @luafunc mulXY
+ */
+static int vectorL_mulXY( lua_State *L )
+{
+   Vector2d *v1;
+   double mod;
+
+   v1    = luaL_checkvector(L,1);
+   mod   = luaL_checknumber(L,2);
+
+   lua_pushnumber(L, v1->x * mod);
+   lua_pushnumber(L, v1->y * mod);
+   return 2;
+}
 
 /**
  * @brief Gets the cartesian positions of the vector.
@@ -480,24 +697,35 @@ static int vectorL_get( lua_State *L )
 /**
  * @brief Gets polar coordinates of a vector.
  *
- * The angle is in degrees, not radians.
+ * The angle is in degrees, not radians. If a second vector is given, the polar
+ * coordinates of the difference are computed without creating a new vector.
  *
  * @usage modulus, angle = my_vec:polar()
+ * @usage modulus, angle = my_vec:polar( your_vec ) -- Same as (my_vec - your_vec):polar()
  *
  *    @luatparam Vec2 v Vector to get polar coordinates of.
+ *    @luatparam[opt] Vec2 v2 Vector to subtract from v first.
  *    @luatreturn number The modulus of the vector.
  *    @luatreturn number The angle of the vector.
  * @luafunc polar
  */
 static int vectorL_polar( lua_State *L )
 {
-   Vector2d *v1;
+   Vector2d *v1, *v2, d;
 
    /* Get self. */
    v1 = luaL_checkvector(L,1);
 
-   lua_pushnumber(L, VMOD(*v1));
-   lua_pushnumber(L, VANGLE(*v1)*180./M_PI);
+   /* Get relative vector. */
+   if (lua_gettop(L) > 1) {
+      v2 = luaL_checkvector(L,2);
+      vect_cset( &d, v1->x - v2->x, v1->y - v2->y );
+   }
+   else
+      d = *v1;
+
+   lua_pushnumber(L, VMOD(d));
+   lua_pushnumber(L, VANGLE(d)*180./M_PI);
    return 2;
 }
 
@@ -505,10 +733,11 @@ static int vectorL_polar( lua_State *L )
  * @brief Sets the vector by cartesian coordinates.
  *
  * @usage my_vec:set(5, 3) -- my_vec is now (5,3)
+ * @usage my_vec:set(your_vec) -- my_vec now has the same coordinates as your_vec
  *
  *    @luatparam Vec2 v Vector to set coordinates of.
- *    @luatparam number x X coordinate to set.
- *    @luatparam number y Y coordinate to set.
+ *    @luatparam number|Vec2 x X coordinate or vector to set.
+ *    @luatparam number|nil y Y coordinate to set or nil.
  * @luafunc set
  */
 static int vectorL_set( lua_State *L )
@@ -518,8 +747,10 @@ static int vectorL_set( lua_State *L )
 
    /* Get parameters. */
    v1 = luaL_checkvector(L,1);
-   x  = luaL_checknumber(L,2);
-   y  = luaL_checknumber(L,3);
+   if (vector_getXY( L, 2, &x, &y )) {
+      NLUA_INVALID_PARAMETER(L);
+      return 0;
+   }
 
    vect_cset( v1, x, y );
    return 0;
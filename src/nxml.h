@@ -148,13 +148,35 @@ do {if (xmlTextWriterEndDocument(w) < 0) { \
    ERR("xmlw: unable to end document"); return -1; } } while (0)
 
 
+/**
+ * @brief A file parsed by a parse stream, see xml_parseStreamNext().
+ */
+typedef struct XmlParseJob_ {
+   const char *filename; /**< File that was parsed. */
+   const char *buf; /**< Contents of the file (see ndata_map()), only kept for embedded headers. */
+   size_t bufsize; /**< Size of buf. */
+   xmlDocPtr doc; /**< Parsed document or NULL on failure. */
+   int err; /**< Error of a worker (XML_PARSE_EREAD or XML_PARSE_EPARSE), logged on the main thread. */
+} XmlParseJob;
+
+
+struct XmlParseStream_;
+typedef struct XmlParseStream_ XmlParseStream; /**< List of files being parsed ahead, see xml_parseStreamOpen(). */
+
+
 /*
  * Functions for generic complex reading.
  */
 xmlDocPtr xml_parsePhysFS( const char* filename );
+XmlParseStream *xml_parseStreamOpen( const char *const *files, int nfiles, int header );
+XmlParseJob *xml_parseStreamNext( XmlParseStream *s );
+void xml_parseStreamClose( XmlParseStream *s );
 glTexture* xml_parseTexture( xmlNodePtr node,
       const char *path, int defsx, int defsy,
       const unsigned int flags );
+glTexture* xml_parseTextureAsync( xmlNodePtr node,
+      const char *path, int defsx, int defsy,
+      const unsigned int flags );
 int xml_parseTime( xmlNodePtr node, time_t *t );
 
 /*
@@ -410,11 +410,11 @@ static void object_renderMesh( const Object *object, int part, GLfloat alpha )
    const int nor_offset = offsetof(Vertex, nor);
 
    /* activates vertices and texture coords */
-   glEnableVertexAttribArray(shaders.material.vertex);
+   gl_enableVertexAttribArray(shaders.material.vertex);
    gl_vboActivateAttribOffset(mesh->vbo, shaders.material.vertex, ver_offset, 3, GL_FLOAT, sizeof(Vertex));
-   glEnableVertexAttribArray(shaders.material.vertex_tex);
+   gl_enableVertexAttribArray(shaders.material.vertex_tex);
    gl_vboActivateAttribOffset(mesh->vbo, shaders.material.vertex_tex, tex_offset, 2, GL_FLOAT, sizeof(Vertex));
-   glEnableVertexAttribArray(shaders.material.vertex_normal);
+   gl_enableVertexAttribArray(shaders.material.vertex_normal);
    gl_vboActivateAttribOffset(mesh->vbo, shaders.material.vertex_normal, nor_offset, 3, GL_FLOAT, sizeof(Vertex));
 
    /* Set material */
@@ -436,15 +436,15 @@ static void object_renderMesh( const Object *object, int part, GLfloat alpha )
    glUniform1i(shaders.material.map_Ks, 1);
    glUniform1i(shaders.material.map_Ke, 2);
    glUniform1i(shaders.material.map_Bump, 3);
-   glActiveTexture(GL_TEXTURE3);
-   glBindTexture(GL_TEXTURE_2D, material->map_Bump == NULL ? zeroTexture->texture : material->map_Bump->texture);
-   glActiveTexture(GL_TEXTURE2);
-   glBindTexture(GL_TEXTURE_2D, material->map_Ke == NULL ? oneTexture->texture : material->map_Ke->texture);
-   glActiveTexture(GL_TEXTURE1);
-   glBindTexture(GL_TEXTURE_2D, material->map_Ks == NULL ? oneTexture->texture : material->map_Ks->texture);
+   gl_activeTexture(GL_TEXTURE3);
+   gl_bindTexture(GL_TEXTURE_2D, material->map_Bump == NULL ? zeroTexture->texture : material->map_Bump->texture);
+   gl_activeTexture(GL_TEXTURE2);
+   gl_bindTexture(GL_TEXTURE_2D, material->map_Ke == NULL ? oneTexture->texture : material->map_Ke->texture);
+   gl_activeTexture(GL_TEXTURE1);
+   gl_bindTexture(GL_TEXTURE_2D, material->map_Ks == NULL ? oneTexture->texture : material->map_Ks->texture);
    /* Need TEXTURE0 to be last. */
-   glActiveTexture(GL_TEXTURE0);
-   glBindTexture(GL_TEXTURE_2D, material->map_Kd == NULL ? oneTexture->texture : material->map_Kd->texture);
+   gl_activeTexture(GL_TEXTURE0);
+   gl_bindTexture(GL_TEXTURE_2D, material->map_Kd == NULL ? oneTexture->texture : material->map_Kd->texture);
 
    glDrawArrays(GL_TRIANGLES, 0, mesh->num_corners);
 }
@@ -469,7 +469,7 @@ void object_renderSolidPart( const Object *object, const Solid *solid, const cha
       return;
    */
 
-   glUseProgram(shaders.material.program);
+   gl_useProgram(shaders.material.program);
 
    projection = gl_gameToScreenMatrix(gl_view_matrix);
    projection = gl_Matrix4_Translate(projection, x, y, 0.);
@@ -481,14 +481,14 @@ void object_renderSolidPart( const Object *object, const Solid *solid, const cha
    gl_Matrix4_Uniform(shaders.material.projection, projection);
    gl_Matrix4_Uniform(shaders.material.model, model);
 
-   glEnable(GL_DEPTH_TEST);
+   gl_enable(GL_DEPTH_TEST);
    glDepthFunc(GL_LESS);  /* XXX this changes the global DepthFunc */
 
    for (i = 0; i < array_size(object->meshes); ++i)
       if (strcmp(part_name, object->meshes[i].name) == 0)
          object_renderMesh(object, i, alpha);
 
-   glDisable(GL_DEPTH_TEST);
-   glUseProgram(0);
+   gl_disable(GL_DEPTH_TEST);
+   gl_useProgram(0);
    gl_checkErr();
 }
@@ -373,12 +373,12 @@ static int gl_getGLInfo (void)
  */
 static int gl_defState (void)
 {
-   glDisable( GL_DEPTH_TEST ); /* set for doing 2d */
-/* glEnable(  GL_TEXTURE_2D ); never enable globally, breaks non-texture blits */
-   glEnable(  GL_BLEND ); /* alpha blending ftw */
+   gl_disable( GL_DEPTH_TEST ); /* set for doing 2d */
+/* gl_enable(  GL_TEXTURE_2D ); never enable globally, breaks non-texture blits */
+   gl_enable(  GL_BLEND ); /* alpha blending ftw */
 
    /* Set the blending/shading model to use. */
-   glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA ); /* good blend model */
+   gl_blendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA ); /* good blend model */
 
    return 0;
 }
@@ -465,6 +465,10 @@ int gl_init (void)
    if ( !GLAD_GL_VERSION_3_1 )
       WARN( "Naev requires OpenGL 3.1, but got OpenGL %d.%d!", GLVersion.major, GLVersion.minor );
 
+   /* Nothing is known about the state of a new context. */
+   gl_stateInvalidate();
+   gl_activeTexture( GL_TEXTURE0 );
+
    /* Some OpenGL options. */
    glClearColor( 0., 0., 0., 1. );
 
@@ -483,6 +487,7 @@ int gl_init (void)
    gl_initTextures();
    gl_initVBO();
    gl_initRender();
+   gl_initBatch();
 
    /* Get info about the OpenGL window */
    gl_getGLInfo();
@@ -497,7 +502,7 @@ int gl_init (void)
    gl_colorblind( conf.colorblind );
 
    /* Set colourspace. */
-   glEnable( GL_FRAMEBUFFER_SRGB );
+   gl_enable( GL_FRAMEBUFFER_SRGB );
 
    /* Cosmetic new line. */
    DEBUG_BLANK();
@@ -521,7 +526,7 @@ void gl_resize (void)
    for (i=0; i<2; i++) {
       if (gl_screen.fbo[i] != GL_INVALID_VALUE) {
          glDeleteFramebuffers( 1, &gl_screen.fbo[i] );
-         glDeleteTextures( 1, &gl_screen.fbo_tex[i] );
+         gl_deleteTextures( 1, &gl_screen.fbo_tex[i] );
       }
       gl_fboCreate( &gl_screen.fbo[i], &gl_screen.fbo_tex[i], gl_screen.rw, gl_screen.rh );
    }
@@ -675,13 +680,14 @@ void gl_exit (void)
    for (i=0; i<2; i++) {
       if (gl_screen.fbo[i] != GL_INVALID_VALUE) {
          glDeleteFramebuffers( 1, &gl_screen.fbo[i] );
-         glDeleteTextures( 1, &gl_screen.fbo_tex[i] );
+         gl_deleteTextures( 1, &gl_screen.fbo_tex[i] );
          gl_screen.fbo[i] = GL_INVALID_VALUE;
          gl_screen.fbo_tex[i] = GL_INVALID_VALUE;
       }
    }
 
    /* Exit the OpenGL subsystems. */
+   gl_exitBatch();
    gl_exitRender();
    gl_exitVBO();
    gl_exitTextures();
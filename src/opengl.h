@@ -17,9 +17,11 @@
 
 #include "colour.h"
 /* We put all the other opengl stuff here to only have to include one header.  */
+#include "opengl_batch.h"
 #include "opengl_matrix.h"
 #include "opengl_render.h"
 #include "opengl_shader.h"
+#include "opengl_state.h"
 #include "opengl_tex.h"
 #include "opengl_vbo.h"
 #include "physics.h"
@@ -0,0 +1,362 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file opengl_batch.c
+ *
+ * @brief Batches textured quads to render them with few draw calls.
+ *
+ * Quads are accumulated in buckets of the textures they use, with their
+ *  transform, sprite sheet coordinates and colour baked into the vertices.
+ *  gl_batchFlush() then uploads everything into a single stream VBO and draws
+ *  each bucket with one call.
+ *
+ * Quads in different buckets are not drawn in submission order, so only batch
+ *  things that don't care about the order they overlap in, and flush before
+ *  rendering anything that has to go on top of them.
+ */
+
+
+/** @cond */
+#include "naev.h"
+/** @endcond */
+
+#include "opengl_batch.h"
+
+#include "array.h"
+#include "camera.h"
+#include "opengl.h"
+#include "opengl_render.h"
+
+
+#define BATCH_VERTEX_SIZE  9 /**< Floats per vertex: position, texture coordinates, colour and interpolation. */
+#define BATCH_VBO_SIZE     (6*BATCH_VERTEX_SIZE*256) /**< Initial number of floats in the VBO. */
+
+
+/**
+ * @brief Quads sharing the same textures.
+ */
+typedef struct BatchBucket_ {
+   GLuint ida; /**< Texture interpolated to. */
+   GLuint idb; /**< Texture interpolated from, same as ida when not interpolating. */
+   GLfloat *data; /**< Array (array.h) of vertex data, six vertices per quad. */
+} BatchBucket;
+
+
+static BatchBucket *batch_buckets = NULL; /**< Array (array.h) of buckets, entries past batch_nbuckets are kept for reuse. */
+static int batch_nbuckets  = 0; /**< Number of buckets in use. */
+static int batch_last      = -1; /**< Last bucket used, consecutive quads tend to share textures. */
+static GLfloat *batch_data = NULL; /**< Array (array.h) of all the vertex data being uploaded. */
+static gl_vbo *batch_vbo   = NULL; /**< Stream VBO the quads are uploaded into. */
+static int batch_sprites   = 0; /**< Quads rendered since the statistics were last read. */
+static int batch_draws     = 0; /**< Draw calls issued since the statistics were last read. */
+
+
+/*
+ * Prototypes.
+ */
+static BatchBucket *batch_getBucket( GLuint ida, GLuint idb );
+
+
+/**
+ * @brief Initializes the batch renderer.
+ *
+ *    @return 0 on success.
+ */
+int gl_initBatch (void)
+{
+   batch_buckets  = array_create( BatchBucket );
+   batch_data     = array_create_size( GLfloat, BATCH_VBO_SIZE );
+   batch_vbo      = gl_vboCreateStream( sizeof(GLfloat) * BATCH_VBO_SIZE, NULL );
+   return 0;
+}
+
+
+/**
+ * @brief Cleans up the batch renderer.
+ */
+void gl_exitBatch (void)
+{
+   int i;
+
+   for (i=0; i<array_size(batch_buckets); i++)
+      array_free( batch_buckets[i].data );
+   array_free( batch_buckets );
+   array_free( batch_data );
+   gl_vboDestroy( batch_vbo );
+   batch_buckets  = NULL;
+   batch_data     = NULL;
+   batch_vbo      = NULL;
+   batch_nbuckets = 0;
+   batch_last     = -1;
+}
+
+
+/**
+ * @brief Gets the bucket of a pair of textures, creating it if needed.
+ */
+static BatchBucket *batch_getBucket( GLuint ida, GLuint idb )
+{
+   int i;
+   BatchBucket *b;
+
+   if ((batch_last >= 0) && (batch_buckets[batch_last].ida == ida)
+         && (batch_buckets[batch_last].idb == idb))
+      return &batch_buckets[batch_last];
+
+   for (i=0; i<batch_nbuckets; i++) {
+      if ((batch_buckets[i].ida == ida) && (batch_buckets[i].idb == idb)) {
+         batch_last = i;
+         return &batch_buckets[i];
+      }
+   }
+
+   /* Reuse a bucket from a previous flush if possible. */
+   if (batch_nbuckets >= array_size(batch_buckets)) {
+      b = &array_grow( &batch_buckets );
+      b->data = array_create( GLfloat );
+   }
+   b = &batch_buckets[ batch_nbuckets ];
+   b->ida = ida;
+   b->idb = idb;
+   batch_last = batch_nbuckets++;
+   return b;
+}
+
+
+/**
+ * @brief Adds a texture to the batch, see gl_blitTexture().
+ *
+ *    @param ta Texture to render (interpolated to).
+ *    @param tb Texture interpolated from, or NULL to not interpolate.
+ *    @param inter Amount of interpolation, value is ta*inter + tb*(1.-inter).
+ *    @param x X position of the texture on the screen.
+ *    @param y Y position of the texture on the screen.
+ *    @param w Width on the screen. (units pixels)
+ *    @param h Height on the screen. (units pixels)
+ *    @param tx X position within the texture.
+ *    @param ty Y position within the texture.
+ *    @param tw Texture width.
+ *    @param th Texture height.
+ *    @param c Colour to use (modifies texture colour).
+ *    @param angle Rotation to apply (radians ccw around the center).
+ */
+void gl_batchTexture( const glTexture *ta, const glTexture *tb, double inter,
+      double x, double y, double w, double h,
+      double tx, double ty, double tw, double th,
+      const glColour *c, double angle )
+{
+   static const GLfloat corners[6][2] = {
+      { 0., 0. }, { 1., 0. }, { 0., 1. },
+      { 0., 1. }, { 1., 0. }, { 1., 1. } };
+   GLuint ida, idb;
+   BatchBucket *b;
+   GLfloat *v;
+   double hw, hh, cx, cy, dx, dy, ca, sa, u, t;
+   int i, n;
+
+   /* Not loaded yet, render what we can. */
+   ida = gl_texID( ta );
+   if (ida == 0)
+      return;
+   idb = (tb != NULL) ? gl_texID( tb ) : 0;
+   if ((idb == 0) || (idb == ida)) {
+      idb   = ida;
+      inter = 1.;
+   }
+
+   /* Must have colour for now. */
+   if (c == NULL)
+      c = &cWhite;
+
+   hw = w/2.;
+   hh = h/2.;
+   cx = x+hw;
+   cy = y+hh;
+   ca = cos(angle);
+   sa = sin(angle);
+
+   b = batch_getBucket( ida, idb );
+   n = array_size( b->data );
+   array_resize( &b->data, n + 6*BATCH_VERTEX_SIZE );
+   v = &b->data[n];
+   for (i=0; i<6; i++) {
+      /* Position, rotated around the center like gl_blitTexture(). */
+      dx = corners[i][0]*w - hw;
+      dy = corners[i][1]*h - hh;
+      if (angle == 0.) {
+         v[0] = cx + dx;
+         v[1] = cy + dy;
+      }
+      else {
+         v[0] = cx + ca*dx - sa*dy;
+         v[1] = cy + sa*dx + ca*dy;
+      }
+
+      /* Texture coordinates. */
+      u = tx + corners[i][0]*tw;
+      t = ty + corners[i][1]*th;
+      v[2] = u;
+      v[3] = (ta->flags & OPENGL_TEX_VFLIP) ? 1.-t : t;
+
+      /* Colour and interpolation. */
+      v[4] = c->r;
+      v[5] = c->g;
+      v[6] = c->b;
+      v[7] = c->a;
+      v[8] = inter;
+      v += BATCH_VERTEX_SIZE;
+   }
+   batch_sprites++;
+}
+
+
+/**
+ * @brief Adds a sprite to the batch, see gl_blitSprite().
+ *
+ *    @param sprite Sprite to render.
+ *    @param bx X position of the texture relative to the player.
+ *    @param by Y position of the texture relative to the player.
+ *    @param sx X position of the sprite to use.
+ *    @param sy Y position of the sprite to use.
+ *    @param c Colour to use (modifies texture colour).
+ */
+void gl_batchSprite( const glTexture *sprite, double bx, double by,
+      int sx, int sy, const glColour *c )
+{
+   gl_batchSpriteInterpolateScale( sprite, NULL, 1., bx, by, 1., 1., sx, sy, c );
+}
+
+
+/**
+ * @brief Adds a scaled sprite interpolating between textures to the batch, see
+ *        gl_blitSpriteInterpolateScale().
+ *
+ *    @param sa Sprite A to render.
+ *    @param sb Sprite B to render, or NULL to not interpolate.
+ *    @param inter Amount to interpolate.
+ *    @param bx X position of the texture relative to the player.
+ *    @param by Y position of the texture relative to the player.
+ *    @param scalew Amount to scale sprite horizontally.
+ *    @param scaleh Amount to scale sprite vertically.
+ *    @param sx X position of the sprite to use.
+ *    @param sy Y position of the sprite to use.
+ *    @param c Colour to use (modifies texture colour).
+ */
+void gl_batchSpriteInterpolateScale( const glTexture *sa, const glTexture *sb,
+      double inter, double bx, double by, double scalew, double scaleh,
+      int sx, int sy, const glColour *c )
+{
+   double x,y, w,h, tx,ty, z;
+
+   /* Translate coords. */
+   gl_gameToScreenCoords( &x, &y, bx - scalew * sa->sw/2., by - scaleh * sa->sh/2. );
+
+   /* Scaled sprite dimensions. */
+   z = cam_getZoom();
+   w = sa->sw*z*scalew;
+   h = sa->sh*z*scaleh;
+
+   /* check if inbounds */
+   if ((x < -w) || (x > SCREEN_W+w) ||
+         (y < -h) || (y > SCREEN_H+h))
+      return;
+
+   /* texture coords */
+   tx = sa->sw*(double)(sx)/sa->w;
+   ty = sa->sh*(sa->sy-(double)sy-1)/sa->h;
+
+   gl_batchTexture( sa, sb, inter, x, y, w, h,
+         tx, ty, sa->srw, sa->srh, c, 0. );
+}
+
+
+/**
+ * @brief Renders everything in the batch.
+ */
+void gl_batchFlush (void)
+{
+   int i, n, first;
+   BatchBucket *b;
+   GLsizei stride;
+
+   if (batch_nbuckets == 0)
+      return;
+
+   /* Gather all the vertices for a single upload. */
+   array_resize( &batch_data, 0 );
+   for (i=0; i<batch_nbuckets; i++) {
+      b = &batch_buckets[i];
+      n = array_size( batch_data );
+      array_resize( &batch_data, n + array_size(b->data) );
+      memcpy( &batch_data[n], b->data, sizeof(GLfloat) * array_size(b->data) );
+   }
+   gl_vboData( batch_vbo, sizeof(GLfloat) * array_size(batch_data), batch_data );
+
+   gl_useProgram( shaders.texture_batch.program );
+
+   /* Set the vertex. */
+   stride = sizeof(GLfloat) * BATCH_VERTEX_SIZE;
+   gl_enableVertexAttribArray( shaders.texture_batch.vertex );
+   gl_enableVertexAttribArray( shaders.texture_batch.vertex_tex );
+   gl_enableVertexAttribArray( shaders.texture_batch.vertex_color );
+   gl_enableVertexAttribArray( shaders.texture_batch.vertex_inter );
+   gl_vboActivateAttribOffset( batch_vbo, shaders.texture_batch.vertex,
+         0, 2, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( batch_vbo, shaders.texture_batch.vertex_tex,
+         sizeof(GLfloat) * 2, 2, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( batch_vbo, shaders.texture_batch.vertex_color,
+         sizeof(GLfloat) * 4, 4, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( batch_vbo, shaders.texture_batch.vertex_inter,
+         sizeof(GLfloat) * 8, 1, GL_FLOAT, stride );
+
+   /* Set shader uniforms. */
+   glUniform1i( shaders.texture_batch.sampler1, 0 );
+   glUniform1i( shaders.texture_batch.sampler2, 1 );
+   gl_Matrix4_Uniform( shaders.texture_batch.projection, gl_view_matrix );
+
+   /* Draw, one call per bucket. */
+   first = 0;
+   for (i=0; i<batch_nbuckets; i++) {
+      b = &batch_buckets[i];
+      n = array_size( b->data ) / BATCH_VERTEX_SIZE;
+      gl_activeTexture( GL_TEXTURE1 );
+      gl_bindTexture( GL_TEXTURE_2D, b->idb );
+      gl_activeTexture( GL_TEXTURE0 );
+      gl_bindTexture( GL_TEXTURE_2D, b->ida );
+      /* Always end with TEXTURE0 active. */
+      glDrawArrays( GL_TRIANGLES, first, n );
+      first += n;
+      batch_draws++;
+      array_resize( &b->data, 0 );
+   }
+
+   /* Clear state. */
+   gl_disableVertexAttribArray( shaders.texture_batch.vertex );
+   gl_disableVertexAttribArray( shaders.texture_batch.vertex_tex );
+   gl_disableVertexAttribArray( shaders.texture_batch.vertex_color );
+   gl_disableVertexAttribArray( shaders.texture_batch.vertex_inter );
+
+   /* anything failed? */
+   gl_checkErr();
+
+
+   batch_nbuckets = 0;
+   batch_last     = -1;
+}
+
+
+/**
+ * @brief Gets and resets the batch statistics.
+ *
+ *    @param[out] sprites Quads rendered since the last call.
+ *    @param[out] draws Draw calls used to render them.
+ */
+void gl_batchStats( int *sprites, int *draws )
+{
+   *sprites       = batch_sprites;
+   *draws         = batch_draws;
+   batch_sprites  = 0;
+   batch_draws    = 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef OPENGL_BATCH_H
+#  define OPENGL_BATCH_H
+
+
+#include "colour.h"
+#include "opengl_tex.h"
+
+
+/*
+ * Init/cleanup.
+ */
+int gl_initBatch (void);
+void gl_exitBatch (void);
+
+
+/*
+ * Rendering.
+ */
+void gl_batchTexture( const glTexture *ta, const glTexture *tb, double inter,
+      double x, double y, double w, double h,
+      double tx, double ty, double tw, double th,
+      const glColour *c, double angle );
+void gl_batchSprite( const glTexture *sprite, double bx, double by,
+      int sx, int sy, const glColour *c );
+void gl_batchSpriteInterpolateScale( const glTexture *sa, const glTexture *sb,
+      double inter, double bx, double by, double scalew, double scaleh,
+      int sx, int sy, const glColour *c );
+void gl_batchFlush (void);
+
+
+/*
+ * Statistics.
+ */
+void gl_batchStats( int *sprites, int *draws );
+
+
+#endif /* OPENGL_BATCH_H */
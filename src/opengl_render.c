@@ -59,32 +59,30 @@ static int gl_renderVBOcolOffset = 0; /**< VBO colour offset. */
 
 void gl_beginSolidProgram(gl_Matrix4 projection, const glColour *c)
 {
-   glUseProgram(shaders.solid.program);
-   glEnableVertexAttribArray(shaders.solid.vertex);
+   gl_useProgram(shaders.solid.program);
+   gl_enableVertexAttribArray(shaders.solid.vertex);
    gl_uniformColor(shaders.solid.color, c);
    gl_Matrix4_Uniform(shaders.solid.projection, projection);
 }
 
 void gl_endSolidProgram (void)
 {
-   glDisableVertexAttribArray(shaders.solid.vertex);
-   glUseProgram(0);
+   gl_disableVertexAttribArray(shaders.solid.vertex);
    gl_checkErr();
 }
 
 
 void gl_beginSmoothProgram(gl_Matrix4 projection)
 {
-   glUseProgram(shaders.smooth.program);
-   glEnableVertexAttribArray(shaders.smooth.vertex);
-   glEnableVertexAttribArray(shaders.smooth.vertex_color);
+   gl_useProgram(shaders.smooth.program);
+   gl_enableVertexAttribArray(shaders.smooth.vertex);
+   gl_enableVertexAttribArray(shaders.smooth.vertex_color);
    gl_Matrix4_Uniform(shaders.smooth.projection, projection);
 }
 
 void gl_endSmoothProgram() {
-   glDisableVertexAttribArray(shaders.smooth.vertex);
-   glDisableVertexAttribArray(shaders.smooth.vertex_color);
-   glUseProgram(0);
+   gl_disableVertexAttribArray(shaders.smooth.vertex);
+   gl_disableVertexAttribArray(shaders.smooth.vertex_color);
    gl_checkErr();
 }
 
@@ -164,7 +162,7 @@ void gl_renderRectH( const gl_Matrix4 *H, const glColour *c, int filled )
  */
 void gl_renderCross( double x, double y, double r, const glColour *c )
 {
-   glUseProgram(shaders.crosshairs.program);
+   gl_useProgram(shaders.crosshairs.program);
    glUniform1f(shaders.crosshairs.paramf, 1.); /* No outline. */
    gl_renderShader( x, y, r, r, 0., &shaders.crosshairs, c, 1 );
 }
@@ -221,10 +219,17 @@ void gl_blitTexture(  const glTexture* texture,
    double hw, hh;
    gl_Matrix4 projection, tex_mat;
 
-   glUseProgram(shaders.texture.program);
+   GLuint id;
+
+   /* Not loaded yet. */
+   id = gl_texID( texture );
+   if (id == 0)
+      return;
+
+   gl_useProgram(shaders.texture.program);
 
    /* Bind the texture. */
-   glBindTexture( GL_TEXTURE_2D, texture->texture);
+   gl_bindTexture( GL_TEXTURE_2D, id );
 
    /* Must have colour for now. */
    if (c == NULL)
@@ -244,7 +249,7 @@ void gl_blitTexture(  const glTexture* texture,
      projection = gl_Matrix4_Translate(projection, -hw, -hh, 0);
      projection = gl_Matrix4_Scale(projection, w, h, 1);
    }
-   glEnableVertexAttribArray( shaders.texture.vertex );
+   gl_enableVertexAttribArray( shaders.texture.vertex );
    gl_vboActivateAttribOffset( gl_squareVBO, shaders.texture.vertex,
          0, 2, GL_FLOAT, 0 );
 
@@ -262,12 +267,10 @@ void gl_blitTexture(  const glTexture* texture,
    glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
 
    /* Clear state. */
-   glDisableVertexAttribArray( shaders.texture.vertex );
+   gl_disableVertexAttribArray( shaders.texture.vertex );
 
    /* anything failed? */
    gl_checkErr();
-
-   glUseProgram(0);
 }
 
 
@@ -313,14 +316,25 @@ void gl_blitTextureInterpolate(  const glTexture* ta,
    }
 
    gl_Matrix4 projection, tex_mat;
+   GLuint ida, idb;
+
+   /* Not loaded yet, render what we can. */
+   ida = gl_texID( ta );
+   idb = gl_texID( tb );
+   if (ida == 0)
+      return;
+   else if (idb == 0) {
+      gl_blitTexture( ta, x, y, w, h, tx, ty, tw, th, c, 0. );
+      return;
+   }
 
-   glUseProgram(shaders.texture_interpolate.program);
+   gl_useProgram(shaders.texture_interpolate.program);
 
    /* Bind the textures. */
-   glActiveTexture( GL_TEXTURE1 );
-   glBindTexture( GL_TEXTURE_2D, tb->texture);
-   glActiveTexture( GL_TEXTURE0 );
-   glBindTexture( GL_TEXTURE_2D, ta->texture);
+   gl_activeTexture( GL_TEXTURE1 );
+   gl_bindTexture( GL_TEXTURE_2D, idb );
+   gl_activeTexture( GL_TEXTURE0 );
+   gl_bindTexture( GL_TEXTURE_2D, ida );
    /* Always end with TEXTURE0 active. */
 
    /* Must have colour for now. */
@@ -331,7 +345,7 @@ void gl_blitTextureInterpolate(  const glTexture* ta,
    projection = gl_view_matrix;
    projection = gl_Matrix4_Translate(projection, x, y, 0);
    projection = gl_Matrix4_Scale(projection, w, h, 1);
-   glEnableVertexAttribArray( shaders.texture_interpolate.vertex );
+   gl_enableVertexAttribArray( shaders.texture_interpolate.vertex );
    gl_vboActivateAttribOffset( gl_squareVBO, shaders.texture_interpolate.vertex, 0, 2, GL_FLOAT, 0 );
 
    /* Set the texture. */
@@ -351,12 +365,10 @@ void gl_blitTextureInterpolate(  const glTexture* ta,
    glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
 
    /* Clear state. */
-   glDisableVertexAttribArray( shaders.texture_interpolate.vertex );
+   gl_disableVertexAttribArray( shaders.texture_interpolate.vertex );
 
    /* anything failed? */
    gl_checkErr();
-
-   glUseProgram(0);
 }
 
 
@@ -720,7 +732,7 @@ void gl_renderShader( double x, double y, double w, double h, double r, const Si
  */
 void gl_renderShaderH( const SimpleShader *shd, const gl_Matrix4 *H, const glColour *c, int center )
 {
-   glEnableVertexAttribArray(shd->vertex);
+   gl_enableVertexAttribArray(shd->vertex);
    gl_vboActivateAttribOffset( center ? gl_circleVBO : gl_squareVBO, shd->vertex, 0, 2, GL_FLOAT, 0 );
 
    if (c != NULL)
@@ -730,8 +742,7 @@ void gl_renderShaderH( const SimpleShader *shd, const gl_Matrix4 *H, const glCol
 
    glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
 
-   glDisableVertexAttribArray(shd->vertex);
-   glUseProgram(0);
+   gl_disableVertexAttribArray(shd->vertex);
    gl_checkErr();
 }
 
@@ -772,7 +783,7 @@ void gl_drawCircleH( const gl_Matrix4 *H, const glColour *c, int filled )
    // TODO handle shearing and different x/y scaling
    GLfloat r = H->m[0][0] / gl_view_matrix.m[0][0];
 
-   glUseProgram( shaders.circle.program );
+   gl_useProgram( shaders.circle.program );
    glUniform2f( shaders.circle.dimensions, r, r );
    glUniform1i( shaders.circle.parami, filled );
    gl_renderShaderH( &shaders.circle, H, c, 1 );
@@ -818,9 +829,9 @@ void gl_drawCirclePartialH( const gl_Matrix4 *H, const glColour *c, double angle
    GLfloat r = H->m[0][0] / gl_view_matrix.m[0][0];
 
    /* Draw. */
-   glUseProgram( shaders.circle_partial.program );
+   gl_useProgram( shaders.circle_partial.program );
 
-   glEnableVertexAttribArray( shaders.circle_partial.vertex );
+   gl_enableVertexAttribArray( shaders.circle_partial.vertex );
    gl_vboActivateAttribOffset( gl_circleVBO, shaders.circle_partial.vertex,
          0, 2, GL_FLOAT, 0 );
 
@@ -835,9 +846,8 @@ void gl_drawCirclePartialH( const gl_Matrix4 *H, const glColour *c, double angle
    glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
 
    /* Clear state. */
-   glDisableVertexAttribArray( shaders.circle_partial.vertex );
+   gl_disableVertexAttribArray( shaders.circle_partial.vertex );
 
-   glUseProgram(0);
    gl_checkErr();
 }
 
@@ -859,7 +869,7 @@ void gl_drawLine( const double x1, const double y1,
    a = atan2( y2-y1, x2-x1 );
    s = sqrt( (x2-x1)*(x2-x1) + (y2-y1)*(y2-y1) );
 
-   glUseProgram(shaders.sdfsolid.program);
+   gl_useProgram(shaders.sdfsolid.program);
    glUniform1f(shaders.sdfsolid.paramf, 1.); /* No outline. */
    gl_renderShader( (x1+x2)/2., (y1+y2)/2., s/2.+0.5, 1.0, a, &shaders.sdfsolid, c, 1 );
 }
@@ -880,8 +890,8 @@ void gl_clipRect( int x, int y, int w, int h )
    ry = (y + gl_screen.y) / gl_screen.myscale;
    rw = w / gl_screen.mxscale;
    rh = h / gl_screen.myscale;
-   glScissor( rx, ry, rw, rh );
-   glEnable( GL_SCISSOR_TEST );
+   gl_scissor( rx, ry, rw, rh );
+   gl_enable( GL_SCISSOR_TEST );
 }
 
 
@@ -890,8 +900,8 @@ void gl_clipRect( int x, int y, int w, int h )
  */
 void gl_unclipRect (void)
 {
-   glDisable( GL_SCISSOR_TEST );
-   glScissor( 0, 0, gl_screen.rw, gl_screen.rh );
+   gl_disable( GL_SCISSOR_TEST );
+   gl_scissor( 0, 0, gl_screen.rw, gl_screen.rh );
 }
 
 
@@ -40,19 +40,20 @@ static GLuint gl_program_make( GLuint vertex_shader, GLuint fragment_shader );
 static char* gl_shader_loadfile( const char *filename, size_t *size, const char *prepend )
 {
    size_t fbufsize;
-   char *buf, *fbuf;
+   char *buf;
+   const char *fbuf;
    char path[PATH_MAX];
 
    /* Load base file. */
    *size = 0;
    snprintf(path, sizeof(path), GLSL_PATH "%s", filename);
-   fbuf = ndata_read(path, &fbufsize);
+   fbuf = ndata_map(path, &fbufsize);
    if (fbuf == NULL) {
       WARN( _("Shader '%s' not found."), path);
       return NULL;
    }
    buf = gl_shader_preprocess( size, fbuf, fbufsize, prepend, filename );
-   free( fbuf );
+   ndata_unmap( fbuf, fbufsize );
    return buf;
 }
 
@@ -75,13 +76,14 @@ static char* gl_shader_preprocess( size_t *size, const char *fbuf, size_t fbufsi
    const char *substart, *subs, *subss, *keyword;
    int offset, len;
 
-   /* Prepend useful information if available. */
+   /* Prepend useful information if available. The buffer may not be NUL
+    * terminated. */
    if (prepend != NULL) {
-      bufsize = asprintf( &buf, "%s%s", prepend, fbuf ) + 1 /* the null byte */;
+      bufsize = asprintf( &buf, "%s%.*s", prepend, (int)fbufsize, fbuf ) + 1 /* the null byte */;
    }
    else {
       bufsize = fbufsize;
-      buf = strdup(fbuf);
+      buf = strndup(fbuf, fbufsize);
    }
 
    /* Preprocess for #include.
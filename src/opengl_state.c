@@ -0,0 +1,327 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file opengl_state.c
+ *
+ * @brief Tracks the OpenGL state to skip calls that would not change it.
+ *
+ * Only the state the renderer changes all the time is tracked: the current
+ *  program, texture bindings, enabled vertex attributes, blending and
+ *  scissoring. All the code must change it through these functions, or call
+ *  gl_stateInvalidate() after changing it behind their back.
+ *
+ * Since there is a single vertex array object, the enabled vertex attributes
+ *  are global.
+ */
+
+
+/** @cond */
+#include "naev.h"
+/** @endcond */
+
+#include "opengl_state.h"
+
+
+#define GL_STATE_TEXTURE_UNITS   16 /**< Number of texture units tracked. */
+#define GL_STATE_ATTRIBS         32 /**< Number of vertex attributes tracked. */
+#define GL_STATE_UNKNOWN         ((GLuint)-1) /**< Value of state that has to be set again. */
+
+
+/**
+ * @brief The known OpenGL state.
+ */
+typedef struct glState_ {
+   GLuint program; /**< Current program. */
+   GLenum active; /**< Active texture unit. */
+   GLuint textures[ GL_STATE_TEXTURE_UNITS ]; /**< 2D texture bound to each unit. */
+   uint32_t attribs; /**< Enabled vertex attributes. */
+   uint32_t attribs_known; /**< Vertex attributes whose state is known. */
+   GLenum blend[4]; /**< Source and destination blend factors for colour and alpha. */
+   int blend_enabled; /**< Whether GL_BLEND is enabled, -1 if unknown. */
+   int depth_enabled; /**< Whether GL_DEPTH_TEST is enabled, -1 if unknown. */
+   int scissor_enabled; /**< Whether GL_SCISSOR_TEST is enabled, -1 if unknown. */
+   GLint scissor[4]; /**< Scissor box. */
+} glState;
+
+
+static glState gl_state; /**< Known state, everything is unknown until set. */
+static unsigned int gl_stateCalls   = 0; /**< Calls made since the statistics were last read. */
+static unsigned int gl_stateAvoided = 0; /**< Calls skipped since the statistics were last read. */
+
+
+/*
+ * Prototypes.
+ */
+static int *gl_stateCap( GLenum cap );
+
+
+/**
+ * @brief Forgets the known state, everything will be set again.
+ *
+ * Use after creating the context or after changing state directly.
+ */
+void gl_stateInvalidate (void)
+{
+   int i;
+
+   gl_state.program = GL_STATE_UNKNOWN;
+   gl_state.active  = GL_STATE_UNKNOWN;
+   for (i=0; i<GL_STATE_TEXTURE_UNITS; i++)
+      gl_state.textures[i] = GL_STATE_UNKNOWN;
+   gl_state.attribs        = 0;
+   gl_state.attribs_known  = 0;
+   for (i=0; i<4; i++)
+      gl_state.blend[i] = GL_STATE_UNKNOWN;
+   gl_state.blend_enabled     = -1;
+   gl_state.depth_enabled     = -1;
+   gl_state.scissor_enabled   = -1;
+   gl_state.scissor[2]        = -1; /* Never a valid width. */
+}
+
+
+/**
+ * @brief glUseProgram() that skips binding the current program.
+ */
+void gl_useProgram( GLuint program )
+{
+   if (gl_state.program == program) {
+      gl_stateAvoided++;
+      return;
+   }
+   glUseProgram( program );
+   gl_state.program = program;
+   gl_stateCalls++;
+}
+
+
+/**
+ * @brief glActiveTexture() that skips activating the active unit.
+ */
+void gl_activeTexture( GLenum texture )
+{
+   if (gl_state.active == texture) {
+      gl_stateAvoided++;
+      return;
+   }
+   glActiveTexture( texture );
+   gl_state.active = texture;
+   gl_stateCalls++;
+}
+
+
+/**
+ * @brief glBindTexture() that skips binding the bound texture.
+ *
+ * Only 2D textures are tracked.
+ */
+void gl_bindTexture( GLenum target, GLuint texture )
+{
+   GLuint unit;
+
+   unit = gl_state.active - GL_TEXTURE0;
+   if ((target != GL_TEXTURE_2D) || (gl_state.active == GL_STATE_UNKNOWN)
+         || (unit >= GL_STATE_TEXTURE_UNITS)) {
+      glBindTexture( target, texture );
+      if (target == GL_TEXTURE_2D)
+         for (unit=0; unit<GL_STATE_TEXTURE_UNITS; unit++)
+            gl_state.textures[unit] = GL_STATE_UNKNOWN;
+      gl_stateCalls++;
+      return;
+   }
+
+   if (gl_state.textures[unit] == texture) {
+      gl_stateAvoided++;
+      return;
+   }
+   glBindTexture( target, texture );
+   gl_state.textures[unit] = texture;
+   gl_stateCalls++;
+}
+
+
+/**
+ * @brief glDeleteTextures() that forgets the bindings of the deleted textures.
+ */
+void gl_deleteTextures( GLsizei n, const GLuint *textures )
+{
+   int i, j;
+
+   /* Deleting a bound texture binds 0 in its place. */
+   for (i=0; i<n; i++)
+      for (j=0; j<GL_STATE_TEXTURE_UNITS; j++)
+         if (gl_state.textures[j] == textures[i])
+            gl_state.textures[j] = 0;
+   glDeleteTextures( n, textures );
+}
+
+
+/**
+ * @brief glEnableVertexAttribArray() that skips enabled attributes.
+ */
+void gl_enableVertexAttribArray( GLuint index )
+{
+   uint32_t bit;
+
+   if (index >= GL_STATE_ATTRIBS) {
+      glEnableVertexAttribArray( index );
+      gl_stateCalls++;
+      return;
+   }
+
+   bit = 1U << index;
+   if ((gl_state.attribs_known & bit) && (gl_state.attribs & bit)) {
+      gl_stateAvoided++;
+      return;
+   }
+   glEnableVertexAttribArray( index );
+   gl_state.attribs        |= bit;
+   gl_state.attribs_known  |= bit;
+   gl_stateCalls++;
+}
+
+
+/**
+ * @brief glDisableVertexAttribArray() that skips disabled attributes.
+ */
+void gl_disableVertexAttribArray( GLuint index )
+{
+   uint32_t bit;
+
+   if (index >= GL_STATE_ATTRIBS) {
+      glDisableVertexAttribArray( index );
+      gl_stateCalls++;
+      return;
+   }
+
+   bit = 1U << index;
+   if ((gl_state.attribs_known & bit) && !(gl_state.attribs & bit)) {
+      gl_stateAvoided++;
+      return;
+   }
+   glDisableVertexAttribArray( index );
+   gl_state.attribs        &= ~bit;
+   gl_state.attribs_known  |= bit;
+   gl_stateCalls++;
+}
+
+
+/**
+ * @brief glBlendFunc() that skips setting the current blend factors.
+ */
+void gl_blendFunc( GLenum sfactor, GLenum dfactor )
+{
+   gl_blendFuncSeparate( sfactor, dfactor, sfactor, dfactor );
+}
+
+
+/**
+ * @brief glBlendFuncSeparate() that skips setting the current blend factors.
+ */
+void gl_blendFuncSeparate( GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha )
+{
+   if ((gl_state.blend[0] == srcRGB) && (gl_state.blend[1] == dstRGB)
+         && (gl_state.blend[2] == srcAlpha) && (gl_state.blend[3] == dstAlpha)) {
+      gl_stateAvoided++;
+      return;
+   }
+   glBlendFuncSeparate( srcRGB, dstRGB, srcAlpha, dstAlpha );
+   gl_state.blend[0] = srcRGB;
+   gl_state.blend[1] = dstRGB;
+   gl_state.blend[2] = srcAlpha;
+   gl_state.blend[3] = dstAlpha;
+   gl_stateCalls++;
+}
+
+
+/**
+ * @brief Gets the tracked state of a capability.
+ *
+ *    @return The state or NULL if the capability is not tracked.
+ */
+static int *gl_stateCap( GLenum cap )
+{
+   switch (cap) {
+      case GL_BLEND:
+         return &gl_state.blend_enabled;
+      case GL_DEPTH_TEST:
+         return &gl_state.depth_enabled;
+      case GL_SCISSOR_TEST:
+         return &gl_state.scissor_enabled;
+      default:
+         return NULL;
+   }
+}
+
+
+/**
+ * @brief glEnable() that skips enabled capabilities.
+ */
+void gl_enable( GLenum cap )
+{
+   int *state;
+
+   state = gl_stateCap( cap );
+   if ((state != NULL) && (*state == 1)) {
+      gl_stateAvoided++;
+      return;
+   }
+   glEnable( cap );
+   if (state != NULL)
+      *state = 1;
+   gl_stateCalls++;
+}
+
+
+/**
+ * @brief glDisable() that skips disabled capabilities.
+ */
+void gl_disable( GLenum cap )
+{
+   int *state;
+
+   state = gl_stateCap( cap );
+   if ((state != NULL) && (*state == 0)) {
+      gl_stateAvoided++;
+      return;
+   }
+   glDisable( cap );
+   if (state != NULL)
+      *state = 0;
+   gl_stateCalls++;
+}
+
+
+/**
+ * @brief glScissor() that skips setting the current scissor box.
+ */
+void gl_scissor( GLint x, GLint y, GLsizei width, GLsizei height )
+{
+   if ((gl_state.scissor[0] == x) && (gl_state.scissor[1] == y)
+         && (gl_state.scissor[2] == width) && (gl_state.scissor[3] == height)) {
+      gl_stateAvoided++;
+      return;
+   }
+   glScissor( x, y, width, height );
+   gl_state.scissor[0] = x;
+   gl_state.scissor[1] = y;
+   gl_state.scissor[2] = width;
+   gl_state.scissor[3] = height;
+   gl_stateCalls++;
+}
+
+
+/**
+ * @brief Gets and resets the state tracking statistics.
+ *
+ *    @param[out] calls State changes that reached OpenGL since the last call.
+ *    @param[out] avoided State changes that were skipped since the last call.
+ */
+void gl_stateStats( unsigned int *calls, unsigned int *avoided )
+{
+   *calls            = gl_stateCalls;
+   *avoided          = gl_stateAvoided;
+   gl_stateCalls     = 0;
+   gl_stateAvoided   = 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef OPENGL_STATE_H
+#  define OPENGL_STATE_H
+
+
+/** @cond */
+#include "glad.h"
+/** @endcond */
+
+
+/*
+ * Init/cleanup.
+ */
+void gl_stateInvalidate (void);
+
+
+/*
+ * Tracked state, these skip the call when it would not change anything.
+ */
+void gl_useProgram( GLuint program );
+void gl_activeTexture( GLenum texture );
+void gl_bindTexture( GLenum target, GLuint texture );
+void gl_deleteTextures( GLsizei n, const GLuint *textures );
+void gl_enableVertexAttribArray( GLuint index );
+void gl_disableVertexAttribArray( GLuint index );
+void gl_blendFunc( GLenum sfactor, GLenum dfactor );
+void gl_blendFuncSeparate( GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha );
+void gl_enable( GLenum cap );
+void gl_disable( GLenum cap );
+void gl_scissor( GLint x, GLint y, GLsizei width, GLsizei height );
+
+
+/*
+ * Statistics.
+ */
+void gl_stateStats( unsigned int *calls, unsigned int *avoided );
+
+
+#endif /* OPENGL_STATE_H */
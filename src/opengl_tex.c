@@ -10,6 +10,7 @@
 
 
 /** @cond */
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "physfsrwops.h"
@@ -22,20 +23,26 @@
 #include "conf.h"
 #include "gui.h"
 #include "log.h"
-#include "md5.h"
+#include "ndata.h"
 #include "nfile.h"
 #include "nstring.h"
 #include "opengl.h"
+#include "threadpool.h"
 
 
 /*
  * graphic list
  */
+#define TEXTURE_HASH_MIN   256 /**< Initial number of buckets of the texture hash table. */
 /**
  * @brief Represents a node in the texture list.
+ *
+ * Nodes are chained in the buckets of a hash table keyed by name, so all the
+ *  sprite layouts of an image share a bucket.
  */
 typedef struct glTexList_ {
-   struct glTexList_ *next; /**< Next in linked list */
+   struct glTexList_ *next; /**< Next in the bucket. */
+   unsigned int hash; /**< Hash of the name. */
    glTexture *tex; /**< associated texture */
    int used; /**< counts how many times texture is being used */
    /* TODO We currently treat images with different number of sprites as
@@ -45,7 +52,76 @@ typedef struct glTexList_ {
    int sx; /**< X sprites */
    int sy; /**< Y sprites */
 } glTexList;
-static glTexList* texture_list = NULL; /**< Texture list. */
+static glTexList** texture_hash = NULL; /**< Texture hash table buckets. */
+static int texture_nhash      = 0; /**< Number of buckets, always a power of two. */
+static int texture_ntex       = 0; /**< Number of textures in the table. */
+
+
+/*
+ * Deferred loading.
+ */
+/**
+ * @brief A texture being decoded in the background.
+ *
+ * Everything but done is only touched by the worker until done is set.
+ */
+typedef struct glTexLoad_ {
+   glTexture *tex; /**< Texture to upload into. */
+   char *path; /**< Path of the image. */
+   unsigned int flags; /**< Flags of the texture. */
+   int upload; /**< Whether to load into tex, or only decode for func because the texture already exists. */
+   int resident; /**< Whether to create the OpenGL texture, evictable textures are created on first use. */
+   glTexLoadFunc func; /**< Function to run once uploaded, or NULL. */
+   void *data; /**< Data for func. */
+   SDL_Surface *surface; /**< Decoded surface. */
+   uint8_t *trans; /**< Transparency map if requested. */
+   int err; /**< Error of the worker, logged by the main thread when uploading. */
+   int done; /**< Worker is done, protected by texload_lock. */
+} glTexLoad;
+#define TEXLOAD_EOPEN   1 /**< Image couldn't be opened. */
+#define TEXLOAD_EDECODE 2 /**< Image couldn't be decoded. */
+#define TEXLOAD_ETRANS  3 /**< Transparency map couldn't be allocated. */
+static glTexLoad **texload_queue = NULL; /**< Pending loads, main thread only. */
+static SDL_mutex *texload_lock   = NULL; /**< Protects the done flags. */
+static SDL_cond *texload_cond    = NULL; /**< Signaled when a load is done. */
+
+
+/*
+ * Residency.
+ */
+static unsigned int tex_frame    = 0; /**< Current frame for the LRU. */
+static size_t tex_evictable      = 0; /**< Resident bytes of evictable textures. */
+static unsigned int tex_evicted  = 0; /**< Number of evictions so far. */
+
+
+/*
+ * Transparency map cache.
+ */
+#define TRANS_CACHE_FILE      "collisions.bin" /**< Packed cache in the cache directory. */
+#define TRANS_CACHE_OLD_DIR   "collisions" /**< Directory of the old per-image cache files. */
+#define TRANS_CACHE_MAGIC     0x5352544E /**< Magic number of the packed cache. */
+#define TRANS_CACHE_VERSION   1 /**< Version of the packed cache format. */
+#define TRANS_CACHE_MAX_DIM   32768 /**< Largest map dimension accepted when loading, keeps the size from overflowing. */
+/**
+ * @brief A cached transparency map.
+ *
+ * Maps are validated by the size and modification time of the image instead
+ *  of hashing its contents.
+ */
+typedef struct glTransEntry_ {
+   char *path; /**< Path of the image in ndata. */
+   int64_t size; /**< Size of the image file. */
+   int64_t mtime; /**< Modification time of the image file. */
+   int w; /**< Width of the map. */
+   int h; /**< Height of the map. */
+   uint8_t *trans; /**< Map, points into trans_blob for loaded entries. */
+} glTransEntry;
+static const char *trans_blob       = NULL; /**< Contents of the cache file (see ndata_mapFile()). */
+static size_t trans_blobsize        = 0; /**< Size of trans_blob. */
+static glTransEntry *trans_cache    = NULL; /**< Loaded entries sorted by path, read-only. */
+static glTransEntry *trans_added    = NULL; /**< Newly generated entries sorted by path, protected by trans_lock. */
+static SDL_mutex *trans_lock        = NULL; /**< Protects trans_added. */
+static int trans_dirty              = 0; /**< Whether the cache needs to be saved. */
 
 
 /*
@@ -60,9 +136,33 @@ static GLuint gl_texParameters( unsigned int flags );
 static GLuint gl_loadSurface( SDL_Surface* surface, unsigned int flags, int freesur );
 static glTexture* gl_loadNewImage( const char* path, unsigned int flags );
 static glTexture* gl_loadNewImageRWops( const char *path, SDL_RWops *rw, unsigned int flags );
+static uint8_t* gl_genTrans( const char *name, SDL_Surface* surface, int w, int h );
+static void gl_setSprites( glTexture *tex, int sx, int sy );
+/* Deferred loading. */
+static int gl_texLoadWorker( void *data );
+static int gl_texLoadDone( glTexLoad *job );
+static void gl_texLoadUpload( int i );
+static void gl_texLoadQueue( glTexLoad *job );
+/* Residency. */
+static size_t gl_texBytes( const glTexture *tex );
+static void gl_texSetResident( glTexture *tex, GLuint texture );
+static int gl_texCmpUse( const void *p1, const void *p2 );
+static int gl_texCmpBytes( const void *p1, const void *p2 );
 /* List. */
+static unsigned int gl_texHash( const char *path );
+static void gl_texRehash( int nhash );
 static glTexture* gl_texExists( const char* path, int sx, int sy );
 static int gl_texAdd( glTexture *tex, int sx, int sy );
+/* transparency cache */
+static int gl_transCacheCmp( const void *p1, const void *p2 );
+static void gl_transCachePath( char *buf, size_t len );
+static void gl_transCacheLoad (void);
+static uint8_t* gl_transCacheGet( const char *path, int64_t size, int64_t mtime, int w, int h );
+static void gl_transCacheAdd( const char *path, int64_t size, int64_t mtime, int w, int h, const uint8_t *trans );
+static int gl_transCacheAddedPos( const char *path, int *found );
+static void gl_transCacheClear( glTransEntry *entries );
+static int gl_transCacheWrite( SDL_RWops *rw, const glTransEntry *e );
+static void gl_transCacheFree (void);
 
 
 /**
@@ -136,12 +236,9 @@ static uint8_t* SDL_MapTrans( SDL_Surface* s, int w, int h )
 
    /* alloc memory for just enough bits to hold all the data we need */
    size = gl_transSize(w, h);
-   t = malloc(size);
-   if (t==NULL) {
-      WARN(_("Out of Memory"));
-      return NULL;
-   }
-   memset(t, 0, size); /* important, must be set to zero */
+   t = calloc(1, size); /* important, must be set to zero */
+   if (t==NULL)
+      return NULL; /* Logged by the caller, may be a worker thread. */
 
    /* Check each pixel individually. */
    for (i=0; i<h; i++)
@@ -175,7 +272,7 @@ static GLuint gl_texParameters( unsigned int flags )
 
    /* opengl texture binding */
    glGenTextures( 1, &texture ); /* Creates the texture */
-   glBindTexture( GL_TEXTURE_2D, texture ); /* Loads the texture */
+   gl_bindTexture( GL_TEXTURE_2D, texture ); /* Loads the texture */
 
    /* Filtering, LINEAR is better for scaling, nearest looks nicer, LINEAR
     * also seems to create a bit of artifacts around the edges */
@@ -214,13 +311,13 @@ int gl_fboCreate( GLuint *fbo, GLuint *tex, GLsizei width, GLsizei height )
 
    /* Create the render buffer. */
    glGenTextures(1, tex);
-   glBindTexture(GL_TEXTURE_2D, *tex);
+   gl_bindTexture(GL_TEXTURE_2D, *tex);
    glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB_ALPHA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-   glBindTexture(GL_TEXTURE_2D, 0);
+   gl_bindTexture(GL_TEXTURE_2D, 0);
 
    /* Create the frame buffer. */
    glGenFramebuffers( 1, fbo );
@@ -260,7 +357,8 @@ glTexture* gl_loadImageData( float *data, int w, int h, int sx, int sy, const ch
 
    /* Copy over. */
    glTexImage2D( GL_TEXTURE_2D, 0, GL_SRGB_ALPHA, w, h, 0, GL_RGBA, GL_FLOAT, data );
-   glBindTexture( GL_TEXTURE_2D, 0 );
+   texture->vram = gl_texBytes( texture );
+   gl_bindTexture( GL_TEXTURE_2D, 0 );
 
    /* Check errors. */
    gl_checkErr();
@@ -341,17 +439,11 @@ static GLuint gl_loadSurface( SDL_Surface* surface, unsigned int flags, int free
  *    @param freesur Whether or not to free the surface.
  *    @return The glTexture for surface.
  */
-glTexture* gl_loadImagePadTrans( const char *name, SDL_Surface* surface, SDL_RWops *rw,
+glTexture* gl_loadImagePadTrans( const char *name, SDL_Surface* surface,
       unsigned int flags, int w, int h, int sx, int sy, int freesur )
 {
    glTexture *texture;
-   size_t i, filesize;
-   size_t cachesize, pngsize;
    uint8_t *trans;
-   char *cachefile, *data;
-   char digest[33];
-   md5_state_t md5;
-   md5_byte_t *md5val;
 
    if ((name != NULL) && !(flags & OPENGL_TEX_SKIPCACHE)) {
       texture = gl_texExists( name, sx, sy );
@@ -365,77 +457,387 @@ glTexture* gl_loadImagePadTrans( const char *name, SDL_Surface* surface, SDL_RWo
    if (flags & OPENGL_TEX_MAPTRANS)
       flags ^= OPENGL_TEX_MAPTRANS;
 
-   /* Appropriate size for the transparency map, see SDL_MapTrans */
-   cachesize = gl_transSize(w, h);
+   trans = gl_genTrans( name, surface, w, h );
+   if (trans == NULL)
+      WARN(_("Out of Memory"));
 
-   cachefile = NULL;
-   trans     = NULL;
+   texture = gl_loadImagePad( name, surface, flags, w, h, sx, sy, freesur );
+   texture->trans = trans;
+   return texture;
+}
 
-   if (rw != NULL) {
-      md5val = malloc(16);
-      md5_init(&md5);
 
-      pngsize = SDL_RWseek( rw, 0, SEEK_END );
-      SDL_RWseek( rw, 0, SEEK_SET );
+/**
+ * @brief Gets the transparency map of a surface, using the cache if possible.
+ *
+ * Does not touch OpenGL, so it is safe to call from worker threads.
+ *
+ *    @param name Name of the image, the cache is only used if it is a path in
+ *           ndata.
+ *    @param surface Surface to map.
+ *    @param w Non-padded width.
+ *    @param h Non-padded height.
+ *    @return Newly allocated transparency map.
+ */
+static uint8_t* gl_genTrans( const char *name, SDL_Surface* surface, int w, int h )
+{
+   PHYSFS_Stat st;
+   uint8_t *trans;
+   int cache;
+
+   /* Only files in ndata can be validated. */
+   cache = (name != NULL) && PHYSFS_stat( name, &st );
+   if (cache) {
+      trans = gl_transCacheGet( name, st.filesize, st.modtime, w, h );
+      if (trans != NULL)
+         return trans;
+   }
 
-      data = malloc(pngsize);
-      if (data == NULL)
-         WARN(_("Out of Memory"));
-      else {
-         SDL_RWread( rw, data, pngsize, 1 );
-         md5_append( &md5, (md5_byte_t*)data, pngsize );
-         free(data);
-      }
-      md5_finish( &md5, md5val );
+   SDL_LockSurface(surface);
+   trans = SDL_MapTrans( surface, w, h );
+   SDL_UnlockSurface(surface);
 
-      for (i=0; i<16; i++)
-         snprintf( &digest[i * 2], 3, "%02x", md5val[i] );
-      free(md5val);
+   if (cache && (trans != NULL))
+      gl_transCacheAdd( name, st.filesize, st.modtime, w, h, trans );
 
-      asprintf( &cachefile, "%scollisions/%s",
-         nfile_cachePath(), digest );
+   return trans;
+}
 
-      /* Attempt to find a cached transparency map. */
-      if (nfile_fileExists(cachefile)) {
-         trans = (uint8_t*)nfile_readFile( &filesize, cachefile );
 
-         /* Consider cached data invalid if the length doesn't match. */
-         if (trans != NULL && cachesize != (unsigned int)filesize) {
-            free(trans);
-            trans = NULL;
-         }
-         /* Cached data matches, no need to overwrite. */
-         else {
-            free(cachefile);
-            cachefile = NULL;
-         }
+/**
+ * @brief Compares transparency cache entries by path.
+ */
+static int gl_transCacheCmp( const void *p1, const void *p2 )
+{
+   return strcmp( ((const glTransEntry*)p1)->path, ((const glTransEntry*)p2)->path );
+}
+
+
+/**
+ * @brief Gets the path of the packed transparency cache.
+ */
+static void gl_transCachePath( char *buf, size_t len )
+{
+   snprintf( buf, len, "%s%s", nfile_cachePath(), TRANS_CACHE_FILE );
+}
+
+
+/**
+ * @brief Loads the packed transparency cache.
+ *
+ * The whole cache is a single blob mapped at once, the entries point into it.
+ *
+ * The format is the header followed by the entries, each one being the
+ *  path length (uint16_t), path (not terminated), file size and modification
+ *  time (int64_t), width and height (uint32_t) and the map itself. Everything
+ *  is in native byte order, the magic number catches foreign caches.
+ */
+static void gl_transCacheLoad (void)
+{
+   char path[PATH_MAX];
+   const char *p, *end;
+   size_t size;
+   uint16_t len;
+   uint32_t header[3], wh[2];
+   int64_t sm[2];
+   glTransEntry *e;
+
+   trans_lock     = SDL_CreateMutex();
+   trans_cache    = array_create( glTransEntry );
+   trans_added    = array_create( glTransEntry );
+
+   /* Get rid of the cache files of older versions. */
+   snprintf( path, sizeof(path), "%s%s", nfile_cachePath(), TRANS_CACHE_OLD_DIR );
+   if (nfile_dirExists( path ) && (nfile_dirRemove( path ) < 0))
+      WARN(_("Unable to remove old collision cache '%s': %s"), path, strerror(errno));
+
+   gl_transCachePath( path, sizeof(path) );
+   trans_blob = ndata_mapFile( path, &size );
+   if (trans_blob == NULL)
+      return;
+   trans_blobsize = size;
+
+   p     = trans_blob;
+   end   = trans_blob + size;
+   if (size < sizeof(header))
+      goto corrupt;
+   memcpy( header, p, sizeof(header) );
+   p += sizeof(header);
+   if ((header[0] != TRANS_CACHE_MAGIC) || (header[1] != TRANS_CACHE_VERSION))
+      goto corrupt;
+
+   array_free( trans_cache );
+   trans_cache = array_create_size( glTransEntry, MIN( header[2], size / sizeof(len) ) );
+   while (p < end) {
+      /* Check against the remaining bytes before moving past them. */
+      if ((size_t)(end-p) < sizeof(len))
+         goto corrupt;
+      memcpy( &len, p, sizeof(len) );
+      p += sizeof(len);
+      if ((size_t)(end-p) < len + sizeof(sm) + sizeof(wh))
+         goto corrupt;
+
+      e = &array_grow( &trans_cache );
+      e->path  = strndup( p, len );
+      p += len;
+      memcpy( sm, p, sizeof(sm) );
+      p += sizeof(sm);
+      memcpy( wh, p, sizeof(wh) );
+      p += sizeof(wh);
+      e->size  = sm[0];
+      e->mtime = sm[1];
+      e->w     = wh[0];
+      e->h     = wh[1];
+      e->trans = NULL;
+      if ((wh[0] == 0) || (wh[1] == 0) || (wh[0] > TRANS_CACHE_MAX_DIM) || (wh[1] > TRANS_CACHE_MAX_DIM))
+         goto corrupt;
+      if (gl_transSize( e->w, e->h ) > (size_t)(end-p))
+         goto corrupt;
+      e->trans = (uint8_t*)p;
+      p += gl_transSize( e->w, e->h );
+   }
+
+   qsort( trans_cache, array_size(trans_cache), sizeof(glTransEntry), gl_transCacheCmp );
+   return;
+
+corrupt:
+   WARN(_("Collision cache '%s' is invalid, regenerating."), path);
+   gl_transCacheClear( trans_cache );
+   trans_cache = array_create( glTransEntry );
+   ndata_unmap( trans_blob, trans_blobsize );
+   trans_blob     = NULL;
+   trans_blobsize = 0;
+   trans_dirty    = 1;
+}
+
+
+/**
+ * @brief Looks up a transparency map in the cache.
+ *
+ *    @return Newly allocated copy of the map or NULL if not cached or stale.
+ */
+static uint8_t* gl_transCacheGet( const char *path, int64_t size, int64_t mtime, int w, int h )
+{
+   glTransEntry key, *e;
+   uint8_t *trans;
+   int i, found;
+
+   if (trans_cache == NULL)
+      return NULL;
+
+   /* The loaded entries are never modified, so no need to lock. */
+   key.path = (char*)path;
+   e = bsearch( &key, trans_cache, array_size(trans_cache), sizeof(glTransEntry), gl_transCacheCmp );
+   if ((e != NULL) && (e->size == size) && (e->mtime == mtime) &&
+         (e->w == w) && (e->h == h)) {
+      trans = malloc( gl_transSize( w, h ) );
+      memcpy( trans, e->trans, gl_transSize( w, h ) );
+      return trans;
+   }
+
+   /* Images generated earlier this run, e.g. reloaded after eviction. */
+   trans = NULL;
+   SDL_LockMutex( trans_lock );
+   i = gl_transCacheAddedPos( path, &found );
+   if (found) {
+      e = &trans_added[i];
+      if ((e->size == size) && (e->mtime == mtime) && (e->w == w) && (e->h == h)) {
+         trans = malloc( gl_transSize( w, h ) );
+         memcpy( trans, e->trans, gl_transSize( w, h ) );
       }
    }
-   else {
-      /* We could hash raw pixel data here, but that's slower than just
-       * generating the map from scratch.
-       */
-      WARN(_("Texture '%s' has no RWops"), name);
-   }
-
-   if (trans == NULL) {
-      SDL_LockSurface(surface);
-      trans = SDL_MapTrans( surface, w, h );
-      SDL_UnlockSurface(surface);
-
-      if (cachefile != NULL) {
-         /* Cache newly-generated transparency map. */
-         char dirpath[PATH_MAX];
-         snprintf( dirpath, sizeof(dirpath), "%s/%s", nfile_cachePath(), "collisions/" );
-         nfile_dirMakeExist( dirpath );
-         nfile_writeFile( (char*)trans, cachesize, cachefile );
-         free(cachefile);
+   SDL_UnlockMutex( trans_lock );
+   return trans;
+}
+
+
+/**
+ * @brief Finds the insertion position of a path in the new entries.
+ *
+ * Must be called with trans_lock held.
+ *
+ *    @param path Path to look for.
+ *    @param[out] found Set to whether the entry at the position has the path.
+ *    @return Position of the entry with the path or where it should go.
+ */
+static int gl_transCacheAddedPos( const char *path, int *found )
+{
+   int l, r, m, c;
+
+   l = 0;
+   r = array_size(trans_added);
+   while (l < r) {
+      m = (l+r) / 2;
+      c = strcmp( trans_added[m].path, path );
+      if (c == 0) {
+         *found = 1;
+         return m;
       }
+      else if (c < 0)
+         l = m+1;
+      else
+         r = m;
    }
+   *found = 0;
+   return l;
+}
 
-   texture = gl_loadImagePad( name, surface, flags, w, h, sx, sy, freesur );
-   texture->trans = trans;
-   return texture;
+
+/**
+ * @brief Adds a newly generated transparency map to the cache.
+ *
+ * An image generated more than once replaces its previous entry.
+ */
+static void gl_transCacheAdd( const char *path, int64_t size, int64_t mtime, int w, int h, const uint8_t *trans )
+{
+   glTransEntry *e;
+   int i, found;
+
+   if (trans_cache == NULL)
+      return;
+
+   SDL_LockMutex( trans_lock );
+   i = gl_transCacheAddedPos( path, &found );
+   if (found) {
+      e = &trans_added[i];
+      free( e->trans );
+   }
+   else {
+      (void)array_grow( &trans_added );
+      e = &trans_added[i];
+      memmove( e+1, e, sizeof(glTransEntry) * (array_size(trans_added)-i-1) );
+      e->path = strdup( path );
+   }
+   e->size  = size;
+   e->mtime = mtime;
+   e->w     = w;
+   e->h     = h;
+   e->trans = malloc( gl_transSize( w, h ) );
+   memcpy( e->trans, trans, gl_transSize( w, h ) );
+   trans_dirty = 1;
+   SDL_UnlockMutex( trans_lock );
+}
+
+
+/**
+ * @brief Frees the paths of cache entries and the array.
+ */
+static void gl_transCacheClear( glTransEntry *entries )
+{
+   int i;
+   for (i=0; i<array_size(entries); i++)
+      free( entries[i].path );
+   array_free( entries );
+}
+
+
+/**
+ * @brief Writes one entry of the packed transparency cache.
+ */
+static int gl_transCacheWrite( SDL_RWops *rw, const glTransEntry *e )
+{
+   uint16_t len;
+   int64_t sm[2];
+   uint32_t wh[2];
+
+   len   = strlen( e->path );
+   sm[0] = e->size;
+   sm[1] = e->mtime;
+   wh[0] = e->w;
+   wh[1] = e->h;
+   if ((SDL_RWwrite( rw, &len, sizeof(len), 1 ) != 1) ||
+         (SDL_RWwrite( rw, e->path, len, 1 ) != 1) ||
+         (SDL_RWwrite( rw, sm, sizeof(sm), 1 ) != 1) ||
+         (SDL_RWwrite( rw, wh, sizeof(wh), 1 ) != 1) ||
+         (SDL_RWwrite( rw, e->trans, gl_transSize( e->w, e->h ), 1 ) != 1))
+      return -1;
+   return 0;
+}
+
+
+/**
+ * @brief Saves the transparency cache if new maps were generated.
+ *
+ * Loaded entries replaced by a new map of the same path are dropped. The
+ *  cache is written to a temporary file which is then renamed into place.
+ */
+void gl_transCacheSave (void)
+{
+   char path[PATH_MAX], tmp[PATH_MAX];
+   int i, n, ret;
+   uint32_t header[3];
+   SDL_RWops *rw;
+   glTransEntry key;
+
+   if ((trans_cache == NULL) || !trans_dirty)
+      return;
+
+   SDL_LockMutex( trans_lock );
+
+   /* Count the entries that are kept. */
+   n = array_size(trans_added);
+   for (i=0; i<array_size(trans_cache); i++) {
+      key.path = trans_cache[i].path;
+      if (bsearch( &key, trans_added, array_size(trans_added), sizeof(glTransEntry), gl_transCacheCmp ) == NULL)
+         n++;
+   }
+
+   nfile_dirMakeExist( nfile_cachePath() );
+   gl_transCachePath( path, sizeof(path) );
+   snprintf( tmp, sizeof(tmp), "%s.tmp", path );
+   rw = SDL_RWFromFile( tmp, "wb" );
+   if (rw == NULL) {
+      WARN(_("Unable to open '%s' for writing: %s"), tmp, SDL_GetError());
+      SDL_UnlockMutex( trans_lock );
+      return;
+   }
+   header[0] = TRANS_CACHE_MAGIC;
+   header[1] = TRANS_CACHE_VERSION;
+   header[2] = n;
+   ret = (SDL_RWwrite( rw, header, sizeof(header), 1 ) != 1);
+   for (i=0; (i<array_size(trans_cache)) && !ret; i++) {
+      key.path = trans_cache[i].path;
+      if (bsearch( &key, trans_added, array_size(trans_added), sizeof(glTransEntry), gl_transCacheCmp ) == NULL)
+         ret = gl_transCacheWrite( rw, &trans_cache[i] );
+   }
+   for (i=0; (i<array_size(trans_added)) && !ret; i++)
+      ret = gl_transCacheWrite( rw, &trans_added[i] );
+   if (SDL_RWclose( rw ) != 0)
+      ret = 1;
+   if (ret) {
+      WARN(_("Error writing collision cache '%s': %s"), tmp, SDL_GetError());
+      remove( tmp );
+   }
+   else if (nfile_rename( tmp, path ) < 0) {
+      WARN(_("Unable to rename '%s' to '%s': %s"), tmp, path, strerror(errno));
+      remove( tmp );
+   }
+   else
+      trans_dirty = 0;
+   SDL_UnlockMutex( trans_lock );
+}
+
+
+/**
+ * @brief Frees the transparency cache.
+ */
+static void gl_transCacheFree (void)
+{
+   int i;
+
+   gl_transCacheSave();
+
+   for (i=0; i<array_size(trans_added); i++)
+      free( trans_added[i].trans );
+   gl_transCacheClear( trans_added );
+   gl_transCacheClear( trans_cache );
+   ndata_unmap( trans_blob, trans_blobsize );
+   SDL_DestroyMutex( trans_lock );
+   trans_added    = NULL;
+   trans_cache    = NULL;
+   trans_blob     = NULL;
+   trans_blobsize = 0;
+   trans_lock     = NULL;
 }
 
 
@@ -465,7 +867,7 @@ glTexture* gl_loadImagePad( const char *name, SDL_Surface* surface,
    }
 
    if (flags & OPENGL_TEX_MAPTRANS)
-      return gl_loadImagePadTrans( name, surface, NULL, flags, w, h,
+      return gl_loadImagePadTrans( name, surface, flags, w, h,
             sx, sy, freesur );
 
    /* set up the texture defaults */
@@ -483,6 +885,7 @@ glTexture* gl_loadImagePad( const char *name, SDL_Surface* surface,
    texture->srw   = texture->sw / texture->w;
    texture->srh   = texture->sh / texture->h;
    texture->flags = flags;
+   texture->vram  = gl_texBytes( texture );
 
    if (name != NULL) {
       texture->name = strdup(name);
@@ -508,6 +911,44 @@ glTexture* gl_loadImage( SDL_Surface* surface, unsigned int flags )
 }
 
 
+/**
+ * @brief Hashes the name of a texture (FNV-1a).
+ */
+static unsigned int gl_texHash( const char *path )
+{
+   unsigned int h = 2166136261u;
+   for (; *path != '\0'; path++) {
+      h ^= (unsigned char) *path;
+      h *= 16777619u;
+   }
+   return h;
+}
+
+
+/**
+ * @brief Resizes the texture hash table.
+ *
+ *    @param nhash New number of buckets, must be a power of two.
+ */
+static void gl_texRehash( int nhash )
+{
+   int i;
+   glTexList **buckets, *cur, *next;
+
+   buckets = calloc( nhash, sizeof(glTexList*) );
+   for (i=0; i<texture_nhash; i++) {
+      for (cur=texture_hash[i]; cur!=NULL; cur=next) {
+         next = cur->next;
+         cur->next = buckets[ cur->hash & (nhash-1) ];
+         buckets[ cur->hash & (nhash-1) ] = cur;
+      }
+   }
+   free( texture_hash );
+   texture_hash   = buckets;
+   texture_nhash  = nhash;
+}
+
+
 /**
  * @brief Check to see if a texture matching a path already exists.
  *
@@ -519,19 +960,19 @@ glTexture* gl_loadImage( SDL_Surface* surface, unsigned int flags )
 static glTexture* gl_texExists( const char* path, int sx, int sy )
 {
    glTexList *cur;
+   unsigned int h;
 
    /* Null does never exist. */
-   if (path==NULL)
+   if ((path==NULL) || (texture_ntex==0))
       return NULL;
 
    /* check to see if it already exists */
-   if (texture_list != NULL) {
-      for (cur=texture_list; cur!=NULL; cur=cur->next) {
-         if ((strcmp(path,cur->tex->name)==0) &&
-               (cur->sx==sx) && (cur->sy==sy)) {
-            cur->used += 1;
-            return cur->tex;
-         }
+   h = gl_texHash( path );
+   for (cur=texture_hash[ h & (texture_nhash-1) ]; cur!=NULL; cur=cur->next) {
+      if ((cur->hash==h) && (cur->sx==sx) && (cur->sy==sy) &&
+            (strcmp(path,cur->tex->name)==0)) {
+         cur->used += 1;
+         return cur->tex;
       }
    }
 
@@ -544,24 +985,26 @@ static glTexture* gl_texExists( const char* path, int sx, int sy )
  */
 static int gl_texAdd( glTexture *tex, int sx, int sy )
 {
-   glTexList *new, *last = texture_list;
+   glTexList *new;
+
+   /* Keep the load factor under 1. */
+   if (texture_nhash == 0)
+      gl_texRehash( TEXTURE_HASH_MIN );
+   else if (texture_ntex >= texture_nhash)
+      gl_texRehash( 2*texture_nhash );
 
    /* Create the new node */
    new = malloc( sizeof(glTexList) );
-   new->next = NULL;
+   new->hash = gl_texHash( tex->name );
    new->used = 1;
    new->tex  = tex;
    new->sx   = sx;
    new->sy   = sy;
 
-   if (texture_list == NULL) /* special condition - creating new list */
-      texture_list = new;
-   else {
-      while (last->next != NULL)
-         last = last->next;
-
-      last->next = new;
-   }
+   /* Newest first, they're the most likely to be looked up again. */
+   new->next = texture_hash[ new->hash & (texture_nhash-1) ];
+   texture_hash[ new->hash & (texture_nhash-1) ] = new;
+   texture_ntex++;
 
    return 0;
 }
@@ -681,7 +1124,7 @@ static glTexture* gl_loadNewImageRWops( const char *path, SDL_RWops *rw, unsigne
    }
 
    if (flags & OPENGL_TEX_MAPTRANS)
-      texture = gl_loadImagePadTrans( path, surface, rw, flags, surface->w, surface->h, 1, 1, 1 );
+      texture = gl_loadImagePadTrans( path, surface, flags, surface->w, surface->h, 1, 1, 1 );
    else
       texture = gl_loadImagePad( path, surface, flags, surface->w, surface->h, 1, 1, 1 );
 
@@ -717,12 +1160,7 @@ glTexture* gl_newSprite( const char* path, const int sx, const int sy,
 
    /* will possibly overwrite an existing textur properties
     * so we have to load same texture always the same sprites */
-   texture->sx    = (double) sx;
-   texture->sy    = (double) sy;
-   texture->sw    = texture->w / texture->sx;
-   texture->sh    = texture->h / texture->sy;
-   texture->srw   = texture->sw / texture->w;
-   texture->srh   = texture->sh / texture->h;
+   gl_setSprites( texture, sx, sy );
    return texture;
 }
 
@@ -756,16 +1194,504 @@ glTexture* gl_newSpriteRWops( const char* path, SDL_RWops *rw,
 
    /* will possibly overwrite an existing textur properties
     * so we have to load same texture always the same sprites */
-   texture->sx    = (double) sx;
-   texture->sy    = (double) sy;
-   texture->sw    = texture->w / texture->sx;
-   texture->sh    = texture->h / texture->sy;
-   texture->srw   = texture->sw / texture->w;
-   texture->srh   = texture->sh / texture->h;
+   gl_setSprites( texture, sx, sy );
    return texture;
 }
 
 
+/**
+ * @brief Sets the sprite layout of a texture.
+ *
+ *    @param tex Texture to set sprites of.
+ *    @param sx Number of X sprites.
+ *    @param sy Number of Y sprites.
+ */
+static void gl_setSprites( glTexture *tex, int sx, int sy )
+{
+   tex->sx    = (double) sx;
+   tex->sy    = (double) sy;
+   tex->sw    = tex->w / tex->sx;
+   tex->sh    = tex->h / tex->sy;
+   tex->srw   = 1. / tex->sx;
+   tex->srh   = 1. / tex->sy;
+}
+
+
+/**
+ * @brief Loads an image in the background.
+ *
+ * The image is read, decoded and has its transparency mapped on the
+ * threadpool, while the upload to OpenGL is done on the main thread by
+ * gl_texLoadUpdate(). Until then the texture is a placeholder with only the
+ * name and sprite layout set, so it renders nothing. Use gl_texLoadWait() if
+ * the dimensions are needed right away.
+ *
+ *    @param path Image to load.
+ *    @param sx Number of X sprites in image.
+ *    @param sy Number of Y sprites in image.
+ *    @param flags Flags to control image parameters.
+ *    @param func Function to run on the main thread once uploaded while the
+ *           decoded surface is still available, or NULL. It is run even if
+ *           the texture already existed.
+ *    @param data Data to pass to func.
+ *    @return Texture being loaded.
+ */
+glTexture* gl_newSpriteAsync( const char* path, const int sx, const int sy,
+      unsigned int flags, glTexLoadFunc func, void *data )
+{
+   glTexture *texture;
+   glTexLoad *job;
+   int upload;
+
+   if (path==NULL) {
+      WARN(_("Trying to load image from NULL path."));
+      return NULL;
+   }
+
+   /* Check if it already exists. */
+   texture = NULL;
+   if (!(flags & OPENGL_TEX_SKIPCACHE)) {
+      texture = gl_texExists( path, sx, sy );
+      if ((texture != NULL) && (func == NULL))
+         return texture;
+   }
+
+   /* Placeholder to upload into, otherwise only decode for func. */
+   upload = (texture == NULL);
+   if (upload) {
+      texture = calloc( 1, sizeof(glTexture) );
+      texture->name  = strdup( path );
+      texture->flags = OPENGL_TEX_PENDING;
+      gl_setSprites( texture, sx, sy );
+      gl_texAdd( texture, sx, sy );
+   }
+
+   job = calloc( 1, sizeof(glTexLoad) );
+   job->tex    = texture;
+   job->path   = strdup( path );
+   job->flags  = flags | OPENGL_TEX_VFLIP;
+   job->upload = upload;
+   job->resident = !(flags & OPENGL_TEX_EVICTABLE);
+   job->func   = func;
+   job->data   = data;
+   gl_texLoadQueue( job );
+
+   return texture;
+}
+
+
+/**
+ * @brief Queues a load to be decoded by a worker.
+ */
+static void gl_texLoadQueue( glTexLoad *job )
+{
+   /* Set up the queue if needed. */
+   if (texload_queue == NULL)
+      texload_queue = array_create( glTexLoad* );
+
+   array_push_back( &texload_queue, job );
+   threadpool_newJob( gl_texLoadWorker, job );
+}
+
+
+/**
+ * @brief Loads an image in the background.
+ *
+ *    @param path Image to load.
+ *    @param flags Flags to control image parameters.
+ *    @return Texture being loaded.
+ *
+ * @sa gl_newSpriteAsync
+ */
+glTexture* gl_newImageAsync( const char* path, const unsigned int flags )
+{
+   return gl_newSpriteAsync( path, 1, 1, flags, NULL, NULL );
+}
+
+
+/**
+ * @brief Decodes an image on a worker thread.
+ *
+ * Nothing is logged here, errors are stored in the job and logged by
+ *  gl_texLoadUpload() on the main thread.
+ */
+static int gl_texLoadWorker( void *data )
+{
+   glTexLoad *job = data;
+   SDL_RWops *rw;
+
+   rw = PHYSFSRWOPS_openRead( job->path );
+   if (rw == NULL)
+      job->err = TEXLOAD_EOPEN;
+   else {
+      job->surface = IMG_Load_RW( rw, 0 );
+      if (job->surface == NULL)
+         job->err = TEXLOAD_EDECODE;
+      else if (job->upload && (job->flags & OPENGL_TEX_MAPTRANS)) {
+         job->trans = gl_genTrans( job->path, job->surface,
+               job->surface->w, job->surface->h );
+         if (job->trans == NULL)
+            job->err = TEXLOAD_ETRANS;
+      }
+      SDL_RWclose( rw );
+   }
+
+   SDL_LockMutex( texload_lock );
+   job->done = 1;
+   SDL_CondBroadcast( texload_cond );
+   SDL_UnlockMutex( texload_lock );
+   return 0;
+}
+
+
+/**
+ * @brief Checks to see if a worker is done with a load.
+ */
+static int gl_texLoadDone( glTexLoad *job )
+{
+   int done;
+   SDL_LockMutex( texload_lock );
+   done = job->done;
+   SDL_UnlockMutex( texload_lock );
+   return done;
+}
+
+
+/**
+ * @brief Uploads a decoded load and removes it from the queue.
+ *
+ *    @param i Index of the load in the queue.
+ */
+static void gl_texLoadUpload( int i )
+{
+   glTexLoad *job;
+   glTexture *tex;
+   SDL_Surface *surface;
+
+   job = texload_queue[i];
+   array_erase( &texload_queue, &texload_queue[i], &texload_queue[i+1] );
+   tex      = job->tex;
+   surface  = job->surface;
+
+   /* Report what went wrong on the worker. */
+   if (job->err == TEXLOAD_EOPEN)
+      WARN(_("Failed to load surface '%s' from ndata."), job->path);
+   else if (job->err == TEXLOAD_EDECODE)
+      WARN(_("Unable to load image '%s'."), job->path );
+   else if (job->err == TEXLOAD_ETRANS)
+      WARN(_("Out of Memory"));
+
+   if (job->upload) {
+      if (surface != NULL) {
+         tex->w         = (double) surface->w;
+         tex->h         = (double) surface->h;
+         if (job->trans != NULL)
+            tex->trans  = job->trans;
+      }
+      tex->flags  = job->flags & ~OPENGL_TEX_MAPTRANS;
+      gl_setSprites( tex, tex->sx, tex->sy );
+      if ((surface != NULL) && job->resident)
+         gl_texSetResident( tex, gl_loadSurface( surface, job->flags, 0 ) );
+      /* Don't keep trying to reload broken images. */
+      else if (surface == NULL)
+         tex->flags &= ~OPENGL_TEX_EVICTABLE;
+   }
+
+   if ((job->func != NULL) && (surface != NULL))
+      job->func( tex, surface, job->data );
+
+   SDL_FreeSurface( surface );
+   free( job->path );
+   free( job );
+}
+
+
+/**
+ * @brief Uploads decoded textures until the time budget runs out.
+ *
+ * Should be called once a frame from the main thread. At least one texture
+ * is uploaded if any is ready, so loading always makes progress.
+ *
+ *    @param budget Time budget in seconds.
+ *    @return Number of loads still pending.
+ */
+int gl_texLoadUpdate( double budget )
+{
+   int i;
+   Uint64 start, end;
+
+   if (array_size(texload_queue) == 0)
+      return 0;
+
+   start = SDL_GetPerformanceCounter();
+   end   = start + (Uint64)(budget * (double)SDL_GetPerformanceFrequency());
+   i     = 0;
+   while (i < array_size(texload_queue)) {
+      if (!gl_texLoadDone( texload_queue[i] )) {
+         i++;
+         continue;
+      }
+      gl_texLoadUpload( i );
+      if (SDL_GetPerformanceCounter() >= end)
+         break;
+   }
+
+   return array_size(texload_queue);
+}
+
+
+/**
+ * @brief Waits for all the pending loads of a texture and uploads them.
+ *
+ *    @param tex Texture to wait for (if NULL, function does nothing).
+ */
+void gl_texLoadWait( const glTexture *tex )
+{
+   int i;
+
+   if (tex == NULL)
+      return;
+
+   i = 0;
+   while (i < array_size(texload_queue)) {
+      if (texload_queue[i]->tex != tex) {
+         i++;
+         continue;
+      }
+      SDL_LockMutex( texload_lock );
+      while (!texload_queue[i]->done)
+         SDL_CondWait( texload_cond, texload_lock );
+      SDL_UnlockMutex( texload_lock );
+      gl_texLoadUpload( i );
+   }
+}
+
+
+/**
+ * @brief Waits for all the pending loads and uploads them.
+ */
+void gl_texLoadFlush (void)
+{
+   while (array_size(texload_queue) > 0) {
+      SDL_LockMutex( texload_lock );
+      while (!texload_queue[0]->done)
+         SDL_CondWait( texload_cond, texload_lock );
+      SDL_UnlockMutex( texload_lock );
+      gl_texLoadUpload( 0 );
+   }
+}
+
+
+/**
+ * @brief Gets the video memory a texture would use once resident.
+ */
+static size_t gl_texBytes( const glTexture *tex )
+{
+   size_t bytes = (size_t)tex->w * (size_t)tex->h * 4;
+   /* Full mipmap chain adds a third. */
+   if (tex->flags & OPENGL_TEX_MIPMAPS)
+      bytes += bytes / 3;
+   return bytes;
+}
+
+
+/**
+ * @brief Changes the OpenGL texture backing a texture, keeping count of the
+ *        resident memory.
+ *
+ *    @param tex Texture to modify.
+ *    @param texture New OpenGL texture, 0 to make it non-resident.
+ */
+static void gl_texSetResident( glTexture *tex, GLuint texture )
+{
+   if (tex->texture != 0) {
+      gl_deleteTextures( 1, &tex->texture );
+      if (tex->flags & OPENGL_TEX_EVICTABLE)
+         tex_evictable -= tex->vram;
+   }
+
+   tex->texture   = texture;
+   tex->vram      = (texture != 0) ? gl_texBytes( tex ) : 0;
+   if (tex->flags & OPENGL_TEX_EVICTABLE)
+      tex_evictable += tex->vram;
+}
+
+
+/**
+ * @brief Gets the OpenGL texture of a texture to render it.
+ *
+ * Evictable textures are marked as used, and reloaded in the background if
+ *  they are not resident.
+ *
+ *    @param tex Texture to get OpenGL texture of.
+ *    @return The OpenGL texture or 0 if it is not available yet, in which case
+ *            nothing should be rendered.
+ */
+GLuint gl_texID( const glTexture *tex )
+{
+   glTexture *t;
+   glTexLoad *job;
+
+   if (!(tex->flags & OPENGL_TEX_EVICTABLE))
+      return tex->texture;
+
+   /* Only the bookkeeping changes, not what is rendered. */
+   t = (glTexture*) tex;
+   t->lastuse = tex_frame;
+   if ((t->texture != 0) || (t->flags & OPENGL_TEX_PENDING))
+      return t->texture;
+
+   /* Reload, the transparency map and dimensions are kept. */
+   job = calloc( 1, sizeof(glTexLoad) );
+   job->tex       = t;
+   job->path      = strdup( t->name );
+   job->flags     = t->flags & ~OPENGL_TEX_MAPTRANS;
+   job->upload    = 1;
+   job->resident  = 1;
+   t->flags      |= OPENGL_TEX_PENDING;
+   gl_texLoadQueue( job );
+   return 0;
+}
+
+
+/**
+ * @brief Makes sure a texture is resident, loading it right away if needed.
+ *
+ * Use when the texture has to be accessed directly instead of rendered.
+ *
+ *    @param tex Texture to make resident.
+ *    @return The OpenGL texture.
+ */
+GLuint gl_texResident( const glTexture *tex )
+{
+   if (gl_texID( tex ) == 0)
+      gl_texLoadWait( tex );
+   return tex->texture;
+}
+
+
+/**
+ * @brief Sorts textures by last use, oldest first.
+ */
+static int gl_texCmpUse( const void *p1, const void *p2 )
+{
+   const glTexture *t1, *t2;
+   t1 = *(const glTexture**) p1;
+   t2 = *(const glTexture**) p2;
+   if (t1->lastuse < t2->lastuse)
+      return -1;
+   else if (t1->lastuse > t2->lastuse)
+      return +1;
+   return 0;
+}
+
+
+/**
+ * @brief Evicts the least recently used textures while over the budget.
+ *
+ * Should be called once a frame. Only evictable textures that were not
+ *  rendered in the last frame and are not referenced by anything but their
+ *  owner are evicted, they are reloaded from disk when rendered again.
+ *
+ *    @param budget Budget for evictable textures in bytes, 0 for unlimited.
+ */
+void gl_texEvict( size_t budget )
+{
+   int i, j;
+   glTexList *cur;
+   glTexture **lru;
+
+   tex_frame++;
+   if ((budget == 0) || (tex_evictable <= budget))
+      return;
+
+   /* Candidates. */
+   lru = array_create( glTexture* );
+   for (j=0; j<texture_nhash; j++)
+      for (cur=texture_hash[j]; cur!=NULL; cur=cur->next)
+         if ((cur->tex->flags & OPENGL_TEX_EVICTABLE) && (cur->tex->texture != 0) &&
+               (cur->used <= 1) && (cur->tex->lastuse+1 < tex_frame))
+            array_push_back( &lru, cur->tex );
+   qsort( lru, array_size(lru), sizeof(glTexture*), gl_texCmpUse );
+
+   for (i=0; (i<array_size(lru)) && (tex_evictable > budget); i++) {
+      gl_texSetResident( lru[i], 0 );
+      tex_evicted++;
+   }
+
+   array_free( lru );
+   gl_checkErr();
+}
+
+
+/**
+ * @brief Sorts textures by resident memory, largest first.
+ */
+static int gl_texCmpBytes( const void *p1, const void *p2 )
+{
+   const glTexList *l1, *l2;
+   l1 = *(const glTexList**) p1;
+   l2 = *(const glTexList**) p2;
+   if (l1->tex->vram > l2->tex->vram)
+      return -1;
+   else if (l1->tex->vram < l2->tex->vram)
+      return +1;
+   return 0;
+}
+
+
+/**
+ * @brief Summarizes the video memory used by textures.
+ *
+ *    @param n Maximum number of textures to list, largest first.
+ *    @return Newly allocated report string.
+ */
+char *gl_texReport( int n )
+{
+   int i, j, l, len, ntex, nres;
+   size_t total;
+   char *buf;
+   glTexList *cur, **list;
+
+   list  = array_create( glTexList* );
+   total = 0;
+   nres  = 0;
+   for (j=0; j<texture_nhash; j++) {
+      for (cur=texture_hash[j]; cur!=NULL; cur=cur->next) {
+         array_push_back( &list, cur );
+         total += cur->tex->vram;
+         if (cur->tex->texture != 0)
+            nres++;
+      }
+   }
+   ntex  = array_size(list);
+   qsort( list, ntex, sizeof(glTexList*), gl_texCmpBytes );
+   n     = CLAMP( 0, ntex, n );
+
+   len   = (n+4) * (PATH_MAX + 64);
+   buf   = malloc( len );
+   l  = scnprintf( buf, len, _("Textures: %.1f MiB resident in %d of %d textures\n"),
+         (double)total / (1024.*1024.), nres, ntex );
+   l += scnprintf( &buf[l], len-l, _("Evictable: %.1f MiB resident, budget %d MiB, %u evictions\n"),
+         (double)tex_evictable / (1024.*1024.), conf.tex_budget, tex_evicted );
+   l += scnprintf( &buf[l], len-l, "%10s %5s %5s  %s\n",
+         _("KiB"), _("refs"), _("idle"), _("texture") );
+   for (i=0; i<n; i++) {
+      cur = list[i];
+      if (cur->tex->flags & OPENGL_TEX_EVICTABLE)
+         l += scnprintf( &buf[l], len-l, "%10.1f %5d %5u  %s\n",
+               (double)cur->tex->vram / 1024., cur->used,
+               tex_frame - cur->tex->lastuse, cur->tex->name );
+      else
+         l += scnprintf( &buf[l], len-l, "%10.1f %5d %5s  %s\n",
+               (double)cur->tex->vram / 1024., cur->used, "-", cur->tex->name );
+   }
+
+   array_free( list );
+   return buf;
+}
+
+
 /**
  * @brief Frees a texture.
  *
@@ -773,37 +1699,40 @@ glTexture* gl_newSpriteRWops( const char* path, SDL_RWops *rw,
  */
 void gl_freeTexture( glTexture* texture )
 {
-   glTexList *cur, *last;
+   glTexList *cur, *last, **bucket;
 
    if (texture == NULL)
       return;
 
-   /* see if we can find it in stack */
-   last = NULL;
-   for (cur=texture_list; cur!=NULL; cur=cur->next) {
-      if (cur->tex == texture) { /* found it */
-         cur->used--;
-         if (cur->used <= 0) { /* not used anymore */
-            /* free the texture */
-            glDeleteTextures( 1, &texture->texture );
-            free(texture->trans);
-            free(texture->name);
-            free(texture);
-
-            /* free the list node */
-            if (last == NULL) { /* case there's no texture before it */
-               if (cur->next != NULL)
-                  texture_list = cur->next;
-               else /* case it's the last texture */
-                  texture_list = NULL;
+   /* Workers may still be decoding into it. */
+   gl_texLoadWait( texture );
+
+   /* see if we can find it in stack, all the layouts of a name share a bucket */
+   if ((texture->name != NULL) && (texture_ntex > 0)) {
+      bucket = &texture_hash[ gl_texHash(texture->name) & (texture_nhash-1) ];
+      last = NULL;
+      for (cur=*bucket; cur!=NULL; cur=cur->next) {
+         if (cur->tex == texture) { /* found it */
+            cur->used--;
+            if (cur->used <= 0) { /* not used anymore */
+               /* free the texture */
+               gl_texSetResident( texture, 0 );
+               free(texture->trans);
+               free(texture->name);
+               free(texture);
+
+               /* free the list node */
+               if (last == NULL)
+                  *bucket = cur->next;
+               else
+                  last->next = cur->next;
+               free(cur);
+               texture_ntex--;
             }
-            else
-               last->next = cur->next;
-            free(cur);
+            return; /* we already found it so we can exit */
          }
-         return; /* we already found it so we can exit */
+         last = cur;
       }
-      last = cur;
    }
 
    /* Not found */
@@ -811,7 +1740,7 @@ void gl_freeTexture( glTexture* texture )
       WARN(_("Attempting to free texture '%s' not found in stack!"), texture->name);
 
    /* Free anyways */
-   glDeleteTextures( 1, &texture->texture );
+   gl_deleteTextures( 1, &texture->texture );
    free(texture->trans);
    free(texture->name);
    free(texture);
@@ -835,8 +1764,9 @@ glTexture* gl_dupTexture( glTexture *texture )
       return NULL;
 
    /* check to see if it already exists */
-   if (texture_list != NULL) {
-      for (cur=texture_list; cur!=NULL; cur=cur->next) {
+   if ((texture->name != NULL) && (texture_ntex > 0)) {
+      for (cur=texture_hash[ gl_texHash(texture->name) & (texture_nhash-1) ];
+            cur!=NULL; cur=cur->next) {
          if (texture == cur->tex) {
             cur->used += 1;
             return cur->tex;
@@ -940,6 +1870,9 @@ glTexture** gl_copyTexArray( glTexture **tex, int *n )
  */
 int gl_initTextures (void)
 {
+   texload_lock = SDL_CreateMutex();
+   texload_cond = SDL_CreateCond();
+   gl_transCacheLoad();
    return 0;
 }
 
@@ -949,14 +1882,28 @@ int gl_initTextures (void)
  */
 void gl_exitTextures (void)
 {
+   int i;
    glTexList *tex;
 
+   /* Finish pending loads. */
+   gl_texLoadFlush();
+   array_free( texload_queue );
+   texload_queue = NULL;
+   SDL_DestroyCond( texload_cond );
+   SDL_DestroyMutex( texload_lock );
+   gl_transCacheFree();
+
    /* Make sure there's no texture leak */
-   if (texture_list != NULL) {
+   if (texture_ntex > 0) {
       DEBUG(_("Texture leak detected!"));
-      for (tex=texture_list; tex!=NULL; tex=tex->next)
-         DEBUG( n_( "   '%s' opened %d time", "   '%s' opened %d times", tex->used ), tex->tex->name, tex->used );
+      for (i=0; i<texture_nhash; i++)
+         for (tex=texture_hash[i]; tex!=NULL; tex=tex->next)
+            DEBUG( n_( "   '%s' opened %d time", "   '%s' opened %d times", tex->used ), tex->tex->name, tex->used );
    }
+   free( texture_hash );
+   texture_hash   = NULL;
+   texture_nhash  = 0;
+   texture_ntex   = 0;
 }
 
 
@@ -31,6 +31,10 @@
 #define OPENGL_TEX_MIPMAPS    (1<<1) /**< Creates mipmaps. */
 #define OPENGL_TEX_VFLIP      (1<<2) /**< Assume loaded from an image (where positive y means down). */
 #define OPENGL_TEX_SKIPCACHE  (1<<3) /**< Skip caching checks and create new texture. */
+#define OPENGL_TEX_PENDING    (1<<4) /**< Still being loaded in the background, set internally. */
+#define OPENGL_TEX_EVICTABLE  (1<<5) /**< Only resident while used, must be loaded with gl_newSpriteAsync(). */
+
+#define OPENGL_TEX_UPLOAD_BUDGET 0.002 /**< Time per frame to spend uploading textures loaded in the background (s). */
 
 /**
  * @brief Abstraction for rendering sprite sheets.
@@ -58,14 +62,29 @@ typedef struct glTexture_ {
 
    /* properties */
    uint8_t flags; /**< flags used for texture properties */
+
+   /* residency */
+   size_t vram; /**< Video memory used in bytes, 0 if not resident. */
+   unsigned int lastuse; /**< Frame the texture was last rendered in, only for evictable textures. */
 } glTexture;
 
 
+/**
+ * @brief Function run once a texture loaded in the background is uploaded.
+ *
+ *    @param tex Texture that was loaded.
+ *    @param surface Decoded image, freed afterwards.
+ *    @param data User data.
+ */
+typedef void (*glTexLoadFunc)( glTexture *tex, SDL_Surface *surface, void *data );
+
+
 /*
  * Init/exit.
  */
 int gl_initTextures (void);
 void gl_exitTextures (void);
+void gl_transCacheSave (void);
 
 /*
  * Creating.
@@ -73,7 +92,7 @@ void gl_exitTextures (void);
 glTexture* gl_loadImageData( float *data, int w, int h, int sx, int sy, const char* name );
 glTexture* gl_loadImagePad( const char *name, SDL_Surface* surface,
       unsigned int flags, int w, int h, int sx, int sy, int freesur );
-glTexture* gl_loadImagePadTrans( const char *name, SDL_Surface* surface, SDL_RWops *rw,
+glTexture* gl_loadImagePadTrans( const char *name, SDL_Surface* surface,
       unsigned int flags, int w, int h, int sx, int sy, int freesur );
 glTexture* gl_loadImage( SDL_Surface* surface, const unsigned int flags ); /* Frees the surface. */
 glTexture* gl_newImage( const char* path, const unsigned int flags );
@@ -84,6 +103,24 @@ glTexture* gl_newSpriteRWops( const char* path, SDL_RWops *rw,
    const int sx, const int sy, const unsigned int flags );
 glTexture* gl_dupTexture( glTexture *texture );
 
+/*
+ * Background loading.
+ */
+glTexture* gl_newImageAsync( const char* path, const unsigned int flags );
+glTexture* gl_newSpriteAsync( const char* path, const int sx, const int sy,
+      unsigned int flags, glTexLoadFunc func, void *data );
+int gl_texLoadUpdate( double budget );
+void gl_texLoadWait( const glTexture *tex );
+void gl_texLoadFlush (void);
+
+/*
+ * Residency.
+ */
+GLuint gl_texID( const glTexture *tex );
+GLuint gl_texResident( const glTexture *tex );
+void gl_texEvict( size_t budget );
+char *gl_texReport( int n );
+
 /*
  * Clean up.
  */
@@ -66,7 +66,7 @@ static void outfit_launcherDesc( Outfit* o );
 /* parsing */
 static int outfit_loadDir( char *dir );
 static int outfit_parseDamage( Damage *dmg, xmlNodePtr node );
-static int outfit_parse( Outfit* temp, const char* file );
+static int outfit_parse( Outfit* temp, xmlDocPtr doc );
 static void outfit_parseSBolt( Outfit* temp, const xmlNodePtr parent );
 static void outfit_parseSBeam( Outfit* temp, const xmlNodePtr parent );
 static void outfit_parseSLauncher( Outfit* temp, const xmlNodePtr parent );
@@ -1218,7 +1218,7 @@ static void outfit_parseSBolt( Outfit* temp, const xmlNodePtr parent )
 
       /* Graphics. */
       if (xml_isNode(node,"gfx")) {
-         temp->u.blt.gfx_space = xml_parseTexture( node,
+         temp->u.blt.gfx_space = xml_parseTextureAsync( node,
                OUTFIT_GFX_PATH"space/%s", 6, 6,
                OPENGL_TEX_MAPTRANS | OPENGL_TEX_MIPMAPS );
          xmlr_attr_strd(node, "spin", buf);
@@ -1240,7 +1240,7 @@ static void outfit_parseSBolt( Outfit* temp, const xmlNodePtr parent )
          continue;
       }
       if (xml_isNode(node,"gfx_end")) {
-         temp->u.blt.gfx_end = xml_parseTexture( node,
+         temp->u.blt.gfx_end = xml_parseTextureAsync( node,
                OUTFIT_GFX_PATH"space/%s", 6, 6,
                OPENGL_TEX_MAPTRANS | OPENGL_TEX_MIPMAPS );
          continue;
@@ -1700,7 +1700,7 @@ static void outfit_parseSAmmo( Outfit* temp, const xmlNodePtr parent )
       xmlr_float(node,"speed",temp->u.amm.speed);
       xmlr_float(node,"energy",temp->u.amm.energy);
       if (xml_isNode(node,"gfx")) {
-         temp->u.amm.gfx_space = xml_parseTexture( node,
+         temp->u.amm.gfx_space = xml_parseTextureAsync( node,
                OUTFIT_GFX_PATH"space/%s", 6, 6,
                OPENGL_TEX_MAPTRANS | OPENGL_TEX_MIPMAPS );
          xmlr_attr_float(node, "spin", temp->u.amm.spin);
@@ -2323,10 +2323,10 @@ if (o) WARN(_("Outfit '%s' missing/invalid '%s' element"), temp->name, s)
  * @brief Parses and returns Outfit from parent node.
 
  *    @param temp Outfit to load into.
- *    @param file Path to the XML file (relative to base directory).
+ *    @param doc Parsed XML file of the outfit.
  *    @return 0 on success.
  */
-static int outfit_parse( Outfit* temp, const char* file )
+static int outfit_parse( Outfit* temp, xmlDocPtr doc )
 {
    xmlNodePtr cur, ccur, node, parent;
    char *prop, *desc_extra;
@@ -2334,7 +2334,6 @@ static int outfit_parse( Outfit* temp, const char* file )
    int group, l;
    ShipStatList *ll, *tail;
 
-   xmlDocPtr doc = xml_parsePhysFS( file );
    if (doc == NULL)
       return -1;
 
@@ -2380,8 +2379,9 @@ static int outfit_parse( Outfit* temp, const char* file )
                continue;
             }
             else if (xml_isNode(cur,"gfx_store")) {
-               temp->gfx_store = xml_parseTexture( cur,
-                     OUTFIT_GFX_PATH"store/%s", 1, 1, OPENGL_TEX_MIPMAPS );
+               temp->gfx_store = xml_parseTextureAsync( cur,
+                     OUTFIT_GFX_PATH"store/%s", 1, 1,
+                     OPENGL_TEX_MIPMAPS | OPENGL_TEX_EVICTABLE );
                continue;
             }
             else if (xml_isNode(cur,"gfx_overlays")) {
@@ -2534,8 +2534,6 @@ if (o) WARN( _("Outfit '%s' missing/invalid '%s' element"), temp->name, s) /**<
    MELEMENT(temp->description==NULL,"description");
 #undef MELEMENT
 
-   xmlFreeDoc(doc);
-
    return 0;
 }
 
@@ -2550,18 +2548,34 @@ static int outfit_loadDir( char *dir )
 {
    int i, n, ret;
    char **outfit_files;
+   const char **xml_files;
+   XmlParseStream *stream;
+   XmlParseJob *job;
 
+   /* Parse all the files in parallel, streaming them. */
    outfit_files = ndata_listRecursive( dir );
-   for ( i = 0; i < array_size( outfit_files ); i++ ) {
-      if (!naev_pollQuit() && ndata_matchExt(outfit_files[i], "xml")) {
-         ret = outfit_parse( &array_grow(&outfit_stack), outfit_files[i] );
-         if (ret < 0) {
-            n = array_size(outfit_stack);
-            array_erase( &outfit_stack, &outfit_stack[n-1], &outfit_stack[n] );
-         }
+   xml_files = array_create_size( const char*, MAX(1,array_size(outfit_files)) );
+   for (i=0; i<array_size(outfit_files); i++)
+      if (ndata_matchExt(outfit_files[i], "xml"))
+         array_push_back( &xml_files, outfit_files[i] );
+   stream = xml_parseStreamOpen( xml_files, array_size(xml_files), 0 );
+
+   /* Load them in order, documents are freed as we go. */
+   while ((job = xml_parseStreamNext( stream )) != NULL) {
+      if (naev_pollQuit())
+         break;
+      ret = outfit_parse( &array_grow(&outfit_stack), job->doc );
+      if (ret < 0) {
+         n = array_size(outfit_stack);
+         array_erase( &outfit_stack, &outfit_stack[n-1], &outfit_stack[n] );
       }
-      free( outfit_files[i] );
    }
+
+   /* Clean up. */
+   xml_parseStreamClose( stream );
+   array_free( xml_files );
+   for (i=0; i<array_size(outfit_files); i++)
+      free( outfit_files[i] );
    array_free( outfit_files );
 
    /* Reduce size. */
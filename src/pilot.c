@@ -44,6 +44,7 @@
 #include "ntime.h"
 #include "nxml.h"
 #include "pause.h"
+#include "pilot_grid.h"
 #include "player.h"
 #include "player_autonav.h"
 #include "rng.h"
@@ -58,6 +59,7 @@ static pilotId_t pilot_id = PLAYER_ID; /**< Stack of pilot ids to assure uniquen
 
 /* stack of pilots */
 static Pilot** pilot_stack = NULL; /**< All the pilots in space. (Player may have other Pilot objects, e.g. backup ships.) */
+static unsigned int pilot_generation = 0; /**< Bumped whenever a pilot is freed or replaced, so cached pointers can be revalidated cheaply. */
 
 
 /* misc */
@@ -81,6 +83,10 @@ static void pilot_refuel( Pilot *p, double dt );
 static void pilot_dead(Pilot* p, pilotId_t killer);
 /* Targeting. */
 static int pilot_validEnemy( const Pilot* p, const Pilot* target );
+static int pilot_gridEnemy( const Pilot *p, const Pilot *target, void *data );
+static int pilot_gridEnemySize( const Pilot *p, const Pilot *target, void *data );
+static int pilot_gridTarget( const Pilot *p, const Pilot *target, void *data );
+static void pilot_enemyQuery( PilotGridQuery *q, const Pilot *p );
 /* Misc. */
 static void pilot_setCommMsg( Pilot *p, const char *s );
 static int pilot_getStackPos(const pilotId_t id);
@@ -97,6 +103,22 @@ Pilot*const* pilot_getAll (void)
 }
 
 
+/**
+ * @brief Gets the pilot generation.
+ *
+ * The generation changes whenever a Pilot is freed or the player's pilot is
+ * replaced. As long as it stays the same, a pointer previously obtained with
+ * pilot_get() is still valid and still belongs to the same ID (though the
+ * pilot may have been flagged for deletion since).
+ *
+ *    @return The current pilot generation.
+ */
+unsigned int pilot_getGeneration (void)
+{
+   return pilot_generation;
+}
+
+
 /**
  * @brief Compare id (for use with bsearch)
  */
@@ -292,6 +314,54 @@ static int pilot_validEnemy( const Pilot* p, const Pilot* target )
 }
 
 
+/**
+ * @brief Grid filter for pilot_validEnemy().
+ */
+static int pilot_gridEnemy( const Pilot *p, const Pilot *target, void *data )
+{
+   (void) data;
+   return pilot_validEnemy( p, target );
+}
+
+
+/**
+ * @brief Grid filter for pilot_validEnemy() with mass bounds.
+ *
+ *    @param data Lower and upper bound of the mass.
+ */
+static int pilot_gridEnemySize( const Pilot *p, const Pilot *target, void *data )
+{
+   const double *bounds = data;
+   if ((target->solid->mass < bounds[0]) || (target->solid->mass > bounds[1]))
+      return 0;
+   return pilot_validEnemy( p, target );
+}
+
+
+/**
+ * @brief Sets up a grid query for the enemies of a pilot.
+ *
+ *    @param[out] q Query to set up.
+ *    @param p Pilot to get the enemies of.
+ */
+static void pilot_enemyQuery( PilotGridQuery *q, const Pilot *p )
+{
+   memset( q, 0, sizeof(PilotGridQuery) );
+   q->p        = p;
+   q->range    = -1.;
+   q->faction  = p->faction;
+   q->visible  = 1;
+   q->filter   = pilot_gridEnemy;
+   /* Only pilots involving the player can be enemies without their factions
+    * being enemies, see pilot_validEnemy(). */
+   if ((p->faction == FACTION_PLAYER) || (p->parent == PLAYER_ID)
+         || pilot_isHostile(p))
+      q->relation = PILOT_GRID_ALL;
+   else
+      q->relation = PILOT_GRID_ENEMY;
+}
+
+
 /**
  * @brief Gets the nearest enemy to the pilot.
  *
@@ -300,25 +370,13 @@ static int pilot_validEnemy( const Pilot* p, const Pilot* target )
  */
 pilotId_t pilot_getNearestEnemy(const Pilot* p)
 {
-   pilotId_t tp;
-   int i;
-   double d, td;
-
-   tp = 0;
-   d  = 0.;
-   for (i=0; i<array_size(pilot_stack); i++) {
-
-      if (!pilot_validEnemy( p, pilot_stack[i] ))
-         continue;
+   PilotGridQuery q;
+   Pilot *t;
 
-      /* Check distance. */
-      td = vect_dist2(&pilot_stack[i]->solid->pos, &p->solid->pos);
-      if (!tp || (td < d)) {
-         d  = td;
-         tp = pilot_stack[i]->id;
-      }
-   }
-   return tp;
+   pilot_enemyQuery( &q, p );
+   if (pilot_gridNearest( &q, &t, NULL, 1 ) <= 0)
+      return 0;
+   return t->id;
 }
 
 /**
@@ -332,29 +390,18 @@ pilotId_t pilot_getNearestEnemy(const Pilot* p)
 pilotId_t pilot_getNearestEnemy_size(const Pilot* p, double target_mass_LB,
       double target_mass_UB)
 {
-   pilotId_t tp;
-   int i;
-   double d, td;
-
-   tp = 0;
-   d  = 0.;
-   for (i=0; i<array_size(pilot_stack); i++) {
-
-      if (!pilot_validEnemy( p, pilot_stack[i] ))
-         continue;
-
-      if (pilot_stack[i]->solid->mass < target_mass_LB || pilot_stack[i]->solid->mass > target_mass_UB)
-         continue;
-
-      /* Check distance. */
-      td = vect_dist2(&pilot_stack[i]->solid->pos, &p->solid->pos);
-      if (!tp || (td < d)) {
-         d = td;
-         tp = pilot_stack[i]->id;
-      }
-   }
-
-   return tp;
+   PilotGridQuery q;
+   Pilot *t;
+   double bounds[2];
+
+   bounds[0]   = target_mass_LB;
+   bounds[1]   = target_mass_UB;
+   pilot_enemyQuery( &q, p );
+   q.filter    = pilot_gridEnemySize;
+   q.data      = bounds;
+   if (pilot_gridNearest( &q, &t, NULL, 1 ) <= 0)
+      return 0;
+   return t->id;
 }
 
 /**
@@ -374,16 +421,18 @@ pilotId_t pilot_getNearestEnemy_heuristic(const Pilot* p,
    pilotId_t tp;
    int i;
    double temp, current_heuristic_value;
-   Pilot *target;
+   Pilot *target, **enemies;
+   PilotGridQuery q;
 
    current_heuristic_value = 10000.;
 
-   tp = 0;
-   for (i=0; i<array_size(pilot_stack); i++) {
-      target = pilot_stack[i];
+   /* Only enemies the pilot can see are candidates. */
+   pilot_enemyQuery( &q, p );
+   enemies = pilot_gridRange( &q );
 
-      if (!pilot_validEnemy( p, target ))
-         continue;
+   tp = 0;
+   for (i=0; i<array_size(enemies); i++) {
+      target = enemies[i];
 
       /* Check distance. */
       temp = range_factor *
@@ -397,6 +446,7 @@ pilotId_t pilot_getNearestEnemy_heuristic(const Pilot* p,
          tp = target->id;
       }
    }
+   array_free( enemies );
 
    return tp;
 }
@@ -483,6 +533,36 @@ pilotId_t pilot_getBoss(const Pilot* p)
    return t;
 }
 
+/**
+ * @brief Grid filter for pilots that can be targeted from the GUI.
+ *
+ *    @param data Pointer to whether or not disabled pilots are allowed.
+ */
+static int pilot_gridTarget( const Pilot *p, const Pilot *target, void *data )
+{
+   int disabled = *(int*)data;
+
+   /* Must not be self. */
+   if (target == p)
+      return 0;
+
+   /* Player doesn't select escorts (unless disabled is active). */
+   if (!disabled && (p->faction == FACTION_PLAYER)
+         && (target->faction == FACTION_PLAYER))
+      return 0;
+
+   /* Shouldn't be disabled. */
+   if (!disabled && pilot_isDisabled(target))
+      return 0;
+
+   /* Must be a valid target. */
+   if (!pilot_validTarget( p, target ))
+      return 0;
+
+   return 1;
+}
+
+
 /**
  * @brief Get the nearest pilot to a pilot from a certain position.
  *
@@ -496,37 +576,23 @@ pilotId_t pilot_getBoss(const Pilot* p)
 double pilot_getNearestPos(const Pilot *p, pilotId_t *tp,
       double x, double y, int disabled)
 {
-   int i;
-   double d, td;
-
-   *tp = PLAYER_ID;
-   d  = 0;
-   for (i=0; i<array_size(pilot_stack); i++) {
-
-      /* Must not be self. */
-      if (pilot_stack[i] == p)
-         continue;
-
-      /* Player doesn't select escorts (unless disabled is active). */
-      if (!disabled && (p->faction == FACTION_PLAYER)
-            && (pilot_stack[i]->faction == FACTION_PLAYER))
-         continue;
-
-      /* Shouldn't be disabled. */
-      if (!disabled && pilot_isDisabled(pilot_stack[i]))
-         continue;
+   PilotGridQuery q;
+   Pilot *t;
+   double d;
 
-      /* Must be a valid target. */
-      if (!pilot_validTarget( p, pilot_stack[i] ))
-         continue;
+   memset( &q, 0, sizeof(q) );
+   q.p         = p;
+   q.x         = x;
+   q.y         = y;
+   q.range     = -1.;
+   q.relation  = PILOT_GRID_ALL;
+   q.filter    = pilot_gridTarget;
+   q.data      = &disabled;
 
-      /* Minimum distance. */
-      td = pow2(x-pilot_stack[i]->solid->pos.x) + pow2(y-pilot_stack[i]->solid->pos.y);
-      if (((*tp==PLAYER_ID) || (td < d))) {
-         d = td;
-         *tp = pilot_stack[i]->id;
-      }
-   }
+   *tp = PLAYER_ID;
+   if (pilot_gridNearest( &q, &t, &d, 1 ) <= 0)
+      return 0.;
+   *tp = t->id;
    return d;
 }
 
@@ -546,43 +612,39 @@ double pilot_getNearestAng(const Pilot *p, pilotId_t *tp, double ang,
    int i;
    double a, ta;
    double rx, ry;
+   Pilot **targets;
+   PilotGridQuery q;
+
+   /* Only pilots in range are candidates. */
+   memset( &q, 0, sizeof(q) );
+   q.p         = p;
+   q.range     = -1.;
+   q.relation  = PILOT_GRID_ALL;
+   q.visible   = 1;
+   q.filter    = pilot_gridTarget;
+   q.data      = &disabled;
+   targets     = pilot_gridRange( &q );
 
    *tp = PLAYER_ID;
    a   = ang + M_PI;
-   for (i=0; i<array_size(pilot_stack); i++) {
-
-      /* Must not be self. */
-      if (pilot_stack[i] == p)
-         continue;
-
-      /* Player doesn't select escorts (unless disabled is active). */
-      if (!disabled && (p->faction == FACTION_PLAYER)
-            && (pilot_stack[i]->faction == FACTION_PLAYER))
-         continue;
-
-      /* Shouldn't be disabled. */
-      if (!disabled && pilot_isDisabled(pilot_stack[i]))
-         continue;
-
-      /* Must be a valid target. */
-      if (!pilot_validTarget( p, pilot_stack[i] ))
-         continue;
+   for (i=0; i<array_size(targets); i++) {
 
       /* Must be in range. */
-      if (!pilot_inRangePilot( p, pilot_stack[i], NULL ))
+      if (!pilot_inRangePilot( p, targets[i], NULL ))
          continue;
 
       /* Only allow selection if off-screen. */
-      if (gui_onScreenPilot( &rx, &ry, pilot_stack[i] ))
+      if (gui_onScreenPilot( &rx, &ry, targets[i] ))
          continue;
 
-      ta = atan2( p->solid->pos.y - pilot_stack[i]->solid->pos.y,
-            p->solid->pos.x - pilot_stack[i]->solid->pos.x );
+      ta = atan2( p->solid->pos.y - targets[i]->solid->pos.y,
+            p->solid->pos.x - targets[i]->solid->pos.x );
       if (ABS(angle_diff(ang, ta)) < ABS(angle_diff(ang, a))) {
          a = ta;
-         *tp = pilot_stack[i]->id;
+         *tp = targets[i]->id;
       }
    }
+   array_free( targets );
    return a;
 }
 
@@ -2669,6 +2731,9 @@ void pilot_hyperspaceAbort( Pilot* p )
          player_soundPlay( snd_hypPowDown, 1 );
       }
    }
+   /* Destination graphics were prefetched when the player started jumping. */
+   if (p->id == PLAYER_ID)
+      space_gfxPrefetchRelease();
    pilot_rmFlag(p, PILOT_HYP_BEGIN);
    pilot_rmFlag(p, PILOT_HYP_BRAKE);
    pilot_rmFlag(p, PILOT_HYP_PREP);
@@ -3133,6 +3198,7 @@ Pilot* pilot_replacePlayer( Pilot* after )
       spfx_trail_remove( pilot_stack[i]->trail[j] );
    array_erase( &pilot_stack[i]->trail, array_begin(pilot_stack[i]->trail), array_end(pilot_stack[i]->trail) );
    pilot_stack[i] = after;
+   pilot_generation++;
    pilot_init_trails( after );
    /* Run Lua stuff. */
    pilot_outfitLInitAll( after );
@@ -3278,6 +3344,9 @@ void pilot_free( Pilot* p )
 #endif /* DEBUGGING */
 
    free(p);
+
+   /* Invalidate cached pointers. */
+   pilot_generation++;
 }
 
 
@@ -3352,6 +3421,7 @@ void pilots_free (void)
    array_free(pilot_stack);
    pilot_stack = NULL;
    player.p = NULL;
+   pilot_gridFree();
 }
 
 
@@ -3404,6 +3474,7 @@ void pilots_clean( int persist )
          pilot_free(pilot_stack[i]);
    }
    array_erase(&pilot_stack, &pilot_stack[persist_count], array_end(pilot_stack));
+   pilot_gridInvalidate();
 
    /* Clear global hooks. */
    pilots_clearGlobalHooks();
@@ -3508,6 +3579,9 @@ void pilots_update( double dt )
          p->think(p, dt);
    }
 
+   /* Pilots are about to move. */
+   pilot_gridInvalidate();
+
    /* Now update all the pilots. */
    for (i=0; i<array_size(pilot_stack); i++) {
       p = pilot_stack[i];
@@ -3524,6 +3598,10 @@ void pilots_update( double dt )
       if (p->update) /* update */
          p->update( p, dt );
    }
+
+   /* Lua run from the updates may have built the grid with only some of the
+    * pilots moved, so it can't be trusted afterwards. */
+   pilot_gridInvalidate();
 }
 
 
@@ -386,6 +386,7 @@ typedef struct Pilot_ {
  */
 Pilot*const* pilot_getAll (void);
 Pilot* pilot_get(const pilotId_t id);
+unsigned int pilot_getGeneration (void);
 pilotId_t pilot_getNextID(const pilotId_t id, int mode);
 pilotId_t pilot_getPrevID(const pilotId_t id, int mode);
 pilotId_t pilot_getNearestEnemy(const Pilot* p);
@@ -0,0 +1,536 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+/**
+ * @file pilot_grid.c
+ *
+ * @brief Spatial index over the pilots in the system.
+ *
+ * Pilots are bucketed into a uniform grid covering the bounding box of the
+ * pilot stack. The grid is built lazily the first time it is queried and is
+ * thrown away whenever the pilots move, get freed, or something that affects
+ * the queries (sensor stats, visibility flags, positions set by scripts)
+ * changes. Since the pilots only think after the deleted ones are removed and
+ * before any of them move, all the AI in a frame shares a single grid.
+ *
+ * Pilots added after the grid was built are simply appended to the pilot
+ * stack, so they are checked linearly until the next rebuild.
+ */
+
+
+/** @cond */
+#include <math.h>
+
+#include "naev.h"
+/** @endcond */
+
+#include "pilot_grid.h"
+
+#include "array.h"
+#include "faction.h"
+#include "log.h"
+#include "space.h"
+
+
+#define PILOT_GRID_CELL_MIN   500. /**< Minimum size of a cell. */
+#define PILOT_GRID_DIM_MAX    64 /**< Maximum number of cells along an axis. */
+
+
+static int grid_valid         = 0; /**< Whether or not the grid is up to date. */
+static unsigned int grid_gen  = 0; /**< Pilot generation the grid was built with. */
+static int grid_n             = 0; /**< Number of pilots from the stack in the grid. */
+static double grid_x0         = 0.; /**< X position of the grid origin. */
+static double grid_y0         = 0.; /**< Y position of the grid origin. */
+static double grid_cs         = 1.; /**< Size of a cell. */
+static int grid_nx            = 0; /**< Number of cells along X. */
+static int grid_ny            = 0; /**< Number of cells along Y. */
+static int *grid_cells        = NULL; /**< Index of the first pilot of each cell, plus the end. */
+static Pilot **grid_pilots    = NULL; /**< Pilots sorted by cell. */
+static Pilot **grid_special   = NULL; /**< Pilots that can be seen regardless of distance. */
+static double grid_detect     = 0.; /**< Largest detection modifier of the pilots. */
+
+
+/*
+ * Prototypes.
+ */
+static void pilot_gridBuild (void);
+static void pilot_gridCheck (void);
+static int pilot_gridCell( double x, double y, int *cx, int *cy );
+static double pilot_gridSensor( const Pilot *p );
+static int pilot_gridKeep( const PilotGridQuery *q, const Pilot *t );
+static int pilot_gridCmpID( const void *p1, const void *p2 );
+static void pilot_gridInsert( const PilotGridQuery *q, Pilot *t,
+      Pilot **out, double *dist2, int k, int *n );
+#if DEBUG_PARANOID
+static void pilot_gridVerify( const PilotGridQuery *q, double x, double y,
+      double r2, Pilot *const* out );
+#endif /* DEBUG_PARANOID */
+
+
+/**
+ * @brief Gets the cell a position falls in, clamped to the grid.
+ *
+ *    @return Index of the cell.
+ */
+static int pilot_gridCell( double x, double y, int *cx, int *cy )
+{
+   *cx = (int)CLAMP( 0., grid_nx-1., floor((x - grid_x0) / grid_cs) );
+   *cy = (int)CLAMP( 0., grid_ny-1., floor((y - grid_y0) / grid_cs) );
+   return *cy * grid_nx + *cx;
+}
+
+
+/**
+ * @brief Builds the grid from the current pilot stack.
+ */
+static void pilot_gridBuild (void)
+{
+   int i, c, cx, cy, n, ncells;
+   double xmin, xmax, ymin, ymax, w, h, mod;
+   Pilot *const* pilot_stack;
+   Pilot *p;
+
+   pilot_stack = pilot_getAll();
+   n = array_size(pilot_stack);
+
+   if (grid_cells == NULL) {
+      grid_cells  = array_create( int );
+      grid_pilots = array_create( Pilot* );
+      grid_special = array_create( Pilot* );
+   }
+   array_clear( grid_special );
+   array_resize( &grid_pilots, n );
+
+   /* Get the bounding box. */
+   xmin = ymin = 0.;
+   xmax = ymax = 0.;
+   for (i=0; i<n; i++) {
+      p = pilot_stack[i];
+      if ((i==0) || (p->solid->pos.x < xmin))
+         xmin = p->solid->pos.x;
+      if ((i==0) || (p->solid->pos.x > xmax))
+         xmax = p->solid->pos.x;
+      if ((i==0) || (p->solid->pos.y < ymin))
+         ymin = p->solid->pos.y;
+      if ((i==0) || (p->solid->pos.y > ymax))
+         ymax = p->solid->pos.y;
+   }
+
+   /* Aim for roughly one pilot per cell. */
+   w        = xmax - xmin;
+   h        = ymax - ymin;
+   grid_cs  = MAX( w, h ) / MAX( 1., ceil( sqrt( n ) ) );
+   grid_cs  = MAX( grid_cs, PILOT_GRID_CELL_MIN );
+   grid_cs  = MAX( grid_cs, MAX( w, h ) / (PILOT_GRID_DIM_MAX-1) );
+   grid_x0  = xmin;
+   grid_y0  = ymin;
+   grid_nx  = (int)(w / grid_cs) + 1;
+   grid_ny  = (int)(h / grid_cs) + 1;
+   ncells   = grid_nx * grid_ny;
+
+   /* Count the pilots in each cell. */
+   array_resize( &grid_cells, ncells+1 );
+   memset( grid_cells, 0, (ncells+1) * sizeof(int) );
+   grid_detect = 0.;
+   for (i=0; i<n; i++) {
+      p = pilot_stack[i];
+      c = pilot_gridCell( p->solid->pos.x, p->solid->pos.y, &cx, &cy );
+      grid_cells[c+1]++;
+
+      /* Pilots that can be seen from anywhere. */
+      if (pilot_isFlag(p, PILOT_VISIBLE) || pilot_isFlag(p, PILOT_VISPLAYER)
+            || (p->parent != 0))
+         array_push_back( &grid_special, p );
+
+      /* Same modifiers as pilot_inRangePilot(). */
+      mod = p->stats.rdr_enemy_range_mod * (1 - ((p->heat_T-CONST_SPACE_STAR_TEMP)
+               / (p->heat_C-CONST_SPACE_STAR_TEMP)));
+      if (!isfinite(mod))
+         mod = HUGE_VAL;
+      grid_detect = MAX( grid_detect, mod );
+   }
+   for (c=0; c<ncells; c++)
+      grid_cells[c+1] += grid_cells[c];
+
+   /* Fill the cells, grid_cells ends up shifted by one cell which we undo. */
+   for (i=0; i<n; i++) {
+      p = pilot_stack[i];
+      c = pilot_gridCell( p->solid->pos.x, p->solid->pos.y, &cx, &cy );
+      grid_pilots[ grid_cells[c]++ ] = p;
+   }
+   for (c=ncells; c>0; c--)
+      grid_cells[c] = grid_cells[c-1];
+   grid_cells[0] = 0;
+
+   grid_n      = n;
+   grid_gen    = pilot_getGeneration();
+   grid_valid  = 1;
+}
+
+
+/**
+ * @brief Makes sure the grid is up to date.
+ */
+static void pilot_gridCheck (void)
+{
+   if (grid_valid && (grid_gen == pilot_getGeneration())
+         && (array_size(pilot_getAll()) >= grid_n))
+      return;
+   pilot_gridBuild();
+}
+
+
+/**
+ * @brief Marks the grid as out of date.
+ *
+ * Must be called whenever pilots move or their detection stats, visibility
+ * flags or parent change. Freeing and adding pilots is handled automatically.
+ */
+void pilot_gridInvalidate (void)
+{
+   grid_valid = 0;
+}
+
+
+/**
+ * @brief Frees the grid.
+ */
+void pilot_gridFree (void)
+{
+   array_free( grid_cells );
+   array_free( grid_pilots );
+   array_free( grid_special );
+   grid_cells     = NULL;
+   grid_pilots    = NULL;
+   grid_special   = NULL;
+   grid_valid     = 0;
+   grid_n         = 0;
+}
+
+
+/**
+ * @brief Gets the furthest distance at which a pilot might see something.
+ *
+ *    @param p Pilot to get the sensor range of.
+ *    @return The maximum range, or HUGE_VAL if unbounded.
+ */
+static double pilot_gridSensor( const Pilot *p )
+{
+   double r;
+
+   if (cur_system == NULL)
+      return HUGE_VAL;
+
+   /* Account for the fuzzy range of pilot_inRangePilot(). */
+   r = p->rdr_range * cur_system->rdr_range_mod * grid_detect * 1.1;
+   if (!isfinite(r))
+      return HUGE_VAL;
+   return MAX( 0., r ) + 1.;
+}
+
+
+/**
+ * @brief Checks the relation mask and filter of a query.
+ *
+ *    @return 1 if the pilot should be kept.
+ */
+static int pilot_gridKeep( const PilotGridQuery *q, const Pilot *t )
+{
+   int rel;
+
+   if (q->relation != PILOT_GRID_ALL) {
+      if (areEnemies( q->faction, t->faction ))
+         rel = PILOT_GRID_ENEMY;
+      else if (areAllies( q->faction, t->faction ))
+         rel = PILOT_GRID_ALLY;
+      else
+         rel = PILOT_GRID_NEUTRAL;
+      if (!(rel & q->relation))
+         return 0;
+   }
+
+   if ((q->filter != NULL) && !q->filter( q->p, t, q->data ))
+      return 0;
+
+   return 1;
+}
+
+
+/**
+ * @brief Compares pilots by ID.
+ */
+static int pilot_gridCmpID( const void *p1, const void *p2 )
+{
+   const Pilot *t1, *t2;
+   t1 = *(const Pilot**)p1;
+   t2 = *(const Pilot**)p2;
+   if (t1->id < t2->id)
+      return -1;
+   else if (t1->id > t2->id)
+      return +1;
+   return 0;
+}
+
+
+/**
+ * @brief Gets all the pilots within range matching a query.
+ *
+ *    @param q Query to run.
+ *    @return Array (array.h) of matching pilots sorted by ID, which must be
+ *            freed by the caller.
+ */
+Pilot **pilot_gridRange( const PilotGridQuery *q )
+{
+   int i, j, cx0, cy0, cx1, cy1;
+   double x, y, r, r2;
+   Pilot **out, *t;
+   Pilot *const* pilot_stack;
+
+   pilot_gridCheck();
+   pilot_stack = pilot_getAll();
+   out = array_create( Pilot* );
+
+   /* Visible queries are centred on the pilot and limited by its sensors. */
+   x = q->x;
+   y = q->y;
+   r = (q->range < 0.) ? HUGE_VAL : q->range;
+   if (q->visible) {
+      x = q->p->solid->pos.x;
+      y = q->p->solid->pos.y;
+      r = MIN( r, pilot_gridSensor( q->p ) );
+   }
+   r2 = (q->range < 0.) ? HUGE_VAL : pow2(q->range);
+
+   /* Cells overlapping the range. */
+   if (isfinite(r)) {
+      pilot_gridCell( x-r, y-r, &cx0, &cy0 );
+      pilot_gridCell( x+r, y+r, &cx1, &cy1 );
+   }
+   else {
+      cx0 = cy0 = 0;
+      cx1 = grid_nx-1;
+      cy1 = grid_ny-1;
+   }
+   for (j=cy0; j<=cy1; j++) {
+      for (i=grid_cells[j*grid_nx+cx0]; i<grid_cells[j*grid_nx+cx1+1]; i++) {
+         t = grid_pilots[i];
+         if (pow2(t->solid->pos.x-x) + pow2(t->solid->pos.y-y) > r2)
+            continue;
+         if (pilot_gridKeep( q, t ))
+            array_push_back( &out, t );
+      }
+   }
+
+   /* Pilots that can be seen beyond sensor range. */
+   if (q->visible && isfinite(r)) {
+      for (i=0; i<array_size(grid_special); i++) {
+         t = grid_special[i];
+         if (pow2(t->solid->pos.x-x) + pow2(t->solid->pos.y-y) > r2)
+            continue;
+         if (pilot_gridKeep( q, t ))
+            array_push_back( &out, t );
+      }
+   }
+
+   /* Pilots added since the grid was built. */
+   for (i=grid_n; i<array_size(pilot_stack); i++) {
+      t = pilot_stack[i];
+      if (pow2(t->solid->pos.x-x) + pow2(t->solid->pos.y-y) > r2)
+         continue;
+      if (pilot_gridKeep( q, t ))
+         array_push_back( &out, t );
+   }
+
+   /* Keep the stack order and remove the duplicates from the special list. */
+   qsort( out, array_size(out), sizeof(Pilot*), pilot_gridCmpID );
+   for (i=1; i<array_size(out); i++) {
+      if (out[i] == out[i-1]) {
+         array_erase( &out, &out[i], &out[i+1] );
+         i--;
+      }
+   }
+
+#if DEBUG_PARANOID
+   pilot_gridVerify( q, x, y, r2, out );
+#endif /* DEBUG_PARANOID */
+
+   return out;
+}
+
+
+#if DEBUG_PARANOID
+/**
+ * @brief Checks the result of a range query against a scan of all pilots.
+ *
+ * Catches a grid that wasn't invalidated after the pilots moved, which is
+ *  what pilot.getVisible() and pilot.getHostiles() rely on.
+ *
+ *    @param q Query that was run.
+ *    @param x X position the query was centred on.
+ *    @param y Y position the query was centred on.
+ *    @param r2 Squared range of the query.
+ *    @param out Result of the query, sorted by ID.
+ */
+static void pilot_gridVerify( const PilotGridQuery *q, double x, double y,
+      double r2, Pilot *const* out )
+{
+   int i, n;
+   Pilot *t;
+   Pilot *const* pilot_stack;
+
+   pilot_stack = pilot_getAll();
+   n = 0;
+   for (i=0; i<array_size(pilot_stack); i++) {
+      t = pilot_stack[i];
+      if (pow2(t->solid->pos.x-x) + pow2(t->solid->pos.y-y) > r2)
+         continue;
+      if (!pilot_gridKeep( q, t ))
+         continue;
+      /* The stack is sorted by ID, so both lists must match in order. */
+      if ((n >= array_size(out)) || (out[n] != t)) {
+         WARN(_("Pilot grid query doesn't match a full scan for pilot '%s' (ID %u)!"),
+               t->name, t->id);
+         return;
+      }
+      n++;
+   }
+   if (n != array_size(out))
+      WARN(_("Pilot grid query returned %d pilots, a full scan found %d!"),
+            array_size(out), n);
+}
+#endif /* DEBUG_PARANOID */
+
+
+/**
+ * @brief Tries to insert a pilot into the list of nearest pilots.
+ */
+static void pilot_gridInsert( const PilotGridQuery *q, Pilot *t,
+      Pilot **out, double *dist2, int k, int *n )
+{
+   int i, j;
+   double d;
+
+   d = pow2(t->solid->pos.x-q->x) + pow2(t->solid->pos.y-q->y);
+   if ((q->range >= 0.) && (d > pow2(q->range)))
+      return;
+
+   /* Find where it goes, ties are broken by ID to match stack order. */
+   for (i=0; i<*n; i++) {
+      if (out[i] == t)
+         return;
+      if ((d < dist2[i]) || ((d == dist2[i]) && (t->id < out[i]->id)))
+         break;
+   }
+   if (i >= k)
+      return;
+
+   /* Run the filter last, it's usually the expensive part. */
+   for (j=i; j<*n; j++)
+      if (out[j] == t)
+         return;
+   if (!pilot_gridKeep( q, t ))
+      return;
+
+   for (j=MIN(*n, k-1); j>i; j--) {
+      out[j]   = out[j-1];
+      dist2[j] = dist2[j-1];
+   }
+   out[i]   = t;
+   dist2[i] = d;
+   *n       = MIN( *n+1, k );
+}
+
+
+/**
+ * @brief Gets the nearest pilots matching a query.
+ *
+ * Cells are visited in rings around the position, stopping as soon as no
+ * closer pilot can be found.
+ *
+ *    @param q Query to run.
+ *    @param[out] out Nearest pilots, closest first.
+ *    @param[out] dist2 Squared distance of the nearest pilots (can be NULL if
+ *                k is 1).
+ *    @param k Maximum number of pilots to get.
+ *    @return Number of pilots found.
+ */
+int pilot_gridNearest( const PilotGridQuery *q, Pilot **out, double *dist2, int k )
+{
+   int i, j, c, n, r, rmax, step, cx, cy, x0, y0, x1, y1;
+   double bx0, by0, bx1, by1, lb, range, d;
+   PilotGridQuery qq;
+   Pilot *const* pilot_stack;
+
+   if (k <= 0)
+      return 0;
+   if (dist2 == NULL) {
+      if (k > 1)
+         return 0;
+      dist2 = &d;
+   }
+
+   pilot_gridCheck();
+   pilot_stack = pilot_getAll();
+
+   /* Visible queries are centred on the pilot and limited by its sensors. */
+   qq    = *q;
+   range = (q->range < 0.) ? HUGE_VAL : q->range;
+   if (q->visible) {
+      qq.x  = q->p->solid->pos.x;
+      qq.y  = q->p->solid->pos.y;
+      range = MIN( range, pilot_gridSensor( q->p ) );
+   }
+   q = &qq;
+   n = 0;
+
+   /* Pilots added since the grid was built, and those seen from afar. */
+   for (i=grid_n; i<array_size(pilot_stack); i++)
+      pilot_gridInsert( q, pilot_stack[i], out, dist2, k, &n );
+   if (q->visible)
+      for (i=0; i<array_size(grid_special); i++)
+         pilot_gridInsert( q, grid_special[i], out, dist2, k, &n );
+
+   /* Visit rings of cells until the rest can't be any closer. The centre cell
+    * may be outside of the grid, in which case we skip the rings that don't
+    * touch it. */
+   cx    = (int)CLAMP( -PILOT_GRID_DIM_MAX, 2*PILOT_GRID_DIM_MAX,
+         floor((q->x - grid_x0) / grid_cs) );
+   cy    = (int)CLAMP( -PILOT_GRID_DIM_MAX, 2*PILOT_GRID_DIM_MAX,
+         floor((q->y - grid_y0) / grid_cs) );
+   rmax  = MAX( MAX( cx, grid_nx-1-cx ), MAX( cy, grid_ny-1-cy ) );
+   r     = MAX( MAX( -cx, cx-grid_nx+1 ), MAX( -cy, cy-grid_ny+1 ) );
+   for (r=MAX(0,r); r<=rmax; r++) {
+      if (r > 0) {
+         /* Everything in this ring is outside the box of the previous ones. */
+         bx0 = grid_x0 + (cx-r+1) * grid_cs;
+         by0 = grid_y0 + (cy-r+1) * grid_cs;
+         bx1 = grid_x0 + (cx+r) * grid_cs;
+         by1 = grid_y0 + (cy+r) * grid_cs;
+         lb  = MIN( MIN( q->x-bx0, bx1-q->x ), MIN( q->y-by0, by1-q->y ) );
+         lb  = MAX( 0., lb );
+         if (lb > range)
+            break;
+         if ((n >= k) && (pow2(lb) > dist2[n-1]))
+            break;
+      }
+
+      x0 = MAX( 0, cx-r );
+      x1 = MIN( grid_nx-1, cx+r );
+      y0 = MAX( 0, cy-r );
+      y1 = MIN( grid_ny-1, cy+r );
+      for (j=y0; j<=y1; j++) {
+         /* Top and bottom rows are full, the rest only has both ends. */
+         step = ((j==cy-r) || (j==cy+r)) ? 1 : MAX( 1, 2*r );
+         for (i=cx-r; i<=cx+r; i+=step) {
+            if ((i < x0) || (i > x1))
+               continue;
+            for (c=grid_cells[j*grid_nx+i]; c<grid_cells[j*grid_nx+i+1]; c++)
+               pilot_gridInsert( q, grid_pilots[c], out, dist2, k, &n );
+         }
+      }
+   }
+
+   return n;
+}
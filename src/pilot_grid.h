@@ -0,0 +1,62 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef PILOT_GRID_H
+#  define PILOT_GRID_H
+
+
+#include "pilot.h"
+
+
+/*
+ * Relation masks for queries.
+ */
+#define PILOT_GRID_ENEMY      (1<<0) /**< Pilots whose faction is an enemy. */
+#define PILOT_GRID_ALLY       (1<<1) /**< Pilots whose faction is an ally. */
+#define PILOT_GRID_NEUTRAL    (1<<2) /**< Pilots whose faction is neither. */
+#define PILOT_GRID_ALL        (PILOT_GRID_ENEMY | PILOT_GRID_ALLY | PILOT_GRID_NEUTRAL) /**< All pilots. */
+
+
+/**
+ * @brief Filter for pilot grid queries.
+ *
+ *    @param p Reference pilot of the query.
+ *    @param target Pilot being considered.
+ *    @param data User data of the query.
+ *    @return Non-zero if the target should be kept.
+ */
+typedef int (*PilotGridFilter)( const Pilot *p, const Pilot *target, void *data );
+
+
+/**
+ * @brief A query on the pilot grid.
+ */
+typedef struct PilotGridQuery_ {
+   const Pilot *p; /**< Reference pilot, passed to the filter. */
+   double x; /**< X position to query around. */
+   double y; /**< Y position to query around. */
+   double range; /**< Maximum distance to the position, negative for unlimited. */
+   factionId_t faction; /**< Faction the relation mask is relative to. */
+   int relation; /**< Relation mask (PILOT_GRID_*). */
+   int visible; /**< Only look at pilots p could possibly see. The query is then centred on p. */
+   PilotGridFilter filter; /**< Filter to apply, or NULL. */
+   void *data; /**< Data passed to the filter. */
+} PilotGridQuery;
+
+
+/*
+ * Queries.
+ */
+Pilot **pilot_gridRange( const PilotGridQuery *q );
+int pilot_gridNearest( const PilotGridQuery *q, Pilot **out, double *dist2, int k );
+
+/*
+ * Maintenance.
+ */
+void pilot_gridInvalidate (void);
+void pilot_gridFree (void);
+
+
+#endif /* PILOT_GRID_H */
@@ -24,12 +24,14 @@
 #include "outfit.h"
 #include "pause.h"
 #include "pilot.h"
+#include "pilot_grid.h"
 #include "player.h"
 #include "slots.h"
 #include "space.h"
 #include "nlua.h"
 #include "nlua_pilot.h"
 #include "nlua_pilotoutfit.h"
+#include "nlua_prof.h"
 
 
 /*
@@ -923,6 +925,9 @@ void pilot_calcStats( Pilot* pilot )
    double ac, sc, ec, tm; /* temporary health coefficients to set */
    ShipStats *s;
 
+   /* Detection stats may change. */
+   pilot_gridInvalidate();
+
    /*
     * set up the basic stuff
     */
@@ -1265,7 +1270,7 @@ int pilot_outfitLInit( Pilot *pilot, PilotOutfitSlot *po )
  */
 void pilot_outfitLUpdate( Pilot *pilot, double dt )
 {
-   int i;
+   int i, ret, prof;
    PilotOutfitSlot *po;
    pilotoutfit_modified = 0;
    for (i=0; i<array_size(pilot->outfits); i++) {
@@ -1286,7 +1291,13 @@ void pilot_outfitLUpdate( Pilot *pilot, double dt )
       lua_pushpilot(naevL, pilot->id); /* f, p */
       lua_pushpilotoutfit(naevL, po);  /* f, p, po */
       lua_pushnumber(naevL, dt);       /* f, p, po, dt */
-      if (nlua_pcall( env, 3, 0 )) {   /* */
+      prof = nlua_profiling;
+      if (prof)
+         nlua_profEnter( "outfit:%s:update", po->outfit->name );
+      ret = nlua_pcall( env, 3, 0 );
+      if (prof)
+         nlua_profLeave();
+      if (ret) {   /* */
          WARN( _("Pilot '%s''s outfit '%s' -> 'update':\n%s"), pilot->name, po->outfit->name, lua_tostring(naevL,-1));
          lua_pop(naevL, 1);
       }
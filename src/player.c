@@ -54,6 +54,7 @@
 #include "pause.h"
 #include "perlin.h"
 #include "pilot.h"
+#include "pilot_grid.h"
 #include "player_gui.h"
 #include "rng.h"
 #include "shiplog.h"
@@ -330,7 +331,7 @@ static int player_newMake (void)
       return -1;
    }
    start_position( &x, &y );
-   vect_cset( &player.p->solid->pos, x, y );
+   player_warp( x, y );
    vectnull( &player.p->solid->vel );
    player.p->solid->dir = RNGF() * 2.*M_PI;
    space_init( start_system() );
@@ -593,7 +594,7 @@ void player_swapShip( const char *shipname, int move_cargo )
       player.p          = pilot_replacePlayer( ship );
 
       /* Copy position back. */
-      player.p->solid->pos = v;
+      player_warp( v.x, v.y );
       player.p->solid->dir = dir;
 
       /* Fill the tank. */
@@ -688,6 +689,7 @@ void player_cleanup (void)
    missions_cleanup();
    events_cleanup();
    space_clearKnown();
+   space_gfxPrefetchRelease();
    land_cleanup();
    map_cleanup();
    factions_clearDynamic();
@@ -876,6 +878,7 @@ void player_soundResume (void)
 void player_warp( const double x, const double y )
 {
    vect_cset( &player.p->solid->pos, x, y );
+   pilot_gridInvalidate();
 }
 
 
@@ -1055,7 +1058,7 @@ void player_render( double dt )
 
                gl_drawLine( x1, y1, x2, y2, &c );
 
-               glUseProgram(shaders.crosshairs.program);
+               gl_useProgram(shaders.crosshairs.program);
                glUniform1f(shaders.crosshairs.paramf, 1.);
                gl_renderShader(x2, y2, 7, 7, 0., &shaders.crosshairs,
                      &cWhite, 1);
@@ -1936,6 +1939,9 @@ int player_jump(int loud)
       /* Order escorts to jump; just for aesthetics (for now) */
       escorts_jump( player.p, &cur_system->jumps[player.p->nav_hyperspace] );
 
+      /* Get the destination graphics ready during the jump. */
+      space_gfxPrefetch( cur_system->jumps[player.p->nav_hyperspace].target );
+
       return 1;
    }
    return 0;
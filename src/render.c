@@ -61,11 +61,11 @@ static int pp_gamma_correction = 0; /**< Gamma correction shader. */
 static void render_fbo( double dt, GLuint fbo, GLuint tex, PPShader *shader )
 {
    /* Have to consider alpha premultiply. */
-   glBlendFuncSeparate( GL_ONE, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
+   gl_blendFuncSeparate( GL_ONE, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
 
    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
 
-   glUseProgram( shader->program );
+   gl_useProgram( shader->program );
 
    /* Screen size. */
    if (shader->love_ScreenSize >= 0)
@@ -79,23 +79,23 @@ static void render_fbo( double dt, GLuint fbo, GLuint tex, PPShader *shader )
    }
 
    /* Set up stuff .*/
-   glEnableVertexAttribArray( shader->VertexPosition );
+   gl_enableVertexAttribArray( shader->VertexPosition );
    gl_vboActivateAttribOffset( gl_squareVBO, shader->VertexPosition, 0, 2, GL_FLOAT, 0 );
    if (shader->VertexTexCoord >= 0) {
-      glEnableVertexAttribArray( shader->VertexTexCoord );
+      gl_enableVertexAttribArray( shader->VertexTexCoord );
       gl_vboActivateAttribOffset( gl_squareVBO, shader->VertexTexCoord, 0, 2, GL_FLOAT, 0 );
    }
 
    /* Set the texture(s). */
-   glBindTexture( GL_TEXTURE_2D, tex );
+   gl_bindTexture( GL_TEXTURE_2D, tex );
    glUniform1i( shader->MainTex, 0 );
    for (int i=0; i<array_size(shader->tex); i++) {
       LuaTexture_t *t = &shader->tex[i];
-      glActiveTexture( t->active );
-      glBindTexture( GL_TEXTURE_2D, t->texid );
+      gl_activeTexture( t->active );
+      gl_bindTexture( GL_TEXTURE_2D, (t->tex != NULL) ? gl_texResident( t->tex ) : 0 );
       glUniform1i( t->uniform, t->value );
    }
-   glActiveTexture( GL_TEXTURE0 );
+   gl_activeTexture( GL_TEXTURE0 );
 
    /* Set shader uniforms. */
    gl_Matrix4_Uniform(shader->ClipSpaceFromLocal, gl_Matrix4_Ortho(0, 1, 1, 0, 1, -1));
@@ -104,13 +104,13 @@ static void render_fbo( double dt, GLuint fbo, GLuint tex, PPShader *shader )
    glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
 
    /* Clear state. */
-   glDisableVertexAttribArray( shader->VertexPosition );
+   gl_disableVertexAttribArray( shader->VertexPosition );
    if (shader->VertexTexCoord >= 0)
-      glDisableVertexAttribArray( shader->VertexTexCoord );
-   glUseProgram( 0 );
+      gl_disableVertexAttribArray( shader->VertexTexCoord );
+   gl_useProgram( 0 );
 
    /* Restore the default mode. */
-   glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+   gl_blendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
 }
 
 
@@ -306,10 +306,7 @@ unsigned int render_postprocessAdd( LuaShader_t *shader, int layer, int priority
    pp->MainTex          = shader->MainTex;
    pp->VertexPosition   = shader->VertexPosition;
    pp->VertexTexCoord   = shader->VertexTexCoord;
-   if (shader->tex != NULL)
-      pp->tex = array_copy( LuaTexture_t, shader->tex );
-   else
-      pp->tex = NULL;
+   pp->tex              = shader->tex; /* Owned by the shader, which removes us when freed. */
    /* Special uniforms. */
    pp->u_time = glGetUniformLocation( pp->program, "u_time" );
    pp->love_ScreenSize = glGetUniformLocation( pp->program, "love_ScreenSize" );
@@ -405,8 +402,8 @@ void render_setGamma( double gamma )
       return;
 
    /* Set gamma and upload. */
-   glUseProgram( shaders.gamma_correction.program );
+   gl_useProgram( shaders.gamma_correction.program );
    glUniform1f( shaders.gamma_correction.gamma, gamma );
-   glUseProgram( 0 );
+   gl_useProgram( 0 );
    pp_gamma_correction = render_postprocessAdd( &gamma_correction_shader, PP_LAYER_FINAL, 98 );
 }
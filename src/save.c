@@ -6,6 +6,13 @@
  * @file save.c
  *
  * @brief Handles saving/loading games.
+ *
+ * The game state is serialised to memory on the main thread, while the
+ *  backup, compression and writing of the file is done by a worker thread.
+ *  The file is written to a temporary file that is renamed over the saved
+ *  game, so it is never left half written, and the backup is only replaced
+ *  once the new saved game is in place. Failures are reported by
+ *  save_poll() on the main thread.
  */
 
 /** @cond */
@@ -35,9 +42,27 @@
 #include "player.h"
 #include "shiplog.h"
 #include "start.h"
+#include "threadpool.h"
 #include "unidiff.h"
 
+
+/**
+ * @brief A saved game being written in the background.
+ */
+typedef struct SaveJob_ {
+   char *path; /**< Real path of the saved game. */
+   int backup; /**< Whether to back up the previous saved game. */
+   int compress; /**< Compression level. */
+   xmlBufferPtr buf; /**< Serialised saved game. */
+} SaveJob;
+
+
 int save_loaded   = 0; /**< Just loaded the saved game. */
+static SDL_mutex *save_lock   = NULL; /**< Protects the save state. */
+static SDL_cond *save_cond    = NULL; /**< Signalled when a save finishes. */
+static int save_inflight      = 0; /**< Whether a save is being written. */
+static int save_failed        = 0; /**< Whether a background save failed and wasn't reported yet. */
+static char save_error[STRMAX_SHORT]; /**< Error of the failed background save. */
 
 
 /*
@@ -62,6 +87,9 @@ extern int space_sysSave( xmlTextWriterPtr writer ); /**< Saves the space stuff.
 extern int diff_save( xmlTextWriterPtr writer ); /**< Saves the universe diffs. */
 /* static */
 static int save_data( xmlTextWriterPtr writer );
+static int save_document( xmlTextWriterPtr writer, const char *annotation );
+static int save_writeFile( const char *path, xmlBufferPtr buf, int compress );
+static int save_write( void *data );
 
 
 /**
@@ -88,30 +116,14 @@ static int save_data( xmlTextWriterPtr writer )
 
 
 /**
- * @brief Saves the current game.
+ * @brief Writes a whole saved game.
  *
+ *    @param writer XML writer to use.
+ *    @param annotation Annotation of the saved game.
  *    @return 0 on success.
  */
-int save_all (void)
+static int save_document( xmlTextWriterPtr writer, const char *annotation )
 {
-   char file[PATH_MAX], buf[PATH_MAX];
-   xmlDocPtr doc;
-   xmlTextWriterPtr writer;
-   int ret;
-
-   /* Do not save if saving is off. */
-   if (player_isFlag(PLAYER_NOSAVE))
-      return 0;
-
-   /* Create the writer. */
-   writer = xmlNewTextWriterDoc(&doc, conf.save_compress);
-   if (writer == NULL) {
-      ERR(_("testXmlwriterDoc: Error creating the xml writer"));
-      return -1;
-   }
-
-   ret = 0;
-
    /* Set the writer parameters. */
    xmlw_setParams(writer);
 
@@ -124,7 +136,7 @@ int save_all (void)
    xmlw_elem(writer, "naev", "%s", VERSION);
    xmlw_elem(writer, "data", "%s", start_name());
    xmlw_elem(writer, "player_name", "%s", player.name);
-   xmlw_elem(writer, "annotation", "%s", player.name);
+   xmlw_elem(writer, "annotation", "%s", annotation);
    xmlw_endElem(writer); /* "version" */
 
    /* Save last played. */
@@ -132,54 +144,251 @@ int save_all (void)
 
    /* Save the data. */
    if (save_data(writer) < 0) {
-      ERR(_("Trying to save game data"));
-      ret = -1;
-      goto exit;
+      WARN(_("Trying to save game data"));
+      return -1;
    }
 
    /* Finish element. */
    xmlw_endElem(writer); /* "naev_save" */
    xmlw_done(writer);
 
-   /* Write to file. */
-   if (PHYSFS_mkdir("saves") == 0) {
-      snprintf(file, sizeof(file), "%s/saves", PHYSFS_getWriteDir());
-      WARN(_("Dir '%s' does not exist and unable to create: %s"), file,
-            PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+   return 0;
+}
+
+
+/**
+ * @brief Compresses and writes a serialised saved game to a file.
+ *
+ * Doesn't log anything so it can be used from worker threads. The file is
+ *  removed on failure.
+ *
+ *    @param path Real path of the file to write.
+ *    @param buf Serialised saved game.
+ *    @param compress Compression level.
+ *    @return 0 on success.
+ */
+static int save_writeFile( const char *path, xmlBufferPtr buf, int compress )
+{
+   xmlOutputBufferPtr out;
+   int ret;
+
+   out = xmlOutputBufferCreateFilename( path, NULL, compress );
+   if (out == NULL)
+      return -1;
+   ret = xmlOutputBufferWrite( out, xmlBufferLength( buf ), (const char*)xmlBufferContent( buf ) );
+   /* Closing flushes the data and the compression trailer. */
+   if ((xmlOutputBufferClose( out ) < 0) || (ret < 0)) {
+      remove( path );
+      return -1;
+   }
+   return 0;
+}
+
+
+/**
+ * @brief Writes a saved game, run on a worker thread.
+ *
+ *    @param data SaveJob to write, freed when done.
+ *    @return 0 on success.
+ */
+static int save_write( void *data )
+{
+   SaveJob *job = data;
+   char tmp[PATH_MAX], backup[PATH_MAX], backup_tmp[PATH_MAX];
+   char err[STRMAX_SHORT];
+   int ret, backed_up;
+
+   ret = 0;
+   backed_up = 0;
+
+   /* Write and compress to a temporary file first so the saved game is never
+    * left half written. */
+   snprintf( tmp, sizeof(tmp), "%s.tmp", job->path );
+   if (save_writeFile( tmp, job->buf, job->compress ) < 0) {
+      snprintf( err, sizeof(err), _("Failed to write saved game '%s'!"), tmp );
       ret = -1;
       goto exit;
    }
-   str2filename(buf, sizeof(buf), player.name);
-   if (snprintf(file, sizeof(file), "saves/%s.ns", buf) < 0)
-      WARN(_("Save file name was truncated: %s"), file);
 
-   /* Back up old saved game. */
-   if (!save_loaded) {
-      if (ndata_backupIfExists(file) < 0) {
-         WARN(_("Aborting save..."));
+   /* Copy the previous saved game aside, it only replaces the backup once
+    * the new saved game is in place. */
+   snprintf( backup, sizeof(backup), "%s.backup", job->path );
+   snprintf( backup_tmp, sizeof(backup_tmp), "%s.backup.tmp", job->path );
+   if (job->backup && nfile_fileExists( job->path )) {
+      if (nfile_copy( job->path, backup_tmp ) < 0) {
+         snprintf( err, sizeof(err), _("Failure to copy '%s' to '%s': %s"),
+               job->path, backup_tmp, strerror(errno) );
+         remove( backup_tmp );
+         remove( tmp );
          ret = -1;
          goto exit;
       }
+      backed_up = 1;
+   }
+
+   if (nfile_rename( tmp, job->path ) < 0) {
+      snprintf( err, sizeof(err), _("Unable to rename '%s' to '%s': %s"),
+            tmp, job->path, strerror(errno) );
+      remove( tmp );
+      if (backed_up)
+         remove( backup_tmp );
+      ret = -1;
+      goto exit;
+   }
+
+   if (backed_up && (nfile_rename( backup_tmp, backup ) < 0)) {
+      snprintf( err, sizeof(err), _("Unable to rename '%s' to '%s': %s"),
+            backup_tmp, backup, strerror(errno) );
+      remove( backup_tmp );
+      ret = -1;
+   }
+
+exit:
+   xmlBufferFree( job->buf );
+   free( job->path );
+   free( job );
+
+   SDL_LockMutex( save_lock );
+   save_inflight = 0;
+   if (ret < 0) {
+      save_failed = 1;
+      strncpy( save_error, err, sizeof(save_error)-1 );
+      save_error[ sizeof(save_error)-1 ] = '\0';
+   }
+   SDL_CondBroadcast( save_cond );
+   SDL_UnlockMutex( save_lock );
+   return ret;
+}
+
+
+/**
+ * @brief Waits for the saved game being written in the background, if any.
+ *
+ * Failures are left for save_poll() to report.
+ */
+void save_wait (void)
+{
+   if (save_lock == NULL)
+      return;
+
+   SDL_LockMutex( save_lock );
+   while (save_inflight)
+      SDL_CondWait( save_cond, save_lock );
+   SDL_UnlockMutex( save_lock );
+}
+
+
+/**
+ * @brief Reports a failure of a saved game written in the background.
+ *
+ * Run every frame from the main loop.
+ */
+void save_poll (void)
+{
+   char err[STRMAX_SHORT];
+   int failed;
+
+   if (save_lock == NULL)
+      return;
+
+   SDL_LockMutex( save_lock );
+   failed = save_failed;
+   if (failed) {
+      strncpy( err, save_error, sizeof(err) );
+      save_failed = 0;
    }
-   save_loaded = 0;
+   SDL_UnlockMutex( save_lock );
+
+   if (!failed)
+      return;
+
+   WARN( "%s", err );
+   dialogue_alert( _("Failed to save game! You should exit and check the log to see what happened and then file a bug report!") );
+}
+
 
-   /* Critical section, if crashes here player's game gets corrupted.
-    * Luckily we have a copy just in case... */
+/**
+ * @brief Saves the current game.
+ *
+ * The file is written in the background, a failure to write it is reported
+ *  by save_poll() once the write finishes.
+ *
+ *    @return 0 on success.
+ */
+int save_all (void)
+{
+   char file[PATH_MAX], buf[PATH_MAX];
+   xmlBufferPtr xbuf;
+   xmlTextWriterPtr writer;
+   SaveJob *job;
+   int ret;
+
+   /* Do not save if saving is off. */
+   if (player_isFlag(PLAYER_NOSAVE))
+      return 0;
+
+   /* Saves are written in order, one at a time. */
+   if (save_lock == NULL) {
+      save_lock = SDL_CreateMutex();
+      save_cond = SDL_CreateCond();
+   }
+   save_wait();
+   ret = 0;
+
+   /* Create the writer. */
+   xbuf = xmlBufferCreate();
+   writer = xmlNewTextWriterMemory(xbuf, 0);
+   if (writer == NULL) {
+      ERR(_("testXmlwriterDoc: Error creating the xml writer"));
+      xmlBufferFree(xbuf);
+      return -1;
+   }
+
+   /* Serialise the game. */
+   if (save_document(writer, player.name) < 0) {
+      ret = -1;
+      goto err;
+   }
+   xmlFreeTextWriter(writer);
+   writer = NULL;
+
+   /* Write to file. */
+   if (PHYSFS_mkdir("saves") == 0) {
+      snprintf(file, sizeof(file), "%s/saves", PHYSFS_getWriteDir());
+      WARN(_("Dir '%s' does not exist and unable to create: %s"), file,
+            PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+      ret = -1;
+      goto err;
+   }
+   str2filename(buf, sizeof(buf), player.name);
    /* TODO: write via physfs */
    if (snprintf(file, sizeof(file), "%s/saves/%s.ns", PHYSFS_getWriteDir(),
          buf) < 0)
       WARN(_("Save file name was truncated: %s"), file);
-   if (xmlSaveFileEnc(file, doc, "UTF-8") < 0) {
-      WARN(_("Failed to write saved game! You'll most likely have to"
-            " restore it by copying your backup saved game over your"
-            " current saved game."));
-      ret = -1;
+
+   /* Hand it over to a worker. */
+   job            = malloc( sizeof(SaveJob) );
+   job->path      = strdup( file );
+   job->backup    = !save_loaded;
+   job->compress  = conf.save_compress;
+   job->buf       = xbuf;
+   save_loaded    = 0;
+   SDL_LockMutex( save_lock );
+   save_inflight  = 1;
+   SDL_UnlockMutex( save_lock );
+   if (threadpool_newJob( save_write, job ) < 0) {
+      /* No worker to hand it to, write it here instead. This also clears
+       * save_inflight and frees the job, failures are still reported by
+       * save_poll() like for background writes. */
+      save_write( job );
    }
 
-exit:
-   xmlFreeTextWriter(writer);
-   xmlFreeDoc(doc);
+   return ret;
 
+err:
+   if (writer != NULL)
+      xmlFreeTextWriter(writer);
+   xmlBufferFree(xbuf);
    return ret;
 }
 
@@ -187,16 +396,18 @@ exit:
 /**
  * @brief Saves data to a snapshot file.
  *
+ * The snapshot is serialised to memory, written to a temporary file and only
+ *  renamed over the snapshot once the file has been written successfully.
+ *
  *    @param annotation The annotation to give the snapshot. Caller must
  *       prompt the user if it will replace existing data.
  *    @return 0 on success.
  */
 int save_snapshot(const char *annotation)
 {
-   char buf[PATH_MAX], buf2[PATH_MAX];
-   char *snapfile;
-   char *path;
-   xmlDocPtr doc;
+   char buf[PATH_MAX], buf2[PATH_MAX], tmp[PATH_MAX];
+   char *snapfile, *path, *name;
+   xmlBufferPtr xbuf;
    xmlTextWriterPtr writer;
    int ret;
 
@@ -206,49 +417,14 @@ int save_snapshot(const char *annotation)
       return 0;
    }
 
-   /* Create the writer. */
-   writer = xmlNewTextWriterDoc(&doc, conf.save_compress);
-   if (writer == NULL) {
-      ERR(_("testXmlwriterDoc: Error creating the xml writer"));
-      return -1;
-   }
-
    /* path and snapfile need to be NULL by default in case we exit
     * without using asprintf (otherwise we'd call free() on an arbitrary
     * location and cause problems). */
    ret = 0;
    snapfile = NULL;
    path = NULL;
-
-   /* Set the writer parameters. */
-   xmlw_setParams(writer);
-
-   /* Start element. */
-   xmlw_start(writer);
-   xmlw_startElem(writer, "naev_save");
-
-   /* Save the version and such. */
-   xmlw_startElem(writer,"version");
-   xmlw_elem(writer, "naev", "%s", VERSION);
-   xmlw_elem(writer, "data", "%s", start_name());
-   xmlw_elem(writer, "player_name", "%s", player.name);
-   xmlw_elem(writer, "annotation",
-         p_("snapshot_name", "%s (%s)"), annotation, player.name);
-   xmlw_endElem(writer); /* "version" */
-
-   /* Save last played. */
-   xmlw_saveTime(writer, "last_played", time(NULL));
-
-   /* Save the data. */
-   if (save_data(writer) < 0) {
-      ERR(_("Error trying to save game data"));
-      ret = -1;
-      goto exit;
-   }
-
-   /* Finish element. */
-   xmlw_endElem(writer); /* "naev_save" */
-   xmlw_done(writer);
+   name = NULL;
+   xbuf = NULL;
 
    /* Write to file. */
    if (PHYSFS_mkdir("saves") == 0) {
@@ -256,7 +432,7 @@ int save_snapshot(const char *annotation)
       WARN(_("Dir '%s' does not exist and unable to create: %s"), buf,
             PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
       ret = -1;
-      goto exit;
+      goto err;
    }
    str2filename(buf, sizeof(buf), player.name);
    str2filename(buf2, sizeof(buf2), annotation);
@@ -270,20 +446,46 @@ int save_snapshot(const char *annotation)
       goto exit;
    }
 
+   /* Serialise the game. */
+   xbuf = xmlBufferCreate();
+   writer = xmlNewTextWriterMemory(xbuf, 0);
+   if (writer == NULL) {
+      WARN(_("testXmlwriterDoc: Error creating the xml writer"));
+      ret = -1;
+      goto err;
+   }
+   asprintf(&name, p_("snapshot_name", "%s (%s)"), annotation, player.name);
+   ret = save_document(writer, name);
+   xmlFreeTextWriter(writer);
+   if (ret < 0)
+      goto err;
+
    /* TODO: write via physfs */
-   if (xmlSaveFileEnc(path, doc, "UTF-8") < 0) {
-      WARN(_("Failed to write snapshot."));
+   snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+   if (save_writeFile(tmp, xbuf, conf.save_compress) < 0) {
+      WARN(_("Failed to write snapshot '%s'."), tmp);
       ret = -1;
-      goto exit;
+      goto err;
+   }
+   if (nfile_rename(tmp, path) < 0) {
+      WARN(_("Unable to rename '%s' to '%s': %s"), tmp, path, strerror(errno));
+      remove(tmp);
+      ret = -1;
+      goto err;
    }
 
    dialogue_msg(_("Save Snapshot"), _("Snapshot '%s' saved."), annotation);
+   goto exit;
+
+err:
+   dialogue_alert(_("Failed to save snapshot '%s'! Check the log to see what happened."), annotation);
 
 exit:
-   xmlFreeTextWriter(writer);
-   xmlFreeDoc(doc);
+   if (xbuf != NULL)
+      xmlBufferFree(xbuf);
    free(snapfile);
    free(path);
+   free(name);
 
    return ret;
 }
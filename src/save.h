@@ -8,6 +8,8 @@
 
 
 int save_all (void);
+void save_wait (void);
+void save_poll (void);
 int save_snapshot(const char *annotation);
 void save_reload (void);
 
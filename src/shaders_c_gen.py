@@ -65,10 +65,10 @@ SHADERS = [
    ),
    Shader(
       name = "trail",
-      vs_path = "project_pos.vert",
+      vs_path = "trail.vert",
       fs_path = "trail.frag",
-      attributes = ["vertex"],
-      uniforms = ["projection", "c1", "c2", "t1", "t2", "dt", "pos1", "pos2", "r", "nebu_col" ],
+      attributes = ["vertex", "corner", "color1", "color2", "time", "bounds", "param"],
+      uniforms = ["projection", "nebu_col" ],
       subroutines = {
         "trail_func" : [
             "trail_default",
@@ -105,6 +105,14 @@ SHADERS = [
       uniforms = ["projection", "color", "tex_mat", "sampler1", "sampler2", "inter"],
       subroutines = {},
    ),
+   Shader(
+      name = "texture_batch",
+      vs_path = "texture_batch.vert",
+      fs_path = "texture_batch.frag",
+      attributes = ["vertex", "vertex_tex", "vertex_color", "vertex_inter"],
+      uniforms = ["projection", "sampler1", "sampler2"],
+      subroutines = {},
+   ),
    Shader(
       name = "nebula",
       vs_path = "nebula.vert",
@@ -141,8 +149,8 @@ SHADERS = [
       name = "font",
       vs_path = "font.vert",
       fs_path = "font.frag",
-      attributes = ["vertex", "tex_coord"],
-      uniforms = ["projection", "m", "color", "outline_color"],
+      attributes = ["vertex", "tex_coord", "color", "m"],
+      uniforms = ["projection", "outline_color"],
       subroutines = {},
    ),
    Shader(
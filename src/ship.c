@@ -11,8 +11,7 @@
 
 /** @cond */
 #include <limits.h>
-#include "physfsrwops.h"
-#include "SDL_image.h"
+#include "physfs.h"
 
 #include "naev.h"
 /** @endcond */
@@ -55,6 +54,7 @@ static Ship* ship_stack = NULL; /**< Stack of ships available in the game. */
 static int ship_loadGFX( Ship *temp, const char *buf, int sx, int sy, int engine );
 static int ship_loadPLG( Ship *temp, const char *buf, int size_hint );
 static int ship_parse( Ship *temp, xmlNodePtr parent );
+static void ship_spaceLoaded( glTexture *tex, SDL_Surface *surface, void *data );
 
 
 /**
@@ -237,8 +237,8 @@ static int ship_genTargetGFX( Ship *temp, SDL_Surface *surface, int sx, int sy )
    char buf[PATH_MAX];
 
    /* Get sprite size. */
-   sw = temp->gfx_space->w / sx;
-   sh = temp->gfx_space->h / sy;
+   sw = surface->w / sx;
+   sh = surface->h / sy;
 
    /* Create the surface. */
    SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
@@ -285,45 +285,45 @@ static int ship_genTargetGFX( Ship *temp, SDL_Surface *surface, int sx, int sy )
 }
 
 
+/**
+ * @brief Generates the target graphics once the space graphics are decoded.
+ *
+ *    @param tex Space graphics of the ship.
+ *    @param surface Decoded space graphics.
+ *    @param data Index of the ship in the stack.
+ */
+static void ship_spaceLoaded( glTexture *tex, SDL_Surface *surface, void *data )
+{
+   ship_genTargetGFX( &ship_stack[ (intptr_t)data ], surface, tex->sx, tex->sy );
+}
+
+
 /**
  * @brief Loads the space graphics for a ship from an image.
  *
- *    @param temp Ship to load into.
+ * The image is decoded in the background, the texture and target graphics
+ *  are only available once it is uploaded (see gl_texLoadUpdate()).
+ *
+ *    @param temp Ship to load into, must be in the ship stack.
  *    @param str Path of the image to use.
  *    @param sx Number of X sprites in image.
  *    @param sy Number of Y sprites in image.
  */
 static int ship_loadSpaceImage( Ship *temp, char *str, int sx, int sy )
 {
-   SDL_RWops *rw;
-   SDL_Surface *surface;
-   int ret;
-
-   /* Load the space sprite. */
-   rw    = PHYSFSRWOPS_openRead( str );
-   if (rw==NULL) {
+   if (!PHYSFS_exists(str)) {
       WARN(_("Unable to open '%s' for reading!"), str);
       return -1;
    }
-   surface = IMG_Load_RW( rw, 0 );
 
    /* Load the texture. */
-   temp->gfx_space = gl_loadImagePadTrans( str, surface, rw,
-         OPENGL_TEX_MAPTRANS | OPENGL_TEX_MIPMAPS | OPENGL_TEX_VFLIP,
-         surface->w, surface->h, sx, sy, 0 );
-
-   /* Create the target graphic. */
-   ret = ship_genTargetGFX( temp, surface, sx, sy );
-   if (ret != 0)
-      return ret;
-
-   /* Free stuff. */
-   SDL_RWclose( rw );
-   SDL_FreeSurface( surface );
+   temp->gfx_space = gl_newSpriteAsync( str, sx, sy,
+         OPENGL_TEX_MAPTRANS | OPENGL_TEX_MIPMAPS | OPENGL_TEX_VFLIP | OPENGL_TEX_EVICTABLE,
+         ship_spaceLoaded, (void*)(intptr_t)(temp - ship_stack) );
 
    /* Calculate mount angle. */
    temp->mangle  = 2.*M_PI;
-   temp->mangle /= temp->gfx_space->sx * temp->gfx_space->sy;
+   temp->mangle /= sx * sy;
    return 0;
 }
 
@@ -338,7 +338,9 @@ static int ship_loadSpaceImage( Ship *temp, char *str, int sx, int sy )
  */
 static int ship_loadEngineImage( Ship *temp, char *str, int sx, int sy )
 {
-   temp->gfx_engine = gl_newSprite( str, sx, sy, OPENGL_TEX_MIPMAPS );
+   if (PHYSFS_exists(str))
+      temp->gfx_engine = gl_newSpriteAsync( str, sx, sy,
+            OPENGL_TEX_MIPMAPS | OPENGL_TEX_EVICTABLE, NULL, NULL );
    return (temp->gfx_engine != NULL);
 }
 
@@ -856,56 +858,44 @@ static int ship_parse( Ship *temp, xmlNodePtr parent )
  */
 int ships_load (void)
 {
-   size_t nfiles;
-   char **ship_files, *file;
+   char **ship_files, **files;
    int i;
    xmlNodePtr node;
-   xmlDocPtr doc;
+   XmlParseStream *stream;
+   XmlParseJob *job;
 
    /* Validity. */
    ss_check();
 
    ship_files = PHYSFS_enumerateFiles( SHIP_DATA_PATH );
-   for (nfiles=0; ship_files[nfiles]!=NULL; nfiles++) {}
+   files = array_create( char* );
+   for (i=0; ship_files[i]!=NULL; i++)
+      if (ndata_matchExt( ship_files[i], "xml" ))
+         asprintf( &array_grow(&files), "%s%s", SHIP_DATA_PATH, ship_files[i] );
 
    /* Initialize stack if needed. */
    if (ship_stack == NULL)
-      ship_stack = array_create_size(Ship, nfiles);
+      ship_stack = array_create_size(Ship, MAX(1,array_size(files)));
+
+   /* Parse the XML in parallel, streaming it. */
+   stream = xml_parseStreamOpen( (const char**)files, array_size(files), 0 );
 
-   for (i=0; ship_files[i]!=NULL; i++) {
+   while ((job = xml_parseStreamNext( stream )) != NULL) {
       if (naev_pollQuit())
          break;
 
-      if (!ndata_matchExt( ship_files[i], "xml" ))
-         continue;
-
-      /* Get the file name .*/
-      asprintf( &file, "%s%s", SHIP_DATA_PATH, ship_files[i] );
-
-      /* Load the XML. */
-      doc  = xml_parsePhysFS( file );
-
-      if (doc == NULL) {
-         free(file);
+      if (job->doc == NULL)
          continue;
-      }
 
-      node = doc->xmlChildrenNode; /* First ship node */
+      node = job->doc->xmlChildrenNode; /* First ship node */
       if (node == NULL) {
-         xmlFreeDoc(doc);
-         WARN(_("Malformed %s file: does not contain elements"), file);
-         free(file);
+         WARN(_("Malformed %s file: does not contain elements"), job->filename);
          continue;
       }
 
-      free(file);
-
       if (xml_isNode(node, XML_SHIP))
          /* Load the ship. */
          ship_parse( &array_grow(&ship_stack), node );
-
-      /* Clean up. */
-      xmlFreeDoc(doc);
    }
 
    /* Shrink stack. */
@@ -913,6 +903,10 @@ int ships_load (void)
    DEBUG( n_( "Loaded %d Ship", "Loaded %d Ships", array_size(ship_stack) ), array_size(ship_stack) );
 
    /* Clean up. */
+   xml_parseStreamClose( stream );
+   for (i=0; i<array_size(files); i++)
+      free( files[i] );
+   array_free( files );
    PHYSFS_freeList( ship_files );
 
    return 0;
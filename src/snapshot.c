@@ -0,0 +1,438 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file snapshot.c
+ *
+ * @brief Binary snapshot of the resolved universe.
+ *
+ * Once the universe is parsed, the presence of every faction has to be
+ * spilled over the jump graph, the dominant factions determined and the base
+ * commodity prices of every asset calculated and smoothed over neighbouring
+ * systems. None of that changes unless the data does, so the results are
+ * stored in the cache directory after the first successful load and restored
+ * on later startups.
+ *
+ * The snapshot is validated against the game and data versions and the
+ * modification times of the data archives and input directories, so it can be
+ * checked without listing every file. Changing the data this way simply
+ * regenerates it. Only the resolved results are stored, the data itself is
+ * still parsed on every load. The blob is a header followed by fixed size records
+ * in native byte order that can be used in place.
+ */
+
+/** @cond */
+#include <errno.h>
+#include <sys/stat.h>
+#include "physfs.h"
+
+#include "naev.h"
+/** @endcond */
+
+#include "snapshot.h"
+
+#include "array.h"
+#include "conf.h"
+#include "log.h"
+#include "ndata.h"
+#include "nfile.h"
+#include "nstring.h"
+#include "space.h"
+
+
+#define SNAPSHOT_FILE      "universe.bin" /**< Snapshot in the cache directory. */
+#define SNAPSHOT_MAGIC     0x50414E53 /**< Magic number of the snapshot. */
+#define SNAPSHOT_VERSION   1 /**< Version of the snapshot format, bump when changing the records. */
+
+
+/**
+ * @brief Header of the snapshot.
+ */
+typedef struct SnapHeader_ {
+   uint32_t magic; /**< SNAPSHOT_MAGIC. */
+   uint32_t version; /**< SNAPSHOT_VERSION. */
+   uint64_t hash; /**< Hash of the input files. */
+   uint32_t nsystems; /**< Number of system records. */
+   uint32_t nplanets; /**< Number of planet records. */
+   uint32_t ncommodities; /**< Number of commodity records. */
+   uint32_t npresences; /**< Number of presence records. */
+   uint32_t nprices; /**< Number of price records. */
+   uint32_t pad; /**< Keeps the records aligned. */
+} SnapHeader;
+
+
+/**
+ * @brief Resolved data of a system.
+ */
+typedef struct SnapSystem_ {
+   uint32_t presence; /**< Index of the first presence record. */
+   uint32_t npresence; /**< Number of presence records. */
+   int64_t faction; /**< Dominant faction. */
+} SnapSystem;
+
+
+/**
+ * @brief Presence of a faction in a system.
+ */
+typedef struct SnapPresence_ {
+   int64_t faction; /**< Faction of the presence. */
+   double value; /**< Amount of presence. */
+} SnapPresence;
+
+
+/**
+ * @brief Base commodity prices of a planet.
+ */
+typedef struct SnapPlanet_ {
+   uint32_t price; /**< Index of the first price record. */
+   uint32_t nprice; /**< Number of price records. */
+} SnapPlanet;
+
+
+/**
+ * @brief Base price of a commodity on a planet.
+ */
+typedef struct SnapPrice_ {
+   double price; /**< Average price. */
+   double planetPeriod; /**< Planet period. */
+   double sysPeriod; /**< System period. */
+   double planetVariation; /**< Planet variation. */
+   double sysVariation; /**< System variation. */
+} SnapPrice;
+
+
+/*
+ * Input files the snapshot depends on.
+ */
+static const char *snapshot_inputs[] = {
+   COMMODITY_DATA_PATH,
+   FACTION_DATA_PATH,
+   PLANET_DATA_PATH,
+   SYSTEM_DATA_PATH,
+   NULL
+};
+
+
+static uint64_t snapshot_hash = 0; /**< Hash of the inputs of the current load. */
+static int snapshot_restored  = 0; /**< Whether the current universe came from the snapshot. */
+
+
+/* @TODO get rid of these externs. */
+extern Commodity* commodity_stack;
+
+
+/*
+ * Prototypes.
+ */
+static uint64_t snapshot_hashData( uint64_t hash, const void *data, size_t len );
+static uint64_t snapshot_hashStat( uint64_t hash, const char *path );
+static uint64_t snapshot_hashInputs (void);
+static void snapshot_path( char *buf, size_t len );
+
+
+/**
+ * @brief Adds data to a FNV-1a hash.
+ */
+static uint64_t snapshot_hashData( uint64_t hash, const void *data, size_t len )
+{
+   const unsigned char *p = data;
+   size_t i;
+   for (i=0; i<len; i++) {
+      hash ^= p[i];
+      hash *= 0x100000001B3ULL;
+   }
+   return hash;
+}
+
+
+/**
+ * @brief Hashes the path, size and modification time of a real file or
+ *        directory, if it exists.
+ */
+static uint64_t snapshot_hashStat( uint64_t hash, const char *path )
+{
+   struct stat st;
+   int64_t sm[2];
+
+   if (stat( path, &st ) != 0)
+      return hash;
+   sm[0] = st.st_size;
+   sm[1] = st.st_mtime;
+   hash = snapshot_hashData( hash, path, strlen(path)+1 );
+   return snapshot_hashData( hash, sm, sizeof(sm) );
+}
+
+
+/**
+ * @brief Hashes the game and data versions and the timestamps of the inputs
+ *        in every component of the search path.
+ *
+ * Archives are covered as a whole. In directories only the input directories
+ *  themselves are looked at, which catches files being added, removed or
+ *  replaced (as most editors save), but not a file being rewritten in place.
+ */
+static uint64_t snapshot_hashInputs (void)
+{
+   int i;
+   char **roots, **r, *data, path[PATH_MAX];
+   const char *version;
+   size_t size;
+   struct stat st;
+   uint64_t hash;
+
+   hash     = 0xCBF29CE484222325ULL;
+   version  = naev_version( 1 );
+   hash     = snapshot_hashData( hash, version, strlen(version)+1 );
+   data     = ndata_read( "VERSION", &size );
+   if (data != NULL) {
+      hash = snapshot_hashData( hash, data, size );
+      free( data );
+   }
+
+   roots = PHYSFS_getSearchPath();
+   for (r=roots; *r!=NULL; r++) {
+      if (stat( *r, &st ) != 0)
+         continue;
+      if (!S_ISDIR( st.st_mode )) {
+         hash = snapshot_hashStat( hash, *r );
+         continue;
+      }
+      for (i=0; snapshot_inputs[i]!=NULL; i++) {
+         nfile_concatPaths( path, sizeof(path), *r, snapshot_inputs[i] );
+         hash = snapshot_hashStat( hash, path );
+      }
+   }
+   PHYSFS_freeList( roots );
+   return hash;
+}
+
+
+/**
+ * @brief Gets the path of the snapshot.
+ */
+static void snapshot_path( char *buf, size_t len )
+{
+   snprintf( buf, len, "%s%s", nfile_cachePath(), SNAPSHOT_FILE );
+}
+
+
+/**
+ * @brief Restores the resolved universe from the snapshot.
+ *
+ * Should be called once the systems and planets are parsed. On success the
+ *  presences, dominant factions and base commodity prices are set, so they
+ *  don't need to be calculated.
+ *
+ *    @return 0 if the universe was restored.
+ */
+int snapshot_load (void)
+{
+   char path[PATH_MAX], *buf;
+   size_t size, need;
+   int i, j;
+   SnapHeader hdr;
+   const SnapSystem *ssys;
+   const SnapPresence *spres;
+   const SnapPlanet *spnt;
+   const SnapPrice *sprice;
+   const double *speriod;
+   StarSystem *systems;
+   Planet *planets;
+   SystemPresence *sp;
+   CommodityPrice *cp;
+
+   snapshot_restored = 0;
+   if (!conf.universe_snapshot)
+      return -1;
+
+   snapshot_hash = snapshot_hashInputs();
+
+   snapshot_path( path, sizeof(path) );
+   if (!nfile_fileExists( path ))
+      return -1;
+   buf = nfile_readFile( &size, path );
+   if (buf == NULL)
+      return -1;
+
+   /* Validate. */
+   systems  = system_getAll();
+   planets  = planet_getAll();
+   if (size < sizeof(SnapHeader))
+      goto stale;
+   memcpy( &hdr, buf, sizeof(SnapHeader) );
+   if ((hdr.magic != SNAPSHOT_MAGIC) || (hdr.version != SNAPSHOT_VERSION) ||
+         (hdr.hash != snapshot_hash) ||
+         (hdr.nsystems != (uint32_t)array_size(systems)) ||
+         (hdr.nplanets != (uint32_t)array_size(planets)) ||
+         (hdr.ncommodities != (uint32_t)array_size(commodity_stack)))
+      goto stale;
+   need = sizeof(SnapHeader) +
+         hdr.nsystems * sizeof(SnapSystem) +
+         hdr.npresences * sizeof(SnapPresence) +
+         hdr.nplanets * sizeof(SnapPlanet) +
+         hdr.nprices * sizeof(SnapPrice) +
+         hdr.ncommodities * sizeof(double);
+   if (size != need)
+      goto stale;
+
+   /* Records are all multiples of 8 bytes so they stay aligned. */
+   ssys     = (const SnapSystem*)(buf + sizeof(SnapHeader));
+   spres    = (const SnapPresence*)&ssys[ hdr.nsystems ];
+   spnt     = (const SnapPlanet*)&spres[ hdr.npresences ];
+   sprice   = (const SnapPrice*)&spnt[ hdr.nplanets ];
+   speriod  = (const double*)&sprice[ hdr.nprices ];
+
+   /* Make sure it matches what was parsed before touching anything. */
+   for (i=0; i<array_size(systems); i++)
+      if ((uint64_t)ssys[i].presence + ssys[i].npresence > hdr.npresences)
+         goto stale;
+   for (i=0; i<array_size(planets); i++)
+      if (((uint64_t)spnt[i].price + spnt[i].nprice > hdr.nprices) ||
+            (spnt[i].nprice != (uint32_t)array_size(planets[i].commodityPrice)))
+         goto stale;
+
+   /* Restore presences and factions. */
+   for (i=0; i<array_size(systems); i++) {
+      array_resize( &systems[i].presence, ssys[i].npresence );
+      for (j=0; j<(int)ssys[i].npresence; j++) {
+         sp = &systems[i].presence[j];
+         memset( sp, 0, sizeof(SystemPresence) );
+         sp->faction = spres[ ssys[i].presence+j ].faction;
+         sp->value   = spres[ ssys[i].presence+j ].value;
+      }
+      systems[i].faction = ssys[i].faction;
+   }
+
+   /* Restore prices. */
+   for (i=0; i<array_size(planets); i++) {
+      for (j=0; j<(int)spnt[i].nprice; j++) {
+         cp = &planets[i].commodityPrice[j];
+         cp->price            = sprice[ spnt[i].price+j ].price;
+         cp->planetPeriod     = sprice[ spnt[i].price+j ].planetPeriod;
+         cp->sysPeriod        = sprice[ spnt[i].price+j ].sysPeriod;
+         cp->planetVariation  = sprice[ spnt[i].price+j ].planetVariation;
+         cp->sysVariation     = sprice[ spnt[i].price+j ].sysVariation;
+      }
+   }
+   for (i=0; i<array_size(commodity_stack); i++)
+      commodity_stack[i].period = speriod[i];
+
+   free( buf );
+   snapshot_restored = 1;
+   DEBUG(_("Restored universe from snapshot"));
+   return 0;
+
+stale:
+   free( buf );
+   return -1;
+}
+
+
+/**
+ * @brief Saves the resolved universe if it wasn't restored from the snapshot.
+ *
+ * Should be called after a successful load and before any unidiffs are
+ *  applied. It is written to a temporary file first, so a partial write
+ *  never replaces a good snapshot.
+ *
+ *    @return 0 on success.
+ */
+int snapshot_save (void)
+{
+   char path[PATH_MAX], tmp[PATH_MAX];
+   int i, j, ret;
+   SnapHeader hdr;
+   SnapSystem ssys;
+   SnapPresence spres;
+   SnapPlanet spnt;
+   SnapPrice sprice;
+   StarSystem *systems;
+   Planet *planets;
+   CommodityPrice *cp;
+   SDL_RWops *rw;
+
+   if (!conf.universe_snapshot || snapshot_restored || naev_isQuit())
+      return 0;
+
+   systems  = system_getAll();
+   planets  = planet_getAll();
+
+   memset( &hdr, 0, sizeof(SnapHeader) );
+   hdr.magic         = SNAPSHOT_MAGIC;
+   hdr.version       = SNAPSHOT_VERSION;
+   hdr.hash          = snapshot_hash;
+   hdr.nsystems      = array_size(systems);
+   hdr.nplanets      = array_size(planets);
+   hdr.ncommodities  = array_size(commodity_stack);
+   for (i=0; i<array_size(systems); i++)
+      hdr.npresences += array_size(systems[i].presence);
+   for (i=0; i<array_size(planets); i++)
+      hdr.nprices += array_size(planets[i].commodityPrice);
+
+   nfile_dirMakeExist( nfile_cachePath() );
+   snapshot_path( path, sizeof(path) );
+   snprintf( tmp, sizeof(tmp), "%s.tmp", path );
+   rw = SDL_RWFromFile( tmp, "wb" );
+   if (rw == NULL) {
+      WARN(_("Unable to open '%s' for writing: %s"), tmp, SDL_GetError());
+      return -1;
+   }
+
+   ret = (SDL_RWwrite( rw, &hdr, sizeof(hdr), 1 ) != 1);
+
+   /* Systems. */
+   memset( &ssys, 0, sizeof(SnapSystem) );
+   for (i=0; (i<array_size(systems)) && !ret; i++) {
+      ssys.npresence = array_size(systems[i].presence);
+      ssys.faction   = systems[i].faction;
+      ret = (SDL_RWwrite( rw, &ssys, sizeof(ssys), 1 ) != 1);
+      ssys.presence += ssys.npresence;
+   }
+   for (i=0; (i<array_size(systems)) && !ret; i++) {
+      for (j=0; (j<array_size(systems[i].presence)) && !ret; j++) {
+         spres.faction  = systems[i].presence[j].faction;
+         spres.value    = systems[i].presence[j].value;
+         ret = (SDL_RWwrite( rw, &spres, sizeof(spres), 1 ) != 1);
+      }
+   }
+
+   /* Planets. */
+   memset( &spnt, 0, sizeof(SnapPlanet) );
+   for (i=0; (i<array_size(planets)) && !ret; i++) {
+      spnt.nprice = array_size(planets[i].commodityPrice);
+      ret = (SDL_RWwrite( rw, &spnt, sizeof(spnt), 1 ) != 1);
+      spnt.price += spnt.nprice;
+   }
+   for (i=0; (i<array_size(planets)) && !ret; i++) {
+      for (j=0; (j<array_size(planets[i].commodityPrice)) && !ret; j++) {
+         cp = &planets[i].commodityPrice[j];
+         sprice.price            = cp->price;
+         sprice.planetPeriod     = cp->planetPeriod;
+         sprice.sysPeriod        = cp->sysPeriod;
+         sprice.planetVariation  = cp->planetVariation;
+         sprice.sysVariation     = cp->sysVariation;
+         ret = (SDL_RWwrite( rw, &sprice, sizeof(sprice), 1 ) != 1);
+      }
+   }
+
+   /* Commodities. */
+   for (i=0; (i<array_size(commodity_stack)) && !ret; i++)
+      ret = (SDL_RWwrite( rw, &commodity_stack[i].period, sizeof(double), 1 ) != 1);
+
+   if (SDL_RWclose( rw ) != 0)
+      ret = 1;
+   if (ret) {
+      WARN(_("Error writing universe snapshot '%s': %s"), tmp, SDL_GetError());
+      remove( tmp );
+      return -1;
+   }
+   if (nfile_rename( tmp, path ) < 0) {
+      WARN(_("Unable to rename '%s' to '%s': %s"), tmp, path, strerror(errno));
+      remove( tmp );
+      return -1;
+   }
+   /* Only save once. */
+   snapshot_restored = 1;
+   return 0;
+}
@@ -0,0 +1,14 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef SNAPSHOT_H
+#  define SNAPSHOT_H
+
+
+int snapshot_load (void);
+int snapshot_save (void);
+
+
+#endif /* SNAPSHOT_H */
@@ -11,10 +11,16 @@
 /** @cond */
 #include <float.h>
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include "physfs.h"
 
 #include "naev.h"
+
+#if HAS_POSIX
+#include <sys/resource.h>
+#include <unistd.h>
+#endif /* HAS_POSIX */
 /** @endcond */
 
 #include "space.h"
@@ -39,6 +45,7 @@
 #include "nlua.h"
 #include "nlua_pilot.h"
 #include "nlua_planet.h"
+#include "nlua_prof.h"
 #include "nluadef.h"
 #include "nmath.h"
 #include "nstring.h"
@@ -50,6 +57,7 @@
 #include "player.h"
 #include "queue.h"
 #include "rng.h"
+#include "snapshot.h"
 #include "sound.h"
 #include "spfx.h"
 #include "toolkit.h"
@@ -100,6 +108,7 @@ static AsteroidType *asteroid_types = NULL; /**< Asteroid types stack. */
  */
 static int systems_loading = 1; /**< Systems are loading. */
 StarSystem *cur_system = NULL; /**< Current star system. */
+static StarSystem *space_prefetched = NULL; /**< System whose graphics were prefetched for a jump. */
 glTexture *jumppoint_gfx = NULL; /**< Jump point graphics. */
 static glTexture *jumpbuoy_gfx = NULL; /**< Jump buoy graphics. */
 static nlua_env landing_env = LUA_NOREF; /**< Landing lua env. */
@@ -108,6 +117,7 @@ static int space_simulating = 0; /**< Are we simulating space? */
 glTexture **asteroid_debris_gfx = NULL;
 static size_t nasterogfx = 0; /**< Nb of asteroid debris gfx. */
 static Planet *space_landQueuePlanet = NULL;
+static const char *space_presenceMask = NULL; /**< Systems presence may be added to, NULL for all. */
 
 /*
  * fleet spawn rate
@@ -119,6 +129,7 @@ int space_spawn = 1; /**< Spawn enabled by default. */
  * Internal Prototypes.
  */
 /* planet load */
+static void space_gfxQueue( StarSystem *sys );
 static int planet_parse( Planet *planet, const xmlNodePtr parent, Commodity **stdList );
 static int space_parseAssets( xmlNodePtr parent, StarSystem* sys );
 /* system load */
@@ -137,10 +148,12 @@ static void system_parseAsteroids( const xmlNodePtr parent, StarSystem *sys );
 static int getPresenceIndex(StarSystem *sys, factionId_t faction);
 static void system_scheduler( double dt, int init );
 static void asteroid_explode ( Asteroid *a, AsteroidAnchor *field, int give_reward );
+static long space_memUsage( long *peak );
 /* Render. */
 static void space_renderJumpPoint( const JumpPoint *jp, int i );
 static void space_renderPlanet( const Planet *p );
 static void space_renderAsteroid( const Asteroid *a );
+static void space_renderAsteroidScan( const Asteroid *a );
 static void space_renderDebris( const Debris *d, double x, double y );
 /*
  * Externed prototypes.
@@ -1055,7 +1068,7 @@ const char *jump_getSymbol( JumpPoint *jp )
  */
 static void system_scheduler( double dt, int init )
 {
-   int i, n;
+   int i, n, ret, prof;
    nlua_env env;
    SystemPresence *p;
    Pilot *pilot;
@@ -1107,7 +1120,14 @@ static void system_scheduler( double dt, int init )
       lua_pushnumber( naevL, p->value ); /* f, [arg,], max */
 
       /* Actually run the function. */
-      if (nlua_pcall(env, n+1, 2)) { /* error has occurred */
+      prof = nlua_profiling;
+      if (prof)
+         nlua_profEnter( "spawn:%s:%s", faction_name( p->faction ),
+               init ? "create" : "spawn" );
+      ret = nlua_pcall(env, n+1, 2);
+      if (prof)
+         nlua_profLeave();
+      if (ret) { /* error has occurred */
          WARN(_("Lua Spawn script for faction '%s' : %s"),
                faction_name( p->faction ), lua_tostring(naevL,-1));
          lua_pop(naevL,1);
@@ -1427,6 +1447,9 @@ void space_init( const char* sysname )
          ERR(_("System %s not found in stack"), sysname);
       cur_system = &systems_stack[i];
 
+      /* Prefetched graphics of anywhere else won't be used now. */
+      space_gfxPrefetchRelease();
+
       nt = ntime_pretty(0, 2);
       player_message(_("#oEntering System %s on %s."), _(sysname), nt);
       if ((player.p != NULL) && (cur_system->nebu_volatility > 0.)) {
@@ -1654,9 +1677,11 @@ Planet *planet_new (void)
 static int planets_load ( void )
 {
    size_t bufsize;
-   char *buf, **planet_files, *file;
+   char **planet_files, **files;
+   const char *buf;
    xmlNodePtr node;
-   xmlDocPtr doc;
+   XmlParseStream *stream;
+   XmlParseJob *job;
    Planet *p;
    size_t i;
    Commodity **stdList;
@@ -1664,14 +1689,14 @@ static int planets_load ( void )
    /* Load landing stuff. */
    landing_env = nlua_newEnv(0);
    nlua_loadStandard(landing_env);
-   buf         = ndata_read( LANDING_DATA_PATH, &bufsize );
+   buf         = ndata_map( LANDING_DATA_PATH, &bufsize );
    if (nlua_dobufenv(landing_env, buf, bufsize, LANDING_DATA_PATH) != 0) {
       WARN( _("Failed to load landing file: %s\n"
             "%s\n"
             "Most likely Lua file has improper syntax, please check"),
             LANDING_DATA_PATH, lua_tostring(naevL,-1));
    }
-   free(buf);
+   ndata_unmap( buf, bufsize );
 
    /* Initialize stack if needed. */
    if (planet_stack == NULL)
@@ -1680,27 +1705,24 @@ static int planets_load ( void )
    /* Extract the list of standard commodities. */
    stdList = standard_commodities();
 
-   /* Load XML stuff. */
+   /* Load XML stuff, parsing in parallel. */
    planet_files = PHYSFS_enumerateFiles( PLANET_DATA_PATH );
-   for (i=0; planet_files[i]!=NULL; i++) {
+   files = array_create( char* );
+   for (i=0; planet_files[i]!=NULL; i++)
+      if (ndata_matchExt( planet_files[i], "xml" ))
+         asprintf( &array_grow(&files), "%s%s", PLANET_DATA_PATH, planet_files[i] );
+   stream = xml_parseStreamOpen( (const char**)files, array_size(files), 0 );
+
+   while ((job = xml_parseStreamNext( stream )) != NULL) {
       if (naev_pollQuit())
          break;
 
-      if (!ndata_matchExt( planet_files[i], "xml" ))
+      if (job->doc == NULL)
          continue;
 
-      asprintf( &file, "%s%s", PLANET_DATA_PATH, planet_files[i]);
-      doc = xml_parsePhysFS( file );
-      if (doc == NULL) {
-         free(file);
-         continue;
-      }
-
-      node = doc->xmlChildrenNode; /* first planet node */
+      node = job->doc->xmlChildrenNode; /* first planet node */
       if (node == NULL) {
-         WARN(_("Malformed %s file: does not contain elements"),file);
-         free(file);
-         xmlFreeDoc(doc);
+         WARN(_("Malformed %s file: does not contain elements"), job->filename);
          continue;
       }
 
@@ -1708,13 +1730,13 @@ static int planets_load ( void )
          p = planet_new();
          planet_parse( p, node, stdList );
       }
-
-      /* Clean up. */
-      free(file);
-      xmlFreeDoc(doc);
    }
 
    /* Clean up. */
+   xml_parseStreamClose( stream );
+   for (i=0; i<(size_t)array_size(files); i++)
+      free( files[i] );
+   array_free( files );
    PHYSFS_freeList( planet_files );
    array_free(stdList);
 
@@ -1878,13 +1900,72 @@ void planet_gfxLoad( Planet *planet )
    if (planet->real != ASSET_REAL)
       return;
 
-   if (planet->gfx_space == NULL) {
-      planet->gfx_space = gl_newImage( planet->gfx_spaceName, OPENGL_TEX_MIPMAPS );
+   if (planet->gfx_space == NULL)
+      planet->gfx_space = gl_newImageAsync( planet->gfx_spaceName, OPENGL_TEX_MIPMAPS );
+
+   /* Need the dimensions right away. */
+   if (planet->gfx_space != NULL) {
+      gl_texLoadWait( planet->gfx_space );
       planet->radius = (planet->gfx_space->w + planet->gfx_space->h)/4.;
    }
 }
 
 
+/**
+ * @brief Starts loading the graphics for a star system in the background.
+ *
+ * They are uploaded over the next frames, space_gfxLoad() finishes whatever
+ *  is left. Only one system is prefetched at a time, they are released by
+ *  space_gfxPrefetchRelease() unless the system becomes the current one.
+ *
+ *    @param sys System to load graphics for.
+ */
+void space_gfxPrefetch( StarSystem *sys )
+{
+   if (sys == space_prefetched)
+      return;
+   space_gfxPrefetchRelease();
+   if (sys == cur_system)
+      return;
+   space_gfxQueue( sys );
+   space_prefetched = sys;
+}
+
+
+/**
+ * @brief Releases the prefetched graphics, unless they belong to the current
+ *        system.
+ *
+ * Called whenever the jump they were prefetched for won't happen, like when
+ *  it is aborted, the player is teleported or a game is loaded.
+ */
+void space_gfxPrefetchRelease (void)
+{
+   StarSystem *sys = space_prefetched;
+   space_prefetched = NULL;
+   if ((sys != NULL) && (sys != cur_system))
+      space_gfxUnload( sys );
+}
+
+
+/**
+ * @brief Queues the missing graphics of a star system for background loading.
+ *
+ *    @param sys System to load graphics for.
+ */
+static void space_gfxQueue( StarSystem *sys )
+{
+   int i;
+   Planet *planet;
+
+   for (i=0; i<array_size(sys->planets); i++) {
+      planet = sys->planets[i];
+      if ((planet->real == ASSET_REAL) && (planet->gfx_space == NULL))
+         planet->gfx_space = gl_newImageAsync( planet->gfx_spaceName, OPENGL_TEX_MIPMAPS );
+   }
+}
+
+
 /**
  * @brief Loads all the graphics for a star system.
  *
@@ -1893,6 +1974,9 @@ void planet_gfxLoad( Planet *planet )
 void space_gfxLoad( StarSystem *sys )
 {
    int i;
+
+   /* Decode them all in parallel before waiting on any. */
+   space_gfxQueue( sys );
    for (i=0; i<array_size(sys->planets); i++)
       planet_gfxLoad( sys->planets[i] );
 }
@@ -1907,6 +1991,9 @@ void space_gfxUnload( StarSystem *sys )
 {
    int i;
    Planet *planet;
+
+   if (sys == space_prefetched)
+      space_prefetched = NULL;
    for (i=0; i<array_size(sys->planets); i++) {
       planet = sys->planets[i];
       gl_freeTexture( planet->gfx_space );
@@ -2447,6 +2534,84 @@ void systems_reconstructJumps (void)
 }
 
 
+/**
+ * @brief Reconstructs the jumps of some systems.
+ *
+ *    @param systems Array (array.h) of the ids of the systems to reconstruct.
+ */
+void systems_reconstructJumpsSubset( const int *systems )
+{
+   int i;
+
+   for (i=0; i<array_size(systems); i++)
+      system_reconstructJumps( &systems_stack[ systems[i] ] );
+}
+
+
+/**
+ * @brief Gets the systems within a number of jumps of some systems.
+ *
+ * Jumps are followed both ways regardless of their flags, so the result is
+ *  a superset of the systems presence could spill over to, in either
+ *  direction.
+ *
+ *    @param systems Array (array.h) of system ids.
+ *    @param range Number of jumps.
+ *    @return Array (array.h) of the ids in increasing order, including the
+ *            systems themselves.
+ */
+int *systems_getNeighbourhood( const int *systems, int range )
+{
+   int i, j, k, r, n;
+   char *in;
+   int *out;
+   StarSystem *sys;
+
+   n  = array_size(systems_stack);
+   in = calloc( MAX(1,n), sizeof(char) );
+   for (i=0; i<array_size(systems); i++)
+      in[ systems[i] ] = 1;
+
+   /* Grow by one jump at a time, marking new systems as 2 until the end of the step. */
+   for (r=0; r<range; r++) {
+      for (i=0; i<n; i++) {
+         sys = &systems_stack[i];
+         for (j=0; j<array_size(sys->jumps); j++) {
+            k = sys->jumps[j].targetid;
+            if ((in[i] == 1) && (in[k] == 0))
+               in[k] = 2;
+            else if ((in[k] == 1) && (in[i] == 0))
+               in[i] = 2;
+         }
+      }
+      for (i=0; i<n; i++)
+         if (in[i] == 2)
+            in[i] = 1;
+   }
+
+   out = array_create( int );
+   for (i=0; i<n; i++)
+      if (in[i])
+         array_push_back( &out, i );
+   free( in );
+   return out;
+}
+
+
+/**
+ * @brief Gets the largest range presence spills over.
+ */
+int space_presenceRange (void)
+{
+   int i, range;
+
+   range = 0;
+   for (i=0; i<array_size(planet_stack); i++)
+      range = MAX( range, planet_stack[i].presenceRange );
+   return range;
+}
+
+
 /**
  * @brief Updates the system planet pointers.
  */
@@ -2937,12 +3102,16 @@ int space_load (void)
 {
    size_t i;
    int j;
-   int ret;
+   int ret, restored;
    StarSystem *sys;
    char **asteroid_files, file[PATH_MAX];
+   Uint32 time;
+   long rss, rss_end, peak, peak_end;
 
    /* Loading. */
    systems_loading = 1;
+   time = SDL_GetTicks();
+   rss  = space_memUsage( &peak );
 
    /* Create some arrays. */
    planetname_stack = array_create( char* );
@@ -2975,19 +3144,24 @@ int space_load (void)
    for (i=0; asteroid_files[i]!=NULL; i++) {
       snprintf(file, sizeof(file), "%s%s",
             ASTEROID_DEBRIS_GFX_PATH, asteroid_files[i]);
-      asteroid_debris_gfx[i] = gl_newImage(file, OPENGL_TEX_MIPMAPS);
+      asteroid_debris_gfx[i] = gl_newImageAsync(file, OPENGL_TEX_MIPMAPS);
    }
 
    /* Done loading. */
    systems_loading = 0;
 
-   /* Apply all the presences. */
-   for (i=0; (int)i<array_size(systems_stack); i++)
-      system_addAllPlanetsPresence(&systems_stack[i]);
+   /* Presences, factions and prices only depend on the data. */
+   restored = (snapshot_load() == 0);
 
-   /* Determine dominant faction. */
-   for (i=0; (int)i<array_size(systems_stack); i++)
-      system_setFaction( &systems_stack[i] );
+   if (!restored) {
+      /* Apply all the presences. */
+      for (i=0; (int)i<array_size(systems_stack); i++)
+         system_addAllPlanetsPresence(&systems_stack[i]);
+
+      /* Determine dominant faction. */
+      for (i=0; (int)i<array_size(systems_stack); i++)
+         system_setFaction( &systems_stack[i] );
+   }
 
    /* Reconstruction. */
    systems_reconstructJumps();
@@ -3007,14 +3181,63 @@ int space_load (void)
    }
 
    /* Calculate commodity prices (sinusoidal model). */
-   economy_initialiseCommodityPrices();
+   if (!restored)
+      economy_initialiseCommodityPrices();
 
    PHYSFS_freeList( asteroid_files );
 
+   /* The peak is for the whole process, so only how much it grew while
+    * loading says anything about the universe. Both are -1 if unknown. */
+   time     = SDL_GetTicks() - time;
+   rss_end  = space_memUsage( &peak_end );
+   DEBUG( _("Loaded the universe in %u ms, RSS grew %ld KiB, peak RSS grew %ld KiB"),
+         time, ((rss < 0) || (rss_end < 0)) ? -1 : rss_end - rss,
+         ((peak < 0) || (peak_end < 0)) ? -1 : peak_end - peak );
+
    return 0;
 }
 
 
+/**
+ * @brief Gets the memory usage of the process, for load statistics.
+ *
+ *    @param[out] peak Peak resident set size of the process so far in KiB,
+ *                -1 if unknown.
+ *    @return Current resident set size in KiB, -1 if unknown.
+ */
+static long space_memUsage( long *peak )
+{
+   long rss;
+#if HAS_POSIX
+   struct rusage usage;
+#endif /* HAS_POSIX */
+#if LINUX
+   FILE *f;
+   long pages;
+#endif /* LINUX */
+
+   rss   = -1;
+   *peak = -1;
+#if HAS_POSIX
+   if (getrusage( RUSAGE_SELF, &usage ) == 0) {
+      *peak = usage.ru_maxrss;
+#if MACOS
+      *peak /= 1024; /* Reported in bytes. */
+#endif /* MACOS */
+   }
+#endif /* HAS_POSIX */
+#if LINUX
+   f = fopen( "/proc/self/statm", "r" );
+   if (f != NULL) {
+      if (fscanf( f, "%*d %ld", &pages ) == 1)
+         rss = pages * (sysconf( _SC_PAGESIZE ) / 1024);
+      fclose( f );
+   }
+#endif /* LINUX */
+   return rss;
+}
+
+
 /**
  * @brief Loads the asteroids types.
  *
@@ -3064,7 +3287,7 @@ static int asteroidTypes_load (void)
          do {
             if (xml_isNode(cur,"gfx"))
                array_push_back(&at->gfxs,
-                     xml_parseTexture(cur, ASTEROID_GFX_PATH"%s", 1, 1, 
+                     xml_parseTextureAsync(cur, ASTEROID_GFX_PATH"%s", 1, 1, 
                         OPENGL_TEX_MAPTRANS | OPENGL_TEX_MIPMAPS));
 
             else if (xml_isNode(cur,"id"))
@@ -3122,35 +3345,37 @@ static int asteroidTypes_load (void)
  */
 static int systems_load (void)
 {
-   char **system_files, *file;
-   xmlNodePtr node;
-   xmlDocPtr doc;
+   char **system_files, **files;
+   xmlNodePtr node, cur, next;
+   XmlParseStream *stream;
+   XmlParseJob *job;
+   xmlDocPtr *docs;
    StarSystem *sys;
-   size_t i;
+   int i;
 
    /* Allocate if needed. */
    if (systems_stack == NULL)
       systems_stack = array_create( StarSystem );
 
+   /* Parse all the files once, in parallel, streaming them. */
    system_files = PHYSFS_enumerateFiles( SYSTEM_DATA_PATH );
+   files = array_create( char* );
+   for (i=0; system_files[i]!=NULL; i++)
+      if (ndata_matchExt( system_files[i], "xml" ))
+         asprintf( &array_grow(&files), "%s%s", SYSTEM_DATA_PATH, system_files[i] );
+   stream = xml_parseStreamOpen( (const char**)files, array_size(files), 0 );
+   docs = array_create_size( xmlDocPtr, MAX(1,array_size(files)) );
 
    /*
     * First pass - loads all the star systems_stack.
     */
-   for (i=0; system_files[i]!=NULL; i++) {
-      if (!ndata_matchExt( system_files[i], "xml" ))
+   while ((job = xml_parseStreamNext( stream )) != NULL) {
+      if (job->doc == NULL)
          continue;
 
-      asprintf( &file, "%s%s", SYSTEM_DATA_PATH, system_files[i] );
-      /* Load the file. */
-      doc = xml_parsePhysFS( file );
-      if (doc == NULL)
-         continue;
-
-      node = doc->xmlChildrenNode; /* first planet node */
+      node = job->doc->xmlChildrenNode; /* first planet node */
       if (node == NULL) {
-         WARN(_("Malformed %s file: does not contain elements"),file);
-         xmlFreeDoc(doc);
+         WARN(_("Malformed %s file: does not contain elements"), job->filename);
          continue;
       }
 
@@ -3158,42 +3383,39 @@ static int systems_load (void)
       system_parse( sys, node );
       system_parseAsteroids(node, sys); /* load the asteroids anchors */
 
-      /* Clean up. */
-      xmlFreeDoc(doc);
-      free( file );
+      /* Only the jumps are needed for the second pass. */
+      for (cur=node->children; cur!=NULL; cur=next) {
+         next = cur->next;
+         if (xml_isNode(cur,"jumps"))
+            continue;
+         xmlUnlinkNode( cur );
+         xmlFreeNode( cur );
+      }
+      array_push_back( &docs, job->doc );
+      job->doc = NULL;
    }
+   xml_parseStreamClose( stream );
 
    /*
     * Second pass - loads all the jump routes.
     */
-   for (i=0; system_files[i]!=NULL; i++) {
+   for (i=0; i<array_size(docs); i++) {
       if (naev_pollQuit())
          break;
 
-      asprintf( &file, "%s%s", SYSTEM_DATA_PATH, system_files[i] );
-      /* Load the file. */
-      doc = xml_parsePhysFS( file );
-      free( file );
-      file = NULL;
-      if (doc == NULL)
-         continue;
-
-      node = doc->xmlChildrenNode; /* first planet node */
-      if (node == NULL) {
-         xmlFreeDoc(doc);
-         continue;
-      }
-
-      system_parseJumps(node); /* will automatically load the jumps into the system */
-
-      /* Clean up. */
-      xmlFreeDoc(doc);
+      system_parseJumps( docs[i]->xmlChildrenNode ); /* will automatically load the jumps into the system */
    }
 
    DEBUG( n_( "Loaded %d Star System", "Loaded %d Star Systems", array_size(systems_stack) ), array_size(systems_stack) );
    DEBUG( n_( "       with %d Planet", "       with %d Planets", array_size(planet_stack) ), array_size(planet_stack) );
 
    /* Clean up. */
+   for (i=0; i<array_size(docs); i++)
+      xmlFreeDoc( docs[i] );
+   array_free( docs );
+   for (i=0; i<array_size(files); i++)
+      free( files[i] );
+   array_free( files );
    PHYSFS_freeList( system_files );
 
    return 0;
@@ -3246,6 +3468,7 @@ void space_renderOverlay( const double dt )
               space_renderDebris( &ast->debris[j], x, y );
          }
       }
+      gl_batchFlush();
    }
 
    /* Render overlay if necessary. */
@@ -3301,6 +3524,16 @@ void planets_render (void)
          }
       }
    }
+   gl_batchFlush();
+
+   /* Add the commodities if player has an asteroid scanner. */
+   if ((player.p != NULL) && player.p->stats.misc_asteroid_scan) {
+      for (i=0; i < array_size(cur_system->asteroids); i++) {
+         ast = &cur_system->asteroids[i];
+         for (j=0; j < ast->nb; j++)
+            space_renderAsteroidScan( &ast->asteroids[j] );
+      }
+   }
 
    /* Render gatherable stuff. */
    gatherable_render();
@@ -3350,12 +3583,8 @@ static void space_renderPlanet( const Planet *p )
  */
 static void space_renderAsteroid( const Asteroid *a )
 {
-   int i;
-   double scale, nx, ny;
+   double scale;
    AsteroidType *at;
-   Commodity *com;
-   char c[20];
-   int fh;
 
    /* Skip invisible asteroids */
    if (a->appearing == ASTEROID_INVISIBLE)
@@ -3371,13 +3600,29 @@ static void space_renderAsteroid( const Asteroid *a )
 
    at = &asteroid_types[a->type];
 
-   gl_blitSpriteInterpolateScale( at->gfxs[a->gfxID], at->gfxs[a->gfxID], 1,
-                                  a->pos.x, a->pos.y, scale, scale, 0, 0, NULL );
+   gl_batchSpriteInterpolateScale( at->gfxs[a->gfxID], NULL, 1.,
+                                   a->pos.x, a->pos.y, scale, scale, 0, 0, NULL );
+}
 
-   /* Add the commodities if player has an asteroid scanner. */
-   if ((player.p == NULL) || (!player.p->stats.misc_asteroid_scan))
+
+/**
+ * @brief Renders the commodities of an asteroid seen by an asteroid scanner.
+ */
+static void space_renderAsteroidScan( const Asteroid *a )
+{
+   int i;
+   double nx, ny;
+   AsteroidType *at;
+   Commodity *com;
+   char c[20];
+   int fh;
+
+   /* Skip invisible asteroids */
+   if (a->appearing == ASTEROID_INVISIBLE)
       return;
 
+   at = &asteroid_types[a->type];
+
    /* Add a buffer to font height to give space for the outline. */
    fh = gl_smallFont.h + 2;
    gl_gameToScreenCoords(&nx, &ny, a->pos.x, a->pos.y);
@@ -3397,19 +3642,17 @@ static void space_renderAsteroid( const Asteroid *a )
 static void space_renderDebris( const Debris *d, double x, double y )
 {
    double scale;
-   Vector2d *testVect;
+   Vector2d testVect;
 
    scale = .5;
 
-   testVect = malloc(sizeof(Vector2d));
-   testVect->x = d->pos.x + x;
-   testVect->y = d->pos.y + y;
+   testVect.x = d->pos.x + x;
+   testVect.y = d->pos.y + y;
 
-   if ( space_isInField( testVect ) == 0 )
-      gl_blitSpriteInterpolateScale(
-         asteroid_debris_gfx[d->gfxID], asteroid_debris_gfx[d->gfxID], 1,
-         testVect->x, testVect->y, scale, scale, 0, 0, &cInert);
-   free(testVect);
+   if ( space_isInField( &testVect ) == 0 )
+      gl_batchSpriteInterpolateScale(
+         asteroid_debris_gfx[d->gfxID], NULL, 1.,
+         testVect.x, testVect.y, scale, scale, 0, 0, &cInert);
 }
 
 
@@ -3424,6 +3667,9 @@ void space_exit (void)
    StarSystem *sys;
    AsteroidType *at;
 
+   /* The prefetched graphics are freed with the planets. */
+   space_prefetched = NULL;
+
    /* Free standalone graphic textures */
    gl_freeTexture(jumppoint_gfx);
    jumppoint_gfx = NULL;
@@ -3836,8 +4082,10 @@ void system_addPresence(StarSystem *sys, factionId_t faction, double amount,
       return;
 
    /* Add the presence to the current system. */
-   i = getPresenceIndex(sys, faction);
-   sys->presence[i].value += amount;
+   if ((space_presenceMask == NULL) || space_presenceMask[ sys->id ]) {
+      i = getPresenceIndex(sys, faction);
+      sys->presence[i].value += amount;
+   }
 
    /* If there's no range, we're done here. */
    if (range < 1)
@@ -3884,8 +4132,10 @@ void system_addPresence(StarSystem *sys, factionId_t faction, double amount,
       }
 
       /* Spill some presence. */
-      x = getPresenceIndex(cur, faction);
-      cur->presence[x].value += amount / (2 + curSpill);
+      if ((space_presenceMask == NULL) || space_presenceMask[ cur->id ]) {
+         x = getPresenceIndex(cur, faction);
+         cur->presence[x].value += amount / (2 + curSpill);
+      }
 
       /* Check to see if we've finished this range and grab the next queue. */
       if (q_isEmpty(q)) {
@@ -3987,6 +4237,53 @@ void space_reconstructPresences( void )
 }
 
 
+/**
+ * @brief Recomputes the presence of some systems.
+ *
+ * Only the planets within space_presenceRange() of the systems can spill
+ *  presence into them, so only those are considered. The result is the same
+ *  as space_reconstructPresences() for these systems.
+ *
+ *    @param systems Array (array.h) of the ids of the systems to recompute.
+ *    @param reschedule Whether to restart the spawn scheduler if the current
+ *           system is among them.
+ */
+void space_reconstructPresencesSubset( const int *systems, int reschedule )
+{
+   int i, *sources;
+   char *mask;
+   StarSystem *sys;
+
+   mask = calloc( MAX(1,array_size(systems_stack)), sizeof(char) );
+   for (i=0; i<array_size(systems); i++) {
+      sys = &systems_stack[ systems[i] ];
+      mask[ sys->id ] = 1;
+      array_free(sys->presence);
+      sys->presence = array_create( SystemPresence );
+      sys->ownerpresence = 0.;
+   }
+
+   /* Re-add presence from everything in range, in the same order as a full rebuild. */
+   sources = systems_getNeighbourhood( systems, space_presenceRange() );
+   space_presenceMask = mask;
+   for (i=0; i<array_size(sources); i++)
+      system_addAllPlanetsPresence( &systems_stack[ sources[i] ] );
+   space_presenceMask = NULL;
+   array_free( sources );
+
+   /* Determine dominant faction. */
+   for (i=0; i<array_size(systems); i++) {
+      sys = &systems_stack[ systems[i] ];
+      system_setFaction( sys );
+      sys->ownerpresence = system_getPresence( sys, sys->faction );
+   }
+
+   if (reschedule && (cur_system != NULL) && mask[ cur_system->id ])
+      system_scheduler( 0., 1 );
+   free( mask );
+}
+
+
 /**
  * @brief See if the position is in an asteroid field.
  *
@@ -383,6 +383,8 @@ const char *jump_getSymbol( JumpPoint *jp );
  */
 void system_reconstructJumps (StarSystem *sys);
 void systems_reconstructJumps (void);
+void systems_reconstructJumpsSubset( const int *systems );
+int *systems_getNeighbourhood( const int *systems, int range );
 void systems_reconstructPlanets (void);
 StarSystem *system_new (void);
 int system_addPlanet( StarSystem *sys, const char *planetname );
@@ -407,6 +409,8 @@ void system_addPresence(StarSystem *sys, factionId_t faction, double amount,
 double system_getPresence(const StarSystem *sys, factionId_t faction);
 void system_addAllPlanetsPresence( StarSystem *sys );
 void space_reconstructPresences( void );
+void space_reconstructPresencesSubset( const int *systems, int reschedule );
+int space_presenceRange (void);
 void system_rmCurrentPresence(StarSystem *sys, factionId_t faction,
       double amount);
 
@@ -419,6 +423,8 @@ unsigned int space_isSimulation( void );
 /*
  * Graphics.
  */
+void space_gfxPrefetch( StarSystem *sys );
+void space_gfxPrefetchRelease (void);
 void space_gfxLoad( StarSystem *sys );
 void space_gfxUnload( StarSystem *sys );
 
@@ -49,8 +49,21 @@
 
 /* Trail stuff. */
 #define TRAIL_UPDATE_DT       0.05  /**< Rate (in seconds) at which trail is updated. */
+#define TRAIL_VERTEX_SIZE     20    /**< Floats per trail vertex: position, corner, colours, times, bounds and parameters. */
+
+/**
+ * @brief Visible trail segments sharing the same style.
+ */
+typedef struct TrailBatch_ {
+   GLuint type; /**< Shader subroutine of the trails. */
+   GLfloat *data; /**< Array (array.h) of vertex data, six vertices per segment. */
+} TrailBatch;
+
 static TrailSpec* trail_spec_stack; /**< Trail specifications. */
 static Trail_spfx** trail_spfx_stack; /**< Active trail effects. */
+static TrailBatch *trail_batch = NULL; /**< Array (array.h) of trail segments to draw, one per style. */
+static GLfloat *trail_data    = NULL; /**< Array (array.h) of all the trail vertex data being uploaded. */
+static gl_vbo *trail_vbo      = NULL; /**< Stream VBO the trail segments are uploaded into. */
 
 
 /*
@@ -155,6 +168,8 @@ static void spfx_hapticRumble( double mod );
 static void spfx_update_trails( double dt );
 static void spfx_trail_update( Trail_spfx* trail, double dt );
 static void spfx_trail_free( Trail_spfx* trail );
+static void spfx_trail_batch( const Trail_spfx* trail );
+static void spfx_trail_flush (void);
 
 
 /**
@@ -240,7 +255,7 @@ static int spfx_base_parse( SPFX_Base *temp, const char *filename )
       temp->u_time      = glGetUniformLocation( temp->shader, "u_time" );
       temp->u_size      = glGetUniformLocation( temp->shader, "u_size" );
       if (uniforms != NULL) {
-         glUseProgram( temp->shader );
+         gl_useProgram( temp->shader );
          node = uniforms->xmlChildrenNode;
          do {
             xml_onlyNodes(node);
@@ -299,7 +314,7 @@ static int spfx_base_parse( SPFX_Base *temp, const char *filename )
                   continue;
             }
          } while (xml_nextNode(node));
-         glUseProgram( 0 );
+         gl_useProgram( 0 );
       }
       gl_checkErr();
    }
@@ -448,6 +463,16 @@ void spfx_free (void)
    for (i=0; i<array_size(trail_spec_stack); i++)
       free( trail_spec_stack[i].name );
    array_free( trail_spec_stack );
+
+   /* Free the trail batch. */
+   for (i=0; i<array_size(trail_batch); i++)
+      array_free( trail_batch[i].data );
+   array_free( trail_batch );
+   trail_batch = NULL;
+   array_free( trail_data );
+   trail_data = NULL;
+   gl_vboDestroy( trail_vbo );
+   trail_vbo = NULL;
 }
 
 
@@ -634,11 +659,11 @@ static void spfx_updateShake( double dt )
    vect_cadd( &shake_pos, shake_vel.x * dt, shake_vel.y * dt );
 
    /* Set the uniform. */
-   glUseProgram( shaders.shake.program );
+   gl_useProgram( shaders.shake.program );
    glUniform2f( shaders.shake.shake_pos, shake_pos.x / SCREEN_W, shake_pos.y / SCREEN_H );
    glUniform2f( shaders.shake.shake_vel, shake_vel.x / SCREEN_W, shake_vel.y / SCREEN_H );
    glUniform1f( shaders.shake.shake_force, shake_force_mean );
-   glUseProgram( 0 );
+   gl_useProgram( 0 );
 
    gl_checkErr();
 }
@@ -701,17 +726,20 @@ void spfx_update_trails( double dt ) {
  */
 static void spfx_trail_update( Trail_spfx* trail, double dt )
 {
-   size_t i;
+   size_t i, iwrite;
    GLfloat rel_dt;
+   TrailPoint *tp;
 
    rel_dt = dt/ trail->spec->ttl;
-   /* Remove outdated elements. */
-   while (trail->iread < trail->iwrite && trail_front(trail).t < rel_dt)
-      trail->iread++;
-
-   /* Update others' timestamps. */
-   for (i = trail->iread; i < trail->iwrite; i++)
-      trail_at( trail, i ).t -= rel_dt;
+   /* Update the timestamps and remove outdated elements in a single pass.
+    * Timestamps grow towards the back, so outdated elements are at the front. */
+   iwrite = trail->iwrite;
+   for (i = trail->iread; i < iwrite; i++) {
+      tp = &trail_at( trail, i );
+      tp->t -= rel_dt;
+      if (tp->t < 0.)
+         trail->iread = i+1;
+   }
 
    /* Update timer. */
    trail->dt += dt;
@@ -783,31 +811,41 @@ static void spfx_trail_free( Trail_spfx* trail )
 
 
 /**
- * @brief Draws a trail on screen.
+ * @brief Adds the segments of a trail to the trail batch.
+ *
+ *    @param trail Trail to add.
  */
-void spfx_trail_draw( const Trail_spfx* trail )
+static void spfx_trail_batch( const Trail_spfx* trail )
 {
-   double x1, y1, x2, y2, z;
+   static const GLfloat corners[6][2] = {
+      { 0., 0. }, { 1., 0. }, { 0., 1. },
+      { 0., 1. }, { 1., 0. }, { 1., 1. } };
+   double x1, y1, x2, y2, z, s, dx, dy, w;
    const TrailPoint *tp, *tpp;
    const TrailStyle *sp, *spp, *styles;
+   TrailBatch *batch;
    size_t i, n;
-   GLfloat len;
-   gl_Matrix4 projection;
-   double s;
+   GLfloat len, *v;
+   int j, k;
 
    n = trail_size(trail);
    if (n==0)
       return;
    styles = trail->spec->style;
 
-   /* Stuff that doesn't change for the entire trail. */
-   glUseProgram( shaders.trail.program );
-   if (gl_has( OPENGL_SUBROUTINES ))
-      glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &trail->spec->type );
-   glEnableVertexAttribArray( shaders.trail.vertex );
-   gl_vboActivateAttribOffset( gl_squareVBO, shaders.trail.vertex, 0, 2, GL_FLOAT, 0 );
-   glUniform1f( shaders.trail.dt, trail->dt );
-   glUniform1f( shaders.trail.r, trail->r );
+   /* Trails of the same style are drawn together. */
+   batch = NULL;
+   for (j=0; j<array_size(trail_batch); j++) {
+      if (trail_batch[j].type == trail->spec->type) {
+         batch = &trail_batch[j];
+         break;
+      }
+   }
+   if (batch == NULL) {
+      batch = &array_grow( &trail_batch );
+      batch->type = trail->spec->type;
+      batch->data = array_create( GLfloat );
+   }
 
    z   = cam_getZoom();
    len = 0.;
@@ -825,36 +863,130 @@ void spfx_trail_draw( const Trail_spfx* trail )
       gl_gameToScreenCoords( &x2, &y2, tpp->x, tpp->y );
 
       s = hypot( x2-x1, y2-y1 );
+      if (s <= 0.)
+         continue;
 
-      /* Set vertex. */
-      projection = gl_Matrix4_Translate(gl_view_matrix, x1, y1, 0);
-      projection = gl_Matrix4_Rotate2dv(projection, (x2-x1)/s, (y2-y1)/s);
-      projection = gl_Matrix4_Scale(projection, s, z*(sp->thick+spp->thick), 1);
-      projection = gl_Matrix4_Translate(projection, 0., -.5, 0);
-
-      /* Set uniforms. */
-      gl_Matrix4_Uniform(shaders.trail.projection, projection);
-      gl_uniformColor(shaders.trail.c1, &sp->col);
-      gl_uniformColor(shaders.trail.c2, &spp->col);
-      glUniform1f(shaders.trail.t1, tp->t);
-      glUniform1f(shaders.trail.t2, tpp->t);
-      glUniform2f(shaders.trail.pos2, len, sp->thick);
+      /* Segment position along the trail, the shader depends on it so it is
+       * computed even for segments that are off screen. */
+      w    = z*(sp->thick+spp->thick);
       len += s;
-      glUniform2f(shaders.trail.pos1, len, spp->thick);
+      if ((MAX(x1,x2) < -w) || (MIN(x1,x2) > SCREEN_W+w) ||
+            (MAX(y1,y2) < -w) || (MIN(y1,y2) > SCREEN_H+w))
+         continue;
+
+      /* Rotate the unit square onto the segment. */
+      dx = (x2-x1)/s;
+      dy = (y2-y1)/s;
+      k  = array_size( batch->data );
+      array_resize( &batch->data, k + 6*TRAIL_VERTEX_SIZE );
+      v  = &batch->data[k];
+      for (k=0; k<6; k++) {
+         v[0]  = x1 + corners[k][0]*s*dx - (corners[k][1]-.5)*w*dy;
+         v[1]  = y1 + corners[k][0]*s*dy + (corners[k][1]-.5)*w*dx;
+         v[2]  = corners[k][0];
+         v[3]  = corners[k][1];
+         v[4]  = sp->col.r;
+         v[5]  = sp->col.g;
+         v[6]  = sp->col.b;
+         v[7]  = sp->col.a;
+         v[8]  = spp->col.r;
+         v[9]  = spp->col.g;
+         v[10] = spp->col.b;
+         v[11] = spp->col.a;
+         v[12] = tp->t;
+         v[13] = tpp->t;
+         v[14] = len;
+         v[15] = spp->thick;
+         v[16] = len - s;
+         v[17] = sp->thick;
+         v[18] = trail->dt;
+         v[19] = trail->r;
+         v += TRAIL_VERTEX_SIZE;
+      }
+   }
+}
+
 
-      /* Draw. */
-      glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
+/**
+ * @brief Renders the trail batch, one draw call per trail style.
+ */
+static void spfx_trail_flush (void)
+{
+   int i, n, first;
+   GLsizei stride;
+   TrailBatch *batch;
+
+   /* Gather all the vertices for a single upload. */
+   array_resize( &trail_data, 0 );
+   for (i=0; i<array_size(trail_batch); i++) {
+      n = array_size( trail_data );
+      array_resize( &trail_data, n + array_size(trail_batch[i].data) );
+      memcpy( &trail_data[n], trail_batch[i].data, sizeof(GLfloat) * array_size(trail_batch[i].data) );
+   }
+   if (array_size(trail_data) == 0)
+      return;
+   if (trail_vbo == NULL)
+      trail_vbo = gl_vboCreateStream( sizeof(GLfloat) * array_size(trail_data), trail_data );
+   else
+      gl_vboData( trail_vbo, sizeof(GLfloat) * array_size(trail_data), trail_data );
+
+   /* Stuff that doesn't change for the entire batch. */
+   gl_useProgram( shaders.trail.program );
+   stride = sizeof(GLfloat) * TRAIL_VERTEX_SIZE;
+   gl_enableVertexAttribArray( shaders.trail.vertex );
+   gl_enableVertexAttribArray( shaders.trail.corner );
+   gl_enableVertexAttribArray( shaders.trail.color1 );
+   gl_enableVertexAttribArray( shaders.trail.color2 );
+   gl_enableVertexAttribArray( shaders.trail.time );
+   gl_enableVertexAttribArray( shaders.trail.bounds );
+   gl_enableVertexAttribArray( shaders.trail.param );
+   gl_vboActivateAttribOffset( trail_vbo, shaders.trail.vertex, 0, 2, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( trail_vbo, shaders.trail.corner, sizeof(GLfloat) * 2, 2, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( trail_vbo, shaders.trail.color1, sizeof(GLfloat) * 4, 4, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( trail_vbo, shaders.trail.color2, sizeof(GLfloat) * 8, 4, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( trail_vbo, shaders.trail.time, sizeof(GLfloat) * 12, 2, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( trail_vbo, shaders.trail.bounds, sizeof(GLfloat) * 14, 4, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( trail_vbo, shaders.trail.param, sizeof(GLfloat) * 18, 2, GL_FLOAT, stride );
+   gl_Matrix4_Uniform( shaders.trail.projection, gl_view_matrix );
+
+   /* Draw each style. */
+   first = 0;
+   for (i=0; i<array_size(trail_batch); i++) {
+      batch = &trail_batch[i];
+      n = array_size( batch->data ) / TRAIL_VERTEX_SIZE;
+      if (n == 0)
+         continue;
+      if (gl_has( OPENGL_SUBROUTINES ))
+         glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &batch->type );
+      glDrawArrays( GL_TRIANGLES, first, n );
+      first += n;
+      array_resize( &batch->data, 0 );
    }
 
    /* Clear state. */
-   glDisableVertexAttribArray( shaders.trail.vertex );
-   glUseProgram(0);
+   gl_disableVertexAttribArray( shaders.trail.vertex );
+   gl_disableVertexAttribArray( shaders.trail.corner );
+   gl_disableVertexAttribArray( shaders.trail.color1 );
+   gl_disableVertexAttribArray( shaders.trail.color2 );
+   gl_disableVertexAttribArray( shaders.trail.time );
+   gl_disableVertexAttribArray( shaders.trail.bounds );
+   gl_disableVertexAttribArray( shaders.trail.param );
 
    /* Check errors. */
    gl_checkErr();
 }
 
 
+/**
+ * @brief Draws a trail on screen.
+ */
+void spfx_trail_draw( const Trail_spfx* trail )
+{
+   spfx_trail_batch( trail );
+   spfx_trail_flush();
+}
+
+
 /**
  * @brief Increases the current rumble level.
  *
@@ -998,12 +1130,14 @@ void spfx_render( const int layer )
    }
 
    /* Trails are special (for now?). */
-   if (layer == SPFX_LAYER_BACK)
+   if (layer == SPFX_LAYER_BACK) {
       for (i=0; i<array_size(trail_spfx_stack); i++) {
          trail = trail_spfx_stack[i];
          if (!trail->ontop)
-            spfx_trail_draw( trail );
+            spfx_trail_batch( trail );
       }
+      spfx_trail_flush();
+   }
 
    /* Now render the layer */
    for (i=array_size(spfx_stack)-1; i>=0; i--) {
@@ -1028,13 +1162,13 @@ void spfx_render( const int layer )
             continue;
 
          /* Let's get to business. */
-         glUseProgram( effect->shader );
+         gl_useProgram( effect->shader );
 
          /* Set up the vertex. */
          projection = gl_view_matrix;
          projection = gl_Matrix4_Translate(projection, x, y, 0);
          projection = gl_Matrix4_Scale(projection, w, h, 1);
-         glEnableVertexAttribArray( effect->vertex );
+         gl_enableVertexAttribArray( effect->vertex );
          gl_vboActivateAttribOffset( gl_squareVBO, effect->vertex,
                0, 2, GL_FLOAT, 0 );
 
@@ -1048,12 +1182,12 @@ void spfx_render( const int layer )
          glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
 
          /* Clear state. */
-         glDisableVertexAttribArray( shaders.texture.vertex );
+         gl_disableVertexAttribArray( shaders.texture.vertex );
 
          /* anything failed? */
          gl_checkErr();
 
-         glUseProgram(0);
+         gl_useProgram(0);
 
       }
       /* No shader. */
@@ -1068,13 +1202,16 @@ void spfx_render( const int layer )
          }
 
          /* Renders */
-         gl_blitSprite( effect->gfx,
+         gl_batchSprite( effect->gfx,
                VX(spfx_stack[i].pos), VY(spfx_stack[i].pos),
                spfx_stack[i].lastframe % sx,
                spfx_stack[i].lastframe / sx,
                NULL );
       }
    }
+
+   /* Sprite effects go on top of the shader ones. */
+   gl_batchFlush();
 }
 
 
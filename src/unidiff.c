@@ -22,6 +22,7 @@
 #include "unidiff.h"
 
 #include "array.h"
+#include "conf.h"
 #include "economy.h"
 #include "faction.h"
 #include "fleet.h"
@@ -142,6 +143,9 @@ typedef struct UniDiff_ {
  * Diff stack.
  */
 static UniDiff_t *diff_stack = NULL; /**< Currently applied universe diffs. */
+static int diff_batch         = 0; /**< Nesting level of diff_begin(). */
+static int diff_batchChanged  = 0; /**< Whether the universe changed during the batch. */
+static int *diff_dirty        = NULL; /**< Ids of the systems changed since the last rebuild. */
 
 
 /*
@@ -158,6 +162,10 @@ static void diff_hunkFailed( UniDiff_t *diff, UniHunk_t *hunk );
 static void diff_hunkSuccess( UniDiff_t *diff, UniHunk_t *hunk );
 static void diff_cleanup( UniDiff_t *diff );
 static void diff_cleanupHunk( UniHunk_t *hunk );
+static void diff_universeChanged (void);
+static void diff_rebuild (void);
+static void diff_markSystem( const char *name );
+static void diff_verifyRebuild (void);
 /* Externed. */
 int diff_save( xmlTextWriterPtr writer ); /**< Used in save.c */
 int diff_load( xmlNodePtr parent ); /**< Used in save.c */
@@ -279,21 +287,223 @@ int diff_apply( const char *name )
 
    xmlFreeDoc(doc);
 
-   /* Reconstruct jumps. */
-   systems_reconstructJumps();
+   diff_universeChanged();
 
-   /* Reconstruct presences. */
-   space_reconstructPresences();
+   return 0;
+}
 
-   /* Re-compute the economy. */
-   economy_addQueuedUpdate();
-   economy_execQueued();
-   economy_initialiseCommodityPrices();
+
+/**
+ * @brief Starts a batch of diff changes.
+ *
+ * The universe is only rebuilt once when the outermost batch is committed,
+ *  instead of after every diff that is applied or removed. Batches can be
+ *  nested.
+ */
+void diff_begin (void)
+{
+   diff_batch++;
+}
+
+
+/**
+ * @brief Ends a batch of diff changes, rebuilding the universe if needed.
+ */
+void diff_commit (void)
+{
+   if (diff_batch <= 0) {
+      WARN(_("Committing UniDiff batch that wasn't started!"));
+      return;
+   }
+   diff_batch--;
+   if ((diff_batch == 0) && diff_batchChanged) {
+      diff_batchChanged = 0;
+      diff_rebuild();
+   }
+}
+
+
+/**
+ * @brief Marks the universe as changed by a diff, rebuilding it unless batched.
+ */
+static void diff_universeChanged (void)
+{
+   if (diff_batch > 0)
+      diff_batchChanged = 1;
+   else
+      diff_rebuild();
+}
+
+
+/**
+ * @brief Marks a system as changed by a hunk.
+ *
+ *    @param name Name of the system, may be NULL.
+ */
+static void diff_markSystem( const char *name )
+{
+   StarSystem *sys;
+
+   if (name == NULL)
+      return;
+   sys = system_get( name );
+   if (sys == NULL)
+      return;
+
+   if (diff_dirty == NULL)
+      diff_dirty = array_create( int );
+   array_push_back( &diff_dirty, sys->id );
+}
+
+
+/**
+ * @brief Rebuilds everything that depends on the universe after diffs changed it.
+ *
+ * Only the neighbourhood of the changed systems is rebuilt: jumps and prices
+ *  depend on the adjacent systems, while presence spills over up to
+ *  space_presenceRange() jumps. Faction and tech hunks don't change any of
+ *  this.
+ */
+static void diff_rebuild (void)
+{
+   int *near, *presence;
+
+   if (array_size(diff_dirty) > 0) {
+      near     = systems_getNeighbourhood( diff_dirty, 1 );
+      presence = systems_getNeighbourhood( diff_dirty, space_presenceRange() );
+
+      /* Reconstruct jumps. */
+      systems_reconstructJumpsSubset( near );
+
+      /* Reconstruct presences. */
+      space_reconstructPresencesSubset( presence, 1 );
+
+      /* Re-compute the economy. */
+      economy_addQueuedUpdate();
+      economy_execQueued();
+      economy_initialiseCommodityPricesSubset( near );
+
+      if (conf.diff_verify)
+         diff_verifyRebuild();
+
+      array_free( near );
+      array_free( presence );
+      array_free( diff_dirty );
+      diff_dirty = NULL;
+   }
 
    /* Update outfitter if necessary. */
    outfits_updateEquipmentOutfits();
+}
 
-   return 0;
+
+/**
+ * @brief Compares the universe after an incremental rebuild with a full one.
+ *
+ * The full rebuild uses the original functions that rebuild everything, not
+ *  the subset ones being checked. Mismatches are reported as warnings, and
+ *  the incremental results are put back afterwards so checking doesn't change
+ *  the game.
+ */
+static void diff_verifyRebuild (void)
+{
+   int i, j, k, errors;
+   StarSystem *systems, *sys;
+   Planet *planets;
+   SystemPresence **presence;
+   factionId_t *faction;
+   double *ownerpresence;
+   CommodityPrice **prices, *p1, *p2;
+   JumpPoint **jumps;
+   StarSystem *cur;
+
+   systems  = system_getAll();
+   planets  = planet_getAll();
+   presence = malloc( MAX(1,array_size(systems)) * sizeof(SystemPresence*) );
+   faction  = malloc( MAX(1,array_size(systems)) * sizeof(factionId_t) );
+   ownerpresence = malloc( MAX(1,array_size(systems)) * sizeof(double) );
+   jumps    = malloc( MAX(1,array_size(systems)) * sizeof(JumpPoint*) );
+   prices   = malloc( MAX(1,array_size(planets)) * sizeof(CommodityPrice*) );
+
+   /* Keep the incremental results. */
+   for (i=0; i<array_size(systems); i++) {
+      presence[i] = array_copy( SystemPresence, systems[i].presence );
+      faction[i]  = systems[i].faction;
+      ownerpresence[i] = systems[i].ownerpresence;
+      jumps[i]    = (systems[i].jumps == NULL) ? NULL : array_copy( JumpPoint, systems[i].jumps );
+   }
+   for (i=0; i<array_size(planets); i++)
+      prices[i] = (planets[i].commodityPrice == NULL) ? NULL :
+            array_copy( CommodityPrice, planets[i].commodityPrice );
+
+   /* Full rebuild, without restarting the spawn scheduler as the incremental
+    * state is put back. */
+   cur         = cur_system;
+   cur_system  = NULL;
+   systems_reconstructJumps();
+   space_reconstructPresences();
+   economy_initialiseCommodityPrices();
+   cur_system  = cur;
+
+   errors = 0;
+   for (i=0; i<array_size(systems); i++) {
+      sys = &systems[i];
+      for (j=0; j<array_size(sys->jumps); j++)
+         if ((j >= array_size(jumps[i])) ||
+               (jumps[i][j].returnJump != sys->jumps[j].returnJump) ||
+               (jumps[i][j].pos.x != sys->jumps[j].pos.x) ||
+               (jumps[i][j].pos.y != sys->jumps[j].pos.y)) {
+            WARN(_("UniDiff rebuild mismatch: jump %d of system '%s'."), j, sys->name);
+            errors++;
+         }
+      k = (array_size(presence[i]) != array_size(sys->presence)) ||
+            (faction[i] != sys->faction);
+      for (j=0; (j<array_size(sys->presence)) && !k; j++)
+         k = (presence[i][j].faction != sys->presence[j].faction) ||
+               (presence[i][j].value != sys->presence[j].value);
+      if (k) {
+         WARN(_("UniDiff rebuild mismatch: presence of system '%s'."), sys->name);
+         errors++;
+      }
+   }
+   for (i=0; i<array_size(planets); i++) {
+      for (j=0; j<array_size(prices[i]); j++) {
+         p1 = &prices[i][j];
+         p2 = &planets[i].commodityPrice[j];
+         if ((p1->price != p2->price) || (p1->planetPeriod != p2->planetPeriod) ||
+               (p1->sysPeriod != p2->sysPeriod) ||
+               (p1->planetVariation != p2->planetVariation) ||
+               (p1->sysVariation != p2->sysVariation)) {
+            WARN(_("UniDiff rebuild mismatch: commodity prices of asset '%s'."), planets[i].name);
+            errors++;
+            break;
+         }
+      }
+   }
+   DEBUG(n_("UniDiff rebuild verified with %d mismatch.", "UniDiff rebuild verified with %d mismatches.", errors), errors);
+
+   /* Put the incremental results back. Jumps and prices are copied into the
+    * existing arrays, as other jumps and the economy point into them. */
+   for (i=0; i<array_size(systems); i++) {
+      sys = &systems[i];
+      array_free( sys->presence );
+      sys->presence        = presence[i];
+      sys->faction         = faction[i];
+      sys->ownerpresence   = ownerpresence[i];
+      if (array_size(jumps[i]) == array_size(sys->jumps))
+         memcpy( sys->jumps, jumps[i], array_size(jumps[i]) * sizeof(JumpPoint) );
+      array_free( jumps[i] );
+   }
+   for (i=0; i<array_size(planets); i++) {
+      if (array_size(prices[i]) == array_size(planets[i].commodityPrice))
+         memcpy( planets[i].commodityPrice, prices[i], array_size(prices[i]) * sizeof(CommodityPrice) );
+      array_free( prices[i] );
+   }
+   free( presence );
+   free( faction );
+   free( ownerpresence );
+   free( jumps );
+   free( prices );
 }
 
 
@@ -798,10 +1008,12 @@ static int diff_patchHunk( UniHunk_t *hunk )
 
       /* Adding an asset. */
       case HUNK_TYPE_ASSET_ADD:
+         diff_markSystem( hunk->target.name );
          planet_updateLand(planet_get(hunk->name));
          return system_addPlanet( system_get(hunk->target.name), hunk->name );
       /* Removing an asset. */
       case HUNK_TYPE_ASSET_REMOVE:
+         diff_markSystem( hunk->target.name );
          return system_rmPlanet(system_get(hunk->target.name), hunk->name);
       /* Making an asset a black market. */
       case HUNK_TYPE_ASSET_BLACKMARKET:
@@ -814,10 +1026,14 @@ static int diff_patchHunk( UniHunk_t *hunk )
 
       /* Adding a Jump. */
       case HUNK_TYPE_JUMP_ADD:
+         diff_markSystem( hunk->target.name );
+         diff_markSystem( hunk->name );
          return system_addJump(system_get(hunk->target.name), hunk->name,
                hunk->pos, hunk->data, hunk->flags);
       /* Removing a jump. */
       case HUNK_TYPE_JUMP_REMOVE:
+         diff_markSystem( hunk->target.name );
+         diff_markSystem( hunk->name );
          jump = jump_get(hunk->name, system_get(hunk->target.name));
          hunk->data = jump->rdr_range_mod;
          hunk->flags = jump->flags;
@@ -837,9 +1053,11 @@ static int diff_patchHunk( UniHunk_t *hunk )
          p = planet_get( hunk->target.name );
          if (p==NULL)
             return -1;
+         diff_markSystem( planet_getSystem( p->name ) );
          hunk->o.faction = faction_name( p->faction );
          return planet_setFaction(p, faction_get(hunk->name));
       case HUNK_TYPE_ASSET_FACTION_REMOVE:
+         diff_markSystem( planet_getSystem( hunk->target.name ) );
          return planet_setFaction(planet_get(hunk->target.name),
                faction_get(hunk->o.faction));
 
@@ -976,8 +1194,10 @@ void diff_remove( const char *name )
  */
 void diff_clear (void)
 {
+   diff_begin();
    while (array_size(diff_stack) > 0)
       diff_removeDiff(&diff_stack[array_size(diff_stack)-1]);
+   diff_commit();
 
    economy_execQueued();
 }
@@ -995,6 +1215,8 @@ void diff_free (void)
    }
    array_free(diff_available);
    diff_available = NULL;
+   array_free(diff_dirty);
+   diff_dirty = NULL;
 }
 
 
@@ -1085,19 +1307,7 @@ static int diff_removeDiff( UniDiff_t *diff )
          WARN(_("Failed to remove hunk type '%d'."), hunk.type);
    }
 
-   /* Reconstruct jumps. */
-   systems_reconstructJumps();
-
-   /* Reconstruct presences. */
-   space_reconstructPresences();
-
-   /* Re-compute the economy. */
-   economy_addQueuedUpdate();
-   economy_execQueued();
-   economy_initialiseCommodityPrices();
-
-   /* Update outfitter if necessary. */
-   outfits_updateEquipmentOutfits();
+   diff_universeChanged();
 
    diff_cleanup(diff);
    array_erase( &diff_stack, diff, &diff[1] );
@@ -1193,6 +1403,8 @@ int diff_load( xmlNodePtr parent )
    xmlNodePtr node, cur;
    char *diffName;
 
+   /* Rebuild the universe only once all the diffs are applied. */
+   diff_begin();
    diff_clear();
 
    node = parent->xmlChildrenNode;
@@ -1212,5 +1424,7 @@ int diff_load( xmlNodePtr parent )
       }
    } while (xml_nextNode(node));
 
+   diff_commit();
+
    return 0;
 }
@@ -668,8 +668,10 @@ void weapons_render( const WeaponLayer layer, const double dt )
          return;
    }
 
+   /* Sprites are batched, beams are rendered right away. */
    for (i=0; i<array_size(wlayer); i++)
       weapon_render( wlayer[i], dt );
+   gl_batchFlush();
 }
 
 
@@ -681,7 +683,7 @@ static void weapon_renderBeam( Weapon* w, const double dt ) {
    w->anim += dt;
 
    /* Load GLSL program */
-   glUseProgram(shaders.beam.program);
+   gl_useProgram(shaders.beam.program);
 
    /* Zoom. */
    z = cam_getZoom();
@@ -695,7 +697,7 @@ static void weapon_renderBeam( Weapon* w, const double dt ) {
    projection = gl_Matrix4_Translate( projection, 0., -0.5, 0. );
 
    /* Set the vertex. */
-   glEnableVertexAttribArray( shaders.beam.vertex );
+   gl_enableVertexAttribArray( shaders.beam.vertex );
    gl_vboActivateAttribOffset( gl_squareVBO, shaders.beam.vertex,
          0, 2, GL_FLOAT, 0 );
 
@@ -714,8 +716,8 @@ static void weapon_renderBeam( Weapon* w, const double dt ) {
    glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
 
    /* Clear state. */
-   glDisableVertexAttribArray( shaders.beam.vertex );
-   glUseProgram(0);
+   gl_disableVertexAttribArray( shaders.beam.vertex );
+   gl_useProgram(0);
 
    /* anything failed? */
    gl_checkErr();
@@ -762,22 +764,22 @@ static void weapon_render( Weapon* w, const double dt )
 
             /* Render. */
             if (outfit_isBolt(w->outfit) && w->outfit->u.blt.gfx_end)
-               gl_blitSpriteInterpolate( gfx, w->outfit->u.blt.gfx_end,
+               gl_batchSpriteInterpolateScale( gfx, w->outfit->u.blt.gfx_end,
                      w->timer / w->life,
-                     w->solid->pos.x, w->solid->pos.y,
+                     w->solid->pos.x, w->solid->pos.y, 1., 1.,
                      w->sprite % (int)gfx->sx, w->sprite / (int)gfx->sx, &c );
             else
-               gl_blitSprite( gfx, w->solid->pos.x, w->solid->pos.y,
+               gl_batchSprite( gfx, w->solid->pos.x, w->solid->pos.y,
                      w->sprite % (int)gfx->sx, w->sprite / (int)gfx->sx, &c );
          }
          /* Outfit faces direction. */
          else {
             if (outfit_isBolt(w->outfit) && w->outfit->u.blt.gfx_end)
-               gl_blitSpriteInterpolate( gfx, w->outfit->u.blt.gfx_end,
+               gl_batchSpriteInterpolateScale( gfx, w->outfit->u.blt.gfx_end,
                      w->timer / w->life,
-                     w->solid->pos.x, w->solid->pos.y, w->sx, w->sy, &c );
+                     w->solid->pos.x, w->solid->pos.y, 1., 1., w->sx, w->sy, &c );
             else
-               gl_blitSprite( gfx, w->solid->pos.x, w->solid->pos.y, w->sx, w->sy, &c );
+               gl_batchSprite( gfx, w->solid->pos.x, w->solid->pos.y, w->sx, w->sy, &c );
          }
          break;
 